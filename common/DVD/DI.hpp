@@ -19,6 +19,16 @@ class DI
 public:
     static DI* s_instance;
 
+    DI() = default;
+
+    /**
+     * Use a resource manager that stands in for /dev/di, such as ~dev/di.
+     */
+    explicit DI(const char* path)
+      : di(path)
+    {
+    }
+
     enum class DIError : s32 {
         Unknown = 0x0,
         OK = 0x1,
@@ -21,4 +21,95 @@ struct DVDPatch {
     u32 drv;
 };
 
+/**
+ * Read counters of a file on the emulated disc, returned by
+ * DI_PROXY_IOCTL_GETFILESTATS.
+ */
+struct DVDFileStats {
+    // Index of the file's entry in the FST
+    u32 fstIndex;
+    u32 wordOffset;
+    u32 size;
+    u32 reads;
+    u64 bytesRead;
+};
+
+/**
+ * Read path statistics, returned by DI_PROXY_IOCTL_GETSTATS.
+ */
+struct DVDReadStats {
+    // Latency histogram bucket i counts reads that took [2^i, 2^(i+1))
+    // microseconds; the first bucket also has faster reads and the last one
+    // slower reads.
+    static constexpr u32 LatencyBuckets = 20;
+
+    struct Category {
+        u32 reads;
+        u32 errors;
+        u64 bytes;
+        // Total and maximum time spent in reads, in microseconds
+        u64 totalMicros;
+        u32 maxMicros;
+        u32 latency[LatencyBuckets];
+    };
+
+    // DVDLowRead from the emulated disc or the real drive
+    Category partitionRead;
+    // DVDLowUnencryptedRead from the emulated disc
+    Category unencryptedRead;
+    // Reads from DVD patch files
+    Category patchedRead;
+
+    // Emulated disc read-ahead, counted since startup
+    u32 streamsStarted;
+    u32 blocksPrefetched;
+    u32 blocksCancelled;
+    // Blocks read by the game that were already prefetched
+    u32 prefetchHits;
+
+    // Prefetch profile of the open partition
+    u32 profileRanges;
+    u32 profileBlocksPrefetched;
+    u32 profileBlocksRead;
+
+    // Requests answered by the DI thread and passed to a worker
+    u32 requestsImmediate;
+    u32 requestsQueued;
+    // Most requests waiting for or being handled by a worker at once
+    u32 maxQueueDepth;
+    // Times the DI thread waited for space in a worker queue
+    u32 queueFullStalls;
+
+    // SD card cache of disc drive reads; hits and misses count reads, the
+    // rest count blocks
+    u32 driveCacheHits;
+    u32 driveCacheMisses;
+    u32 driveCacheBlocksWritten;
+    // Blocks not cached because the cache writer was busy
+    u32 driveCacheBlocksDropped;
+    u32 driveCacheHashFailures;
+
+    // Emulated disc hash verification
+    u32 blocksVerified;
+    u32 verifyFailures;
+    u64 verifyMicros;
+
+    // Emulated disc block decryption, the time is what reads spent waiting
+    // for the AES engine
+    u32 blocksDecrypted;
+    u64 decryptMicros;
+
+    // Device the disc image is read from, counted since it was mounted.
+    // Sector cache counts are in sectors. Requests are reads and writes from
+    // FatFS, transfers the commands sent to the device after merging them.
+    u32 deviceCacheHits;
+    u32 deviceCacheMisses;
+    u32 deviceCacheEvictions;
+    u32 deviceCacheWriteBacks;
+    u32 deviceRequests;
+    u32 deviceRequestSectors;
+    u32 deviceTransfers;
+    u32 deviceTransferSectors;
+};
+
 } // namespace EmuDI
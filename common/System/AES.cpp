@@ -4,5 +4,242 @@
 // SPDX-License-Identifier: MIT
 
 #include "AES.hpp"
+#include <cstring>
 
 AES* AES::s_instance = nullptr;
+
+static constexpr u32 RotateRight(u32 value, u32 shift)
+{
+    return (value >> shift) | (value << (32 - shift));
+}
+
+static constexpr u8 Mul(u8 a, u8 b, const u8* log, const u8* exp)
+{
+    if (a == 0 || b == 0)
+        return 0;
+
+    return exp[(log[a] + log[b]) % 255];
+}
+
+/**
+ * Lookup tables for the software implementation. Built at compile time, so
+ * SoftwareEncrypt and SoftwareDecrypt work without an AES instance.
+ */
+struct AESTables {
+    u8 sbox[256] = {};
+    u8 invSbox[256] = {};
+    // Combined SubBytes and MixColumns for the first row; the other rows are
+    // rotations of it
+    u32 te[256] = {};
+    // Combined InvSubBytes and InvMixColumns
+    u32 td[256] = {};
+
+    constexpr AESTables()
+    {
+        // Log and antilog tables over GF(2^8), using 3 as the generator
+        u8 log[256] = {};
+        u8 exp[256] = {};
+        u8 x = 1;
+        for (u32 i = 0; i < 255; i++) {
+            exp[i] = x;
+            log[x] = i;
+            // Multiply by 3
+            x ^= (x << 1) ^ ((x & 0x80) ? 0x1B : 0);
+        }
+
+        for (u32 i = 0; i < 256; i++) {
+            // Multiplicative inverse followed by the affine transform
+            u8 inv = i == 0 ? 0 : exp[(255 - log[i]) % 255];
+            u8 s = inv;
+            for (u32 j = 1; j < 5; j++) {
+                s ^= (inv << j) | (inv >> (8 - j));
+            }
+            s ^= 0x63;
+
+            sbox[i] = s;
+            invSbox[s] = i;
+        }
+
+        for (u32 i = 0; i < 256; i++) {
+            u8 s = sbox[i];
+            te[i] = (Mul(s, 2, log, exp) << 24) | (s << 16) | (s << 8) |
+                    Mul(s, 3, log, exp);
+
+            u8 si = invSbox[i];
+            td[i] = (Mul(si, 14, log, exp) << 24) |
+                    (Mul(si, 9, log, exp) << 16) |
+                    (Mul(si, 13, log, exp) << 8) | Mul(si, 11, log, exp);
+        }
+    }
+};
+
+static constexpr AESTables s_tables;
+static constexpr const auto& s_sbox = s_tables.sbox;
+static constexpr const auto& s_invSbox = s_tables.invSbox;
+static constexpr const auto& s_te = s_tables.te;
+static constexpr const auto& s_td = s_tables.td;
+
+static_assert(s_sbox[0x00] == 0x63 && s_sbox[0x53] == 0xED);
+static_assert(s_invSbox[0x63] == 0x00);
+
+static inline u32 Load32(const u8* p)
+{
+    return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static inline void Store32(u8* p, u32 value)
+{
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+}
+
+static inline u32 SubWord(u32 w)
+{
+    return (s_sbox[w >> 24] << 24) | (s_sbox[(w >> 16) & 0xFF] << 16) |
+           (s_sbox[(w >> 8) & 0xFF] << 8) | s_sbox[w & 0xFF];
+}
+
+static void ExpandKey(const u8* key, u32* rk)
+{
+    for (u32 i = 0; i < 4; i++) {
+        rk[i] = Load32(key + i * 4);
+    }
+
+    u8 rcon = 1;
+    for (u32 i = 4; i < 44; i++) {
+        u32 temp = rk[i - 1];
+        if (i % 4 == 0) {
+            temp = SubWord(RotateRight(temp, 24)) ^ (rcon << 24);
+            rcon = (rcon << 1) ^ ((rcon & 0x80) ? 0x1B : 0);
+        }
+
+        rk[i] = rk[i - 4] ^ temp;
+    }
+}
+
+/**
+ * Make the round keys for the equivalent inverse cipher: the encryption
+ * round keys in reverse order, with InvMixColumns applied to the middle
+ * rounds.
+ */
+static void ExpandDecryptKey(const u8* key, u32* dk)
+{
+    u32 rk[44];
+    ExpandKey(key, rk);
+
+    for (u32 round = 0; round <= 10; round++) {
+        for (u32 i = 0; i < 4; i++) {
+            u32 w = rk[(10 - round) * 4 + i];
+            if (round != 0 && round != 10) {
+                w = s_td[s_sbox[w >> 24]] ^
+                    RotateRight(s_td[s_sbox[(w >> 16) & 0xFF]], 8) ^
+                    RotateRight(s_td[s_sbox[(w >> 8) & 0xFF]], 16) ^
+                    RotateRight(s_td[s_sbox[w & 0xFF]], 24);
+            }
+
+            dk[round * 4 + i] = w;
+        }
+    }
+}
+
+static void EncryptBlock(const u32* rk, const u8* in, u8* out)
+{
+    u32 s[4], t[4];
+    for (u32 i = 0; i < 4; i++) {
+        s[i] = Load32(in + i * 4) ^ rk[i];
+    }
+
+    for (u32 round = 1; round < 10; round++) {
+        for (u32 i = 0; i < 4; i++) {
+            t[i] = s_te[s[i] >> 24] ^
+                   RotateRight(s_te[(s[(i + 1) % 4] >> 16) & 0xFF], 8) ^
+                   RotateRight(s_te[(s[(i + 2) % 4] >> 8) & 0xFF], 16) ^
+                   RotateRight(s_te[s[(i + 3) % 4] & 0xFF], 24) ^
+                   rk[round * 4 + i];
+        }
+
+        std::memcpy(s, t, sizeof(s));
+    }
+
+    // Final round has no MixColumns
+    for (u32 i = 0; i < 4; i++) {
+        u32 w = (s_sbox[s[i] >> 24] << 24) |
+                (s_sbox[(s[(i + 1) % 4] >> 16) & 0xFF] << 16) |
+                (s_sbox[(s[(i + 2) % 4] >> 8) & 0xFF] << 8) |
+                s_sbox[s[(i + 3) % 4] & 0xFF];
+        Store32(out + i * 4, w ^ rk[40 + i]);
+    }
+}
+
+static void DecryptBlock(const u32* dk, const u8* in, u8* out)
+{
+    u32 s[4], t[4];
+    for (u32 i = 0; i < 4; i++) {
+        s[i] = Load32(in + i * 4) ^ dk[i];
+    }
+
+    for (u32 round = 1; round < 10; round++) {
+        for (u32 i = 0; i < 4; i++) {
+            t[i] = s_td[s[i] >> 24] ^
+                   RotateRight(s_td[(s[(i + 3) % 4] >> 16) & 0xFF], 8) ^
+                   RotateRight(s_td[(s[(i + 2) % 4] >> 8) & 0xFF], 16) ^
+                   RotateRight(s_td[s[(i + 1) % 4] & 0xFF], 24) ^
+                   dk[round * 4 + i];
+        }
+
+        std::memcpy(s, t, sizeof(s));
+    }
+
+    for (u32 i = 0; i < 4; i++) {
+        u32 w = (s_invSbox[s[i] >> 24] << 24) |
+                (s_invSbox[(s[(i + 3) % 4] >> 16) & 0xFF] << 16) |
+                (s_invSbox[(s[(i + 2) % 4] >> 8) & 0xFF] << 8) |
+                s_invSbox[s[(i + 1) % 4] & 0xFF];
+        Store32(out + i * 4, w ^ dk[40 + i]);
+    }
+}
+
+void AES::SoftwareEncrypt(
+  const u8* key, u8* iv, const void* input, u32 size, void* output)
+{
+    u32 rk[44];
+    ExpandKey(key, rk);
+
+    const u8* in = reinterpret_cast<const u8*>(input);
+    u8* out = reinterpret_cast<u8*>(output);
+
+    for (u32 offset = 0; offset + 16 <= size; offset += 16) {
+        u8 block[16];
+        for (u32 i = 0; i < 16; i++) {
+            block[i] = in[offset + i] ^ iv[i];
+        }
+
+        EncryptBlock(rk, block, out + offset);
+        std::memcpy(iv, out + offset, 16);
+    }
+}
+
+void AES::SoftwareDecrypt(
+  const u8* key, u8* iv, const void* input, u32 size, void* output)
+{
+    u32 dk[44];
+    ExpandDecryptKey(key, dk);
+
+    const u8* in = reinterpret_cast<const u8*>(input);
+    u8* out = reinterpret_cast<u8*>(output);
+
+    for (u32 offset = 0; offset + 16 <= size; offset += 16) {
+        // Save the ciphertext first, the output may overwrite it
+        u8 cipher[16];
+        std::memcpy(cipher, in + offset, 16);
+
+        DecryptBlock(dk, cipher, out + offset);
+        for (u32 i = 0; i < 16; i++) {
+            out[offset + i] ^= iv[i];
+        }
+
+        std::memcpy(iv, cipher, 16);
+    }
+}
@@ -13,6 +13,29 @@ class AES
 public:
     static AES* s_instance;
 
+    enum class Backend {
+        // Always use the /dev/aes hardware engine
+        Hardware,
+        // Always decrypt on the CPU
+        Software,
+        // Use software for small requests, where the IPC round trip to the
+        // hardware engine costs more than the decryption itself
+        Auto,
+    };
+
+    // Largest request done in software by the Auto backend
+    static constexpr u32 AutoSoftwareMaxSize = 0x100;
+
+    void SetBackend(Backend backend)
+    {
+        m_backend = backend;
+    }
+
+    Backend GetBackend() const
+    {
+        return m_backend;
+    }
+
 private:
     enum class AESIoctl {
         Encrypt = 2,
@@ -33,15 +56,13 @@ public:
     s32 Encrypt(
       const u8* key, u8* iv, const void* input, u32 size, void* output)
     {
+        if (UseSoftware(size)) {
+            SoftwareEncrypt(key, iv, input, size, output);
+            return IOSError::OK;
+        }
+
         IOS::IOVector<2, 2> vec;
-        vec.in[0].data = input;
-        vec.in[0].len = size;
-        vec.in[1].data = key;
-        vec.in[1].len = 16;
-        vec.out[0].data = output;
-        vec.out[0].len = size;
-        vec.out[1].data = iv;
-        vec.out[1].len = 16;
+        SetupVector(&vec, key, iv, input, size, output);
         return m_rm.ioctlv(AESIoctl::Encrypt, vec);
     }
 
@@ -58,18 +79,103 @@ public:
     s32 Decrypt(
       const u8* key, u8* iv, const void* input, u32 size, void* output)
     {
+        if (UseSoftware(size)) {
+            SoftwareDecrypt(key, iv, input, size, output);
+            return IOSError::OK;
+        }
+
         IOS::IOVector<2, 2> vec;
-        vec.in[0].data = input;
-        vec.in[0].len = size;
-        vec.in[1].data = key;
-        vec.in[1].len = 16;
-        vec.out[0].data = output;
-        vec.out[0].len = size;
-        vec.out[1].data = iv;
-        vec.out[1].len = 16;
+        SetupVector(&vec, key, iv, input, size, output);
         return m_rm.ioctlv(AESIoctl::Decrypt, vec);
     }
 
+    /**
+     * Asynchronous AES request. Must stay valid until it's received from the
+     * completion queue, and the result is then in req.result.
+     */
+    struct AsyncRequest {
+        IOS::Request req;
+        IOS::IOVector<2, 2> vec;
+    };
+
+    /**
+     * AES-128 CBC encrypt a block asynchronously, see Encrypt.
+     * @param[in] queue Completion queue, receives &req->req when done.
+     * @param[in] req Request to use for the operation.
+     */
+    s32 EncryptAsync(const u8* key, u8* iv, const void* input, u32 size,
+      void* output, Queue<IOS::Request*>* queue, AsyncRequest* req)
+    {
+        if (UseSoftware(size)) {
+            SoftwareEncrypt(key, iv, input, size, output);
+            return CompleteSoftware(queue, req);
+        }
+
+        SetupVector(&req->vec, key, iv, input, size, output);
+        return m_rm.ioctlvAsync(AESIoctl::Encrypt, req->vec, queue, &req->req);
+    }
+
+    /**
+     * AES-128 CBC decrypt a block asynchronously, see Decrypt.
+     * @param[in] queue Completion queue, receives &req->req when done.
+     * @param[in] req Request to use for the operation.
+     */
+    s32 DecryptAsync(const u8* key, u8* iv, const void* input, u32 size,
+      void* output, Queue<IOS::Request*>* queue, AsyncRequest* req)
+    {
+        if (UseSoftware(size)) {
+            SoftwareDecrypt(key, iv, input, size, output);
+            return CompleteSoftware(queue, req);
+        }
+
+        SetupVector(&req->vec, key, iv, input, size, output);
+        return m_rm.ioctlvAsync(AESIoctl::Decrypt, req->vec, queue, &req->req);
+    }
+
+    /**
+     * AES-128 CBC encrypt on the CPU. Same arguments as Encrypt, except there
+     * are no size or alignment limits beyond the size being a multiple of 16.
+     */
+    static void SoftwareEncrypt(
+      const u8* key, u8* iv, const void* input, u32 size, void* output);
+
+    /**
+     * AES-128 CBC decrypt on the CPU, see SoftwareEncrypt.
+     */
+    static void SoftwareDecrypt(
+      const u8* key, u8* iv, const void* input, u32 size, void* output);
+
 private:
+    bool UseSoftware(u32 size) const
+    {
+        return m_backend == Backend::Software ||
+               (m_backend == Backend::Auto && size <= AutoSoftwareMaxSize);
+    }
+
+    /**
+     * Complete an async request that was done synchronously in software.
+     */
+    static s32 CompleteSoftware(
+      Queue<IOS::Request*>* queue, AsyncRequest* req)
+    {
+        req->req.result = IOSError::OK;
+        queue->send(&req->req);
+        return IOSError::OK;
+    }
+
+    static void SetupVector(IOS::IOVector<2, 2>* vec, const u8* key, u8* iv,
+      const void* input, u32 size, void* output)
+    {
+        vec->in[0].data = input;
+        vec->in[0].len = size;
+        vec->in[1].data = key;
+        vec->in[1].len = 16;
+        vec->out[0].data = output;
+        vec->out[0].len = size;
+        vec->out[1].data = iv;
+        vec->out[1].len = 16;
+    }
+
     IOS::ResourceCtrl<AESIoctl> m_rm{"/dev/aes"};
+    Backend m_backend = Backend::Auto;
 };
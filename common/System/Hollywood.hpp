@@ -17,6 +17,11 @@ constexpr u32 HW_BASE = 0x0D000000;
  */
 constexpr u32 HW_BASE_TRUSTED = 0x0D800000;
 
+/**
+ * Frequency of the ACR timer in Hz.
+ */
+constexpr u32 HW_TIMER_FREQ = 1898614;
+
 /**
  * ACR (Hollywood Registers).
  */
@@ -208,12 +213,23 @@ enum class ACRResetLine {
     NLCKB_EDRAM = 0x2000000,
 };
 
+#ifdef TARGET_HOST
+/**
+ * Registers read by the IOS module on the host build, see host/System.cpp.
+ */
+u32 HostACRRead(ACRReg reg);
+#endif
+
 /**
  * Read ACR register. Requires BUSPROT::PPCKERN set if used from PPC.
  */
 static inline u32 ACRReadTrusted(ACRReg reg)
 {
+#ifdef TARGET_HOST
+    return HostACRRead(reg);
+#else
     return read32(HW_BASE_TRUSTED + static_cast<u32>(reg));
+#endif
 }
 
 /**
@@ -19,6 +19,7 @@ LIBOGC_SUCKS_END
 #  include <cassert>
 #endif
 #include <new>
+#include <type_traits>
 
 #define DASSERT assert
 #define ASSERT assert
@@ -61,7 +62,10 @@ enum {
 template <typename T>
 class IOS_Queue
 {
-    static_assert(sizeof(T) == 4, "T must be equal to 4 bytes");
+    // Messages are 32-bit. Pointers can be wider on the host build, which
+    // keeps all of its memory below 4 GB instead.
+    static_assert(sizeof(T) == 4 || std::is_pointer_v<T>,
+      "T must be equal to 4 bytes");
 
 public:
     IOS_Queue(const IOS_Queue& from) = delete;
@@ -83,16 +87,17 @@ public:
 
     void send(T msg, u32 flags = 0)
     {
-        const s32 ret = IOS_SendMessage(this->m_queue, (u32) (msg), flags);
+        const s32 ret =
+          IOS_SendMessage(this->m_queue, (u32) (uintptr_t) (msg), flags);
         ASSERT(ret == IOSError::OK);
     }
 
     T receive(u32 flags = 0)
     {
-        T msg;
-        const s32 ret = IOS_ReceiveMessage(this->m_queue, (u32*) (&msg), flags);
+        u32 msg;
+        const s32 ret = IOS_ReceiveMessage(this->m_queue, &msg, flags);
         ASSERT(ret == IOSError::OK);
-        return reinterpret_cast<T>(msg);
+        return (T) (uintptr_t) (msg);
     }
 
     s32 id() const
@@ -456,10 +461,14 @@ struct OVector {
 };
 
 struct Request {
+#ifdef TARGET_IOS
+    Command cmd;
+#else
     union {
         Command cmd;
         Queue<IOS::Request*>* cbQueue;
     };
+#endif
 
     s32 result;
 
@@ -4,5 +4,174 @@
 // SPDX-License-Identifier: MIT
 
 #include "SHA.hpp"
+#include <algorithm>
+#include <cstring>
 
 SHA* SHA::s_instance = nullptr;
+
+static inline u32 RotateLeft(u32 value, u32 shift)
+{
+    return (value << shift) | (value >> (32 - shift));
+}
+
+/**
+ * Hash 64 byte blocks into the state in software.
+ */
+static void SoftwareTransform(u32* state, const u8* data, u32 blockCount)
+{
+    for (; blockCount != 0; blockCount--, data += 64) {
+        u32 w[80];
+        for (u32 i = 0; i < 16; i++) {
+            w[i] = (data[i * 4] << 24) | (data[i * 4 + 1] << 16) |
+                   (data[i * 4 + 2] << 8) | data[i * 4 + 3];
+        }
+        for (u32 i = 16; i < 80; i++) {
+            w[i] = RotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+
+        u32 a = state[0], b = state[1], c = state[2], d = state[3],
+            e = state[4];
+
+        for (u32 i = 0; i < 80; i++) {
+            u32 f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+
+            u32 temp = RotateLeft(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = RotateLeft(b, 30);
+            b = a;
+            a = temp;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+    }
+}
+
+s32 SHA::Init(Context* ctx, bool software)
+{
+    ctx->length = 0;
+    ctx->bufferLen = 0;
+    ctx->software = software;
+
+    if (!software)
+        return Command(SHAIoctl::Init, ctx, nullptr, 0, nullptr);
+
+    ctx->state[0] = 0x67452301;
+    ctx->state[1] = 0xEFCDAB89;
+    ctx->state[2] = 0x98BADCFE;
+    ctx->state[3] = 0x10325476;
+    ctx->state[4] = 0xC3D2E1F0;
+    ctx->count[0] = 0;
+    ctx->count[1] = 0;
+    return IOSError::OK;
+}
+
+s32 SHA::Transform(Context* ctx, const u8* data, u32 blockCount)
+{
+    if (ctx->software) {
+        SoftwareTransform(ctx->state, data, blockCount);
+        return IOSError::OK;
+    }
+
+    return Command(SHAIoctl::Update, ctx, data, blockCount * 64, nullptr);
+}
+
+s32 SHA::Update(Context* ctx, const void* data, u32 len)
+{
+    const u8* in = reinterpret_cast<const u8*>(data);
+    ctx->length += len;
+
+    // Complete a block left over from the previous update first
+    if (ctx->bufferLen != 0) {
+        u32 copyLen = std::min(len, 64 - ctx->bufferLen);
+        std::memcpy(ctx->buffer + ctx->bufferLen, in, copyLen);
+        ctx->bufferLen += copyLen;
+        in += copyLen;
+        len -= copyLen;
+
+        if (ctx->bufferLen < 64)
+            return IOSError::OK;
+
+        s32 ret = Transform(ctx, ctx->buffer, 1);
+        if (ret != IOSError::OK)
+            return ret;
+
+        ctx->bufferLen = 0;
+    }
+
+    u32 blockLen = len & ~63;
+    if (blockLen != 0) {
+        // The engine leaves the state of the whole blocks it has hashed in
+        // the context, so misaligned data is hashed in software from there on
+        if (!aligned(in, 64))
+            ctx->software = true;
+
+        s32 ret = Transform(ctx, in, blockLen / 64);
+        if (ret != IOSError::OK)
+            return ret;
+    }
+
+    ctx->bufferLen = len - blockLen;
+    std::memcpy(ctx->buffer, in + blockLen, ctx->bufferLen);
+    return IOSError::OK;
+}
+
+s32 SHA::Final(Context* ctx, const void* data, u32 len, u8* hashOut)
+{
+    if (len != 0) {
+        s32 ret = Update(ctx, data, len);
+        if (ret != IOSError::OK)
+            return ret;
+    }
+
+    if (!ctx->software) {
+        // The hardware engine pads the last partial block itself
+        return Command(SHAIoctl::Final, ctx, ctx->buffer, ctx->bufferLen,
+          hashOut);
+    }
+
+    u32 bitsHigh = u32(ctx->length >> 29);
+    u32 bitsLow = u32(ctx->length << 3);
+
+    // Pad with a 1 bit, zeroes, then the message length in bits
+    u8* buffer = ctx->buffer;
+    buffer[ctx->bufferLen++] = 0x80;
+    if (ctx->bufferLen > 56) {
+        std::memset(buffer + ctx->bufferLen, 0, 64 - ctx->bufferLen);
+        SoftwareTransform(ctx->state, buffer, 1);
+        ctx->bufferLen = 0;
+    }
+
+    std::memset(buffer + ctx->bufferLen, 0, 56 - ctx->bufferLen);
+    for (u32 i = 0; i < 4; i++) {
+        buffer[56 + i] = bitsHigh >> (24 - i * 8);
+        buffer[60 + i] = bitsLow >> (24 - i * 8);
+    }
+    SoftwareTransform(ctx->state, buffer, 1);
+    ctx->bufferLen = 0;
+
+    if (hashOut != nullptr) {
+        for (u32 i = 0; i < 20; i++) {
+            hashOut[i] = ctx->state[i / 4] >> (24 - (i % 4) * 8);
+        }
+    }
+
+    return IOSError::OK;
+}
@@ -13,11 +13,46 @@ class SHA
 public:
     static SHA* s_instance;
 
+    enum class Backend : u8 {
+        // Always use the /dev/sha hardware engine
+        Hardware,
+        // Always hash on the CPU
+        Software,
+        // Hash small buffers given to Calculate in software, where the IPC
+        // round trips cost more than the hashing itself
+        Auto,
+    };
+
+    // Largest buffer hashed in software by the Auto backend
+    static constexpr u32 AutoSoftwareMaxSize = 0x400;
+
     struct Context {
         u32 state[5];
+        // Only used by the hardware engine
         u32 count[2];
+
+        // Not seen by the hardware engine. Data that doesn't fill a whole
+        // 64 byte block is kept here until the next update, so updates can be
+        // any length on either backend. The engine only takes 64 byte aligned
+        // data, so the buffer is aligned for it.
+        u8 buffer[64] ATTRIBUTE_ALIGN(64);
+        // Message length in bytes, counted on both backends so a context
+        // started on the hardware can be finished in software
+        u64 length;
+        u32 bufferLen;
+        bool software;
     };
 
+    void SetBackend(Backend backend)
+    {
+        m_backend = backend;
+    }
+
+    Backend GetBackend() const
+    {
+        return m_backend;
+    }
+
 private:
     enum class SHAIoctl {
         Init = 0,
@@ -25,6 +60,9 @@ private:
         Final = 2,
     };
 
+    // Part of the context used by the hardware engine
+    static constexpr u32 HardwareContextSize = 0x1C;
+
     s32 Command(
       SHAIoctl cmd, Context* ctx, const void* data, u32 len, u8* hashOut)
     {
@@ -32,45 +70,51 @@ private:
         vec.in[0].data = data;
         vec.in[0].len = len;
         vec.out[0].data = reinterpret_cast<void*>(ctx);
-        vec.out[0].len = sizeof(Context);
+        vec.out[0].len = HardwareContextSize;
         vec.out[1].data = hashOut;
         vec.out[1].len = hashOut ? 0x14 : 0;
 
         return m_rm.ioctlv(cmd, vec);
     }
 
+    /**
+     * Hash whole 64 byte blocks into the context on its backend.
+     */
+    s32 Transform(Context* ctx, const u8* data, u32 blockCount);
+
 public:
+    /**
+     * Start a new SHA-1 context on the current backend. Auto starts contexts
+     * on the hardware, as the total length isn't known yet.
+     */
     s32 Init(Context* ctx)
     {
-        return Command(SHAIoctl::Init, ctx, nullptr, 0, nullptr);
+        return Init(ctx, m_backend == Backend::Software);
     }
 
+    /**
+     * Start a new SHA-1 context.
+     * @param software Hash in software instead of using the hardware engine.
+     */
+    s32 Init(Context* ctx, bool software);
+
     /**
      * Update hash in the SHA-1 context.
      */
-    s32 Update(Context* ctx, const void* data, u32 len)
-    {
-        return Command(SHAIoctl::Update, ctx, data, len, nullptr);
-    }
+    s32 Update(Context* ctx, const void* data, u32 len);
 
     /**
      * Finalize the SHA-1 context and get the result hash.
      */
     s32 Final(Context* ctx, u8* hashOut)
     {
-        return Command(SHAIoctl::Final, ctx, nullptr, 0, hashOut);
+        return Final(ctx, nullptr, 0, hashOut);
     }
 
     /**
      * Finalize the SHA-1 context and get the result hash.
      */
-    s32 Final(Context* ctx, const void* data, u32 len, u8* hashOut)
-    {
-        if (!len)
-            return Final(ctx, hashOut);
-
-        return Command(SHAIoctl::Final, ctx, data, len, hashOut);
-    }
+    s32 Final(Context* ctx, const void* data, u32 len, u8* hashOut);
 
     /**
      * Quick full hash calculate.
@@ -81,7 +125,12 @@ public:
 
         Context ctx PPC_ALIGN;
 
-        s32 ret = s_instance->Init(&ctx);
+        Backend backend = s_instance->m_backend;
+        bool software =
+          backend == Backend::Software ||
+          (backend == Backend::Auto && len <= AutoSoftwareMaxSize);
+
+        s32 ret = s_instance->Init(&ctx, software);
         if (ret != IOSError::OK)
             return ret;
 
@@ -90,4 +139,5 @@ public:
 
 private:
     IOS::ResourceCtrl<SHAIoctl> m_rm{"/dev/sha"};
+    Backend m_backend = Backend::Auto;
 };
@@ -0,0 +1,99 @@
+#---------------------------------------------------------------------------------
+# Clear the implicit built in rules
+#---------------------------------------------------------------------------------
+.SUFFIXES:
+
+#---------------------------------------------------------------------------------
+# Host build of the IOS module's disc read path, for tests and benchmarks on
+# Linux. The IOS system calls and devices are provided by host/.
+#
+# BUILD is the directory where object files & intermediate files will be placed
+# SOURCES is a list of directories containing source code
+# INCLUDES is a list of directories containing extra header files
+#---------------------------------------------------------------------------------
+BUILD		:=	build_host
+SOURCES		:=	ios/Disk ios/EmuDI ios/FAT ios/System common/DVD common/Debug \
+				common/System host
+EXTRA_CPPFILES	:=	ios/IOS/IPCLog.cpp ios/IOS/EmuES.cpp
+INCLUDES	:=	ios common host
+BIN			:=  bin/host
+
+CC			:= gcc
+CXX			:= g++
+LD			:= g++
+
+#---------------------------------------------------------------------------------
+# automatically build a list of object files for our project
+#---------------------------------------------------------------------------------
+DUMMY != mkdir -p $(BIN) $(BUILD) $(foreach dir,$(SOURCES) ios/IOS host/tests host/bench,$(BUILD)/$(dir))
+
+CFILES		:=	$(foreach dir,$(SOURCES),$(wildcard $(dir)/*.c))
+CPPFILES	:=	$(foreach dir,$(SOURCES),$(wildcard $(dir)/*.cpp)) $(EXTRA_CPPFILES)
+
+OFILES		:=	$(CPPFILES:.cpp=_cpp.o) $(CFILES:.c=_c.o)
+OFILES		:= $(addprefix $(BUILD)/, $(OFILES))
+
+TEST_OFILES	:=	$(addprefix $(BUILD)/, $(patsubst %.cpp,%_cpp.o,$(wildcard host/tests/*.cpp)))
+BENCH_OFILES	:=	$(addprefix $(BUILD)/, $(patsubst %.cpp,%_cpp.o,$(wildcard host/bench/*.cpp)))
+DIBENCH_OFILES	:=	$(BUILD)/host/bench/DIBench_cpp.o
+CRYPTOBENCH_OFILES	:=	$(BUILD)/host/bench/CryptoBench_cpp.o
+
+DEPENDS		:=	$(addsuffix .d, $(basename $(OFILES) $(TEST_OFILES) $(BENCH_OFILES)))
+
+#---------------------------------------------------------------------------------
+# options for code generation
+#---------------------------------------------------------------------------------
+INCLUDE	:=			$(foreach dir,$(INCLUDES),-I$(dir))
+
+CFLAGS	:=	 $(INCLUDE) -DTARGET_IOS -DTARGET_HOST -Wall -Wextra -Wpedantic -Werror -Wno-unused-parameter \
+	-Wno-unused-const-variable -Wno-unused-function -O2 -fshort-enums -fno-exceptions -Wno-pointer-arith
+# The IOS build is at -O0, where neither aliasing nor these warnings come up
+CFLAGS	+=	-fno-strict-aliasing -Wno-array-bounds -Wno-format-truncation
+CXXFLAGS = $(CFLAGS) -std=c++20 -fno-rtti -Wno-narrowing
+
+# Pointers are passed in 32-bit IOS messages, so the program is kept below 4 GB
+# and above the emulated MEM1 and MEM2 (see host/Host.hpp)
+LDFLAGS	= -no-pie -pthread -Wl,-Ttext-segment=0x20000000
+
+
+default: $(BIN)/hosttest $(BIN)/dibench $(BIN)/cryptobench
+
+test: $(BIN)/hosttest
+	@$(BIN)/hosttest --backend iso
+	@$(BIN)/hosttest --backend decrypted
+	@$(BIN)/hosttest --backend compressed
+
+bench: $(BIN)/dibench $(BIN)/cryptobench
+	@$(BIN)/cryptobench
+	@$(BIN)/dibench --backend iso
+	@$(BIN)/dibench --backend decrypted
+	@$(BIN)/dibench --backend compressed
+	@$(BIN)/dibench --backend iso --verify strict
+
+clean:
+	@echo cleaning...
+	@rm -rf $(BIN) $(BUILD)
+
+$(BIN)/hosttest: $(OFILES) $(TEST_OFILES)
+	@echo linking ... $(notdir $@)
+	@$(LD) -g -o $@ $^ $(LDFLAGS)
+
+$(BIN)/dibench: $(OFILES) $(DIBENCH_OFILES)
+	@echo linking ... $(notdir $@)
+	@$(LD) -g -o $@ $^ $(LDFLAGS)
+
+$(BIN)/cryptobench: $(OFILES) $(CRYPTOBENCH_OFILES)
+	@echo linking ... $(notdir $@)
+	@$(LD) -g -o $@ $^ $(LDFLAGS)
+
+$(BUILD)/%_cpp.o : %.cpp
+	@echo $(notdir $<)
+	@$(CXX) -g -MMD -MF $(BUILD)/$*_cpp.d $(CXXFLAGS) -c $< -o$@
+
+$(BUILD)/%_c.o : %.c
+	@echo $(notdir $<)
+	@$(CC) -g -MMD -MF $(BUILD)/$*_c.d $(CFLAGS)  -c $< -o$@
+
+-include $(DEPENDS)
+
+.PHONY: default test bench clean
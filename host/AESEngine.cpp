@@ -0,0 +1,264 @@
+// AESEngine.cpp - Mock /dev/aes for the host build
+//
+// SPDX-License-Identifier: MIT
+
+#include "AESEngine.hpp"
+#include "Host.hpp"
+#include <IOS/System.hpp>
+#include <cstdio>
+#include <cstring>
+
+enum class AESIoctl {
+    Encrypt = 2,
+    Decrypt = 3,
+};
+
+static constexpr u32 MaxSize = 0x10000;
+
+// Plain byte-wise AES-128 following FIPS 197, separate from the table based
+// one in AES.cpp so the two can be checked against each other. The state is
+// kept in input order, column by column.
+
+static u8 s_sbox[256];
+static u8 s_invSbox[256];
+// Products over GF(2^8), so the mock isn't much slower than it needs to be
+static u8 s_product[256][256];
+
+static u8 XTime(u8 x)
+{
+    return (x << 1) ^ ((x & 0x80) ? 0x1B : 0);
+}
+
+static u8 Multiply(u8 a, u8 b)
+{
+    return s_product[a][b];
+}
+
+static void MakeTables()
+{
+    for (u32 a = 0; a < 256; a++) {
+        for (u32 b = 0; b < 256; b++) {
+            u8 x = a;
+            u8 result = 0;
+            for (u32 bits = b; bits != 0; bits >>= 1, x = XTime(x)) {
+                if (bits & 1)
+                    result ^= x;
+            }
+            s_product[a][b] = result;
+        }
+    }
+
+    for (u32 i = 0; i < 256; i++) {
+        u8 inv = 0;
+        for (u32 j = 1; j < 256 && i != 0; j++) {
+            if (Multiply(i, j) == 1) {
+                inv = j;
+                break;
+            }
+        }
+
+        u8 s = 0x63;
+        for (u32 bit = 0; bit < 8; bit++) {
+            u8 b = ((inv >> bit) ^ (inv >> ((bit + 4) % 8)) ^
+                     (inv >> ((bit + 5) % 8)) ^ (inv >> ((bit + 6) % 8)) ^
+                     (inv >> ((bit + 7) % 8))) &
+                   1;
+            s ^= b << bit;
+        }
+
+        s_sbox[i] = s;
+        s_invSbox[s] = i;
+    }
+}
+
+static void ExpandKey(const u8* key, u8* w)
+{
+    memcpy(w, key, 16);
+
+    u8 rcon = 1;
+    for (u32 i = 16; i < 176; i += 4) {
+        u8 t[4];
+        memcpy(t, w + i - 4, 4);
+        if (i % 16 == 0) {
+            u8 first = t[0];
+            t[0] = s_sbox[t[1]] ^ rcon;
+            t[1] = s_sbox[t[2]];
+            t[2] = s_sbox[t[3]];
+            t[3] = s_sbox[first];
+            rcon = XTime(rcon);
+        }
+
+        for (u32 j = 0; j < 4; j++)
+            w[i + j] = w[i + j - 16] ^ t[j];
+    }
+}
+
+static void AddRoundKey(u8* state, const u8* w, u32 round)
+{
+    for (u32 i = 0; i < 16; i++)
+        state[i] ^= w[round * 16 + i];
+}
+
+static void EncryptBlock(const u8* w, u8* state)
+{
+    AddRoundKey(state, w, 0);
+
+    for (u32 round = 1; round <= 10; round++) {
+        u8 t[16];
+        // SubBytes and ShiftRows: row r moves left by r columns
+        for (u32 c = 0; c < 4; c++) {
+            for (u32 r = 0; r < 4; r++)
+                t[c * 4 + r] = s_sbox[state[((c + r) % 4) * 4 + r]];
+        }
+
+        if (round != 10) {
+            for (u32 c = 0; c < 4; c++) {
+                u8* col = t + c * 4;
+                u8 a[4];
+                memcpy(a, col, 4);
+                for (u32 r = 0; r < 4; r++) {
+                    col[r] = Multiply(a[r], 2) ^ Multiply(a[(r + 1) % 4], 3) ^
+                             a[(r + 2) % 4] ^ a[(r + 3) % 4];
+                }
+            }
+        }
+
+        memcpy(state, t, 16);
+        AddRoundKey(state, w, round);
+    }
+}
+
+static void DecryptBlock(const u8* w, u8* state)
+{
+    AddRoundKey(state, w, 10);
+
+    for (u32 round = 9;; round--) {
+        u8 t[16];
+        // InvShiftRows and InvSubBytes
+        for (u32 c = 0; c < 4; c++) {
+            for (u32 r = 0; r < 4; r++)
+                t[((c + r) % 4) * 4 + r] = s_invSbox[state[c * 4 + r]];
+        }
+
+        memcpy(state, t, 16);
+        AddRoundKey(state, w, round);
+        if (round == 0)
+            break;
+
+        for (u32 c = 0; c < 4; c++) {
+            u8* col = state + c * 4;
+            u8 a[4];
+            memcpy(a, col, 4);
+            for (u32 r = 0; r < 4; r++) {
+                col[r] = Multiply(a[r], 14) ^ Multiply(a[(r + 1) % 4], 11) ^
+                         Multiply(a[(r + 2) % 4], 13) ^
+                         Multiply(a[(r + 3) % 4], 9);
+            }
+        }
+    }
+}
+
+Host::AESEngine::AESEngine()
+{
+    MakeTables();
+
+    m_queue = IOS_CreateMessageQueue(m_queueData, 8);
+    s32 ret = IOS_RegisterResourceManager("/dev/aes", m_queue);
+    assert(m_queue >= 0 && ret == IOS_SUCCESS);
+
+    ret = IOS_CreateThread(ThreadEntry, this, nullptr, 0, 80, true);
+    assert(ret >= 0);
+    IOS_StartThread(ret);
+}
+
+s32 Host::AESEngine::ThreadEntry(void* arg)
+{
+    reinterpret_cast<AESEngine*>(arg)->Run();
+    return 0;
+}
+
+void Host::AESEngine::Run()
+{
+    while (true) {
+        u32 msg;
+        s32 ret = IOS_ReceiveMessage(m_queue, &msg, 0);
+        assert(ret == IOS_SUCCESS);
+        IOSRequest* req = reinterpret_cast<IOSRequest*>(uintptr_t(msg));
+
+        switch (req->cmd) {
+        case IOS_OPEN:
+        case IOS_CLOSE:
+            IOS_ResourceReply(req, IOS_SUCCESS);
+            break;
+
+        case IOS_IOCTLV:
+            IOS_ResourceReply(req,
+              HandleIoctlv(req->ioctlv.cmd, req->ioctlv.in_count,
+                req->ioctlv.io_count, req->ioctlv.vec));
+            break;
+
+        default:
+            IOS_ResourceReply(req, IOS_EINVAL);
+            break;
+        }
+    }
+}
+
+s32 Host::AESEngine::HandleIoctlv(
+  u32 cmd, u32 inCount, u32 ioCount, IOVector* vec)
+{
+    auto ioctl = static_cast<AESIoctl>(cmd);
+    if ((ioctl != AESIoctl::Encrypt && ioctl != AESIoctl::Decrypt) ||
+        inCount != 2 || ioCount != 2 || vec[1].len != 16 || vec[3].len != 16)
+        return IOS_EINVAL;
+
+    u32 size = vec[0].len;
+    if (vec[2].len != size || size % 16 != 0 || size > MaxSize) {
+        m_stats.badRequests++;
+        fprintf(stderr, "host: AES engine request of 0x%X bytes\n", size);
+        return IOS_EINVAL;
+    }
+
+    auto in = reinterpret_cast<const u8*>(vec[0].data);
+    auto out = reinterpret_cast<u8*>(vec[2].data);
+    auto iv = reinterpret_cast<u8*>(vec[3].data);
+
+    u8 w[176];
+    ExpandKey(reinterpret_cast<const u8*>(vec[1].data), w);
+
+    for (u32 offset = 0; offset < size; offset += 16) {
+        u8 block[16];
+        memcpy(block, in + offset, 16);
+
+        if (ioctl == AESIoctl::Encrypt) {
+            for (u32 i = 0; i < 16; i++)
+                block[i] ^= iv[i];
+            EncryptBlock(w, block);
+            memcpy(iv, block, 16);
+            memcpy(out + offset, block, 16);
+        } else {
+            u8 cipher[16];
+            memcpy(cipher, block, 16);
+            DecryptBlock(w, block);
+            for (u32 i = 0; i < 16; i++)
+                out[offset + i] = block[i] ^ iv[i];
+            memcpy(iv, cipher, 16);
+        }
+    }
+
+    m_stats.requests++;
+    m_stats.bytes += size;
+    return IOS_SUCCESS;
+}
+
+Host::AESEngine::Stats Host::AESEngine::GetStats() const
+{
+    CPULock lock;
+    return m_stats;
+}
+
+void Host::AESEngine::ResetStats()
+{
+    CPULock lock;
+    m_stats = {};
+}
@@ -0,0 +1,44 @@
+// AESEngine.hpp - Mock /dev/aes for the host build
+//
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <IOS/Syscalls.h>
+#include <System/Types.h>
+
+namespace Host
+{
+
+/**
+ * Mock of the AES engine resource manager. Like the hardware, it takes
+ * AES-128-CBC requests of whole 16 byte blocks, up to 0x10000 bytes, and
+ * returns the next IV.
+ */
+class AESEngine
+{
+public:
+    AESEngine();
+
+    struct Stats {
+        u32 requests;
+        u64 bytes;
+        // Requests refused for their size or vectors
+        u32 badRequests;
+    };
+
+    Stats GetStats() const;
+    void ResetStats();
+
+private:
+    static s32 ThreadEntry(void* arg);
+    void Run();
+    s32 HandleIoctlv(u32 cmd, u32 inCount, u32 ioCount, IOVector* vec);
+
+    s32 m_queue;
+    u32 m_queueData[8];
+
+    Stats m_stats = {};
+};
+
+} // namespace Host
@@ -0,0 +1,164 @@
+// Harness.cpp - Common setup of the host tests and benchmarks
+//
+// SPDX-License-Identifier: MIT
+
+#include "Harness.hpp"
+#include "Host.hpp"
+#include "Image.hpp"
+#include <IOS/System.hpp>
+#include <cstdio>
+#include <cstring>
+
+static Host::AESEngine* s_aes = nullptr;
+static DI* s_di = nullptr;
+static const char* s_imagePath = nullptr;
+static Host::SDIO* s_sdio = nullptr;
+static Host::SHAEngine* s_sha = nullptr;
+static Host::USBVen* s_usb = nullptr;
+
+struct DiscParams {
+    u32 dataSize;
+    u32 fileCount;
+    Host::Disc::Format format;
+};
+
+static s32 WriteDiscEntry(void* arg)
+{
+    auto params = reinterpret_cast<const DiscParams*>(arg);
+    if (!Host::Disc::Write("0:/xaa", params->dataSize, params->fileCount))
+        return false;
+
+    switch (params->format) {
+    case Host::Disc::Format::Decrypted:
+        return Host::Disc::WriteDecrypted(
+          s_imagePath, params->dataSize, params->fileCount);
+
+    case Host::Disc::Format::Compressed:
+        return Host::Disc::WriteCompressed(
+          s_imagePath, params->dataSize, params->fileCount);
+
+    default:
+        return true;
+    }
+}
+
+bool Host::Harness::Start(const Options& options)
+{
+    Init();
+    SetVerbose(options.verbose);
+
+    if (!FormatFAT32(options.imagePath, options.imageSizeMB)) {
+        fprintf(stderr, "host: Failed to create %s\n", options.imagePath);
+        return false;
+    }
+
+    s_sdio = new SDIO(options.imagePath);
+    s_usb = new USBVen();
+    s_sha = new SHAEngine();
+    s_aes = new AESEngine();
+
+    if (!Boot())
+        return false;
+
+    Config::s_instance->SetDiscVerifyMode(options.discVerifyMode);
+
+    // The module picks the first image it finds, a decrypted or compressed
+    // one comes before 0:/xaa
+    const char* const paths[] = {"0:/xaa", "0:/game.wdec", "0:/game.wcmp"};
+    s_imagePath = paths[u32(options.discFormat)];
+
+    // Through FatFS on IOS, as the module has the volume mounted already
+    DiscParams params = {
+      .dataSize = options.discDataSize,
+      .fileCount = options.discFileCount,
+      .format = options.discFormat,
+    };
+    if (RunOnIOS(WriteDiscEntry, &params) != 1) {
+        fprintf(stderr, "host: Failed to write the disc image\n");
+        return false;
+    }
+
+    if (!StartDI())
+        return false;
+
+    s_di = new DI("~dev/di");
+    DI::DiskID* diskID = reinterpret_cast<DI::DiskID*>(
+      IOS_AllocAligned(IPCHeap, sizeof(DI::DiskID), 32));
+    auto tmd = reinterpret_cast<ES::TMDFixed<512>*>(
+      IOS_AllocAligned(IPCHeap, sizeof(ES::TMDFixed<512>), 32));
+    assert(diskID != nullptr && tmd != nullptr);
+
+    DI::DIError ret = s_di->ReadDiskID(diskID);
+    if (ret == DI::DIError::OK) {
+        ES::ESError esError;
+        ret = s_di->OpenPartition(Disc::PartitionOffset >> 2, tmd, &esError);
+    }
+
+    IOS_Free(IPCHeap, tmd);
+    IOS_Free(IPCHeap, diskID);
+
+    if (ret != DI::DIError::OK) {
+        fprintf(stderr, "host: Failed to open the disc partition: %s\n",
+          DI::PrintError(ret));
+        return false;
+    }
+
+    return true;
+}
+
+DI* Host::Harness::GetDI()
+{
+    return s_di;
+}
+
+const char* Host::Harness::GetImagePath()
+{
+    return s_imagePath;
+}
+
+bool Host::Harness::ParseBackend(const char* name, Disc::Format* format)
+{
+    const char* const names[] = {"iso", "decrypted", "compressed"};
+    for (u32 i = 0; i < 3; i++) {
+        if (strcmp(name, names[i]) == 0) {
+            *format = Disc::Format(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool Host::Harness::ParseVerifyMode(
+  const char* name, Config::DiscVerifyMode* mode)
+{
+    const char* const names[] = {"off", "lazy", "strict"};
+    for (u32 i = 0; i < 3; i++) {
+        if (strcmp(name, names[i]) == 0) {
+            *mode = Config::DiscVerifyMode(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+Host::AESEngine* Host::Harness::GetAES()
+{
+    return s_aes;
+}
+
+Host::SDIO* Host::Harness::GetSDIO()
+{
+    return s_sdio;
+}
+
+Host::SHAEngine* Host::Harness::GetSHA()
+{
+    return s_sha;
+}
+
+Host::USBVen* Host::Harness::GetUSB()
+{
+    return s_usb;
+}
@@ -0,0 +1,69 @@
+// Harness.hpp - Common setup of the host tests and benchmarks
+//
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "AESEngine.hpp"
+#include "Image.hpp"
+#include "SDIO.hpp"
+#include "SHAEngine.hpp"
+#include "USB.hpp"
+#include <DVD/DI.hpp>
+#include <System/Config.hpp>
+#include <System/Types.h>
+
+namespace Host::Harness
+{
+
+struct Options {
+    const char* imagePath = "/tmp/saoirse_host_sd.img";
+    // Size of the SD card image, which is sparse
+    u32 imageSizeMB = 320;
+    // Size of the partition data of the disc image
+    u32 discDataSize = 64 * 1024 * 1024;
+    u32 discFileCount = 256;
+    // Image the module reads the disc from, which decides its backend. The
+    // disc is written as 0:/xaa as well, for tests that open it themselves.
+    Disc::Format discFormat = Disc::Format::ISO;
+    // How the module checks the hash tree, instead of Config's default
+    Config::DiscVerifyMode discVerifyMode = Config::DiscVerifyMode::Off;
+    bool verbose = false;
+};
+
+/**
+ * Create an SD card image with the test disc on it, register the device
+ * mocks and boot the IOS module with the emulated DI started. The disc's
+ * game partition is opened through ~dev/di, like a game would.
+ * @returns False if any step failed, after printing why.
+ */
+bool Start(const Options& options);
+
+/**
+ * Client of ~dev/di, with the game partition open.
+ */
+DI* GetDI();
+
+/**
+ * Path of the disc image the module reads.
+ */
+const char* GetImagePath();
+
+/**
+ * Parse a --backend argument: iso, decrypted or compressed.
+ * @returns False if the name isn't one of them.
+ */
+bool ParseBackend(const char* name, Disc::Format* format);
+
+/**
+ * Parse a --verify argument: off, lazy or strict.
+ * @returns False if the name isn't one of them.
+ */
+bool ParseVerifyMode(const char* name, Config::DiscVerifyMode* mode);
+
+AESEngine* GetAES();
+SDIO* GetSDIO();
+SHAEngine* GetSHA();
+USBVen* GetUSB();
+
+} // namespace Host::Harness
@@ -0,0 +1,115 @@
+// Host.hpp - IOS runtime for building the IOS module on a Linux host
+//
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <IOS/Syscalls.h>
+#include <System/Types.h>
+
+/**
+ * The host build runs the IOS module sources as a normal Linux program, to
+ * test and benchmark the disc read path without a Wii. Syscalls.cpp
+ * implements the IOS system calls on POSIX threads, and the resource managers
+ * the module talks to are replaced with mocks registered under the same
+ * names.
+ *
+ * IOS passes pointers in 32-bit messages, so all memory the module uses is
+ * kept below 4 GB. The heaps are mapped at the Wii's MEM1 and MEM2
+ * addresses, thread stacks come from the IPC heap, and the program itself is
+ * linked above them without PIE (see host.mk).
+ *
+ * Like on the Starlet, only one IOS thread runs at a time. A thread keeps
+ * the CPU until it blocks in a system call; there is no preemption and
+ * thread priorities are ignored. Threads created with CreatePPCThread play
+ * the role of the PowerPC: they run alongside IOS and only take the CPU
+ * inside system calls.
+ *
+ * Disc images are big-endian, and the module reads their structures without
+ * byte swapping. The disc images made by Image.cpp are written in host byte
+ * order for this reason, and real dumps only work on a big-endian host. FAT
+ * is little-endian on any machine and FatFS reads it byte by byte, so SD card
+ * images are the same on the host as on the Wii.
+ */
+namespace Host
+{
+
+constexpr u32 MEM1Base = 0x00800000;
+constexpr u32 MEM1Size = 0x01000000;
+constexpr u32 MEM2Base = 0x10000000;
+constexpr u32 MEM2Size = 0x04000000;
+
+// Shared IPC heap, like heap 0 on IOS. Also holds the thread stacks.
+constexpr s32 IPCHeap = 0;
+constexpr u32 IPCHeapSize = 0x02000000;
+
+// Heap in MEM1, for testing the paths for MEM1 buffers
+constexpr s32 MEM1Heap = 1;
+
+// Free MEM2 after the IPC heap, for the system heap and the mocks
+constexpr u32 SystemHeapBase = MEM2Base + IPCHeapSize;
+
+/**
+ * Map the emulated memory and create the IPC and MEM1 heaps. Must be called
+ * before any system call.
+ */
+void Init();
+
+/**
+ * Flush the output and exit, without running the destructors of objects
+ * the IOS threads may still be using.
+ */
+[[noreturn]] void Exit(int status);
+
+/**
+ * Start a thread that runs like the PowerPC, outside of the IOS scheduling.
+ * @returns Thread ID, or an IOS error code.
+ */
+s32 CreatePPCThread(IOSThreadProc proc, void* arg);
+
+/**
+ * Run a function on a new IOS thread and wait for it to return, to call
+ * module code that expects to run on IOS.
+ * @returns Return value of the function, or an IOS error code.
+ */
+s32 RunOnIOS(IOSThreadProc proc, void* arg);
+
+/**
+ * Lock the CPU from a PowerPC thread, to access state owned by IOS threads.
+ * Does nothing on IOS threads, which hold the CPU while they run.
+ */
+class CPULock
+{
+public:
+    CPULock();
+    ~CPULock();
+
+    CPULock(const CPULock& from) = delete;
+
+private:
+    bool m_locked;
+};
+
+/**
+ * Boot the IOS module the way Entry and SystemThreadEntry do, with a
+ * PowerPC thread reading its log, and wait for the SD card to be mounted.
+ * AES is set to software, as there is no mock of the AES engine.
+ * Call after Init, with the mocks of the devices the module opens already
+ * registered.
+ * @returns False if the SD card couldn't be mounted.
+ */
+bool Boot();
+
+/**
+ * Send the start request and wait for the emulated DI resource manager to
+ * start. The disc image must be on the SD card by then.
+ * @returns False if DI didn't start.
+ */
+bool StartDI();
+
+/**
+ * Print INFO logs from IOS, not only warnings and errors.
+ */
+void SetVerbose(bool verbose);
+
+} // namespace Host
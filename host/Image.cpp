@@ -0,0 +1,722 @@
+// Image.cpp - SD card and disc images for the host build
+//
+// SPDX-License-Identifier: MIT
+
+#include "Image.hpp"
+#include "Host.hpp"
+#include <DVD/DI.hpp>
+#include <EmuDI/CompressedISO.hpp>
+#include <EmuDI/DecryptedISO.hpp>
+#include <FAT/ff.h>
+#include <IOS/System.hpp>
+#include <System/AES.hpp>
+#include <System/ES.hpp>
+#include <System/SHA.hpp>
+#include <System/Util.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+static constexpr u32 SectorSize = 512;
+
+static void PutLE16(u8* out, u16 value)
+{
+    out[0] = value;
+    out[1] = value >> 8;
+}
+
+static void PutLE32(u8* out, u32 value)
+{
+    PutLE16(out, value);
+    PutLE16(out + 2, value >> 16);
+}
+
+u32 Host::CompressLZ4(const u8* in, u32 inSize, u8* out, u32 outSize)
+{
+    constexpr u32 MinMatch = 4;
+    // The format wants the last 5 bytes to be literals, and the last match
+    // to start at least 12 bytes before the end
+    constexpr u32 LastLiterals = 5;
+    constexpr u32 MatchStartLimit = 12;
+    constexpr u32 HashBits = 12;
+    constexpr u32 MaxOffset = 0xFFFF;
+
+    // Position + 1 of the last 4 bytes with each hash, 0 if none
+    auto table = reinterpret_cast<u32*>(
+      IOS_Alloc(Host::IPCHeap, sizeof(u32) << HashBits));
+    assert(table != nullptr);
+    memset(table, 0, sizeof(u32) << HashBits);
+
+    u32 op = 0;
+    auto putLength = [&](u32 length) {
+        for (; length >= 255; length -= 255) {
+            if (op == outSize)
+                return false;
+            out[op++] = 255;
+        }
+
+        if (op == outSize)
+            return false;
+        out[op++] = length;
+        return true;
+    };
+
+    // A sequence of literals, then a match unless it's the last one
+    auto putSequence = [&](u32 literalStart, u32 literalLen, u32 offset,
+                         u32 matchLen) {
+        if (op == outSize)
+            return false;
+
+        u32 matchCode = matchLen != 0 ? matchLen - MinMatch : 0;
+        out[op++] = std::min<u32>(literalLen, 15) << 4 |
+                    std::min<u32>(matchCode, 15);
+
+        if (literalLen >= 15 && !putLength(literalLen - 15))
+            return false;
+
+        if (literalLen > outSize - op)
+            return false;
+        memcpy(out + op, in + literalStart, literalLen);
+        op += literalLen;
+
+        if (matchLen == 0)
+            return true;
+
+        if (outSize - op < 2)
+            return false;
+        out[op++] = offset;
+        out[op++] = offset >> 8;
+
+        return matchCode < 15 || putLength(matchCode - 15);
+    };
+
+    u32 anchor = 0;
+    bool ok = true;
+    for (u32 ip = 0; ok && ip + MatchStartLimit < inSize;) {
+        u32 sequence;
+        memcpy(&sequence, in + ip, 4);
+        u32 hash = (sequence * 2654435761u) >> (32 - HashBits);
+        u32 ref = table[hash];
+        table[hash] = ip + 1;
+
+        if (ref == 0 || ip - (ref - 1) > MaxOffset ||
+            memcmp(in + ref - 1, in + ip, MinMatch) != 0) {
+            ip++;
+            continue;
+        }
+
+        ref--;
+        u32 end = ip + MinMatch;
+        while (end < inSize - LastLiterals && in[end] == in[ref + end - ip])
+            end++;
+
+        ok = putSequence(anchor, ip - anchor, ip - ref, end - ip);
+        ip = end;
+        anchor = end;
+    }
+
+    ok = ok && putSequence(anchor, inSize - anchor, 0, 0);
+
+    IOS_Free(Host::IPCHeap, table);
+    return ok ? op : 0;
+}
+
+bool Host::FormatFAT32(const char* path, u32 sizeMB)
+{
+    constexpr u32 ReservedSectors = 32;
+    constexpr u32 FATCount = 2;
+    // FatFS decides the FAT type from the cluster count alone
+    constexpr u32 MinClusters = 65526 + 16;
+
+    if (sizeMB < 64)
+        return false;
+
+    u32 totalSectors = sizeMB * (0x100000 / SectorSize);
+
+    // Largest cluster size up to 4 KB that still makes it FAT32
+    u32 clusterSectors = 8;
+    u32 fatSectors = 0;
+    u32 clusters = 0;
+    for (; clusterSectors >= 1; clusterSectors /= 2) {
+        fatSectors = 1;
+        for (u32 i = 0; i < 4; i++) {
+            u32 dataSectors =
+              totalSectors - ReservedSectors - FATCount * fatSectors;
+            clusters = dataSectors / clusterSectors;
+            fatSectors = (u64(clusters + 2) * 4 + SectorSize - 1) / SectorSize;
+        }
+
+        if (clusters >= MinClusters)
+            break;
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return false;
+
+    bool ret = ftruncate(fd, off_t(totalSectors) * SectorSize) == 0;
+
+    u8 sector[SectorSize] = {};
+    memcpy(sector, "\xEB\x58\x90MSWIN4.1", 11);
+    PutLE16(sector + 11, SectorSize);
+    sector[13] = clusterSectors;
+    PutLE16(sector + 14, ReservedSectors);
+    sector[16] = FATCount;
+    sector[21] = 0xF8;
+    PutLE16(sector + 24, 63);
+    PutLE16(sector + 26, 255);
+    PutLE32(sector + 32, totalSectors);
+    PutLE32(sector + 36, fatSectors);
+    // Root directory cluster
+    PutLE32(sector + 44, 2);
+    // FSInfo and backup boot sector
+    PutLE16(sector + 48, 1);
+    PutLE16(sector + 50, 6);
+    sector[64] = 0x80;
+    sector[66] = 0x29;
+    PutLE32(sector + 67, 0x484F5354);
+    memcpy(sector + 71, "NO NAME    FAT32   ", 19);
+    sector[510] = 0x55;
+    sector[511] = 0xAA;
+    ret = ret && pwrite(fd, sector, SectorSize, 0) == SectorSize &&
+          pwrite(fd, sector, SectorSize, 6 * SectorSize) == SectorSize;
+
+    memset(sector, 0, SectorSize);
+    PutLE32(sector, 0x41615252);
+    PutLE32(sector + 484, 0x61417272);
+    PutLE32(sector + 488, 0xFFFFFFFF);
+    PutLE32(sector + 492, 0xFFFFFFFF);
+    PutLE32(sector + 508, 0xAA550000);
+    ret = ret && pwrite(fd, sector, SectorSize, SectorSize) == SectorSize &&
+          pwrite(fd, sector, SectorSize, 7 * SectorSize) == SectorSize;
+
+    // Media and end of chain entries, then the root directory's only cluster
+    memset(sector, 0, SectorSize);
+    PutLE32(sector, 0x0FFFFFF8);
+    PutLE32(sector + 4, 0x0FFFFFFF);
+    PutLE32(sector + 8, 0x0FFFFFFF);
+    for (u32 i = 0; i < FATCount; i++) {
+        off_t offset = off_t(ReservedSectors + i * fatSectors) * SectorSize;
+        ret = ret && pwrite(fd, sector, SectorSize, offset) == SectorSize;
+    }
+
+    close(fd);
+    return ret;
+}
+
+static constexpr u32 BlockSize = 0x8000;
+static constexpr u32 BlockHeaderSize = 0x400;
+static constexpr u32 BlockDataSize = BlockSize - BlockHeaderSize;
+static constexpr u32 BlockIVOffset = 0x3D0;
+
+static constexpr u32 PartitionTableOffset = 0x40000;
+static constexpr u32 TMDOffset = 0x2C0;
+static constexpr u32 H3TableOffset = 0x8000;
+static constexpr u32 H3TableSize = 0x18000;
+static constexpr u32 DataOffset = 0x20000;
+static constexpr u32 NameSize = 6;
+
+static const u8 CommonKey[16] = {
+  0xeb,
+  0xe4,
+  0x2a,
+  0x22,
+  0x5e,
+  0x85,
+  0x93,
+  0xe4,
+  0x48,
+  0xd9,
+  0xc5,
+  0x45,
+  0x73,
+  0x81,
+  0xaa,
+  0xf7,
+};
+
+const u8 Host::Disc::TitleKey[16] = {
+  0x00,
+  0x11,
+  0x22,
+  0x33,
+  0x44,
+  0x55,
+  0x66,
+  0x77,
+  0x88,
+  0x99,
+  0xaa,
+  0xbb,
+  0xcc,
+  0xdd,
+  0xee,
+  0xff,
+};
+
+bool Host::Disc::Check(const void* data, u32 wordOffset, u32 byteLen)
+{
+    const u8* bytes = reinterpret_cast<const u8*>(data);
+
+    for (u32 i = 0; i < byteLen / 4; i++) {
+        u32 word = wordOffset + i;
+        if (word < PatternStart / 4)
+            continue;
+
+        u32 value;
+        memcpy(&value, bytes + i * 4, 4);
+        if (value != PatternWord(word))
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * Partition data before the pattern: the boot header and the FST. Files
+ * split the pattern area evenly.
+ */
+static void MakeDataHeader(u8* out, u32 dataSize, u32 fileCount)
+{
+    memset(out, 0, Host::Disc::PatternStart);
+    memcpy(out, "RHST01", 6);
+
+    u32 fileSize = ((dataSize - Host::Disc::PatternStart) / fileCount) & ~3;
+    u32 fstSize = (fileCount + 1) * 12 + fileCount * NameSize;
+
+    u32* fstInfo = reinterpret_cast<u32*>(out + 0x420);
+    fstInfo[1] = Host::Disc::FSTOffset >> 2;
+    fstInfo[2] = (fstSize + 3) >> 2;
+    fstInfo[3] = fstInfo[2];
+
+    u32* fst = reinterpret_cast<u32*>(out + Host::Disc::FSTOffset);
+    char* names = reinterpret_cast<char*>(fst + (fileCount + 1) * 3);
+
+    // Root directory, its size is the entry count
+    fst[0] = 0x01000000;
+    fst[1] = 0;
+    fst[2] = fileCount + 1;
+
+    for (u32 i = 0; i < fileCount; i++) {
+        u32* entry = fst + (i + 1) * 3;
+        entry[0] = i * NameSize;
+        entry[1] = (Host::Disc::PatternStart + i * fileSize) >> 2;
+        entry[2] = fileSize;
+        snprintf(names + i * NameSize, NameSize, "f%04u", i);
+    }
+}
+
+/**
+ * Decrypted data of a partition block: the pattern, with the data header
+ * over it in the first blocks.
+ */
+static void MakeBlockData(u8* data, u32 block, const u8* dataHeader)
+{
+    u32 offset = block * BlockDataSize;
+
+    for (u32 i = 0; i < BlockDataSize; i += 4) {
+        u32 value = Host::Disc::PatternWord((offset + i) >> 2);
+        memcpy(data + i, &value, 4);
+    }
+
+    if (offset < Host::Disc::PatternStart) {
+        memcpy(data, dataHeader + offset,
+          std::min(BlockDataSize, Host::Disc::PatternStart - offset));
+    }
+}
+
+static void Hash(const void* data, u32 len, u8* hash)
+{
+    // In software, the host's SHA engine is a mock and much slower
+    SHA::Context ctx ATTRIBUTE_ALIGN(32);
+    SHA::s_instance->Init(&ctx, true);
+    SHA::s_instance->Final(&ctx, data, len, hash);
+}
+
+/**
+ * Hash tree of the partition, like a real disc has: the H0 hashes of each
+ * 0x400 bytes of a block's data, and the H1, H2 and H3 hashes of the tables
+ * below them for each subgroup of 8 blocks, group of 64 blocks and the whole
+ * partition. Block headers are made a group at a time, as the writers go
+ * through the blocks in order.
+ */
+class HashTree
+{
+public:
+    HashTree(u32 blockCount, const u8* dataHeader)
+      : m_blockCount(blockCount),
+        m_dataHeader(dataHeader)
+    {
+        m_headers = reinterpret_cast<u8*>(
+          IOS_Alloc(Host::IPCHeap, GroupBlocks * BlockHeaderSize));
+        m_data = reinterpret_cast<u8*>(IOS_Alloc(Host::IPCHeap, BlockDataSize));
+        m_h3Table =
+          reinterpret_cast<u8*>(IOS_Alloc(Host::IPCHeap, H3TableSize));
+        assert(m_headers != nullptr && m_data != nullptr &&
+               m_h3Table != nullptr);
+
+        // The H3 table is needed in the partition header, before any block
+        memset(m_h3Table, 0, H3TableSize);
+        u32 groupCount = (blockCount + GroupBlocks - 1) / GroupBlocks;
+        assert(groupCount <= H3TableSize / HashSize);
+        for (u32 group = 0; group < groupCount; group++) {
+            MakeGroup(group);
+            Hash(m_headers + H2Offset, H1H2Size, m_h3Table + group * HashSize);
+        }
+    }
+
+    ~HashTree()
+    {
+        IOS_Free(Host::IPCHeap, m_h3Table);
+        IOS_Free(Host::IPCHeap, m_data);
+        IOS_Free(Host::IPCHeap, m_headers);
+    }
+
+    /**
+     * Hash header of a block, as it is before encryption.
+     */
+    const u8* GetHeader(u32 block)
+    {
+        if (block / GroupBlocks != m_group)
+            MakeGroup(block / GroupBlocks);
+
+        return m_headers + block % GroupBlocks * BlockHeaderSize;
+    }
+
+    const u8* GetH3Table() const
+    {
+        return m_h3Table;
+    }
+
+private:
+    static constexpr u32 HashSize = 0x14;
+    static constexpr u32 H1Offset = 0x280;
+    static constexpr u32 H2Offset = 0x340;
+    static constexpr u32 H1H2Size = 8 * HashSize;
+    static constexpr u32 H0ChunkSize = 0x400;
+    static constexpr u32 GroupBlocks = 64;
+
+    void MakeGroup(u32 group)
+    {
+        // Blocks past the end of the partition have no hashes
+        memset(m_headers, 0, GroupBlocks * BlockHeaderSize);
+        u32 first = group * GroupBlocks;
+        u32 count = std::min(GroupBlocks, m_blockCount - first);
+
+        for (u32 i = 0; i < count; i++) {
+            u8* header = m_headers + i * BlockHeaderSize;
+            MakeBlockData(m_data, first + i, m_dataHeader);
+            for (u32 j = 0; j < BlockDataSize / H0ChunkSize; j++) {
+                Hash(m_data + j * H0ChunkSize, H0ChunkSize,
+                  header + j * HashSize);
+            }
+        }
+
+        // H1 of each block in the subgroup, and H2 of each subgroup
+        u8 h2Table[H1H2Size] = {};
+        for (u32 sub = 0; sub * 8 < count; sub++) {
+            u8 h1Table[H1H2Size] = {};
+            for (u32 i = sub * 8; i < std::min(sub * 8 + 8, count); i++) {
+                Hash(m_headers + i * BlockHeaderSize, 31 * HashSize,
+                  h1Table + i % 8 * HashSize);
+            }
+
+            for (u32 i = sub * 8; i < sub * 8 + 8; i++) {
+                memcpy(m_headers + i * BlockHeaderSize + H1Offset, h1Table,
+                  H1H2Size);
+            }
+            Hash(h1Table, H1H2Size, h2Table + sub * HashSize);
+        }
+
+        for (u32 i = 0; i < GroupBlocks; i++) {
+            memcpy(
+              m_headers + i * BlockHeaderSize + H2Offset, h2Table, H1H2Size);
+        }
+
+        m_group = group;
+    }
+
+    u32 m_blockCount;
+    const u8* m_dataHeader;
+    u32 m_group = ~0;
+    u8* m_headers;
+    u8* m_data;
+    u8* m_h3Table;
+};
+
+/**
+ * Encrypted partition block. The hash header is encrypted with a zero IV, and
+ * the data with the last 16 bytes of the encrypted header.
+ */
+static void MakeBlock(u8* out, u32 block, HashTree* tree, const u8* dataHeader)
+{
+    u8* data = out + BlockHeaderSize;
+    MakeBlockData(data, block, dataHeader);
+
+    u8 iv[16] = {};
+    AES::SoftwareEncrypt(
+      Host::Disc::TitleKey, iv, tree->GetHeader(block), BlockHeaderSize, out);
+
+    memcpy(iv, out + BlockIVOffset, sizeof(iv));
+    AES::SoftwareEncrypt(Host::Disc::TitleKey, iv, data, BlockDataSize, data);
+}
+
+/**
+ * Everything before the partition data: the disc ID, the partition table
+ * and the partition header with the ticket, the TMD and the H3 table.
+ */
+static void MakeDiscHeader(u8* out, u32 blockCount, const HashTree& tree)
+{
+    memset(out, 0, Host::Disc::PartitionOffset + DataOffset);
+
+    auto diskID = reinterpret_cast<DI::DiskID*>(out);
+    memcpy(diskID->gameID, "RHST", 4);
+    diskID->groupID = 0x3031;
+    diskID->discMagic = 0x5D1C9EA3;
+
+    u32* table = reinterpret_cast<u32*>(out + PartitionTableOffset);
+    table[0] = 1;
+    table[1] = (PartitionTableOffset + 0x20) >> 2;
+    table[8] = Host::Disc::PartitionOffset >> 2;
+    table[9] = 0;
+
+    auto partition =
+      reinterpret_cast<DI::Partition*>(out + Host::Disc::PartitionOffset);
+    partition->ticket.sigType = ES::SigType::RSA_2048;
+    partition->ticket.info.titleID = Host::Disc::TitleID;
+    partition->ticket.info.commonKeyIndex = 0;
+
+    u8 iv[16] = {};
+    memcpy(iv, &partition->ticket.info.titleID, 8);
+    AES::SoftwareEncrypt(
+      CommonKey, iv, Host::Disc::TitleKey, 16, partition->ticket.titleKey);
+
+    partition->tmdByteLength = sizeof(ES::TMDFixed<1>);
+    partition->tmdWordOffset = TMDOffset >> 2;
+    partition->h3TableWordOffset = H3TableOffset >> 2;
+    partition->dataWordOffset = DataOffset >> 2;
+    partition->dataWordLength = u64(blockCount) * BlockSize >> 2;
+
+    auto tmd = reinterpret_cast<ES::TMDFixed<1>*>(
+      out + Host::Disc::PartitionOffset + TMDOffset);
+    tmd->header.sigType = ES::SigType::RSA_2048;
+    tmd->header.titleID = Host::Disc::TitleID;
+    tmd->header.numContents = 1;
+    tmd->contents[0].size = u64(blockCount) * BlockSize;
+
+    memcpy(out + Host::Disc::PartitionOffset + H3TableOffset,
+      tree.GetH3Table(), H3TableSize);
+    Hash(tree.GetH3Table(), H3TableSize, tmd->contents[0].hash);
+}
+
+bool Host::Disc::Write(const char* path, u32 dataSize, u32 fileCount)
+{
+    u32 blockCount = dataSize / BlockDataSize;
+    dataSize = blockCount * BlockDataSize;
+    if (fileCount == 0 || dataSize <= PatternStart + fileCount * 4 ||
+        (fileCount + 1) * 12 + fileCount * NameSize > PatternStart - FSTOffset)
+        return false;
+
+    // In IPC memory like the buffers of a real client
+    constexpr u32 HeaderSize = PartitionOffset + DataOffset;
+    auto file = reinterpret_cast<FIL*>(IOS_Alloc(Host::IPCHeap, sizeof(FIL)));
+    auto buffer =
+      reinterpret_cast<u8*>(IOS_AllocAligned(Host::IPCHeap, HeaderSize, 32));
+    auto dataHeader =
+      reinterpret_cast<u8*>(IOS_Alloc(Host::IPCHeap, PatternStart));
+    assert(file != nullptr && buffer != nullptr && dataHeader != nullptr);
+
+    MakeDataHeader(dataHeader, dataSize, fileCount);
+    HashTree tree(blockCount, dataHeader);
+
+    bool ret = f_open(file, path, FA_CREATE_ALWAYS | FA_WRITE) == FR_OK;
+    if (ret) {
+        UINT bw;
+        MakeDiscHeader(buffer, blockCount, tree);
+        ret = f_write(file, buffer, HeaderSize, &bw) == FR_OK &&
+              bw == HeaderSize;
+
+        for (u32 block = 0; ret && block < blockCount; block++) {
+            MakeBlock(buffer, block, &tree, dataHeader);
+            ret = f_write(file, buffer, BlockSize, &bw) == FR_OK &&
+                  bw == BlockSize;
+        }
+
+        ret = f_close(file) == FR_OK && ret;
+    }
+
+    IOS_Free(Host::IPCHeap, dataHeader);
+    IOS_Free(Host::IPCHeap, buffer);
+    IOS_Free(Host::IPCHeap, file);
+    return ret;
+}
+
+bool Host::Disc::WriteDecrypted(const char* path, u32 dataSize, u32 fileCount)
+{
+    u32 blockCount = dataSize / BlockDataSize;
+    dataSize = blockCount * BlockDataSize;
+    if (fileCount == 0 || dataSize <= PatternStart + fileCount * 4 ||
+        (fileCount + 1) * 12 + fileCount * NameSize > PatternStart - FSTOffset)
+        return false;
+
+    // Laid out like tools/decrypt_disc.py makes it: the header and extent
+    // table in the first block, then the disc header and the partition header
+    // as two extents, then the decrypted partition data
+    constexpr u32 HeaderSize = PartitionOffset + DataOffset;
+    constexpr u32 ExtentTableOffset = 0x40;
+    constexpr u32 ExtentsFileOffset = BlockSize;
+
+    auto file = reinterpret_cast<FIL*>(IOS_Alloc(Host::IPCHeap, sizeof(FIL)));
+    auto buffer =
+      reinterpret_cast<u8*>(IOS_AllocAligned(Host::IPCHeap, HeaderSize, 32));
+    auto dataHeader =
+      reinterpret_cast<u8*>(IOS_Alloc(Host::IPCHeap, PatternStart));
+    assert(file != nullptr && buffer != nullptr && dataHeader != nullptr);
+
+    memset(buffer, 0, BlockSize);
+    auto header = reinterpret_cast<DecryptedISO::Header*>(buffer);
+    header->magic = DecryptedISO::Magic;
+    header->version = DecryptedISO::Version;
+    header->extentCount = 2;
+    header->extentTableOffset = ExtentTableOffset;
+    header->partitionWordOffset = PartitionOffset >> 2;
+    header->dataOffset = ExtentsFileOffset + HeaderSize;
+    header->dataSize = dataSize;
+
+    auto extents =
+      reinterpret_cast<DecryptedISO::Extent*>(buffer + ExtentTableOffset);
+    extents[0] = {0, PartitionOffset, ExtentsFileOffset};
+    extents[1] = {PartitionOffset >> 2, DataOffset,
+      ExtentsFileOffset + PartitionOffset};
+
+    MakeDataHeader(dataHeader, dataSize, fileCount);
+    HashTree tree(blockCount, dataHeader);
+
+    bool ret = f_open(file, path, FA_CREATE_ALWAYS | FA_WRITE) == FR_OK;
+    if (ret) {
+        UINT bw;
+        ret = f_write(file, buffer, BlockSize, &bw) == FR_OK &&
+              bw == BlockSize;
+
+        MakeDiscHeader(buffer, blockCount, tree);
+        ret = ret && f_write(file, buffer, HeaderSize, &bw) == FR_OK &&
+              bw == HeaderSize;
+
+        for (u32 block = 0; ret && block < blockCount; block++) {
+            MakeBlockData(buffer, block, dataHeader);
+            ret = f_write(file, buffer, BlockDataSize, &bw) == FR_OK &&
+                  bw == BlockDataSize;
+        }
+
+        ret = f_close(file) == FR_OK && ret;
+    }
+
+    IOS_Free(Host::IPCHeap, dataHeader);
+    IOS_Free(Host::IPCHeap, buffer);
+    IOS_Free(Host::IPCHeap, file);
+    return ret;
+}
+
+bool Host::Disc::WriteCompressed(const char* path, u32 dataSize, u32 fileCount)
+{
+    u32 blockCount = dataSize / BlockDataSize;
+    dataSize = blockCount * BlockDataSize;
+    if (fileCount == 0 || dataSize <= PatternStart + fileCount * 4 ||
+        (fileCount + 1) * 12 + fileCount * NameSize > PatternStart - FSTOffset)
+        return false;
+
+    // The disc header and the partition header up to the data take whole
+    // chunks, each partition block one chunk
+    constexpr u32 HeaderSize = PartitionOffset + DataOffset;
+    constexpr u32 ChunkSize = CompressedISO::ChunkSize;
+    constexpr u32 IndexOffset = 0x40;
+    static_assert(HeaderSize % ChunkSize == 0 && BlockSize == ChunkSize);
+
+    u32 chunkCount = HeaderSize / ChunkSize + blockCount;
+    u32 indexSize = chunkCount * sizeof(CompressedISO::ChunkEntry);
+
+    auto file = reinterpret_cast<FIL*>(IOS_Alloc(Host::IPCHeap, sizeof(FIL)));
+    auto buffer =
+      reinterpret_cast<u8*>(IOS_AllocAligned(Host::IPCHeap, HeaderSize, 32));
+    auto dataHeader =
+      reinterpret_cast<u8*>(IOS_Alloc(Host::IPCHeap, PatternStart));
+    auto index = reinterpret_cast<CompressedISO::ChunkEntry*>(
+      IOS_Alloc(Host::IPCHeap, indexSize));
+    auto compressed =
+      reinterpret_cast<u8*>(IOS_AllocAligned(Host::IPCHeap, ChunkSize, 32));
+    assert(file != nullptr && buffer != nullptr && dataHeader != nullptr &&
+           index != nullptr && compressed != nullptr);
+
+    u32 chunk = 0;
+    auto writeChunk = [&](const u8* data) {
+        CompressedISO::ChunkEntry* entry = &index[chunk++];
+
+        if (std::all_of(data, data + ChunkSize,
+              [&](u8 value) { return value == data[0]; })) {
+            *entry = {0, CompressedISO::ChunkType::Fill, {0, 0, data[0]}};
+            return true;
+        }
+
+        u32 size = CompressLZ4(data, ChunkSize, compressed, ChunkSize - 1);
+        const u8* stored = size != 0 ? compressed : data;
+        u32 storedSize = size != 0 ? size : ChunkSize;
+        *entry = {u32(f_tell(file) >> 4),
+          size != 0 ? CompressedISO::ChunkType::LZ4
+                    : CompressedISO::ChunkType::Stored,
+          {u8(size >> 16), u8(size >> 8), u8(size)}};
+
+        // Chunk offsets are stored in 16 byte units
+        static const u8 Padding[16] = {};
+        UINT bw;
+        return f_write(file, stored, storedSize, &bw) == FR_OK &&
+               bw == storedSize &&
+               f_write(file, Padding, -storedSize & 15, &bw) == FR_OK &&
+               bw == (-storedSize & 15);
+    };
+
+    MakeDataHeader(dataHeader, dataSize, fileCount);
+    HashTree tree(blockCount, dataHeader);
+
+    bool ret = f_open(file, path, FA_CREATE_ALWAYS | FA_WRITE) == FR_OK;
+    if (ret) {
+        ret = f_lseek(file, round_up(IndexOffset + indexSize, 0x20)) == FR_OK;
+
+        MakeDiscHeader(buffer, blockCount, tree);
+        for (u32 i = 0; ret && i < HeaderSize / ChunkSize; i++)
+            ret = writeChunk(buffer + i * ChunkSize);
+
+        // Partition blocks are stored decrypted, with their hash header
+        for (u32 block = 0; ret && block < blockCount; block++) {
+            memcpy(buffer, tree.GetHeader(block), BlockHeaderSize);
+            MakeBlockData(buffer + BlockHeaderSize, block, dataHeader);
+            ret = writeChunk(buffer);
+        }
+
+        memset(buffer, 0, IndexOffset);
+        auto header = reinterpret_cast<CompressedISO::Header*>(buffer);
+        header->magic = CompressedISO::Magic;
+        header->version = CompressedISO::Version;
+        header->chunkSize = ChunkSize;
+        header->chunkCount = chunkCount;
+        header->discSize = HeaderSize + u64(blockCount) * BlockSize;
+        header->indexOffset = IndexOffset;
+        header->partitionWordOffset = PartitionOffset >> 2;
+
+        UINT bw;
+        ret = ret && f_lseek(file, 0) == FR_OK &&
+              f_write(file, buffer, IndexOffset, &bw) == FR_OK &&
+              bw == IndexOffset &&
+              f_write(file, index, indexSize, &bw) == FR_OK && bw == indexSize;
+
+        ret = f_close(file) == FR_OK && ret;
+    }
+
+    IOS_Free(Host::IPCHeap, compressed);
+    IOS_Free(Host::IPCHeap, index);
+    IOS_Free(Host::IPCHeap, dataHeader);
+    IOS_Free(Host::IPCHeap, buffer);
+    IOS_Free(Host::IPCHeap, file);
+    return ret;
+}
@@ -0,0 +1,91 @@
+// Image.hpp - SD card and disc images for the host build
+//
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <System/Types.h>
+
+namespace Host
+{
+
+/**
+ * Create an image file with an empty FAT32 volume, without a partition
+ * table. FatFS is built without f_mkfs, so this is done here.
+ * @param sizeMB Size of the image, at least 64 MB.
+ */
+bool FormatFAT32(const char* path, u32 sizeMB);
+
+/**
+ * Compress data as an LZ4 block, like lz4.block.compress does for
+ * tools/compress_disc.py. The output isn't always the same as the Python
+ * module's, but it decompresses to the same data.
+ * @returns Size of the compressed data, or 0 if it doesn't fit in outSize.
+ */
+u32 CompressLZ4(const u8* in, u32 inSize, u8* out, u32 outSize);
+
+/**
+ * Layout of the disc written by WriteDisc, with a single encrypted game
+ * partition. The partition data has a boot header and an FST, and a pattern
+ * from PatternStart on that reads can be checked against.
+ */
+namespace Disc
+{
+
+constexpr u32 PartitionOffset = 0x50000;
+constexpr u64 TitleID = 0x0001000052485354; // RHST
+constexpr u32 FSTOffset = 0x1000;
+constexpr u32 PatternStart = 0x8000;
+
+enum class Format {
+    // Encrypted partition, read by ISO from 0:/xaa
+    ISO,
+    // Decrypted partition, read by DecryptedISO from 0:/game.wdec
+    Decrypted,
+    // Decrypted partition in LZ4 chunks, read by CompressedISO from
+    // 0:/game.wcmp
+    Compressed,
+};
+
+// Decrypted title key of the partition, stored encrypted in the ticket
+extern const u8 TitleKey[16];
+
+/**
+ * Word of the pattern at a word offset in the partition data. The second half
+ * of each 64 byte line repeats the first, so LZ4 compresses the decrypted
+ * data to a little over half, while a read from the wrong offset still
+ * doesn't match.
+ */
+static inline u32 PatternWord(u32 wordOffset)
+{
+    return (wordOffset & ~8) * 0x9E3779B1 + 0x7F4A7C15;
+}
+
+/**
+ * Check data read from the partition against the pattern. Anything before
+ * PatternStart is not checked.
+ */
+bool Check(const void* data, u32 wordOffset, u32 byteLen);
+
+/**
+ * Write the disc image to a file on a mounted FAT volume, through FatFS.
+ * @param dataSize Size of the partition data, rounded down to whole blocks.
+ * @param fileCount Number of files in the FST, splitting the pattern area.
+ */
+bool Write(const char* path, u32 dataSize, u32 fileCount);
+
+/**
+ * Write the same disc as a pre-decrypted image for DecryptedISO, with the
+ * partition data in the clear and no block headers.
+ */
+bool WriteDecrypted(const char* path, u32 dataSize, u32 fileCount);
+
+/**
+ * Write the same disc as a chunk-compressed image for CompressedISO, laid out
+ * like tools/compress_disc.py makes it.
+ */
+bool WriteCompressed(const char* path, u32 dataSize, u32 fileCount);
+
+} // namespace Disc
+
+} // namespace Host
@@ -0,0 +1,234 @@
+// SDIO.cpp - Mock /dev/sdio/slot0 for the host build
+//
+// SPDX-License-Identifier: MIT
+
+#include "SDIO.hpp"
+#include "Host.hpp"
+#include <IOS/System.hpp>
+#include <System/Util.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define IOCTL_SDIO_READHCREG 0x02
+#define IOCTL_SDIO_RESETCARD 0x04
+#define IOCTL_SDIO_SENDCMD 0x07
+#define IOCTL_SDIO_GETSTATUS 0x0B
+
+#define SDIO_CMD_READBLOCK 0x11
+#define SDIO_CMD_READMULTIBLOCK 0x12
+#define SDIO_CMD_WRITEBLOCK 0x18
+#define SDIO_CMD_WRITEMULTIBLOCK 0x19
+
+#define SDIO_STATUS_CARD_INSERTED 0x1
+#define SDIO_STATUS_CARD_INITIALIZED 0x10000
+#define SDIO_STATUS_CARD_SDHC 0x100000
+
+// Same layout as in SDCard.cpp
+struct _sdiorequest {
+    u32 cmd;
+    u32 cmd_type;
+    u32 rsp_type;
+    u32 arg;
+    u32 blk_cnt;
+    u32 blk_size;
+    void* dma_addr;
+    u32 isdma;
+    u32 pad0;
+};
+
+static constexpr u32 SectorSize = 512;
+static constexpr u16 CardRCA = 1;
+
+Host::SDIO::SDIO(const char* imagePath)
+{
+    m_fd = open(imagePath, O_RDWR);
+    struct stat st;
+    if (m_fd < 0 || fstat(m_fd, &st) != 0) {
+        fprintf(stderr, "host: Failed to open SD card image %s\n", imagePath);
+        Host::Exit(1);
+    }
+    m_sectorCount = st.st_size / SectorSize;
+
+    m_queue = IOS_CreateMessageQueue(m_queueData, 8);
+    s32 ret = IOS_RegisterResourceManager("/dev/sdio/slot0", m_queue);
+    assert(m_queue >= 0 && ret == IOS_SUCCESS);
+
+    ret = IOS_CreateThread(ThreadEntry, this, nullptr, 0, 80, true);
+    assert(ret >= 0);
+    IOS_StartThread(ret);
+}
+
+s32 Host::SDIO::ThreadEntry(void* arg)
+{
+    reinterpret_cast<SDIO*>(arg)->Run();
+    return 0;
+}
+
+void Host::SDIO::Run()
+{
+    while (true) {
+        u32 msg;
+        s32 ret = IOS_ReceiveMessage(m_queue, &msg, 0);
+        assert(ret == IOS_SUCCESS);
+        IOSRequest* req = reinterpret_cast<IOSRequest*>(uintptr_t(msg));
+
+        switch (req->cmd) {
+        case IOS_OPEN:
+        case IOS_CLOSE:
+            IOS_ResourceReply(req, IOS_SUCCESS);
+            break;
+
+        case IOS_IOCTL:
+            IOS_ResourceReply(req,
+              HandleIoctl(req->ioctl.cmd, req->ioctl.in, req->ioctl.in_len,
+                req->ioctl.io, req->ioctl.io_len));
+            break;
+
+        case IOS_IOCTLV:
+            if (req->ioctlv.cmd != IOCTL_SDIO_SENDCMD ||
+                req->ioctlv.in_count != 2 || req->ioctlv.io_count != 1 ||
+                req->ioctlv.vec[0].len != sizeof(_sdiorequest)) {
+                IOS_ResourceReply(req, IOS_EINVAL);
+                break;
+            }
+
+            IOS_ResourceReply(req,
+              SendCommand(req->ioctlv.vec[0].data, req->ioctlv.vec[1].data,
+                req->ioctlv.vec[1].len));
+            break;
+
+        default:
+            IOS_ResourceReply(req, IOS_EINVAL);
+            break;
+        }
+    }
+}
+
+s32 Host::SDIO::HandleIoctl(u32 cmd, void* in, u32 inLen, void* io, u32 ioLen)
+{
+    switch (cmd) {
+    case IOCTL_SDIO_GETSTATUS:
+        if (ioLen != sizeof(u32))
+            return IOS_EINVAL;
+
+        *reinterpret_cast<u32*>(io) = SDIO_STATUS_CARD_INSERTED |
+                                      SDIO_STATUS_CARD_INITIALIZED |
+                                      SDIO_STATUS_CARD_SDHC;
+        return IOS_SUCCESS;
+
+    case IOCTL_SDIO_RESETCARD:
+        if (ioLen != sizeof(u32))
+            return IOS_EINVAL;
+
+        *reinterpret_cast<u32*>(io) = u32(CardRCA) << 16;
+        return IOS_SUCCESS;
+
+    case IOCTL_SDIO_READHCREG:
+        if (ioLen != sizeof(u32))
+            return IOS_EINVAL;
+
+        *reinterpret_cast<u32*>(io) = 0;
+        return IOS_SUCCESS;
+
+    case IOCTL_SDIO_SENDCMD:
+        if (inLen != sizeof(_sdiorequest))
+            return IOS_EINVAL;
+
+        return SendCommand(in, nullptr, 0);
+
+    default:
+        // Host controller and clock setup
+        return IOS_SUCCESS;
+    }
+}
+
+s32 Host::SDIO::SendCommand(const void* request, void* buffer, u32 bufferLen)
+{
+    auto cmd = reinterpret_cast<const _sdiorequest*>(request);
+
+    switch (cmd->cmd) {
+    case SDIO_CMD_READBLOCK:
+    case SDIO_CMD_READMULTIBLOCK:
+    case SDIO_CMD_WRITEBLOCK:
+    case SDIO_CMD_WRITEMULTIBLOCK:
+        break;
+
+    default:
+        return IOS_SUCCESS;
+    }
+
+    if (buffer == nullptr || cmd->dma_addr != buffer ||
+        cmd->blk_size != SectorSize || bufferLen != cmd->blk_cnt * SectorSize)
+        return IOS_EINVAL;
+
+    bool isWrite = cmd->cmd == SDIO_CMD_WRITEBLOCK ||
+                   cmd->cmd == SDIO_CMD_WRITEMULTIBLOCK;
+    return Transfer(isWrite, cmd->arg, cmd->blk_cnt, buffer);
+}
+
+s32 Host::SDIO::Transfer(bool isWrite, u32 sector, u32 count, void* buffer)
+{
+    if (!aligned(buffer, 32)) {
+        m_stats.unalignedCommands++;
+        fprintf(stderr, "host: SD DMA to unaligned buffer %p\n", buffer);
+        return IOS_EINVAL;
+    }
+
+    if (sector > m_sectorCount || count > m_sectorCount - sector)
+        return IOS_EIO;
+
+    if (m_logging && m_logCount < MaxLogCommands) {
+        m_log[m_logCount++] = {
+          .isWrite = isWrite,
+          .sector = sector,
+          .count = count,
+          .buffer = uintptr_t(buffer),
+        };
+    }
+
+    off_t offset = off_t(sector) * SectorSize;
+    size_t len = size_t(count) * SectorSize;
+    ssize_t ret = isWrite ? pwrite(m_fd, buffer, len, offset)
+                          : pread(m_fd, buffer, len, offset);
+    if (ret != ssize_t(len))
+        return IOS_EIO;
+
+    if (isWrite) {
+        m_stats.writeCommands++;
+        m_stats.writeSectors += count;
+    } else {
+        m_stats.readCommands++;
+        m_stats.readSectors += count;
+    }
+
+    return IOS_SUCCESS;
+}
+
+void Host::SDIO::StartLog()
+{
+    CPULock lock;
+    m_logging = true;
+    m_logCount = 0;
+}
+
+u32 Host::SDIO::StopLog()
+{
+    CPULock lock;
+    m_logging = false;
+    return m_logCount;
+}
+
+Host::SDIO::Stats Host::SDIO::GetStats() const
+{
+    CPULock lock;
+    return m_stats;
+}
+
+void Host::SDIO::ResetStats()
+{
+    CPULock lock;
+    m_stats = {};
+}
@@ -0,0 +1,78 @@
+// SDIO.hpp - Mock /dev/sdio/slot0 for the host build
+//
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <System/Types.h>
+
+namespace Host
+{
+
+/**
+ * Mock of the SD slot resource manager, with an initialized SDHC card backed
+ * by an image file. Like the real one, it only does DMA to 32 byte aligned
+ * buffers, and fails other transfers.
+ */
+class SDIO
+{
+public:
+    explicit SDIO(const char* imagePath);
+
+    struct Command {
+        bool isWrite;
+        u32 sector;
+        u32 count;
+        uintptr_t buffer;
+    };
+
+    static constexpr u32 MaxLogCommands = 1024;
+
+    /**
+     * Start recording read and write commands, up to MaxLogCommands.
+     */
+    void StartLog();
+
+    /**
+     * Stop recording commands.
+     * @returns Number of commands recorded.
+     */
+    u32 StopLog();
+
+    const Command& GetLogCommand(u32 index) const
+    {
+        return m_log[index];
+    }
+
+    struct Stats {
+        u32 readCommands;
+        u64 readSectors;
+        u32 writeCommands;
+        u64 writeSectors;
+        // Transfers refused for an unaligned buffer
+        u32 unalignedCommands;
+    };
+
+    Stats GetStats() const;
+    void ResetStats();
+
+private:
+    static s32 ThreadEntry(void* arg);
+    void Run();
+    s32 HandleIoctl(u32 cmd, void* in, u32 inLen, void* io, u32 ioLen);
+    s32 SendCommand(const void* request, void* buffer, u32 bufferLen);
+    s32 Transfer(bool isWrite, u32 sector, u32 count, void* buffer);
+
+    int m_fd;
+    u32 m_sectorCount;
+    s32 m_queue;
+    u32 m_queueData[8];
+
+    bool m_logging = false;
+    u32 m_logCount = 0;
+    Command m_log[MaxLogCommands];
+
+    Stats m_stats = {};
+};
+
+} // namespace Host
@@ -0,0 +1,202 @@
+// SHAEngine.cpp - Mock /dev/sha for the host build
+//
+// SPDX-License-Identifier: MIT
+
+#include "SHAEngine.hpp"
+#include "Host.hpp"
+#include <IOS/System.hpp>
+#include <System/Util.h>
+#include <cstdio>
+#include <cstring>
+
+enum class SHAIoctl {
+    Init = 0,
+    Update = 1,
+    Final = 2,
+};
+
+// Layout used by IOS, the bit count is the high word first
+struct EngineContext {
+    u32 state[5];
+    u32 bits[2];
+};
+
+static u32 RotateLeft(u32 value, u32 shift)
+{
+    return (value << shift) | (value >> (32 - shift));
+}
+
+/**
+ * Plain SHA-1 block function, separate from the one in SHA.cpp so the two
+ * can be checked against each other.
+ */
+static void HashBlock(u32* state, const u8* block)
+{
+    u32 w[80];
+    for (u32 i = 0; i < 16; i++) {
+        w[i] = u32(block[i * 4]) << 24 | u32(block[i * 4 + 1]) << 16 |
+               u32(block[i * 4 + 2]) << 8 | block[i * 4 + 3];
+    }
+    for (u32 i = 16; i < 80; i++)
+        w[i] = RotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    static const u32 k[4] = {0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xCA62C1D6};
+    u32 v[5];
+    memcpy(v, state, sizeof(v));
+
+    for (u32 i = 0; i < 80; i++) {
+        u32 b = v[1], c = v[2], d = v[3];
+        u32 f = i < 20   ? (b & c) | (~b & d)
+                : i < 40 ? b ^ c ^ d
+                : i < 60 ? (b & c) | (b & d) | (c & d)
+                         : b ^ c ^ d;
+
+        u32 temp = RotateLeft(v[0], 5) + f + v[4] + k[i / 20] + w[i];
+        v[4] = d;
+        v[3] = c;
+        v[2] = RotateLeft(b, 30);
+        v[1] = v[0];
+        v[0] = temp;
+    }
+
+    for (u32 i = 0; i < 5; i++)
+        state[i] += v[i];
+}
+
+static void AddBits(EngineContext* ctx, u32 len)
+{
+    u64 bits = (u64(ctx->bits[0]) << 32 | ctx->bits[1]) + u64(len) * 8;
+    ctx->bits[0] = bits >> 32;
+    ctx->bits[1] = u32(bits);
+}
+
+Host::SHAEngine::SHAEngine()
+{
+    m_queue = IOS_CreateMessageQueue(m_queueData, 8);
+    s32 ret = IOS_RegisterResourceManager("/dev/sha", m_queue);
+    assert(m_queue >= 0 && ret == IOS_SUCCESS);
+
+    ret = IOS_CreateThread(ThreadEntry, this, nullptr, 0, 80, true);
+    assert(ret >= 0);
+    IOS_StartThread(ret);
+}
+
+s32 Host::SHAEngine::ThreadEntry(void* arg)
+{
+    reinterpret_cast<SHAEngine*>(arg)->Run();
+    return 0;
+}
+
+void Host::SHAEngine::Run()
+{
+    while (true) {
+        u32 msg;
+        s32 ret = IOS_ReceiveMessage(m_queue, &msg, 0);
+        assert(ret == IOS_SUCCESS);
+        IOSRequest* req = reinterpret_cast<IOSRequest*>(uintptr_t(msg));
+
+        switch (req->cmd) {
+        case IOS_OPEN:
+        case IOS_CLOSE:
+            IOS_ResourceReply(req, IOS_SUCCESS);
+            break;
+
+        case IOS_IOCTLV:
+            IOS_ResourceReply(req,
+              HandleIoctlv(req->ioctlv.cmd, req->ioctlv.in_count,
+                req->ioctlv.io_count, req->ioctlv.vec));
+            break;
+
+        default:
+            IOS_ResourceReply(req, IOS_EINVAL);
+            break;
+        }
+    }
+}
+
+s32 Host::SHAEngine::HandleIoctlv(
+  u32 cmd, u32 inCount, u32 ioCount, IOVector* vec)
+{
+    if (inCount != 1 || ioCount != 2 ||
+        vec[1].len < sizeof(EngineContext))
+        return IOS_EINVAL;
+
+    auto ctx = reinterpret_cast<EngineContext*>(vec[1].data);
+    auto data = reinterpret_cast<const u8*>(vec[0].data);
+    u32 len = vec[0].len;
+
+    if (len != 0 && !aligned(data, 64)) {
+        m_stats.unalignedCommands++;
+        fprintf(stderr, "host: SHA engine given unaligned data %p\n", data);
+        return IOS_EINVAL;
+    }
+
+    switch (static_cast<SHAIoctl>(cmd)) {
+    case SHAIoctl::Init:
+        *ctx = {
+          .state = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476,
+            0xC3D2E1F0},
+          .bits = {0, 0},
+        };
+        return IOS_SUCCESS;
+
+    case SHAIoctl::Update:
+        if (len % 64 != 0) {
+            m_stats.unalignedCommands++;
+            fprintf(stderr, "host: SHA engine update of 0x%X bytes\n", len);
+            return IOS_EINVAL;
+        }
+
+        for (u32 i = 0; i < len; i += 64)
+            HashBlock(ctx->state, data + i);
+        AddBits(ctx, len);
+        m_stats.updates++;
+        m_stats.bytesHashed += len;
+        return IOS_SUCCESS;
+
+    case SHAIoctl::Final: {
+        if (vec[2].len < 0x14)
+            return IOS_EINVAL;
+
+        u32 blocks = len / 64;
+        for (u32 i = 0; i < blocks; i++)
+            HashBlock(ctx->state, data + i * 64);
+        AddBits(ctx, len);
+
+        // Pad with a 1 bit, zeroes, then the message length in bits
+        u8 last[128] = {};
+        u32 rest = len % 64;
+        memcpy(last, data + blocks * 64, rest);
+        last[rest] = 0x80;
+        u32 lastLen = rest < 56 ? 64 : 128;
+        for (u32 i = 0; i < 4; i++) {
+            last[lastLen - 8 + i] = ctx->bits[0] >> (24 - i * 8);
+            last[lastLen - 4 + i] = ctx->bits[1] >> (24 - i * 8);
+        }
+        for (u32 i = 0; i < lastLen; i += 64)
+            HashBlock(ctx->state, last + i);
+
+        u8* hash = reinterpret_cast<u8*>(vec[2].data);
+        for (u32 i = 0; i < 0x14; i++)
+            hash[i] = ctx->state[i / 4] >> (24 - (i % 4) * 8);
+
+        m_stats.bytesHashed += len;
+        return IOS_SUCCESS;
+    }
+
+    default:
+        return IOS_EINVAL;
+    }
+}
+
+Host::SHAEngine::Stats Host::SHAEngine::GetStats() const
+{
+    CPULock lock;
+    return m_stats;
+}
+
+void Host::SHAEngine::ResetStats()
+{
+    CPULock lock;
+    m_stats = {};
+}
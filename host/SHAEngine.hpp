@@ -0,0 +1,44 @@
+// SHAEngine.hpp - Mock /dev/sha for the host build
+//
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <IOS/Syscalls.h>
+#include <System/Types.h>
+
+namespace Host
+{
+
+/**
+ * Mock of the SHA-1 engine resource manager. Like the hardware, it only
+ * hashes whole 64 byte blocks from 64 byte aligned buffers, and fails other
+ * updates.
+ */
+class SHAEngine
+{
+public:
+    SHAEngine();
+
+    struct Stats {
+        u32 updates;
+        u64 bytesHashed;
+        // Updates refused for an unaligned buffer or length
+        u32 unalignedCommands;
+    };
+
+    Stats GetStats() const;
+    void ResetStats();
+
+private:
+    static s32 ThreadEntry(void* arg);
+    void Run();
+    s32 HandleIoctlv(u32 cmd, u32 inCount, u32 ioCount, IOVector* vec);
+
+    s32 m_queue;
+    u32 m_queueData[8];
+
+    Stats m_stats = {};
+};
+
+} // namespace Host
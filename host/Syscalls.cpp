@@ -0,0 +1,1287 @@
+// Syscalls.cpp - IOS system calls for the host build
+//
+// SPDX-License-Identifier: MIT
+
+#include "Host.hpp"
+#include <System/Util.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <time.h>
+
+// All state below is protected by the CPU lock. IOS threads hold it while
+// they run and give it up when they block, which gives the one thread at a
+// time scheduling of IOS.
+static pthread_mutex_t s_cpuLock = PTHREAD_MUTEX_INITIALIZER;
+static thread_local bool t_isIOSThread = false;
+static thread_local s32 t_threadId = 0;
+
+Host::CPULock::CPULock()
+  : m_locked(!t_isIOSThread)
+{
+    if (m_locked)
+        pthread_mutex_lock(&s_cpuLock);
+}
+
+Host::CPULock::~CPULock()
+{
+    if (m_locked)
+        pthread_mutex_unlock(&s_cpuLock);
+}
+
+static void Fatal(const char* message)
+{
+    fprintf(stderr, "host: %s\n", message);
+    abort();
+}
+
+static void InitCond(pthread_cond_t* cond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static u64 MonotonicMicros()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return u64(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * Heaps
+ */
+
+// Allocations are aligned to 32 bytes like on IOS, and each one has a header
+// of the same size in front of it
+static constexpr uintptr_t HeapAlign = 32;
+static constexpr u32 MaxHeaps = 16;
+
+struct HeapBlock {
+    HeapBlock* next;
+    HeapBlock* prev;
+    // Including the header
+    uintptr_t size;
+    bool free;
+};
+
+static_assert(sizeof(HeapBlock) <= HeapAlign);
+
+struct Heap {
+    bool inUse;
+    uintptr_t base;
+    uintptr_t size;
+    HeapBlock* first;
+};
+
+static Heap s_heaps[MaxHeaps];
+
+static s32 CreateHeapLocked(void* ptr, u32 length)
+{
+    if (!aligned(ptr, HeapAlign) || length < 2 * HeapAlign)
+        return IOS_EINVAL;
+
+    for (s32 i = 0; i < s32(MaxHeaps); i++) {
+        Heap* heap = &s_heaps[i];
+        if (heap->inUse)
+            continue;
+
+        heap->inUse = true;
+        heap->base = uintptr_t(ptr);
+        heap->size = round_down(length, HeapAlign);
+        heap->first = reinterpret_cast<HeapBlock*>(ptr);
+        *heap->first = {
+          .next = nullptr,
+          .prev = nullptr,
+          .size = heap->size,
+          .free = true,
+        };
+        return i;
+    }
+
+    return IOS_EMAX;
+}
+
+static Heap* GetHeap(s32 heapId)
+{
+    if (heapId < 0 || heapId >= s32(MaxHeaps) || !s_heaps[heapId].inUse)
+        return nullptr;
+
+    return &s_heaps[heapId];
+}
+
+static void InsertBlockAfter(HeapBlock* block, HeapBlock* newBlock)
+{
+    newBlock->prev = block;
+    newBlock->next = block->next;
+    if (block->next != nullptr)
+        block->next->prev = newBlock;
+    block->next = newBlock;
+}
+
+static void MergeWithNext(HeapBlock* block)
+{
+    HeapBlock* next = block->next;
+    block->size += next->size;
+    block->next = next->next;
+    if (next->next != nullptr)
+        next->next->prev = block;
+}
+
+static void* HeapAlloc(Heap* heap, u32 length, u32 align)
+{
+    if (align == 0 || (align & (align - 1)) != 0)
+        return nullptr;
+
+    uintptr_t need = round_up(std::max<uintptr_t>(length, 1), HeapAlign);
+    align = std::max<u32>(align, HeapAlign);
+
+    for (HeapBlock* block = heap->first; block != nullptr;
+         block = block->next) {
+        if (!block->free)
+            continue;
+
+        // Space skipped for alignment becomes a free block of its own, so it
+        // needs room for a header
+        uintptr_t start = uintptr_t(block) + HeapAlign;
+        uintptr_t data = round_up(start, uintptr_t(align));
+        while (data != start && data - start < HeapAlign)
+            data += align;
+
+        uintptr_t end = data + need;
+        if (end > uintptr_t(block) + block->size)
+            continue;
+
+        if (data != start) {
+            HeapBlock* aligned = reinterpret_cast<HeapBlock*>(data - HeapAlign);
+            aligned->size = uintptr_t(block) + block->size - uintptr_t(aligned);
+            aligned->free = true;
+            block->size = uintptr_t(aligned) - uintptr_t(block);
+            InsertBlockAfter(block, aligned);
+            block = aligned;
+        }
+
+        uintptr_t used = end - uintptr_t(block);
+        if (block->size - used >= 2 * HeapAlign) {
+            HeapBlock* rest = reinterpret_cast<HeapBlock*>(end);
+            rest->size = block->size - used;
+            rest->free = true;
+            block->size = used;
+            InsertBlockAfter(block, rest);
+        }
+
+        block->free = false;
+        return reinterpret_cast<void*>(data);
+    }
+
+    return nullptr;
+}
+
+static s32 HeapFree(Heap* heap, void* ptr)
+{
+    uintptr_t data = uintptr_t(ptr);
+    if (data < heap->base + HeapAlign || data >= heap->base + heap->size ||
+        !aligned(data, HeapAlign))
+        return IOS_EINVAL;
+
+    HeapBlock* block = reinterpret_cast<HeapBlock*>(data - HeapAlign);
+    if (block->free)
+        return IOS_EINVAL;
+
+    block->free = true;
+    if (block->next != nullptr && block->next->free)
+        MergeWithNext(block);
+    if (block->prev != nullptr && block->prev->free)
+        MergeWithNext(block->prev);
+
+    return IOS_SUCCESS;
+}
+
+static void* AllocLocked(s32 heapId, u32 length, u32 align)
+{
+    Heap* heap = GetHeap(heapId);
+    if (heap == nullptr)
+        return nullptr;
+
+    return HeapAlloc(heap, length, align);
+}
+
+s32 IOS_CreateHeap(void* ptr, s32 length)
+{
+    Host::CPULock lock;
+    if (length < 0)
+        return IOS_EINVAL;
+
+    return CreateHeapLocked(ptr, length);
+}
+
+s32 IOS_DestroyHeap(s32 heap)
+{
+    Host::CPULock lock;
+    if (GetHeap(heap) == nullptr)
+        return IOS_EINVAL;
+
+    s_heaps[heap].inUse = false;
+    return IOS_SUCCESS;
+}
+
+void* IOS_Alloc(s32 heap, u32 length)
+{
+    Host::CPULock lock;
+    return AllocLocked(heap, length, HeapAlign);
+}
+
+void* IOS_AllocAligned(s32 heap, u32 length, u32 align)
+{
+    Host::CPULock lock;
+    return AllocLocked(heap, length, align);
+}
+
+s32 IOS_Free(s32 heapId, void* ptr)
+{
+    Host::CPULock lock;
+    Heap* heap = GetHeap(heapId);
+    if (heap == nullptr)
+        return IOS_EINVAL;
+
+    return HeapFree(heap, ptr);
+}
+
+/*
+ * Message queues
+ */
+
+static constexpr u32 MaxQueues = 256;
+
+struct MessageQueue {
+    bool inUse;
+    u32* messages;
+    u32 count;
+    u32 head;
+    u32 used;
+    pthread_cond_t notEmpty;
+    pthread_cond_t notFull;
+};
+
+static MessageQueue s_queues[MaxQueues];
+
+static MessageQueue* GetQueue(s32 queueId)
+{
+    if (queueId < 0 || queueId >= s32(MaxQueues) || !s_queues[queueId].inUse)
+        return nullptr;
+
+    return &s_queues[queueId];
+}
+
+/**
+ * Wait on a condition with the CPU lock. Must be called with the lock held,
+ * which all system calls do.
+ */
+static void Wait(pthread_cond_t* cond)
+{
+    pthread_cond_wait(cond, &s_cpuLock);
+}
+
+static s32 SendLocked(s32 queueId, u32 message, u32 flags, bool jam)
+{
+    MessageQueue* queue = GetQueue(queueId);
+    if (queue == nullptr)
+        return IOS_EINVAL;
+
+    while (queue->used == queue->count) {
+        if (flags != 0)
+            return IOS_EQUEUEFULL;
+
+        Wait(&queue->notFull);
+        if (!queue->inUse)
+            return IOS_EINVAL;
+    }
+
+    if (jam) {
+        queue->head = (queue->head + queue->count - 1) % queue->count;
+        queue->messages[queue->head] = message;
+    } else {
+        queue->messages[(queue->head + queue->used) % queue->count] = message;
+    }
+    queue->used++;
+
+    pthread_cond_signal(&queue->notEmpty);
+    return IOS_SUCCESS;
+}
+
+static s32 ReceiveLocked(s32 queueId, u32* message, u32 flags)
+{
+    MessageQueue* queue = GetQueue(queueId);
+    if (queue == nullptr)
+        return IOS_EINVAL;
+
+    while (queue->used == 0) {
+        if (flags != 0)
+            return IOS_EQUEUEFULL;
+
+        Wait(&queue->notEmpty);
+        if (!queue->inUse)
+            return IOS_EINVAL;
+    }
+
+    u32 value = queue->messages[queue->head];
+    queue->head = (queue->head + 1) % queue->count;
+    queue->used--;
+
+    if (message != nullptr)
+        *message = value;
+
+    pthread_cond_signal(&queue->notFull);
+    return IOS_SUCCESS;
+}
+
+s32 IOS_CreateMessageQueue(u32* buf, u32 msg_count)
+{
+    Host::CPULock lock;
+    if (buf == nullptr || msg_count == 0)
+        return IOS_EINVAL;
+
+    for (s32 i = 0; i < s32(MaxQueues); i++) {
+        MessageQueue* queue = &s_queues[i];
+        if (queue->inUse)
+            continue;
+
+        queue->inUse = true;
+        queue->messages = buf;
+        queue->count = msg_count;
+        queue->head = 0;
+        queue->used = 0;
+        return i;
+    }
+
+    return IOS_EMAX;
+}
+
+s32 IOS_DestroyMessageQueue(s32 queue_id)
+{
+    Host::CPULock lock;
+    MessageQueue* queue = GetQueue(queue_id);
+    if (queue == nullptr)
+        return IOS_EINVAL;
+
+    queue->inUse = false;
+    pthread_cond_broadcast(&queue->notEmpty);
+    pthread_cond_broadcast(&queue->notFull);
+    return IOS_SUCCESS;
+}
+
+s32 IOS_SendMessage(s32 queue_id, u32 message, u32 flags)
+{
+    Host::CPULock lock;
+    return SendLocked(queue_id, message, flags, false);
+}
+
+s32 IOS_JamMessage(s32 queue_id, u32 message, u32 flags)
+{
+    Host::CPULock lock;
+    return SendLocked(queue_id, message, flags, true);
+}
+
+s32 IOS_ReceiveMessage(s32 queue_id, u32* message, u32 flags)
+{
+    Host::CPULock lock;
+    return ReceiveLocked(queue_id, message, flags);
+}
+
+/*
+ * Threads
+ */
+
+static constexpr u32 MaxThreads = 48;
+// The stacks given to IOS_CreateThread are sized for the Starlet and not
+// for host code and libc, so every thread gets its own
+static constexpr u32 HostStackSize = 0x80000;
+
+struct Thread {
+    bool inUse;
+    bool ios;
+    bool started;
+    bool finished;
+    IOSThreadProc proc;
+    void* arg;
+    void* stack;
+    u32 priority;
+    s32 result;
+    pthread_t pthread;
+    pthread_cond_t cond;
+};
+
+static Thread s_threads[MaxThreads];
+
+// Thread IDs start at 1, IOS uses 0 for the current thread
+static Thread* GetThread(s32 threadId)
+{
+    if (threadId == 0)
+        threadId = t_threadId;
+
+    if (threadId <= 0 || threadId > s32(MaxThreads) ||
+        !s_threads[threadId - 1].inUse)
+        return nullptr;
+
+    return &s_threads[threadId - 1];
+}
+
+static void* ThreadStart(void* arg)
+{
+    Thread* thread = reinterpret_cast<Thread*>(arg);
+
+    pthread_mutex_lock(&s_cpuLock);
+    t_threadId = s32(thread - s_threads) + 1;
+    t_isIOSThread = thread->ios;
+
+    while (!thread->started)
+        Wait(&thread->cond);
+
+    if (!thread->ios)
+        pthread_mutex_unlock(&s_cpuLock);
+
+    s32 result = thread->proc(thread->arg);
+
+    if (!thread->ios)
+        pthread_mutex_lock(&s_cpuLock);
+
+    thread->result = result;
+    thread->finished = true;
+    pthread_cond_broadcast(&thread->cond);
+    pthread_mutex_unlock(&s_cpuLock);
+    return nullptr;
+}
+
+static s32 CreateThreadLocked(
+  IOSThreadProc proc, void* arg, s32 priority, bool ios)
+{
+    if (proc == nullptr)
+        return IOS_EINVAL;
+
+    s32 index = 0;
+    while (index < s32(MaxThreads) && s_threads[index].inUse)
+        index++;
+    if (index == s32(MaxThreads))
+        return IOS_EMAX;
+
+    void* stack = AllocLocked(Host::IPCHeap, HostStackSize, 0x1000);
+    if (stack == nullptr)
+        return IOS_ENOMEM;
+
+    Thread* thread = &s_threads[index];
+    thread->inUse = true;
+    thread->ios = ios;
+    thread->started = false;
+    thread->finished = false;
+    thread->proc = proc;
+    thread->arg = arg;
+    thread->stack = stack;
+    thread->priority = priority;
+    thread->result = 0;
+    InitCond(&thread->cond);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, stack, HostStackSize);
+    s32 ret = pthread_create(&thread->pthread, &attr, ThreadStart, thread);
+    pthread_attr_destroy(&attr);
+    if (ret != 0) {
+        HeapFree(GetHeap(Host::IPCHeap), stack);
+        thread->inUse = false;
+        return IOS_ENOMEM;
+    }
+
+    return index + 1;
+}
+
+s32 IOS_CreateThread(IOSThreadProc proc, void* arg, u32* stack_top,
+  u32 stacksize, s32 priority, bool detached)
+{
+    Host::CPULock lock;
+    return CreateThreadLocked(proc, arg, priority, true);
+}
+
+s32 Host::CreatePPCThread(IOSThreadProc proc, void* arg)
+{
+    Host::CPULock lock;
+    s32 ret = CreateThreadLocked(proc, arg, 0, false);
+    if (ret < 0)
+        return ret;
+
+    s_threads[ret - 1].started = true;
+    pthread_cond_broadcast(&s_threads[ret - 1].cond);
+    return ret;
+}
+
+s32 IOS_StartThread(s32 threadid)
+{
+    Host::CPULock lock;
+    Thread* thread = GetThread(threadid);
+    if (thread == nullptr || thread->started)
+        return IOS_EINVAL;
+
+    thread->started = true;
+    pthread_cond_broadcast(&thread->cond);
+    return IOS_SUCCESS;
+}
+
+s32 IOS_JoinThread(s32 threadid, void** value)
+{
+    Host::CPULock lock;
+    Thread* thread = GetThread(threadid);
+    if (thread == nullptr || threadid == t_threadId || threadid == 0)
+        return IOS_EINVAL;
+
+    while (!thread->finished)
+        Wait(&thread->cond);
+
+    if (value != nullptr)
+        *value = reinterpret_cast<void*>(intptr_t(thread->result));
+
+    // The stack is still in use until the thread has really exited
+    pthread_join(thread->pthread, nullptr);
+    HeapFree(GetHeap(Host::IPCHeap), thread->stack);
+    pthread_cond_destroy(&thread->cond);
+    thread->inUse = false;
+    return IOS_SUCCESS;
+}
+
+s32 Host::RunOnIOS(IOSThreadProc proc, void* arg)
+{
+    s32 threadId = IOS_CreateThread(proc, arg, nullptr, 0, 80, false);
+    if (threadId < 0)
+        return threadId;
+
+    void* result;
+    IOS_StartThread(threadId);
+    s32 ret = IOS_JoinThread(threadId, &result);
+    return ret == IOS_SUCCESS ? s32(intptr_t(result)) : ret;
+}
+
+s32 IOS_CancelThread(s32 threadid, void* value)
+{
+    // Only threads ending themselves are supported
+    Thread* self = GetThread(0);
+    if (self == nullptr || (threadid != 0 && threadid != t_threadId))
+        return IOS_EACCES;
+
+    if (!t_isIOSThread)
+        pthread_mutex_lock(&s_cpuLock);
+
+    self->result = s32(intptr_t(value));
+    self->finished = true;
+    pthread_cond_broadcast(&self->cond);
+    pthread_mutex_unlock(&s_cpuLock);
+    pthread_exit(nullptr);
+}
+
+s32 IOS_GetThreadId(void)
+{
+    return t_threadId;
+}
+
+s32 IOS_GetProcessId(void)
+{
+    return 0;
+}
+
+s32 IOS_SuspendThread(s32 threadid)
+{
+    return IOS_EACCES;
+}
+
+void IOS_YieldThread(void)
+{
+    if (!t_isIOSThread)
+        return;
+
+    pthread_mutex_unlock(&s_cpuLock);
+    sched_yield();
+    pthread_mutex_lock(&s_cpuLock);
+}
+
+u32 IOS_GetThreadPriority(s32 threadid)
+{
+    Host::CPULock lock;
+    Thread* thread = GetThread(threadid);
+    return thread != nullptr ? thread->priority : 0;
+}
+
+s32 IOS_SetThreadPriority(s32 threadid, u32 priority)
+{
+    Host::CPULock lock;
+    Thread* thread = GetThread(threadid);
+    if (thread == nullptr)
+        return IOS_EINVAL;
+
+    thread->priority = priority;
+    return IOS_SUCCESS;
+}
+
+/*
+ * Timers
+ */
+
+static constexpr u32 MaxTimers = 64;
+
+struct Timer {
+    bool inUse;
+    bool active;
+    u64 deadline;
+    u32 repeat;
+    s32 queue;
+    u32 message;
+};
+
+static Timer s_timers[MaxTimers];
+static pthread_cond_t s_timerCond;
+
+static void* TimerThread(void* arg)
+{
+    pthread_mutex_lock(&s_cpuLock);
+
+    while (true) {
+        u64 now = MonotonicMicros();
+        u64 next = ~0ull;
+
+        for (Timer& timer : s_timers) {
+            if (!timer.inUse || !timer.active)
+                continue;
+
+            if (timer.deadline <= now) {
+                // Like IOS, a timer message is dropped if the queue is full
+                SendLocked(timer.queue, timer.message, 1, false);
+
+                if (timer.repeat != 0) {
+                    timer.deadline =
+                      std::max(now, timer.deadline + timer.repeat);
+                } else {
+                    timer.active = false;
+                    continue;
+                }
+            }
+
+            next = std::min(next, timer.deadline);
+        }
+
+        if (next == ~0ull) {
+            Wait(&s_timerCond);
+            continue;
+        }
+
+        timespec ts = {
+          .tv_sec = time_t(next / 1000000),
+          .tv_nsec = long(next % 1000000) * 1000,
+        };
+        pthread_cond_timedwait(&s_timerCond, &s_cpuLock, &ts);
+    }
+
+    return nullptr;
+}
+
+static void StartTimer(Timer* timer, s32 usec, s32 repeat_usec)
+{
+    timer->active = true;
+    timer->deadline = MonotonicMicros() + std::max(usec, 0);
+    timer->repeat = std::max(repeat_usec, 0);
+    pthread_cond_signal(&s_timerCond);
+}
+
+static Timer* GetTimer(s32 timerId)
+{
+    if (timerId < 0 || timerId >= s32(MaxTimers) || !s_timers[timerId].inUse)
+        return nullptr;
+
+    return &s_timers[timerId];
+}
+
+s32 IOS_CreateTimer(s32 usec, s32 repeat_usec, s32 queue, u32 msg)
+{
+    Host::CPULock lock;
+    if (GetQueue(queue) == nullptr)
+        return IOS_EINVAL;
+
+    for (s32 i = 0; i < s32(MaxTimers); i++) {
+        Timer* timer = &s_timers[i];
+        if (timer->inUse)
+            continue;
+
+        timer->inUse = true;
+        timer->queue = queue;
+        timer->message = msg;
+        StartTimer(timer, usec, repeat_usec);
+        return i;
+    }
+
+    return IOS_EMAX;
+}
+
+s32 IOS_RestartTimer(s32 timerId, s32 usec, s32 repeat_usec)
+{
+    Host::CPULock lock;
+    Timer* timer = GetTimer(timerId);
+    if (timer == nullptr)
+        return IOS_EINVAL;
+
+    StartTimer(timer, usec, repeat_usec);
+    return IOS_SUCCESS;
+}
+
+s32 IOS_StopTimer(s32 timerId)
+{
+    Host::CPULock lock;
+    Timer* timer = GetTimer(timerId);
+    if (timer == nullptr)
+        return IOS_EINVAL;
+
+    timer->active = false;
+    return IOS_SUCCESS;
+}
+
+s32 IOS_DestroyTimer(s32 timerId)
+{
+    Host::CPULock lock;
+    Timer* timer = GetTimer(timerId);
+    if (timer == nullptr)
+        return IOS_EINVAL;
+
+    timer->inUse = false;
+    timer->active = false;
+    return IOS_SUCCESS;
+}
+
+u32 IOS_GetTime()
+{
+    return u32(MonotonicMicros());
+}
+
+/*
+ * IPC
+ */
+
+static constexpr u32 MaxResources = 32;
+static constexpr u32 MaxFds = 128;
+
+struct ResourceManager {
+    char path[64];
+    s32 queue;
+};
+
+struct FileDescriptor {
+    bool inUse;
+    // Set while the close request is with the resource manager
+    bool closing;
+    u32 resource;
+};
+
+/**
+ * Request as seen by the kernel. The resource manager gets a pointer to the
+ * IOSRequest at the start of it, so it's allocated from the IPC heap to fit
+ * in a message.
+ */
+struct KernelRequest {
+    IOSRequest request;
+    // The resource manager may change request.cmd
+    u32 cmd;
+    s32 kernelFd;
+    // Async requests reply to a queue, sync ones wake up the caller
+    s32 replyQueue;
+    IOSRequest* clientMsg;
+    bool done;
+    s32 result;
+    pthread_cond_t cond;
+    char path[64];
+};
+
+static ResourceManager s_resources[MaxResources];
+static u32 s_resourceCount = 0;
+static FileDescriptor s_fds[MaxFds];
+
+s32 IOS_RegisterResourceManager(const char* device, s32 queue_id)
+{
+    Host::CPULock lock;
+    if (GetQueue(queue_id) == nullptr ||
+        strlen(device) >= sizeof(ResourceManager::path))
+        return IOS_EINVAL;
+
+    for (u32 i = 0; i < s_resourceCount; i++) {
+        if (strcmp(s_resources[i].path, device) == 0)
+            return IOS_EEXIST;
+    }
+
+    if (s_resourceCount == MaxResources)
+        return IOS_EMAX;
+
+    ResourceManager* rm = &s_resources[s_resourceCount++];
+    strcpy(rm->path, device);
+    rm->queue = queue_id;
+    return IOS_SUCCESS;
+}
+
+/**
+ * Find the resource manager for a path, the one with the longest name
+ * that is a prefix of it.
+ */
+static s32 FindResource(const char* path)
+{
+    s32 found = IOS_ENOENT;
+    size_t foundLen = 0;
+
+    for (u32 i = 0; i < s_resourceCount; i++) {
+        size_t len = strlen(s_resources[i].path);
+        if (len > foundLen && strncmp(path, s_resources[i].path, len) == 0) {
+            found = i;
+            foundLen = len;
+        }
+    }
+
+    return found;
+}
+
+static FileDescriptor* GetFd(s32 fd)
+{
+    if (fd < 0 || fd >= s32(MaxFds) || !s_fds[fd].inUse)
+        return nullptr;
+
+    return &s_fds[fd];
+}
+
+static KernelRequest* NewRequest(u32 cmd, s32 queue, IOSRequest* msg)
+{
+    auto req = reinterpret_cast<KernelRequest*>(
+      AllocLocked(Host::IPCHeap, sizeof(KernelRequest), HeapAlign));
+    if (req == nullptr)
+        return nullptr;
+
+    memset(&req->request, 0, sizeof(req->request));
+    req->request.cmd = cmd;
+    req->cmd = cmd;
+    req->kernelFd = -1;
+    req->replyQueue = queue;
+    req->clientMsg = msg;
+    req->done = false;
+    req->result = 0;
+    InitCond(&req->cond);
+    return req;
+}
+
+static void FreeRequest(KernelRequest* req)
+{
+    pthread_cond_destroy(&req->cond);
+    HeapFree(GetHeap(Host::IPCHeap), req);
+}
+
+/**
+ * Finish a request without it reaching a resource manager.
+ */
+static s32 FailRequest(KernelRequest* req, s32 result)
+{
+    if (req->replyQueue < 0) {
+        FreeRequest(req);
+        return result;
+    }
+
+    req->clientMsg->cmd = IOS_IPC_REPLY;
+    req->clientMsg->result = result;
+    SendLocked(req->replyQueue,
+      u32(reinterpret_cast<uintptr_t>(req->clientMsg)), 0, false);
+    FreeRequest(req);
+    return IOS_SUCCESS;
+}
+
+/**
+ * Pass a request to its resource manager, and wait for the reply if it's
+ * synchronous.
+ */
+static s32 SubmitRequest(KernelRequest* req, u32 resource)
+{
+    if (req->replyQueue >= 0 && GetQueue(req->replyQueue) == nullptr) {
+        FreeRequest(req);
+        return IOS_EINVAL;
+    }
+
+    s32 ret = SendLocked(s_resources[resource].queue,
+      u32(reinterpret_cast<uintptr_t>(&req->request)), 0, false);
+    if (ret != IOS_SUCCESS)
+        return FailRequest(req, ret);
+
+    if (req->replyQueue >= 0)
+        return IOS_SUCCESS;
+
+    while (!req->done)
+        Wait(&req->cond);
+
+    s32 result = req->result;
+    FreeRequest(req);
+    return result;
+}
+
+static s32 OpenLocked(const char* path, u32 mode, s32 queue, IOSRequest* msg)
+{
+    KernelRequest* req = NewRequest(IOS_OPEN, queue, msg);
+    if (req == nullptr)
+        return IOS_ENOMEM;
+
+    s32 resource = FindResource(path);
+    if (resource < 0 || strlen(path) >= sizeof(req->path))
+        return FailRequest(req, IOS_ENOENT);
+
+    s32 fd = 0;
+    while (fd < s32(MaxFds) && s_fds[fd].inUse)
+        fd++;
+    if (fd == s32(MaxFds))
+        return FailRequest(req, IOS_EMAX);
+
+    s_fds[fd] = {
+      .inUse = true,
+      .closing = false,
+      .resource = u32(resource),
+    };
+
+    strcpy(req->path, path);
+    req->kernelFd = fd;
+    req->request.fd = fd;
+    req->request.open.path = req->path;
+    req->request.open.mode = mode;
+    return SubmitRequest(req, resource);
+}
+
+static s32 CloseLocked(s32 fd, s32 queue, IOSRequest* msg)
+{
+    FileDescriptor* file = GetFd(fd);
+    if (file == nullptr)
+        return IOS_EINVAL;
+
+    // The resource manager closing the handle it's being asked to close
+    if (file->closing)
+        return IOS_SUCCESS;
+
+    KernelRequest* req = NewRequest(IOS_CLOSE, queue, msg);
+    if (req == nullptr)
+        return IOS_ENOMEM;
+
+    file->closing = true;
+    req->kernelFd = fd;
+    req->request.fd = fd;
+    return SubmitRequest(req, file->resource);
+}
+
+/**
+ * Start a request on an open file descriptor. The caller fills in the
+ * arguments and submits it.
+ */
+static KernelRequest* FdRequest(
+  s32 fd, u32 cmd, s32 queue, IOSRequest* msg, u32* resource)
+{
+    FileDescriptor* file = GetFd(fd);
+    if (file == nullptr || file->closing)
+        return nullptr;
+
+    KernelRequest* req = NewRequest(cmd, queue, msg);
+    if (req == nullptr)
+        return nullptr;
+
+    req->request.fd = fd;
+    *resource = file->resource;
+    return req;
+}
+
+static s32 ReadWriteLocked(s32 fd, u32 cmd, const void* buf, s32 len,
+  s32 queue, IOSRequest* msg)
+{
+    u32 resource;
+    KernelRequest* req = FdRequest(fd, cmd, queue, msg, &resource);
+    if (req == nullptr)
+        return IOS_EINVAL;
+
+    req->request.read.data = const_cast<void*>(buf);
+    req->request.read.len = len;
+    return SubmitRequest(req, resource);
+}
+
+static s32 SeekLocked(
+  s32 fd, s32 where, s32 whence, s32 queue, IOSRequest* msg)
+{
+    u32 resource;
+    KernelRequest* req = FdRequest(fd, IOS_SEEK, queue, msg, &resource);
+    if (req == nullptr)
+        return IOS_EINVAL;
+
+    req->request.seek.where = where;
+    req->request.seek.whence = whence;
+    return SubmitRequest(req, resource);
+}
+
+static s32 IoctlLocked(s32 fd, u32 command, void* in, u32 in_len, void* io,
+  u32 io_len, s32 queue, IOSRequest* msg)
+{
+    u32 resource;
+    KernelRequest* req = FdRequest(fd, IOS_IOCTL, queue, msg, &resource);
+    if (req == nullptr)
+        return IOS_EINVAL;
+
+    req->request.ioctl.cmd = command;
+    req->request.ioctl.in = in;
+    req->request.ioctl.in_len = in_len;
+    req->request.ioctl.io = io;
+    req->request.ioctl.io_len = io_len;
+    return SubmitRequest(req, resource);
+}
+
+static s32 IoctlvLocked(s32 fd, u32 command, u32 in_cnt, u32 out_cnt,
+  IOVector* vec, s32 queue, IOSRequest* msg)
+{
+    u32 resource;
+    KernelRequest* req = FdRequest(fd, IOS_IOCTLV, queue, msg, &resource);
+    if (req == nullptr)
+        return IOS_EINVAL;
+
+    req->request.ioctlv.cmd = command;
+    req->request.ioctlv.in_count = in_cnt;
+    req->request.ioctlv.io_count = out_cnt;
+    req->request.ioctlv.vec = vec;
+    return SubmitRequest(req, resource);
+}
+
+s32 IOS_Open(const char* path, u32 mode)
+{
+    Host::CPULock lock;
+    return OpenLocked(path, mode, -1, nullptr);
+}
+
+s32 IOS_OpenAsync(const char* path, u32 mode, s32 queue_id, IOSRequest* msg)
+{
+    Host::CPULock lock;
+    return OpenLocked(path, mode, queue_id, msg);
+}
+
+s32 IOS_Close(s32 fd)
+{
+    Host::CPULock lock;
+    return CloseLocked(fd, -1, nullptr);
+}
+
+s32 IOS_CloseAsync(s32 fd, s32 queue_id, IOSRequest* msg)
+{
+    Host::CPULock lock;
+    return CloseLocked(fd, queue_id, msg);
+}
+
+s32 IOS_Seek(s32 fd, s32 where, s32 whence)
+{
+    Host::CPULock lock;
+    return SeekLocked(fd, where, whence, -1, nullptr);
+}
+
+s32 IOS_SeekAsync(s32 fd, s32 where, s32 whence, s32 queue_id, IOSRequest* msg)
+{
+    Host::CPULock lock;
+    return SeekLocked(fd, where, whence, queue_id, msg);
+}
+
+s32 IOS_Read(s32 fd, void* buf, s32 len)
+{
+    Host::CPULock lock;
+    return ReadWriteLocked(fd, IOS_READ, buf, len, -1, nullptr);
+}
+
+s32 IOS_ReadAsync(s32 fd, void* buf, s32 len, s32 queue_id, IOSRequest* msg)
+{
+    Host::CPULock lock;
+    return ReadWriteLocked(fd, IOS_READ, buf, len, queue_id, msg);
+}
+
+s32 IOS_Write(s32 fd, const void* buf, s32 len)
+{
+    Host::CPULock lock;
+    return ReadWriteLocked(fd, IOS_WRITE, buf, len, -1, nullptr);
+}
+
+s32 IOS_WriteAsync(
+  s32 fd, const void* buf, s32 len, s32 queue_id, IOSRequest* msg)
+{
+    Host::CPULock lock;
+    return ReadWriteLocked(fd, IOS_WRITE, buf, len, queue_id, msg);
+}
+
+s32 IOS_Ioctl(s32 fd, u32 command, void* in, u32 in_len, void* io, u32 io_len)
+{
+    Host::CPULock lock;
+    return IoctlLocked(fd, command, in, in_len, io, io_len, -1, nullptr);
+}
+
+s32 IOS_IoctlAsync(s32 fd, u32 command, void* in, u32 in_len, void* io,
+  u32 io_len, s32 queue_id, IOSRequest* msg)
+{
+    Host::CPULock lock;
+    return IoctlLocked(fd, command, in, in_len, io, io_len, queue_id, msg);
+}
+
+s32 IOS_Ioctlv(s32 fd, u32 command, u32 in_cnt, u32 out_cnt, IOVector* vec)
+{
+    Host::CPULock lock;
+    return IoctlvLocked(fd, command, in_cnt, out_cnt, vec, -1, nullptr);
+}
+
+s32 IOS_IoctlvAsync(s32 fd, u32 command, u32 in_cnt, u32 out_cnt, IOVector* vec,
+  s32 queue_id, IOSRequest* msg)
+{
+    Host::CPULock lock;
+    return IoctlvLocked(fd, command, in_cnt, out_cnt, vec, queue_id, msg);
+}
+
+s32 IOS_ResourceReply(const IOSRequest* request, s32 reply)
+{
+    Host::CPULock lock;
+    auto req =
+      reinterpret_cast<KernelRequest*>(const_cast<IOSRequest*>(request));
+
+    Heap* ipcHeap = GetHeap(Host::IPCHeap);
+    if (uintptr_t(req) < ipcHeap->base ||
+        uintptr_t(req) >= ipcHeap->base + ipcHeap->size)
+        Fatal("IOS_ResourceReply: Not a request");
+
+    // The client gets the kernel file descriptor for the open, and the
+    // resource manager sees it as the handle in later requests
+    if (req->cmd == IOS_OPEN) {
+        if (reply < 0)
+            s_fds[req->kernelFd].inUse = false;
+        else
+            reply = req->kernelFd;
+    } else if (req->cmd == IOS_CLOSE) {
+        s_fds[req->kernelFd].inUse = false;
+    }
+
+    if (req->replyQueue < 0) {
+        req->result = reply;
+        req->done = true;
+        pthread_cond_broadcast(&req->cond);
+        return IOS_SUCCESS;
+    }
+
+    req->clientMsg->cmd = IOS_IPC_REPLY;
+    req->clientMsg->result = reply;
+    s32 ret = SendLocked(req->replyQueue,
+      u32(reinterpret_cast<uintptr_t>(req->clientMsg)), 0, false);
+    FreeRequest(req);
+    return ret;
+}
+
+/*
+ * Memory and cache
+ */
+
+void IOS_InvalidateDCache(void* address, u32 size)
+{
+}
+
+void IOS_FlushDCache(const void* address, u32 size)
+{
+}
+
+void* IOS_VirtualToPhysical(void* virt)
+{
+    return virt;
+}
+
+/*
+ * Misc
+ */
+
+s32 IOS_SetPPCACRPerms(u8 enable)
+{
+    return IOS_SUCCESS;
+}
+
+s32 IOS_SetIpcAccessRights(u8* rights)
+{
+    return IOS_SUCCESS;
+}
+
+s32 IOS_SetUid(u32 pid, u32 uid)
+{
+    return IOS_SUCCESS;
+}
+
+u32 IOS_GetUid()
+{
+    return 0;
+}
+
+s32 IOS_SetGid(u32 pid, u16 gid)
+{
+    return IOS_SUCCESS;
+}
+
+u16 IOS_GetGid()
+{
+    return 0;
+}
+
+s32 IOS_LaunchElf(const char* path)
+{
+    return IOS_EACCES;
+}
+
+s32 IOS_LaunchRM(const char* path)
+{
+    return IOS_EACCES;
+}
+
+/*
+ * Setup
+ */
+
+static void MapMemory(u32 base, u32 size)
+{
+    void* ptr = mmap(reinterpret_cast<void*>(uintptr_t(base)), size,
+      PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE | MAP_NORESERVE, -1, 0);
+    if (ptr != reinterpret_cast<void*>(uintptr_t(base))) {
+        fprintf(stderr, "host: Failed to map memory at 0x%08X: %s\n", base,
+          strerror(errno));
+        abort();
+    }
+}
+
+void Host::Init()
+{
+    static bool initialized = false;
+    if (initialized)
+        return;
+    initialized = true;
+
+    MapMemory(MEM1Base, MEM1Size);
+    MapMemory(MEM2Base, MEM2Size);
+
+    if (CreateHeapLocked(reinterpret_cast<void*>(uintptr_t(MEM2Base)),
+          IPCHeapSize) != IPCHeap ||
+        CreateHeapLocked(reinterpret_cast<void*>(uintptr_t(MEM1Base)),
+          MEM1Size) != MEM1Heap)
+        Fatal("Failed to create the IPC heaps");
+
+    for (MessageQueue& queue : s_queues) {
+        InitCond(&queue.notEmpty);
+        InitCond(&queue.notFull);
+    }
+
+    InitCond(&s_timerCond);
+    pthread_t timerThread;
+    if (pthread_create(&timerThread, nullptr, TimerThread, nullptr) != 0)
+        Fatal("Failed to start the timer thread");
+    pthread_detach(timerThread);
+}
+
+void Host::Exit(int status)
+{
+    fflush(stdout);
+    fflush(stderr);
+    _Exit(status);
+}
@@ -0,0 +1,331 @@
+// System.cpp - IOS system for the host build
+//
+// SPDX-License-Identifier: MIT
+
+#include "Host.hpp"
+#include <DVD/DI.hpp>
+#include <Debug/Log.hpp>
+#include <Disk/DeviceMgr.hpp>
+#include <EmuDI/EmuDI.hpp>
+#include <IOS/IPCLog.hpp>
+#include <IOS/System.hpp>
+#include <System/AES.hpp>
+#include <System/Config.hpp>
+#include <System/ES.hpp>
+#include <System/Hollywood.hpp>
+#include <System/OS.hpp>
+#include <System/SHA.hpp>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+// The same size as on IOS, so the module running out of memory shows up on
+// the host too. Objects with pointers are a little bigger on a 64-bit host,
+// which the spare memory covers. Tests that need a second disc image keep its
+// buffers in the IPC heap, see tests/UncachedISO.hpp.
+constexpr u32 SystemHeapSize = 0x40000; // 256 KB
+s32 System::s_heapId = -1;
+
+static std::atomic<bool> s_verbose = false;
+static std::atomic<u32> s_noticeCount = 0;
+static std::atomic<u32> s_insertedDevices = 0;
+
+/**
+ * Heap for operator new. Static constructors can run before the system heap
+ * exists, those allocate from the IPC heap.
+ */
+static s32 NewHeap()
+{
+    if (System::GetHeap() >= 0)
+        return System::GetHeap();
+
+    Host::Init();
+    return Host::IPCHeap;
+}
+
+static void* Allocate(std::size_t size, u32 align)
+{
+    s32 heap = NewHeap();
+    void* block = IOS_AllocAligned(heap, size, align);
+    if (block == nullptr) {
+        fprintf(stderr, "host: Out of memory for 0x%zX bytes in heap %d\n",
+          size, heap);
+        abort();
+    }
+    return block;
+}
+
+static void Deallocate(void* ptr)
+{
+    if (ptr == nullptr)
+        return;
+
+    if (IOS_Free(NewHeap(), ptr) != IOS_SUCCESS)
+        IOS_Free(Host::IPCHeap, ptr);
+}
+
+void* operator new(std::size_t size)
+{
+    return Allocate(size, 32);
+}
+
+void* operator new[](std::size_t size)
+{
+    return Allocate(size, 32);
+}
+
+void* operator new(std::size_t size, std::align_val_t align)
+{
+    return Allocate(size, static_cast<u32>(align));
+}
+
+void* operator new[](std::size_t size, std::align_val_t align)
+{
+    return Allocate(size, static_cast<u32>(align));
+}
+
+void operator delete(void* ptr) noexcept
+{
+    Deallocate(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    Deallocate(ptr);
+}
+
+void operator delete(void* ptr, std::size_t size) noexcept
+{
+    Deallocate(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t size) noexcept
+{
+    Deallocate(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t align) noexcept
+{
+    Deallocate(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t align) noexcept
+{
+    Deallocate(ptr);
+}
+
+void AbortColor(u32 color)
+{
+    fprintf(stderr, "host: AbortColor(0x%08X) in thread %d\n", color,
+      IOS_GetThreadId());
+    abort();
+}
+
+void AssertFail(const char* expr, const char* file, s32 line)
+{
+    fprintf(stderr,
+      "host: Assertion failed in thread %d:\n%s\nfile %s, line %d\n",
+      IOS_GetThreadId(), expr, file, line);
+    abort();
+}
+
+int usleep(useconds_t usec)
+{
+    if (usec == 0)
+        return 0;
+
+    u32 queueData;
+    const s32 queue = IOS_CreateMessageQueue(&queueData, 1);
+    assert(queue >= 0);
+
+    const s32 timer = IOS_CreateTimer(usec, 0, queue, 1);
+    assert(timer >= 0);
+
+    u32 msg;
+    const s32 ret = IOS_ReceiveMessage(queue, &msg, 0);
+    assert(ret == IOS_SUCCESS && msg == 1);
+
+    IOS_DestroyTimer(timer);
+    IOS_DestroyMessageQueue(queue);
+    return 0;
+}
+
+void System::SetTime(u32 hwTimerVal, u64 epoch)
+{
+}
+
+u64 System::GetTime()
+{
+    return time(nullptr);
+}
+
+void* System::UnalignedMemcpy(void* dest, const void* src, size_t len)
+{
+    return memcpy(dest, src, len);
+}
+
+u32 HostACRRead(ACRReg reg)
+{
+    if (reg != ACRReg::TIMER)
+        return 0;
+
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return u32(u64(ts.tv_sec) * HW_TIMER_FREQ +
+               u64(ts.tv_nsec) * HW_TIMER_FREQ / 1000000000);
+}
+
+void Host::SetVerbose(bool verbose)
+{
+    s_verbose = verbose;
+}
+
+/**
+ * Read the IOS log like the channel does, and follow the notices and device
+ * insertions it reports.
+ */
+static s32 ConsoleEntry([[maybe_unused]] void* arg)
+{
+    s32 fd;
+    while ((fd = IOS_Open("/dev/saoirse", 0)) < 0)
+        usleep(1000);
+
+    char* buffer = reinterpret_cast<char*>(
+      IOS_AllocAligned(Host::IPCHeap, IPCLog::printSize, 32));
+    assert(buffer != nullptr);
+
+    while (true) {
+        s32 ret = IOS_Ioctl(fd,
+          static_cast<u32>(Log::IPCLogIoctl::RegisterPrintHook), buffer, 0,
+          buffer, IPCLog::printSize);
+
+        switch (static_cast<Log::IPCLogReply>(ret)) {
+        case Log::IPCLogReply::Print:
+            buffer[IPCLog::printSize - 1] = 0;
+            // INFO logs start with white
+            if (s_verbose || strncmp(buffer, "\x1b[37;1m", 7) != 0)
+                fprintf(stderr, "%s\x1b[0m\n", buffer);
+            break;
+
+        case Log::IPCLogReply::Notice:
+            s_noticeCount++;
+            break;
+
+        case Log::IPCLogReply::DevInsert:
+            s_insertedDevices |= 1 << u8(buffer[0]);
+            break;
+
+        case Log::IPCLogReply::DevRemove:
+            s_insertedDevices &= ~(1 << u8(buffer[0]));
+            break;
+
+        case Log::IPCLogReply::Close:
+        default:
+            return 0;
+        }
+    }
+}
+
+static s32 SystemThreadEntry([[maybe_unused]] void* arg)
+{
+    SHA::s_instance = new SHA();
+    AES::s_instance = new AES();
+    // The mock engine is far slower than the hardware, so the disc reads
+    // decrypt in software to keep the benchmarks meaningful
+    AES::s_instance->SetBackend(AES::Backend::Software);
+    DI::s_instance = new DI();
+    ES::s_instance = new ES();
+
+    IOS::Resource::MakeIPCToCallbackThread();
+
+    DeviceMgr::s_instance = new DeviceMgr();
+
+    PRINT(IOS, INFO, "Wait for start request...");
+    IPCLog::s_instance->WaitForStartRequest();
+    PRINT(IOS, INFO, "Starting up game IOS...");
+
+    // No EmuFS or EmuES, the host has no NAND or ES to stand in for
+    new Thread(EmuDI::ThreadEntry, nullptr, nullptr, 0x2000, 80);
+
+    return 0;
+}
+
+static s32 EntryThread([[maybe_unused]] void* arg)
+{
+    s32 ret = IOS_CreateHeap(
+      reinterpret_cast<void*>(uintptr_t(Host::SystemHeapBase)), SystemHeapSize);
+    if (ret < 0)
+        AbortColor(YUV_YELLOW);
+    System::SetHeap(ret);
+
+    Config::s_instance = new Config();
+    IPCLog::s_instance = new IPCLog();
+    Log::ipcLogEnabled = true;
+
+    ret = IOS_CreateThread(SystemThreadEntry, nullptr, nullptr, 0, 80, true);
+    if (ret < 0)
+        AbortColor(YUV_YELLOW);
+
+    ret = IOS_StartThread(ret);
+    if (ret < 0)
+        AbortColor(YUV_YELLOW);
+
+    IPCLog::s_instance->Run();
+    return 0;
+}
+
+/**
+ * Wait for a condition the console thread sets.
+ */
+template <typename F>
+static bool WaitFor(F condition, u32 timeoutMs)
+{
+    for (u32 i = 0; !condition(); i++) {
+        if (i == timeoutMs)
+            return false;
+
+        usleep(1000);
+    }
+
+    return true;
+}
+
+bool Host::Boot()
+{
+    s32 ret = IOS_CreateThread(EntryThread, nullptr, nullptr, 0, 80, true);
+    if (ret < 0 || IOS_StartThread(ret) < 0)
+        return false;
+
+    if (CreatePPCThread(ConsoleEntry, nullptr) < 0)
+        return false;
+
+    if (!WaitFor([] { return (s_insertedDevices & 1) != 0; }, 5000)) {
+        fprintf(stderr, "host: The SD card was not inserted\n");
+        return false;
+    }
+
+    return true;
+}
+
+bool Host::StartDI()
+{
+    // Never closed, closing /dev/saoirse turns the log off
+    s32 fd = IOS_Open("/dev/saoirse", 0);
+    if (fd < 0)
+        return false;
+
+    s32 ret = IOS_Ioctl(fd,
+      static_cast<u32>(Log::IPCLogIoctl::StartGameEvent), nullptr, 0, nullptr,
+      0);
+    if (ret != IOS_SUCCESS)
+        return false;
+
+    // EmuDI sends a notice when it has registered ~dev/di
+    if (!WaitFor([] { return s_noticeCount != 0; }, 10000)) {
+        fprintf(stderr, "host: DI did not start\n");
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,346 @@
+// USB.cpp - Mock /dev/usb/ven for the host build
+//
+// SPDX-License-Identifier: MIT
+
+#include "USB.hpp"
+#include "Host.hpp"
+#include <Disk/USB.hpp>
+#include <IOS/System.hpp>
+#include <System/Util.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// The CBW, CSW and SCSI commands are read and written with the same
+// accessors as in USBStorage.cpp, so they match on a little endian host too
+
+static constexpr u32 CBWSize = 0x1F;
+static constexpr u32 CSWSize = 0xD;
+static constexpr u32 CBWSignature = 0x43425355;
+static constexpr u32 CSWSignature = 0x53425355;
+
+static constexpr u8 InEndpoint = 0x81;
+static constexpr u8 OutEndpoint = 0x02;
+
+enum {
+    MSC_GET_MAX_LUN = 0xfe,
+};
+
+enum {
+    SCSI_TEST_UNIT_READY = 0x0,
+    SCSI_REQUEST_SENSE = 0x3,
+    SCSI_INQUIRY = 0x12,
+    SCSI_READ_CAPACITY_10 = 0x25,
+    SCSI_READ_10 = 0x28,
+    SCSI_WRITE_10 = 0x2a,
+    SCSI_SYNCHRONIZE_CACHE_10 = 0x35,
+};
+
+Host::USBVen::USBVen()
+{
+    const u32 devIds[DiskCount] = {HighSpeedDisk, FullSpeedDisk};
+    const u16 packetSizes[DiskCount] = {512, 64};
+    for (u32 i = 0; i < DiskCount; i++) {
+        Disk* disk = &m_disks[i];
+        *disk = {};
+        disk->devId = devIds[i];
+        disk->maxPacketSize = packetSizes[i];
+        disk->data =
+          reinterpret_cast<u8*>(malloc(DiskBlockCount * DiskBlockSize));
+        assert(disk->data != nullptr);
+
+        for (u32 j = 0; j < DiskBlockCount * DiskBlockSize; j += 4) {
+            u32 word = j * 0x9E3779B1 + disk->devId;
+            memcpy(disk->data + j, &word, 4);
+        }
+    }
+
+    m_queue = IOS_CreateMessageQueue(m_queueData, 8);
+    s32 ret = IOS_RegisterResourceManager("/dev/usb/ven", m_queue);
+    assert(m_queue >= 0 && ret == IOS_SUCCESS);
+
+    ret = IOS_CreateThread(ThreadEntry, this, nullptr, 0, 80, true);
+    assert(ret >= 0);
+    IOS_StartThread(ret);
+}
+
+u8* Host::USBVen::GetDiskData(u32 devId)
+{
+    Disk* disk = FindDisk(devId);
+    assert(disk != nullptr);
+    return disk->data;
+}
+
+void Host::USBVen::StartLog()
+{
+    m_logCount = 0;
+    m_logging = true;
+}
+
+u32 Host::USBVen::StopLog()
+{
+    m_logging = false;
+    return m_logCount;
+}
+
+s32 Host::USBVen::ThreadEntry(void* arg)
+{
+    reinterpret_cast<USBVen*>(arg)->Run();
+    return 0;
+}
+
+void Host::USBVen::Run()
+{
+    while (true) {
+        u32 msg;
+        s32 ret = IOS_ReceiveMessage(m_queue, &msg, 0);
+        assert(ret == IOS_SUCCESS);
+        IOSRequest* req = reinterpret_cast<IOSRequest*>(uintptr_t(msg));
+
+        switch (req->cmd) {
+        case IOS_OPEN:
+        case IOS_CLOSE:
+            IOS_ResourceReply(req, IOS_SUCCESS);
+            break;
+
+        case IOS_IOCTL:
+            HandleIoctl(req);
+            break;
+
+        case IOS_IOCTLV:
+            IOS_ResourceReply(req, HandleIoctlv(req));
+            break;
+
+        default:
+            IOS_ResourceReply(req, IOS_EINVAL);
+            break;
+        }
+    }
+}
+
+void Host::USBVen::HandleIoctl(IOSRequest* req)
+{
+    switch (static_cast<USB::USBv5Ioctl>(req->ioctl.cmd)) {
+    case USB::USBv5Ioctl::GetVersion:
+        if (req->ioctl.io_len < sizeof(u32)) {
+            IOS_ResourceReply(req, IOS_EINVAL);
+            break;
+        }
+
+        write32(req->ioctl.io, 0x00050001);
+        IOS_ResourceReply(req, IOS_SUCCESS);
+        break;
+
+    case USB::USBv5Ioctl::GetDeviceChange:
+        if (!m_changeReported) {
+            m_changeReported = true;
+            IOS_ResourceReply(req, 0);
+        } else {
+            m_changeRequest = req;
+        }
+        break;
+
+    case USB::USBv5Ioctl::GetDeviceInfo: {
+        Disk* disk = req->ioctl.in_len >= sizeof(u32)
+                       ? FindDisk(read32(req->ioctl.in))
+                       : nullptr;
+        if (disk == nullptr || req->ioctl.io_len != sizeof(USB::DeviceInfo)) {
+            IOS_ResourceReply(req, IOS_EINVAL);
+            break;
+        }
+
+        auto info = reinterpret_cast<USB::DeviceInfo*>(req->ioctl.io);
+        memset(info, 0, sizeof(*info));
+        info->devId = disk->devId;
+        info->device.vid = 0x0781;
+        info->device.pid = 0x5567;
+        info->interface.numEndpoints = 2;
+        info->interface.ifClass = USB::ClassCode::MassStorage;
+        info->interface.ifSubClass = USB::SubClass::MassStorage_SCSI;
+        info->interface.ifProtocol = USB::Protocol::MassStorage_BulkOnly;
+        info->endpoint[0].endpointAddr = InEndpoint;
+        info->endpoint[0].attributes = USB::CtrlType::TransferType_Bulk;
+        info->endpoint[0].maxPacketSize = disk->maxPacketSize;
+        info->endpoint[1].endpointAddr = OutEndpoint;
+        info->endpoint[1].attributes = USB::CtrlType::TransferType_Bulk;
+        info->endpoint[1].maxPacketSize = disk->maxPacketSize;
+        IOS_ResourceReply(req, IOS_SUCCESS);
+        break;
+    }
+
+    case USB::USBv5Ioctl::Attach:
+    case USB::USBv5Ioctl::AttachFinish:
+    case USB::USBv5Ioctl::SuspendResume:
+    case USB::USBv5Ioctl::CancelEndpoint:
+        IOS_ResourceReply(req, IOS_SUCCESS);
+        break;
+
+    default:
+        IOS_ResourceReply(req, IOS_EINVAL);
+        break;
+    }
+}
+
+s32 Host::USBVen::HandleIoctlv(IOSRequest* req)
+{
+    if (req->ioctlv.in_count + req->ioctlv.io_count != 2 ||
+        req->ioctlv.vec[0].len != sizeof(USB::Input))
+        return IOS_EINVAL;
+
+    auto input = reinterpret_cast<const USB::Input*>(req->ioctlv.vec[0].data);
+    Disk* disk = FindDisk(input->fd);
+    if (disk == nullptr)
+        return IOS_EINVAL;
+
+    switch (static_cast<USB::USBv5Ioctl>(req->ioctlv.cmd)) {
+    case USB::USBv5Ioctl::CtrlTransfer:
+        if (input->ctrl.data != req->ioctlv.vec[1].data)
+            return IOS_EINVAL;
+
+        // A single logical unit
+        if (input->ctrl.request == MSC_GET_MAX_LUN && input->ctrl.length >= 1)
+            write8(input->ctrl.data, 0);
+
+        // The setup packet is counted too
+        return input->ctrl.length + 8;
+
+    case USB::USBv5Ioctl::BulkTransfer:
+        if (input->bulk.data != req->ioctlv.vec[1].data ||
+            input->bulk.length != req->ioctlv.vec[1].len)
+            return IOS_EINVAL;
+
+        return BulkMessage(
+          disk, input->bulk.endpoint, input->bulk.data, input->bulk.length);
+
+    default:
+        return IOS_EINVAL;
+    }
+}
+
+Host::USBVen::Disk* Host::USBVen::FindDisk(u32 devId)
+{
+    for (u32 i = 0; i < DiskCount; i++) {
+        if (m_disks[i].devId == devId)
+            return &m_disks[i];
+    }
+
+    return nullptr;
+}
+
+s32 Host::USBVen::BulkMessage(Disk* disk, u8 endpoint, void* data, u16 length)
+{
+    constexpr s32 Halted = s32(USB::USBError::Halted);
+
+    if (!aligned(data, 32))
+        return IOS_EINVAL;
+
+    bool isIn = endpoint == InEndpoint;
+    if (!isIn && endpoint != OutEndpoint)
+        return IOS_EINVAL;
+
+    switch (disk->phase) {
+    case Phase::Command:
+        if (isIn || length != CBWSize)
+            return Halted;
+
+        StartCommand(disk, reinterpret_cast<const u8*>(data));
+        return length;
+
+    case Phase::Data:
+        // A message with a short packet ends the data phase
+        if (isIn == disk->isWrite || length > disk->remaining ||
+            (length != disk->remaining && length % disk->maxPacketSize != 0)) {
+            fprintf(stderr, "host: USB data message of 0x%X with 0x%X left\n",
+              length, disk->remaining);
+            disk->phase = Phase::Command;
+            return Halted;
+        }
+
+        if (m_logging && m_logCount < MaxLogMessages) {
+            m_log[m_logCount++] = {
+              .isWrite = !isIn,
+              .length = length,
+              .buffer = uintptr_t(data),
+            };
+        }
+
+        if (isIn) {
+            memcpy(data, disk->dataPtr, length);
+        } else {
+            memcpy(disk->dataPtr, data, length);
+        }
+
+        disk->dataPtr += length;
+        disk->remaining -= length;
+        if (disk->remaining == 0)
+            disk->phase = Phase::Status;
+        return length;
+
+    case Phase::Status:
+        if (!isIn || length != CSWSize)
+            return Halted;
+
+        write32_le(reinterpret_cast<u8*>(data) + 0x0, CSWSignature);
+        write32_le(reinterpret_cast<u8*>(data) + 0x4, disk->tag);
+        write32_le(reinterpret_cast<u8*>(data) + 0x8, 0);
+        write8(reinterpret_cast<u8*>(data) + 0xC, disk->failed ? 1 : 0);
+        disk->phase = Phase::Command;
+        return length;
+    }
+
+    return Halted;
+}
+
+void Host::USBVen::StartCommand(Disk* disk, const u8* cbw)
+{
+    u32 dataLength = read32_le(cbw + 0x8);
+    const u8* cb = cbw + 0xF;
+
+    disk->tag = read32_le(cbw + 0x4);
+    disk->isWrite = !(read8(cbw + 0xC) & 0x80);
+    disk->failed = read32_le(cbw) != CBWSignature;
+    disk->dataPtr = disk->response;
+    disk->remaining = dataLength;
+    memset(disk->response, 0, sizeof(disk->response));
+
+    switch (read8(cb)) {
+    case SCSI_TEST_UNIT_READY:
+    case SCSI_SYNCHRONIZE_CACHE_10:
+        disk->failed |= dataLength != 0;
+        break;
+
+    case SCSI_REQUEST_SENSE:
+    case SCSI_INQUIRY:
+        // No sense data, and a direct access device
+        disk->failed |= dataLength > sizeof(disk->response);
+        break;
+
+    case SCSI_READ_CAPACITY_10:
+        write32(disk->response + 0x0, DiskBlockCount - 1);
+        write32(disk->response + 0x4, DiskBlockSize);
+        disk->failed |= dataLength != 8;
+        break;
+
+    case SCSI_READ_10:
+    case SCSI_WRITE_10: {
+        u32 block = u32(read16(cb + 0x2)) << 16 | read16(cb + 0x4);
+        u32 count = u32(read8(cb + 0x7)) << 8 | read8(cb + 0x8);
+        disk->failed |= block > DiskBlockCount ||
+                        count > DiskBlockCount - block ||
+                        dataLength != count * DiskBlockSize ||
+                        disk->isWrite != (read8(cb) == SCSI_WRITE_10);
+        disk->dataPtr = disk->data + block * DiskBlockSize;
+        break;
+    }
+
+    default:
+        disk->failed = true;
+        break;
+    }
+
+    if (disk->failed)
+        disk->remaining = 0;
+
+    disk->phase = disk->remaining != 0 ? Phase::Data : Phase::Status;
+}
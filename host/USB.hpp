@@ -0,0 +1,110 @@
+// USB.hpp - Mock /dev/usb/ven for the host build
+//
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <IOS/Syscalls.h>
+#include <System/Types.h>
+
+namespace Host
+{
+
+/**
+ * Mock of the USB resource manager, with bulk-only mass storage disks held
+ * in memory. The disks are never reported as attached, so DeviceMgr leaves
+ * them alone and tests can drive USBStorage on them directly. Like a real
+ * device, a disk ends the data phase with an error if a message that isn't
+ * the last one isn't made of whole packets.
+ */
+class USBVen
+{
+public:
+    USBVen();
+
+    // Disk with 512 byte bulk packets, like a high speed device
+    static constexpr u32 HighSpeedDisk = 0x100;
+    // Disk with 64 byte bulk packets, like a full speed device
+    static constexpr u32 FullSpeedDisk = 0x101;
+
+    static constexpr u32 DiskBlockSize = 512;
+    static constexpr u32 DiskBlockCount = 0x2000;
+
+    /**
+     * Contents of a disk, filled with a pattern at startup.
+     */
+    u8* GetDiskData(u32 devId);
+
+    struct Message {
+        bool isWrite;
+        u32 length;
+        uintptr_t buffer;
+    };
+
+    static constexpr u32 MaxLogMessages = 256;
+
+    /**
+     * Start recording the bulk messages of data phases, up to MaxLogMessages.
+     */
+    void StartLog();
+
+    /**
+     * Stop recording messages.
+     * @returns Number of messages recorded.
+     */
+    u32 StopLog();
+
+    const Message& GetLogMessage(u32 index) const
+    {
+        return m_log[index];
+    }
+
+private:
+    enum class Phase {
+        Command,
+        Data,
+        Status,
+    };
+
+    struct Disk {
+        u32 devId;
+        u16 maxPacketSize;
+        u8* data;
+
+        Phase phase;
+        u32 tag;
+        bool isWrite;
+        bool failed;
+        // Remaining data of the current command, from or to 'data' or
+        // 'response'
+        u8* dataPtr;
+        u32 remaining;
+        u8 response[36];
+    };
+
+    static constexpr u32 DiskCount = 2;
+
+    static s32 ThreadEntry(void* arg);
+    void Run();
+    void HandleIoctl(IOSRequest* req);
+    s32 HandleIoctlv(IOSRequest* req);
+    Disk* FindDisk(u32 devId);
+    s32 BulkMessage(Disk* disk, u8 endpoint, void* data, u16 length);
+    void StartCommand(Disk* disk, const u8* cbw);
+
+    s32 m_queue;
+    u32 m_queueData[8];
+
+    // GetDeviceChange replies right away the first time, later requests wait
+    // for a change
+    bool m_changeReported = false;
+    IOSRequest* m_changeRequest = nullptr;
+
+    Disk m_disks[DiskCount];
+
+    bool m_logging = false;
+    u32 m_logCount = 0;
+    Message m_log[MaxLogMessages];
+};
+
+} // namespace Host
@@ -0,0 +1,162 @@
+// CryptoBench.cpp - Benchmark of the crypto engines against software
+//
+// SPDX-License-Identifier: MIT
+//
+// Times AES-128-CBC decryption and SHA-1 hashes of each size, in software and
+// through /dev/aes and /dev/sha, to see where the engines' round trips stop
+// costing more than they save. On the host the engines are mocks, so their
+// columns measure the IPC round trip plus a plain reference implementation;
+// run the same sizes on the console for the hardware figures.
+//
+// Usage: cryptobench [-v] [--bytes MB]
+
+#include "Harness.hpp"
+#include "Host.hpp"
+#include <IOS/System.hpp>
+#include <System/AES.hpp>
+#include <System/SHA.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+
+static constexpr u32 MaxSize = 0x8000;
+static const u32 AESSizes[] = {0x10, 0x40, 0x100, 0x400, 0x1000, 0x7C00};
+// With the H1 and H2 tables of the disc hash checks
+static const u32 SHASizes[] = {0x40, 0xA0, 0x26C, 0x400, 0x1000, 0x7C00};
+
+static u64 NowMicros()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return u64(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+struct Result {
+    double microsPerOp;
+    double mbPerSecond;
+};
+
+/**
+ * Decrypt requests of one size until the byte budget is used up.
+ */
+static Result TimeAES(
+  AES* aes, AES::Backend backend, u32 size, u64 budget, u8* key, u8* iv,
+  u8* data)
+{
+    aes->SetBackend(backend);
+    u32 count = std::max<u64>(budget / size, 16);
+
+    u64 start = NowMicros();
+    for (u32 i = 0; i < count; i++) {
+        if (aes->Decrypt(key, iv, data, size, data) != IOSError::OK) {
+            fprintf(stderr, "cryptobench: AES request of 0x%X failed\n",
+              size);
+            Host::Exit(1);
+        }
+    }
+    u64 micros = std::max<u64>(NowMicros() - start, 1);
+
+    return {
+      .microsPerOp = double(micros) / count,
+      .mbPerSecond = double(count) * size / micros * 1e6 / (1024 * 1024),
+    };
+}
+
+/**
+ * Hash buffers of one size, each with a new context, until the byte budget is
+ * used up.
+ */
+static Result TimeSHA(SHA* sha, bool software, u32 size, u64 budget, u8* data)
+{
+    SHA::Context ctx ATTRIBUTE_ALIGN(32);
+    u8 hash[0x14] ATTRIBUTE_ALIGN(32);
+    u32 count = std::max<u64>(budget / size, 16);
+
+    u64 start = NowMicros();
+    for (u32 i = 0; i < count; i++) {
+        if (sha->Init(&ctx, software) != IOSError::OK ||
+            sha->Final(&ctx, data, size, hash) != IOSError::OK) {
+            fprintf(stderr, "cryptobench: SHA hash of 0x%X failed\n", size);
+            Host::Exit(1);
+        }
+    }
+    u64 micros = std::max<u64>(NowMicros() - start, 1);
+
+    return {
+      .microsPerOp = double(micros) / count,
+      .mbPerSecond = double(count) * size / micros * 1e6 / (1024 * 1024),
+    };
+}
+
+static void Usage(const char* name)
+{
+    fprintf(stderr, "usage: %s [-v] [--bytes MB]\n", name);
+    Host::Exit(2);
+}
+
+int main(int argc, char** argv)
+{
+    Host::Harness::Options options;
+    // Only the device mocks are needed, keep the disc small
+    options.discDataSize = 4 * 1024 * 1024;
+    u64 budget = 2 * 1024 * 1024;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) {
+            options.verbose = true;
+        } else if (strcmp(argv[i], "--bytes") == 0 && i + 1 < argc) {
+            budget = u64(strtoul(argv[++i], nullptr, 0)) * 1024 * 1024;
+            if (budget == 0)
+                Usage(argv[0]);
+        } else {
+            Usage(argv[0]);
+        }
+    }
+
+    if (!Host::Harness::Start(options))
+        Host::Exit(1);
+
+    auto key = reinterpret_cast<u8*>(IOS_AllocAligned(Host::IPCHeap, 16, 32));
+    auto iv = reinterpret_cast<u8*>(IOS_AllocAligned(Host::IPCHeap, 16, 32));
+    auto data =
+      reinterpret_cast<u8*>(IOS_AllocAligned(Host::IPCHeap, MaxSize, 32));
+    assert(key != nullptr && iv != nullptr && data != nullptr);
+
+    for (u32 i = 0; i < MaxSize; i++)
+        data[i] = u8(i * 7 + (i >> 8));
+    memset(key, 0x5A, 16);
+    memset(iv, 0, 16);
+
+    AES* aes = new AES();
+
+    printf("%-8s %8s %12s %12s %12s %12s\n", "aes", "size", "sw us/op",
+      "sw MB/s", "engine us/op", "engine MB/s");
+    for (u32 size : AESSizes) {
+        Result sw =
+          TimeAES(aes, AES::Backend::Software, size, budget, key, iv, data);
+        Result hw =
+          TimeAES(aes, AES::Backend::Hardware, size, budget, key, iv, data);
+        printf("%-8s %8u %12.2f %12.1f %12.2f %12.1f\n", "", size,
+          sw.microsPerOp, sw.mbPerSecond, hw.microsPerOp, hw.mbPerSecond);
+    }
+    printf("Auto uses software up to 0x%X bytes\n", AES::AutoSoftwareMaxSize);
+
+    SHA* sha = new SHA();
+
+    printf("%-8s %8s %12s %12s %12s %12s\n", "sha", "size", "sw us/op",
+      "sw MB/s", "engine us/op", "engine MB/s");
+    for (u32 size : SHASizes) {
+        Result sw = TimeSHA(sha, true, size, budget, data);
+        Result hw = TimeSHA(sha, false, size, budget, data);
+        printf("%-8s %8u %12.2f %12.1f %12.2f %12.1f\n", "", size,
+          sw.microsPerOp, sw.mbPerSecond, hw.microsPerOp, hw.mbPerSecond);
+    }
+    printf("Auto uses software up to 0x%X bytes\n", SHA::AutoSoftwareMaxSize);
+    fflush(stdout);
+
+    delete sha;
+    delete aes;
+    Host::Exit(0);
+}
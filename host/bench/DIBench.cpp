@@ -0,0 +1,331 @@
+// DIBench.cpp - Benchmark of emulated disc reads on the host
+//
+// SPDX-License-Identifier: MIT
+//
+// Runs read patterns against ~dev/di with the test disc on a mocked SD card,
+// and prints throughput and latency for each, with the time reads spent on
+// decryption and hash verification. Recorded ditrace.bin files can be
+// replayed as well; their offsets are wrapped into the test disc. The disc is
+// read through the encrypted ISO backend, or through DecryptedISO or
+// CompressedISO with --backend, to compare them. Hash verification is off,
+// as in the module's config, unless --verify turns it on.
+//
+// Usage: dibench [-v] [--reads N] [--size MB]
+//                [--backend iso|decrypted|compressed]
+//                [--verify off|lazy|strict] [ditrace.bin...]
+
+#include "Harness.hpp"
+#include "Host.hpp"
+#include "Image.hpp"
+#include <DVD/EmuDI.hpp>
+#include <IOS/System.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+
+static constexpr u32 BlockDataSize = 0x7C00;
+static constexpr u32 MaxReadSize = 0x100000;
+
+struct Read {
+    u32 wordOffset;
+    u32 length;
+};
+
+struct Pattern {
+    const char* name;
+    Read* reads;
+    u32 count;
+};
+
+static u32 s_dataSize;
+static u32 s_fileCount;
+
+static u64 NowMicros()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return u64(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+static Read* AllocReads(u32 count)
+{
+    auto reads = reinterpret_cast<Read*>(
+      IOS_Alloc(Host::IPCHeap, std::max<u32>(count, 1) * sizeof(Read)));
+    if (reads == nullptr) {
+        fprintf(stderr, "dibench: Out of memory for %u reads\n", count);
+        Host::Exit(1);
+    }
+    return reads;
+}
+
+static u32 Random(u32* seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 1;
+}
+
+static Pattern MakeSequential(u32 count)
+{
+    constexpr u32 Length = 0x20000;
+    Read* reads = AllocReads(count);
+    u32 offset = Host::Disc::PatternStart;
+    for (u32 i = 0; i < count; i++) {
+        if (offset + Length > s_dataSize)
+            offset = Host::Disc::PatternStart;
+
+        reads[i] = {offset >> 2, Length};
+        offset += Length;
+    }
+
+    return {"sequential 128K", reads, count};
+}
+
+static Pattern MakeRandom(u32 count)
+{
+    constexpr u32 Length = 0x8000;
+    Read* reads = AllocReads(count);
+    u32 seed = 1;
+    for (u32 i = 0; i < count; i++)
+        reads[i] = {(Random(&seed) % (s_dataSize - Length)) >> 2, Length};
+
+    return {"random 32K", reads, count};
+}
+
+/**
+ * Small reads of file headers, in the order of the files. Like a game
+ * looking at each file before loading it.
+ */
+static Pattern MakeFileHeaders(u32 count)
+{
+    constexpr u32 Length = 0x20;
+    Read* reads = AllocReads(count);
+    u32 fileSize = ((s_dataSize - Host::Disc::PatternStart) / s_fileCount) & ~3;
+    for (u32 i = 0; i < count; i++) {
+        u32 file = i % s_fileCount;
+        reads[i] = {(Host::Disc::PatternStart + file * fileSize) >> 2, Length};
+    }
+
+    return {"file headers 32B", reads, count};
+}
+
+static u32 ReadBE32(const u8* data)
+{
+    return u32(data[0]) << 24 | u32(data[1]) << 16 | u32(data[2]) << 8 |
+           data[3];
+}
+
+/**
+ * Load the reads from a trace recorded by ReadTrace, see tools/ditrace.py
+ * for the format.
+ */
+static Pattern LoadTrace(const char* path)
+{
+    constexpr u32 Magic = 0x44495452;
+    constexpr u32 HeaderSize = 0x10;
+    constexpr u32 MinRecordSize = 0x14;
+    constexpr u8 IoctlRead = 0x71;
+
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr) {
+        fprintf(stderr, "dibench: Failed to open %s\n", path);
+        Host::Exit(1);
+    }
+
+    u8 header[HeaderSize];
+    u32 recordSize = 0;
+    if (fread(header, HeaderSize, 1, file) == 1 &&
+        ReadBE32(header) == Magic && ReadBE32(header + 4) == 1)
+        recordSize = ReadBE32(header + 8);
+
+    if (recordSize < MinRecordSize || recordSize > 0x100) {
+        fprintf(stderr, "dibench: %s is not a DI read trace\n", path);
+        Host::Exit(1);
+    }
+
+    fseek(file, 0, SEEK_END);
+    u32 maxCount = (ftell(file) - HeaderSize) / recordSize;
+    fseek(file, HeaderSize, SEEK_SET);
+
+    Read* reads = AllocReads(maxCount);
+    u32 count = 0;
+    u32 dataWords = s_dataSize >> 2;
+    u8 record[0x100];
+    while (fread(record, recordSize, 1, file) == 1) {
+        u32 length = ReadBE32(record + 12) & ~0x1F;
+        if (record[16] != IoctlRead || length == 0)
+            continue;
+
+        length = std::min(length, MaxReadSize);
+        u32 wordOffset = ReadBE32(record + 8) % (dataWords - (length >> 2));
+        reads[count++] = {wordOffset, length};
+    }
+
+    fclose(file);
+
+    const char* name = strrchr(path, '/');
+    return {name != nullptr ? name + 1 : path, reads, count};
+}
+
+/**
+ * Get the read path statistics through ~dev/di, like the channel does.
+ */
+static void GetStats(EmuDI::DVDReadStats* stats)
+{
+    constexpr u32 GetStatsIoctl = 0x03;
+
+    s32 fd = IOS_Open("~dev/di", 0);
+    s32 ret = fd >= 0 ? IOS_Ioctl(fd, GetStatsIoctl, nullptr, 0, stats,
+                          sizeof(*stats))
+                      : fd;
+    if (fd >= 0)
+        IOS_Close(fd);
+
+    if (ret != IOS_SUCCESS) {
+        fprintf(stderr, "dibench: Failed to get the read stats: %d\n", ret);
+        Host::Exit(1);
+    }
+}
+
+static u32 Percentile(const u32* sorted, u32 count, u32 percent)
+{
+    return count == 0 ? 0 : sorted[std::min(count - 1, count * percent / 100)];
+}
+
+/**
+ * Run the reads of a pattern one after the other, like a game waiting for
+ * each of them, and print the results. The data is checked after each read,
+ * outside of the timed part.
+ */
+static bool Run(const Pattern& pattern, u8* buffer)
+{
+    DI* di = Host::Harness::GetDI();
+    Host::SDIO* sdio = Host::Harness::GetSDIO();
+    auto latencies = reinterpret_cast<u32*>(
+      IOS_Alloc(Host::IPCHeap, std::max<u32>(pattern.count, 1) * 4));
+    auto stats = reinterpret_cast<EmuDI::DVDReadStats*>(
+      IOS_AllocAligned(Host::IPCHeap, sizeof(EmuDI::DVDReadStats), 32));
+    assert(latencies != nullptr && stats != nullptr);
+
+    GetStats(stats);
+    u64 decryptMicros = stats->decryptMicros;
+    u64 verifyMicros = stats->verifyMicros;
+
+    sdio->ResetStats();
+    u64 bytes = 0;
+    u64 totalMicros = 0;
+    bool ok = true;
+
+    for (u32 i = 0; i < pattern.count; i++) {
+        const Read& read = pattern.reads[i];
+
+        u64 start = NowMicros();
+        DI::DIError ret = di->Read(buffer, read.length, read.wordOffset);
+        u64 micros = NowMicros() - start;
+
+        if (ret != DI::DIError::OK ||
+            !Host::Disc::Check(buffer, read.wordOffset, read.length)) {
+            fprintf(stderr, "dibench: Read 0x%X at word 0x%X failed\n",
+              read.length, read.wordOffset);
+            ok = false;
+            break;
+        }
+
+        latencies[i] = u32(micros);
+        totalMicros += micros;
+        bytes += read.length;
+    }
+
+    Host::SDIO::Stats sd = sdio->GetStats();
+    GetStats(stats);
+    decryptMicros = stats->decryptMicros - decryptMicros;
+    verifyMicros = stats->verifyMicros - verifyMicros;
+
+    u32 count = ok ? pattern.count : 0;
+    std::sort(latencies, latencies + count);
+
+    double seconds = std::max<u64>(totalMicros, 1) / 1e6;
+    printf("%-20s %8u %9.1f %9.0f %8u %8u %8u %8u %9.2f %9.1f %9.1f %9.1f\n",
+      pattern.name, count, bytes / seconds / (1024 * 1024), count / seconds,
+      Percentile(latencies, count, 50), Percentile(latencies, count, 90),
+      Percentile(latencies, count, 99), count ? latencies[count - 1] : 0,
+      count ? double(sd.readCommands) / count : 0.0,
+      sd.readCommands ? double(sd.readSectors) / sd.readCommands : 0.0,
+      count ? double(decryptMicros) / count : 0.0,
+      count ? double(verifyMicros) / count : 0.0);
+    fflush(stdout);
+
+    IOS_Free(Host::IPCHeap, stats);
+    IOS_Free(Host::IPCHeap, latencies);
+    return ok;
+}
+
+static void Usage(const char* name)
+{
+    fprintf(stderr,
+      "usage: %s [-v] [--reads N] [--size MB] "
+      "[--backend iso|decrypted|compressed] [--verify off|lazy|strict] "
+      "[ditrace.bin...]\n",
+      name);
+    Host::Exit(2);
+}
+
+int main(int argc, char** argv)
+{
+    Host::Harness::Options options;
+    u32 readCount = 2000;
+    const char* traces[16];
+    u32 traceCount = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) {
+            options.verbose = true;
+        } else if (strcmp(argv[i], "--reads") == 0 && i + 1 < argc) {
+            readCount = strtoul(argv[++i], nullptr, 0);
+        } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            u32 sizeMB = strtoul(argv[++i], nullptr, 0);
+            if (sizeMB < 2 || sizeMB > 2048)
+                Usage(argv[0]);
+
+            options.discDataSize = sizeMB * 1024 * 1024;
+            // 0:/xaa is always written, the image for the backend may be
+            // as large again
+            options.imageSizeMB = std::max<u32>(320, sizeMB * 2 + 64);
+        } else if (strcmp(argv[i], "--backend") == 0 && i + 1 < argc) {
+            if (!Host::Harness::ParseBackend(argv[++i], &options.discFormat))
+                Usage(argv[0]);
+        } else if (strcmp(argv[i], "--verify") == 0 && i + 1 < argc) {
+            if (!Host::Harness::ParseVerifyMode(
+                  argv[++i], &options.discVerifyMode))
+                Usage(argv[0]);
+        } else if (argv[i][0] != '-' && traceCount < 16) {
+            traces[traceCount++] = argv[i];
+        } else {
+            Usage(argv[0]);
+        }
+    }
+
+    s_dataSize = options.discDataSize / BlockDataSize * BlockDataSize;
+    s_fileCount = options.discFileCount;
+
+    if (!Host::Harness::Start(options))
+        Host::Exit(1);
+
+    u8* buffer = reinterpret_cast<u8*>(
+      IOS_AllocAligned(Host::IPCHeap, MaxReadSize, 32));
+    assert(buffer != nullptr);
+
+    printf("image: %s\n", Host::Harness::GetImagePath());
+    printf("%-20s %8s %9s %9s %8s %8s %8s %8s %9s %9s %9s %9s\n", "pattern",
+      "reads", "MB/s", "reads/s", "p50 us", "p90 us", "p99 us", "max us",
+      "sd cmd/rd", "sec/cmd", "aes us/rd", "sha us/rd");
+
+    bool ok = Run(MakeSequential(readCount), buffer);
+    ok = Run(MakeRandom(readCount), buffer) && ok;
+    ok = Run(MakeFileHeaders(readCount), buffer) && ok;
+    for (u32 i = 0; i < traceCount; i++)
+        ok = Run(LoadTrace(traces[i]), buffer) && ok;
+
+    Host::Exit(ok ? 0 : 1);
+}
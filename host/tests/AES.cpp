@@ -0,0 +1,190 @@
+// AES.cpp - Tests of AES-128-CBC on the engine and in software
+//
+// SPDX-License-Identifier: MIT
+
+#include "Harness.hpp"
+#include "Host.hpp"
+#include "Test.hpp"
+#include <IOS/System.hpp>
+#include <System/AES.hpp>
+#include <cstring>
+
+static constexpr u32 DataSize = 0x8000;
+
+// NIST SP 800-38A, F.2.1 and F.2.2 CBC-AES128
+static const u8 Key[] = {0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6,
+  0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C};
+static const u8 IV[] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+  0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F};
+static const u8 Plaintext[] = {0x6B, 0xC1, 0xBE, 0xE2, 0x2E, 0x40, 0x9F, 0x96,
+  0xE9, 0x3D, 0x7E, 0x11, 0x73, 0x93, 0x17, 0x2A, 0xAE, 0x2D, 0x8A, 0x57,
+  0x1E, 0x03, 0xAC, 0x9C, 0x9E, 0xB7, 0x6F, 0xAC, 0x45, 0xAF, 0x8E, 0x51,
+  0x30, 0xC8, 0x1C, 0x46, 0xA3, 0x5C, 0xE4, 0x11, 0xE5, 0xFB, 0xC1, 0x19,
+  0x1A, 0x0A, 0x52, 0xEF, 0xF6, 0x9F, 0x24, 0x45, 0xDF, 0x4F, 0x9B, 0x17,
+  0xAD, 0x2B, 0x41, 0x7B, 0xE6, 0x6C, 0x37, 0x10};
+static const u8 Ciphertext[] = {0x76, 0x49, 0xAB, 0xAC, 0x81, 0x19, 0xB2, 0x46,
+  0xCE, 0xE9, 0x8E, 0x9B, 0x12, 0xE9, 0x19, 0x7D, 0x50, 0x86, 0xCB, 0x9B,
+  0x50, 0x72, 0x19, 0xEE, 0x95, 0xDB, 0x11, 0x3A, 0x91, 0x76, 0x78, 0xB2,
+  0x73, 0xBE, 0xD6, 0xB8, 0xE3, 0xC1, 0x74, 0x3B, 0x71, 0x16, 0xE6, 0x9E,
+  0x22, 0x22, 0x95, 0x16, 0x3F, 0xF1, 0xCA, 0xA1, 0x68, 0x1F, 0xAC, 0x09,
+  0x12, 0x0E, 0xCA, 0x30, 0x75, 0x86, 0xE1, 0xA7};
+
+static_assert(sizeof(Plaintext) == sizeof(Ciphertext));
+
+struct Buffers {
+    u8* key;
+    u8* iv;
+    u8* data;
+    u8* out;
+};
+
+static Buffers AllocBuffers()
+{
+    Buffers buffers = {
+      .key = reinterpret_cast<u8*>(IOS_AllocAligned(Host::IPCHeap, 16, 32)),
+      .iv = reinterpret_cast<u8*>(IOS_AllocAligned(Host::IPCHeap, 16, 32)),
+      .data =
+        reinterpret_cast<u8*>(IOS_AllocAligned(Host::IPCHeap, DataSize, 32)),
+      .out =
+        reinterpret_cast<u8*>(IOS_AllocAligned(Host::IPCHeap, DataSize, 32)),
+    };
+    memcpy(buffers.key, Key, 16);
+    return buffers;
+}
+
+static void FreeBuffers(const Buffers& buffers)
+{
+    IOS_Free(Host::IPCHeap, buffers.out);
+    IOS_Free(Host::IPCHeap, buffers.data);
+    IOS_Free(Host::IPCHeap, buffers.iv);
+    IOS_Free(Host::IPCHeap, buffers.key);
+}
+
+/**
+ * Check the known answer on one backend: in one request, then in place in
+ * two requests that carry the IV over.
+ */
+static bool CheckKnownAnswer(AES* aes, const Buffers& b)
+{
+    constexpr u32 Size = sizeof(Plaintext);
+    constexpr u32 Half = Size / 2;
+    const u8* lastBlock = Ciphertext + Size - 16;
+
+    memcpy(b.iv, IV, 16);
+    memcpy(b.data, Plaintext, Size);
+    if (aes->Encrypt(b.key, b.iv, b.data, Size, b.out) != IOSError::OK ||
+        memcmp(b.out, Ciphertext, Size) != 0 || memcmp(b.iv, lastBlock, 16))
+        return false;
+
+    memcpy(b.iv, IV, 16);
+    if (aes->Decrypt(b.key, b.iv, b.out, Size, b.data) != IOSError::OK ||
+        memcmp(b.data, Plaintext, Size) != 0 || memcmp(b.iv, lastBlock, 16))
+        return false;
+
+    memcpy(b.iv, IV, 16);
+    if (aes->Encrypt(b.key, b.iv, b.data, Half, b.data) != IOSError::OK ||
+        aes->Encrypt(b.key, b.iv, b.data + Half, Half, b.data + Half) !=
+          IOSError::OK ||
+        memcmp(b.data, Ciphertext, Size) != 0)
+        return false;
+
+    memcpy(b.iv, IV, 16);
+    if (aes->Decrypt(b.key, b.iv, b.data, Half, b.data) != IOSError::OK ||
+        aes->Decrypt(b.key, b.iv, b.data + Half, Half, b.data + Half) !=
+          IOSError::OK ||
+        memcmp(b.data, Plaintext, Size) != 0)
+        return false;
+
+    return true;
+}
+
+HOST_TEST(AESKnownAnswer)
+{
+    Buffers b = AllocBuffers();
+    AES* aes = new AES();
+
+    const AES::Backend backends[] = {
+      AES::Backend::Software, AES::Backend::Hardware, AES::Backend::Auto};
+    for (AES::Backend backend : backends) {
+        aes->SetBackend(backend);
+        EXPECT(CheckKnownAnswer(aes, b));
+    }
+
+    // The software functions don't need an instance
+    constexpr u32 Size = sizeof(Plaintext);
+    memcpy(b.iv, IV, 16);
+    AES::SoftwareEncrypt(b.key, b.iv, Plaintext, Size, b.out);
+    EXPECT(memcmp(b.out, Ciphertext, Size) == 0);
+    memcpy(b.iv, IV, 16);
+    AES::SoftwareDecrypt(b.key, b.iv, Ciphertext, Size, b.out);
+    EXPECT(memcmp(b.out, Plaintext, Size) == 0);
+
+    delete aes;
+    FreeBuffers(b);
+    return true;
+}
+
+HOST_TEST(AESBackendsMatch)
+{
+    Buffers b = AllocBuffers();
+    AES* aes = new AES();
+    Host::AESEngine* engine = Host::Harness::GetAES();
+    auto expected =
+      reinterpret_cast<u8*>(IOS_AllocAligned(Host::IPCHeap, DataSize, 32));
+    auto queue = new Queue<IOS::Request*>(1);
+    auto request = new AES::AsyncRequest;
+
+    u32 seed = 1;
+    for (u32 i = 0; i < DataSize; i++) {
+        seed = seed * 1103515245 + 12345;
+        b.data[i] = seed >> 16;
+    }
+
+    // A whole disc block, in software and on the engine, which is what the
+    // ISO backend decrypts asynchronously
+    aes->SetBackend(AES::Backend::Software);
+    memcpy(b.iv, IV, 16);
+    EXPECT(aes->Decrypt(b.key, b.iv, b.data, DataSize, expected) ==
+           IOSError::OK);
+
+    aes->SetBackend(AES::Backend::Hardware);
+    engine->ResetStats();
+    memcpy(b.iv, IV, 16);
+    EXPECT(aes->DecryptAsync(b.key, b.iv, b.data, DataSize, b.out, queue,
+             request) == IOSError::OK);
+    EXPECT(queue->receive() == &request->req);
+    EXPECT(request->req.result == IOSError::OK);
+    EXPECT(memcmp(b.out, expected, DataSize) == 0);
+    EXPECT(memcmp(b.iv, b.data + DataSize - 16, 16) == 0);
+    EXPECT(engine->GetStats().requests == 1);
+
+    // Auto only goes to the engine for requests larger than
+    // AutoSoftwareMaxSize
+    aes->SetBackend(AES::Backend::Auto);
+    engine->ResetStats();
+    memcpy(b.iv, IV, 16);
+    EXPECT(aes->Encrypt(b.key, b.iv, b.data, AES::AutoSoftwareMaxSize,
+             b.out) == IOSError::OK);
+    EXPECT(engine->GetStats().requests == 0);
+    EXPECT(aes->Encrypt(b.key, b.iv, b.data + AES::AutoSoftwareMaxSize,
+             AES::AutoSoftwareMaxSize + 16,
+             b.out + AES::AutoSoftwareMaxSize) == IOSError::OK);
+    EXPECT(engine->GetStats().requests == 1);
+
+    u32 size = AES::AutoSoftwareMaxSize * 2 + 16;
+    memcpy(b.iv, IV, 16);
+    AES::SoftwareEncrypt(b.key, b.iv, b.data, size, expected);
+    EXPECT(memcmp(b.out, expected, size) == 0);
+
+    // Like the hardware, the engine refuses partial blocks
+    aes->SetBackend(AES::Backend::Hardware);
+    EXPECT(aes->Encrypt(b.key, b.iv, b.data, 0x408, b.out) != IOSError::OK);
+    EXPECT(engine->GetStats().badRequests == 1);
+
+    delete request;
+    delete queue;
+    IOS_Free(Host::IPCHeap, expected);
+    delete aes;
+    FreeBuffers(b);
+    return true;
+}
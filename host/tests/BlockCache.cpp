@@ -0,0 +1,130 @@
+// BlockCache.cpp - Tests of the decrypted disc block cache
+//
+// SPDX-License-Identifier: MIT
+
+#include "Harness.hpp"
+#include "Host.hpp"
+#include "Image.hpp"
+#include "Test.hpp"
+#include "UncachedISO.hpp"
+#include <EmuDI/BlockCache.hpp>
+#include <IOS/System.hpp>
+#include <cstring>
+
+static constexpr u32 BlockDataSize = 0x7C00;
+static constexpr u32 BlockWords = 0x8000 >> 2;
+// The block size doesn't matter to the replacement, so small blocks keep the
+// caches in the space the module leaves in the heap
+static constexpr u32 TestBlockSize = 0x400;
+
+/**
+ * Look up each block of a read pattern like ISO::ReadAndDecryptBlock, filling
+ * the blocks that miss with their key.
+ * @returns False if a hit returned another block's data.
+ */
+static bool Replay(BlockCache* cache, const u32* blocks, u32 count)
+{
+    for (u32 i = 0; i < count; i++) {
+        u32 key = blocks[i] * BlockWords;
+        if (u8* data = cache->Lookup(key)) {
+            u32 stored;
+            memcpy(&stored, data, sizeof(stored));
+            if (stored != key)
+                return false;
+            continue;
+        }
+
+        u8* data = cache->Insert(key);
+        if (data != nullptr)
+            memcpy(data, &key, sizeof(key));
+    }
+
+    return true;
+}
+
+HOST_TEST(BlockCacheReplay)
+{
+    BlockCache cache(3, TestBlockSize);
+    EXPECT(cache.GetBlockCount() == 3);
+
+    // Two files read in turn, with a header block read before each: the
+    // three blocks in use at once stay cached, each new block evicts one
+    const u32 interleaved[] = {
+      0, 10, 20, 0, 10, 20, 0, 11, 21, 0, 11, 21, 0, 12, 22, 0, 12, 22};
+    EXPECT(Replay(&cache, interleaved, 18));
+    EXPECT(cache.GetStats().hits == 11);
+    EXPECT(cache.GetStats().misses == 7);
+    EXPECT(cache.GetStats().evictions == 4);
+
+    // A scan of more blocks than the cache holds never hits, even when it's
+    // repeated
+    cache.Clear();
+    cache.ResetStats();
+    const u32 scan[] = {30, 31, 32, 33, 30, 31, 32, 33};
+    EXPECT(Replay(&cache, scan, 8));
+    EXPECT(cache.GetStats().hits == 0);
+    EXPECT(cache.GetStats().misses == 8);
+    EXPECT(cache.GetStats().evictions == 5);
+
+    // The least recently used block is replaced, not the oldest inserted
+    cache.Clear();
+    cache.ResetStats();
+    const u32 reuse[] = {40, 41, 42, 40, 43, 40, 41};
+    EXPECT(Replay(&cache, reuse, 7));
+    EXPECT(cache.GetStats().hits == 2);
+    EXPECT(cache.GetStats().misses == 5);
+    EXPECT(cache.Contains(40 * BlockWords));
+    EXPECT(cache.Contains(41 * BlockWords));
+    EXPECT(cache.Contains(43 * BlockWords));
+    EXPECT(!cache.Contains(42 * BlockWords));
+    return true;
+}
+
+HOST_TEST(BlockCacheBudget)
+{
+    // More blocks than the heap holds, the cache takes what fits
+    BlockCache large(0x1000, TestBlockSize);
+    EXPECT(large.GetBlockCount() != 0);
+    EXPECT(large.GetBlockCount() < 0x1000);
+
+    // With no blocks, nothing is cached and every lookup misses
+    BlockCache empty(0, TestBlockSize);
+    EXPECT(empty.GetBlockCount() == 0);
+    EXPECT(empty.Insert(BlockWords) == nullptr);
+
+    const u32 pattern[] = {1, 2, 1, 2};
+    EXPECT(Replay(&empty, pattern, 4));
+    EXPECT(empty.GetStats().hits == 0);
+    EXPECT(empty.GetStats().misses == 4);
+    return true;
+}
+
+HOST_TEST(BlockCacheUncachedRead)
+{
+    const char* path = "0:/xaa";
+    UncachedISO* iso = new UncachedISO(&path, 1);
+
+    auto tmd = reinterpret_cast<ES::TMDFixed<512>*>(
+      IOS_AllocAligned(Host::IPCHeap, sizeof(ES::TMDFixed<512>), 32));
+    auto buffer = reinterpret_cast<u8*>(
+      IOS_AllocAligned(Host::IPCHeap, BlockDataSize * 3, 32));
+
+    DI::DiskID diskID;
+    EXPECT(iso->ReadDiskID(&diskID));
+    EXPECT(iso->OpenPartition(Host::Disc::PartitionOffset >> 2, tmd) ==
+           DI::DIError::OK);
+
+    // Reads that start or end inside a block, or go to an unaligned buffer,
+    // decrypt in the raw block buffer instead of the cache
+    u32 offset = Host::Disc::PatternStart + 0x100;
+    EXPECT(iso->ReadFromPartition(buffer, offset >> 2, BlockDataSize * 2));
+    EXPECT(Host::Disc::Check(buffer, offset >> 2, BlockDataSize * 2));
+    EXPECT(iso->ReadFromPartition(buffer + 4, offset >> 2, BlockDataSize));
+    EXPECT(Host::Disc::Check(buffer + 4, offset >> 2, BlockDataSize));
+    EXPECT(!iso->Prefetch(offset >> 2, BlockDataSize));
+
+    IOS_Free(Host::IPCHeap, buffer);
+    IOS_Free(Host::IPCHeap, tmd);
+    delete iso;
+    return true;
+}
@@ -0,0 +1,87 @@
+// DiscMetadata.cpp - Tests of the saved disc headers
+//
+// SPDX-License-Identifier: MIT
+
+#include "Harness.hpp"
+#include "Host.hpp"
+#include "Image.hpp"
+#include "Test.hpp"
+#include "UncachedISO.hpp"
+#include <EmuDI/DiscMetadata.hpp>
+#include <FAT/ff.h>
+#include <IOS/System.hpp>
+#include <cstring>
+
+HOST_TEST(DiscMetadataNoTitleKey)
+{
+    // Written when the harness opened the partition
+    char path[64];
+    snprintf(path, sizeof(path), "%s.meta", Host::Harness::GetImagePath());
+    FIL file;
+    EXPECT(f_open(&file, path, FA_READ) == FR_OK);
+
+    UINT size = f_size(&file);
+    auto data = reinterpret_cast<u8*>(IOS_Alloc(Host::IPCHeap, size));
+    UINT br = 0;
+    EXPECT(f_read(&file, data, size, &br) == FR_OK && br == size);
+    f_close(&file);
+
+    EXPECT(reinterpret_cast<u32*>(data)[1] == DiscMetadata::Version);
+
+    bool found = false;
+    for (UINT i = 0; i + sizeof(Host::Disc::TitleKey) <= size; i++) {
+        if (!memcmp(data + i, Host::Disc::TitleKey,
+              sizeof(Host::Disc::TitleKey)))
+            found = true;
+    }
+
+    IOS_Free(Host::IPCHeap, data);
+    EXPECT(!found);
+    return true;
+}
+
+HOST_TEST(DiscMetadataReopen)
+{
+    // A second open of the image loads the saved partition, so the title key
+    // has to come from the saved ticket
+    const char* path = "0:/xaa";
+    ISO* iso = new UncachedISO(&path, 1);
+    auto tmd = reinterpret_cast<ES::TMDFixed<512>*>(
+      IOS_AllocAligned(Host::IPCHeap, sizeof(ES::TMDFixed<512>), 32));
+    auto buffer = reinterpret_cast<u8*>(
+      IOS_AllocAligned(Host::IPCHeap, 0x8000, 32));
+
+    DI::DiskID diskID;
+    EXPECT(iso->ReadDiskID(&diskID));
+    EXPECT(iso->OpenPartition(Host::Disc::PartitionOffset >> 2, tmd) ==
+           DI::DIError::OK);
+
+    u32 offset = Host::Harness::Options().discDataSize / 2 & ~3;
+    EXPECT(iso->ReadFromPartition(buffer, offset >> 2, 0x8000));
+    EXPECT(Host::Disc::Check(buffer, offset >> 2, 0x8000));
+
+    IOS_Free(Host::IPCHeap, buffer);
+    IOS_Free(Host::IPCHeap, tmd);
+    delete iso;
+    return true;
+}
+
+HOST_TEST(DiscMetadataLongPath)
+{
+    // Not saved to or loaded from a cut off path
+    const char* imagePath = "0:/a_long_name_for_the_disc_image.iso";
+    char truncated[DiscMetadata::MaxPathSize];
+    snprintf(truncated, sizeof(truncated), "%s.meta", imagePath);
+
+    DiscMetadata* metadata = new DiscMetadata(imagePath, 0x8000, 0);
+    DI::DiskID diskID = {};
+    memcpy(diskID.gameID, "RLNG", 4);
+    metadata->SetDiskID(diskID);
+    metadata->Save();
+    EXPECT(!metadata->Load());
+    delete metadata;
+
+    FILINFO info;
+    EXPECT(f_stat(truncated, &info) == FR_NO_FILE);
+    return true;
+}
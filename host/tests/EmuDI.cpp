@@ -0,0 +1,205 @@
+// EmuDI.cpp - Tests of emulated disc reads through ~dev/di
+//
+// SPDX-License-Identifier: MIT
+
+#include "Harness.hpp"
+#include "Host.hpp"
+#include "Image.hpp"
+#include "Test.hpp"
+#include <DVD/EmuDI.hpp>
+#include <IOS/Syscalls.h>
+#include <IOS/System.hpp>
+#include <cstring>
+
+static constexpr u32 BlockDataSize = 0x7C00;
+static constexpr u32 MaxReadSize = 0x40000;
+
+/**
+ * Read from the game partition and check the data against the pattern.
+ */
+static bool ReadAndCheck(u32 offset, u32 length)
+{
+    static u8* buffer = reinterpret_cast<u8*>(
+      IOS_AllocAligned(Host::IPCHeap, MaxReadSize, 32));
+
+    memset(buffer, 0xA5, length);
+    DI::DIError ret = Host::Harness::GetDI()->Read(buffer, length, offset >> 2);
+    if (ret != DI::DIError::OK) {
+        fprintf(stderr, "Read 0x%X at 0x%X failed: %s\n", length, offset,
+          DI::PrintError(ret));
+        return false;
+    }
+
+    if (!Host::Disc::Check(buffer, offset >> 2, length)) {
+        fprintf(stderr, "Read 0x%X at 0x%X returned wrong data\n", length,
+          offset);
+        return false;
+    }
+
+    return true;
+}
+
+HOST_TEST(ReadDiskID)
+{
+    auto diskID = reinterpret_cast<DI::DiskID*>(
+      IOS_AllocAligned(Host::IPCHeap, sizeof(DI::DiskID), 32));
+    EXPECT(Host::Harness::GetDI()->ReadDiskID(diskID) == DI::DIError::OK);
+    EXPECT(memcmp(diskID->gameID, "RHST", 4) == 0);
+    EXPECT(diskID->discMagic == 0x5D1C9EA3);
+    IOS_Free(Host::IPCHeap, diskID);
+    return true;
+}
+
+HOST_TEST(ReadFST)
+{
+    auto header = reinterpret_cast<u32*>(
+      IOS_AllocAligned(Host::IPCHeap, 0x440, 32));
+    EXPECT(Host::Harness::GetDI()->Read(header, 0x440, 0) == DI::DIError::OK);
+    EXPECT(memcmp(header, "RHST01", 6) == 0);
+
+    u32 fstWordOffset = header[0x420 / 4 + 1];
+    EXPECT(fstWordOffset == Host::Disc::FSTOffset >> 2);
+
+    auto root = reinterpret_cast<u32*>(
+      IOS_AllocAligned(Host::IPCHeap, 0x20, 32));
+    EXPECT(
+      Host::Harness::GetDI()->Read(root, 0x20, fstWordOffset) ==
+      DI::DIError::OK);
+    EXPECT(root[0] == 0x01000000);
+    EXPECT(root[2] == Host::Harness::Options().discFileCount + 1);
+
+    IOS_Free(Host::IPCHeap, root);
+    IOS_Free(Host::IPCHeap, header);
+    return true;
+}
+
+HOST_TEST(ReadBlockBoundaries)
+{
+    // Reads starting, ending and crossing block boundaries, some of them
+    // only word aligned. DI needs the length to be a multiple of 32 bytes.
+    for (u32 block = 1; block < 8; block++) {
+        u32 boundary = block * BlockDataSize;
+        EXPECT(ReadAndCheck(boundary, 0x20));
+        EXPECT(ReadAndCheck(boundary - 0x20, 0x20));
+        EXPECT(ReadAndCheck(boundary - 0x20, 0x40));
+        EXPECT(ReadAndCheck(boundary - 0x1004, 0x2020));
+        EXPECT(ReadAndCheck(boundary, BlockDataSize));
+        EXPECT(ReadAndCheck(boundary + 4, BlockDataSize * 3));
+    }
+
+    return true;
+}
+
+HOST_TEST(ReadSequential)
+{
+    u32 end = Host::Harness::Options().discDataSize / BlockDataSize *
+              BlockDataSize;
+    for (u32 offset = Host::Disc::PatternStart; offset + 0x20000 <= end;
+         offset += 0x20000)
+        EXPECT(ReadAndCheck(offset, 0x20000));
+
+    return true;
+}
+
+HOST_TEST(ReadRandom)
+{
+    u32 end = Host::Harness::Options().discDataSize / BlockDataSize *
+              BlockDataSize;
+    u32 seed = 1;
+    for (u32 i = 0; i < 500; i++) {
+        seed = seed * 1103515245 + 12345;
+        u32 length = ((seed >> 8) % MaxReadSize + 0x20) & ~0x1F;
+        seed = seed * 1103515245 + 12345;
+        u32 offset = (seed % (end - length)) & ~3;
+        EXPECT(ReadAndCheck(offset, length));
+    }
+
+    return true;
+}
+
+/**
+ * Get the read path statistics, like the channel does.
+ */
+static bool GetStats(EmuDI::DVDReadStats* stats)
+{
+    constexpr u32 GetStatsIoctl = 0x03;
+
+    s32 fd = IOS_Open("~dev/di", 0);
+    if (fd < 0)
+        return false;
+
+    s32 ret = IOS_Ioctl(fd, GetStatsIoctl, nullptr, 0, stats, sizeof(*stats));
+    IOS_Close(fd);
+    return ret == IOS_SUCCESS;
+}
+
+HOST_TEST(ReadDeviceStats)
+{
+    auto stats = reinterpret_cast<EmuDI::DVDReadStats*>(
+      IOS_AllocAligned(Host::IPCHeap, sizeof(EmuDI::DVDReadStats), 32));
+    EXPECT(GetStats(stats));
+    u32 requests = stats->deviceRequests;
+    u32 transfers = stats->deviceTransfers;
+    u32 cacheReads = stats->deviceCacheHits + stats->deviceCacheMisses;
+
+    // Long out of the block cache by now, so the SD card has to be read
+    u32 end = Host::Harness::Options().discDataSize / BlockDataSize *
+              BlockDataSize;
+    EXPECT(ReadAndCheck(end - 0x20000, 0x20000));
+
+    EXPECT(GetStats(stats));
+    EXPECT(stats->deviceRequests > requests);
+    EXPECT(stats->deviceTransfers > transfers);
+    EXPECT(stats->deviceRequestSectors >= stats->deviceRequests);
+    EXPECT(stats->deviceTransferSectors >= stats->deviceTransfers);
+    EXPECT(stats->deviceCacheHits + stats->deviceCacheMisses > cacheReads);
+
+    IOS_Free(Host::IPCHeap, stats);
+    return true;
+}
+
+HOST_TEST(ImmediateRequests)
+{
+    auto stats = reinterpret_cast<EmuDI::DVDReadStats*>(
+      IOS_AllocAligned(Host::IPCHeap, sizeof(EmuDI::DVDReadStats), 32));
+    auto block = reinterpret_cast<DI::DICommand*>(
+      IOS_AllocAligned(Host::IPCHeap, sizeof(DI::DICommand), 32));
+    auto cover = reinterpret_cast<u32*>(
+      IOS_AllocAligned(Host::IPCHeap, sizeof(u32), 32));
+
+    EXPECT(GetStats(stats));
+    u32 immediate = stats->requestsImmediate;
+    u32 queued = stats->requestsQueued;
+
+    s32 fd = IOS_Open("~dev/di", 0);
+    EXPECT(fd >= 0);
+
+    // Answered by the dispatcher: the open, and the cover register, which
+    // shows the disc as inserted
+    *block = {.cmd = DI::DIIoctl::GetCoverRegister, .args = {0}};
+    *cover = 0xFFFFFFFF;
+    s32 ret = IOS_Ioctl(fd, u32(DI::DIIoctl::GetCoverRegister), block,
+      sizeof(DI::DICommand), cover, sizeof(u32));
+    EXPECT(ret == s32(DI::DIError::OK));
+    EXPECT(*cover == 0);
+
+    // Passed to a worker, as it needs the disc backend
+    auto diskID = reinterpret_cast<DI::DiskID*>(
+      IOS_AllocAligned(Host::IPCHeap, sizeof(DI::DiskID), 32));
+    *block = {.cmd = DI::DIIoctl::ReadDiskID, .args = {0}};
+    ret = IOS_Ioctl(fd, u32(DI::DIIoctl::ReadDiskID), block,
+      sizeof(DI::DICommand), diskID, sizeof(DI::DiskID));
+    EXPECT(ret == s32(DI::DIError::OK));
+    IOS_Close(fd);
+
+    // GetStats opens another handle, then asks for the statistics
+    EXPECT(GetStats(stats));
+    EXPECT(stats->requestsImmediate - immediate == 3);
+    EXPECT(stats->requestsQueued - queued == 4);
+
+    IOS_Free(Host::IPCHeap, diskID);
+    IOS_Free(Host::IPCHeap, cover);
+    IOS_Free(Host::IPCHeap, block);
+    IOS_Free(Host::IPCHeap, stats);
+    return true;
+}
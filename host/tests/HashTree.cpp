@@ -0,0 +1,108 @@
+// HashTree.cpp - Tests of the partition hash tree checks
+//
+// SPDX-License-Identifier: MIT
+
+#include "Host.hpp"
+#include "Image.hpp"
+#include "Test.hpp"
+#include "UncachedISO.hpp"
+#include <FAT/ff.h>
+#include <IOS/System.hpp>
+#include <cstring>
+
+static constexpr u32 BlockSize = 0x8000;
+static constexpr u32 BlockHeaderSize = 0x400;
+static constexpr u32 BlockDataSize = 0x7C00;
+// Partition data offset of the test disc
+static constexpr u32 DataOffset = 0x20000;
+// A group of 64 blocks, and a second group with only some of its blocks
+static constexpr u32 BlockCount = 72;
+static constexpr u32 CorruptBlock = 66;
+static constexpr const char* Path = "0:/hashtree.iso";
+
+/**
+ * Flip a byte in the encrypted data of a block of the image, which garbles
+ * the 16 bytes around it when decrypted.
+ */
+static bool CorruptData(const char* path, u32 block)
+{
+    FIL file;
+    if (f_open(&file, path, FA_READ | FA_WRITE) != FR_OK)
+        return false;
+
+    u64 offset = Host::Disc::PartitionOffset + DataOffset +
+                 u64(block) * BlockSize + BlockHeaderSize + 0x1234;
+    u8 value;
+    UINT count;
+    bool ret = f_lseek(&file, offset) == FR_OK &&
+               f_read(&file, &value, 1, &count) == FR_OK && count == 1;
+
+    value ^= 0x40;
+    ret = ret && f_lseek(&file, offset) == FR_OK &&
+          f_write(&file, &value, 1, &count) == FR_OK && count == 1;
+
+    return f_close(&file) == FR_OK && ret;
+}
+
+static bool ReadBlocks(ISO* iso, u8* buffer, u32 block, u32 count)
+{
+    u32 wordOffset = block * BlockDataSize >> 2;
+    return iso->ReadFromPartition(buffer, wordOffset, count * BlockDataSize) &&
+           Host::Disc::Check(buffer, wordOffset, count * BlockDataSize);
+}
+
+HOST_TEST(HashTreeCorruptBlock)
+{
+    EXPECT(Host::Disc::Write(Path, BlockCount * BlockDataSize, 4));
+    EXPECT(CorruptData(Path, CorruptBlock));
+
+    auto tmd = reinterpret_cast<ES::TMDFixed<512>*>(
+      IOS_AllocAligned(Host::IPCHeap, sizeof(ES::TMDFixed<512>), 32));
+    auto buffer = reinterpret_cast<u8*>(
+      IOS_AllocAligned(Host::IPCHeap, BlockDataSize * 2, 32));
+
+    const Config::DiscVerifyMode modes[] = {Config::DiscVerifyMode::Off,
+      Config::DiscVerifyMode::Lazy, Config::DiscVerifyMode::Strict};
+    for (Config::DiscVerifyMode mode : modes) {
+        const char* path = Path;
+        UncachedISO* iso = new UncachedISO(&path, 1, mode);
+        bool verify = mode != Config::DiscVerifyMode::Off;
+        bool strict = mode == Config::DiscVerifyMode::Strict;
+
+        // The H3 table is checked against the TMD when the partition opens
+        DI::DiskID diskID;
+        EXPECT(iso->ReadDiskID(&diskID));
+        EXPECT(iso->OpenPartition(Host::Disc::PartitionOffset >> 2, tmd) ==
+               DI::DIError::OK);
+        EXPECT(tmd->contents[0].size == u64(BlockCount) * BlockSize);
+
+        // Intact blocks pass, lazy mode only checks them the first time
+        EXPECT(ReadBlocks(iso, buffer, 1, 2));
+        EXPECT(iso->GetReadStats().blocksVerified == (verify ? 2 : 0));
+        EXPECT(ReadBlocks(iso, buffer, 1, 2));
+        EXPECT(iso->GetReadStats().blocksVerified ==
+               (strict ? 4 : verify ? 2 : 0));
+        EXPECT(ReadBlocks(iso, buffer, CorruptBlock - 1, 1));
+        EXPECT(ReadBlocks(iso, buffer, BlockCount - 1, 1));
+
+        // The corrupted block fails every time it's read, unless nothing is
+        // checked and the wrong data is returned
+        u32 verified = iso->GetReadStats().blocksVerified;
+        for (u32 i = 0; i < 2; i++) {
+            EXPECT(iso->ReadFromPartition(buffer,
+                     CorruptBlock * BlockDataSize >> 2, BlockDataSize) ==
+                   !verify);
+        }
+        EXPECT(iso->GetReadStats().verifyFailures == (verify ? 2 : 0));
+        EXPECT(iso->GetReadStats().blocksVerified ==
+               verified + (verify ? 2 : 0));
+        EXPECT(!ReadBlocks(iso, buffer, CorruptBlock, 1));
+
+        delete iso;
+    }
+
+    IOS_Free(Host::IPCHeap, buffer);
+    IOS_Free(Host::IPCHeap, tmd);
+    EXPECT(f_unlink(Path) == FR_OK);
+    return true;
+}
@@ -0,0 +1,134 @@
+// LZ4.cpp - Tests of LZ4 block decompression for compressed disc images
+//
+// SPDX-License-Identifier: MIT
+
+#include "Host.hpp"
+#include "Image.hpp"
+#include "Test.hpp"
+#include <EmuDI/LZ4.hpp>
+#include <IOS/System.hpp>
+#include <cstring>
+
+static constexpr u32 ChunkSize = 0x8000;
+
+/**
+ * Decrypted partition data from PatternStart on, as a compressed image
+ * stores it.
+ */
+static void MakePattern(u8* out, u32 len)
+{
+    for (u32 i = 0; i < len / 4; i++) {
+        u32 value = Host::Disc::PatternWord(Host::Disc::PatternStart / 4 + i);
+        memcpy(out + i * 4, &value, 4);
+    }
+}
+
+/**
+ * A run of zeroes, a short repeated string and bytes that don't repeat.
+ */
+static void MakeMixed(u8* out)
+{
+    memset(out, 0, 0x40);
+    for (u32 i = 0; i < 0x60; i++)
+        out[0x40 + i] = "abc"[i % 3];
+    for (u32 i = 0; i < 0x60; i++)
+        out[0xA0 + i] = u8(i * 37);
+}
+
+static bool RoundTrip(const u8* data, u32 len, u8* compressed, u8* out)
+{
+    u32 size = Host::CompressLZ4(data, len, compressed, ChunkSize);
+    return (size != 0 || len == 0) &&
+           LZ4::Decompress(compressed, size, out, ChunkSize) == s32(len) &&
+           memcmp(out, data, len) == 0;
+}
+
+HOST_TEST(LZ4PythonBlocks)
+{
+    // From lz4.block.compress(data, store_size=False), as used by
+    // tools/compress_disc.py
+    static const u8 pattern[] = {0xFF, 0x11, 0x15, 0x9C, 0x80, 0x6E, 0xC6, 0x15,
+      0xB8, 0x0C, 0x77, 0x8F, 0xEF, 0xAA, 0x28, 0x09, 0x27, 0x49, 0xD9, 0x82,
+      0x5E, 0xE7, 0x8A, 0xFC, 0x95, 0x85, 0x3B, 0x76, 0xCD, 0x23, 0xEC, 0xEF,
+      0x04, 0xC2, 0x20, 0x00, 0x0D, 0xFF, 0x11, 0x25, 0x37, 0xF8, 0x51, 0xD6,
+      0xB0, 0x2F, 0xF0, 0x87, 0x2A, 0x67, 0x8E, 0x38, 0xA4, 0x9E, 0x2C, 0xE9,
+      0x1D, 0xD6, 0xCA, 0x9A, 0x97, 0x0D, 0x69, 0x4B, 0x11, 0x45, 0x07, 0xFC,
+      0x8A, 0x7C, 0xA5, 0x20, 0x00, 0x0D, 0xFF, 0x11, 0x35, 0xD2, 0x6F, 0x35,
+      0xE6, 0x4B, 0xA7, 0xD3, 0x97, 0xC5, 0xDE, 0x71, 0x48, 0x3F, 0x16, 0x10,
+      0xF9, 0xB8, 0x4D, 0xAE, 0xAA, 0x32, 0x85, 0x4C, 0x5B, 0xAC, 0xBC, 0xEA,
+      0x0C, 0x26, 0xF4, 0x88, 0x20, 0x00, 0x0D, 0xFF, 0x11, 0x45, 0x6D, 0xE7,
+      0x18, 0xF6, 0xE6, 0x1E, 0xB7, 0xA7, 0x60, 0x56, 0x55, 0x58, 0xDA, 0x8D,
+      0xF3, 0x09, 0x54, 0xC5, 0x91, 0xBA, 0xCD, 0xFC, 0x2F, 0x6B, 0x47, 0x34,
+      0xCE, 0x1C, 0xC1, 0x6B, 0x6C, 0x20, 0x00, 0x08, 0x50, 0xCE, 0x1C, 0xC1,
+      0x6B, 0x6C};
+    static const u8 mixed[] = {0x1F, 0x00, 0x01, 0x00, 0x2C, 0x3F, 0x61, 0x62,
+      0x63, 0x03, 0x00, 0x4A, 0xF0, 0x51, 0x00, 0x25, 0x4A, 0x6F, 0x94, 0xB9,
+      0xDE, 0x03, 0x28, 0x4D, 0x72, 0x97, 0xBC, 0xE1, 0x06, 0x2B, 0x50, 0x75,
+      0x9A, 0xBF, 0xE4, 0x09, 0x2E, 0x53, 0x78, 0x9D, 0xC2, 0xE7, 0x0C, 0x31,
+      0x56, 0x7B, 0xA0, 0xC5, 0xEA, 0x0F, 0x34, 0x59, 0x7E, 0xA3, 0xC8, 0xED,
+      0x12, 0x37, 0x5C, 0x81, 0xA6, 0xCB, 0xF0, 0x15, 0x3A, 0x5F, 0x84, 0xA9,
+      0xCE, 0xF3, 0x18, 0x3D, 0x62, 0x87, 0xAC, 0xD1, 0xF6, 0x1B, 0x40, 0x65,
+      0x8A, 0xAF, 0xD4, 0xF9, 0x1E, 0x43, 0x68, 0x8D, 0xB2, 0xD7, 0xFC, 0x21,
+      0x46, 0x6B, 0x90, 0xB5, 0xDA, 0xFF, 0x24, 0x49, 0x6E, 0x93, 0xB8, 0xDD,
+      0x02, 0x27, 0x4C, 0x71, 0x96, 0xBB};
+    constexpr u32 Size = 0x100;
+
+    auto expected = reinterpret_cast<u8*>(IOS_Alloc(Host::IPCHeap, Size));
+    auto out = reinterpret_cast<u8*>(IOS_Alloc(Host::IPCHeap, Size));
+
+    MakePattern(expected, Size);
+    EXPECT(LZ4::Decompress(pattern, sizeof(pattern), out, Size) == s32(Size));
+    EXPECT(memcmp(out, expected, Size) == 0);
+
+    // The last literals cut short, or more output than there's room for
+    EXPECT(LZ4::Decompress(pattern, sizeof(pattern) - 1, out, Size) == -1);
+    EXPECT(LZ4::Decompress(pattern, sizeof(pattern), out, Size - 1) == -1);
+
+    // A literal run longer than 15 and an overlapping match
+    MakeMixed(expected);
+    EXPECT(LZ4::Decompress(mixed, sizeof(mixed), out, Size) == s32(Size));
+    EXPECT(memcmp(out, expected, Size) == 0);
+
+    IOS_Free(Host::IPCHeap, out);
+    IOS_Free(Host::IPCHeap, expected);
+    return true;
+}
+
+HOST_TEST(LZ4RoundTrip)
+{
+    auto data = reinterpret_cast<u8*>(IOS_Alloc(Host::IPCHeap, ChunkSize));
+    auto compressed =
+      reinterpret_cast<u8*>(IOS_Alloc(Host::IPCHeap, ChunkSize));
+    auto out = reinterpret_cast<u8*>(IOS_Alloc(Host::IPCHeap, ChunkSize));
+
+    // A whole chunk of the test disc, each 64 byte line half repeated
+    MakePattern(data, ChunkSize);
+    EXPECT(RoundTrip(data, ChunkSize, compressed, out));
+    EXPECT(Host::CompressLZ4(data, ChunkSize, compressed, ChunkSize) <
+           ChunkSize * 3 / 5);
+
+    // Shorter than the format's minimum for a match, and just long enough
+    const u32 sizes[] = {0, 1, 12, 13, 100};
+    for (u32 size : sizes)
+        EXPECT(RoundTrip(data, size, compressed, out));
+
+    MakeMixed(data);
+    EXPECT(RoundTrip(data, 0x100, compressed, out));
+
+    memset(data, 0, ChunkSize);
+    EXPECT(RoundTrip(data, ChunkSize, compressed, out));
+    EXPECT(Host::CompressLZ4(data, ChunkSize, compressed, ChunkSize) < 0x100);
+
+    // Data that doesn't compress doesn't fit, the image stores it as is
+    u32 seed = 1;
+    for (u32 i = 0; i < ChunkSize; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = seed >> 16;
+    }
+    EXPECT(Host::CompressLZ4(data, ChunkSize, compressed, ChunkSize - 1) == 0);
+
+    IOS_Free(Host::IPCHeap, out);
+    IOS_Free(Host::IPCHeap, compressed);
+    IOS_Free(Host::IPCHeap, data);
+    return true;
+}
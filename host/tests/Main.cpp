@@ -0,0 +1,83 @@
+// Main.cpp - Host test runner
+//
+// SPDX-License-Identifier: MIT
+
+#include "Harness.hpp"
+#include "Host.hpp"
+#include "Test.hpp"
+#include <cstring>
+
+static Host::Test::Case* s_first = nullptr;
+static Host::Test::Case* s_last = nullptr;
+
+void Host::Test::Register(Case* test)
+{
+    // In registration order, which is the link order
+    if (s_last == nullptr)
+        s_first = test;
+    else
+        s_last->next = test;
+    s_last = test;
+}
+
+static s32 RunTest(void* arg)
+{
+    return reinterpret_cast<Host::Test::Case*>(arg)->func();
+}
+
+static bool IsSelected(const char* name, int argc, char** argv)
+{
+    bool any = false;
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] == '-') {
+            // Skip the option's argument
+            if (strcmp(argv[i], "--backend") == 0)
+                i++;
+            continue;
+        }
+
+        any = true;
+        if (strstr(name, argv[i]) != nullptr)
+            return true;
+    }
+
+    return !any;
+}
+
+int main(int argc, char** argv)
+{
+    Host::Harness::Options options;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) {
+            options.verbose = true;
+        } else if (strcmp(argv[i], "--backend") == 0 && i + 1 < argc &&
+                   Host::Harness::ParseBackend(
+                     argv[i + 1], &options.discFormat)) {
+            i++;
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr,
+              "usage: %s [-v] [--backend iso|decrypted|compressed] "
+              "[test name filter...]\n",
+              argv[0]);
+            Host::Exit(2);
+        }
+    }
+
+    if (!Host::Harness::Start(options))
+        Host::Exit(1);
+
+    u32 passed = 0;
+    u32 failed = 0;
+    for (Host::Test::Case* test = s_first; test != nullptr; test = test->next) {
+        if (!IsSelected(test->name, argc, argv))
+            continue;
+
+        bool result = Host::RunOnIOS(RunTest, test) == 1;
+        printf("[%s] %s\n", result ? "  OK  " : " FAIL ", test->name);
+        fflush(stdout);
+        (result ? passed : failed)++;
+    }
+
+    printf("%u passed, %u failed\n", passed, failed);
+    Host::Exit(failed == 0 ? 0 : 1);
+}
@@ -0,0 +1,56 @@
+// ReadTrace.cpp - Tests of the DI read trace writer
+//
+// SPDX-License-Identifier: MIT
+
+#include "Test.hpp"
+#include <EmuDI/ReadTrace.hpp>
+#include <FAT/ff.h>
+#include <IOS/System.hpp>
+
+static constexpr u32 RecordCount = 64;
+
+/**
+ * Wait for the trace file to have the header and a number of records.
+ */
+static bool WaitForRecords(const char* path, u32 count, u32 timeoutMs)
+{
+    FSIZE_t size =
+      sizeof(ReadTrace::FileHeader) + count * sizeof(ReadTrace::Record);
+
+    for (u32 i = 0; i < timeoutMs; i += 10) {
+        FILINFO info;
+        if (f_stat(path, &info) == FR_OK && info.fsize == size)
+            return true;
+
+        usleep(10000);
+    }
+
+    return false;
+}
+
+HOST_TEST(ReadTraceFlushRequest)
+{
+    const char* path = "0:/trace_flush.bin";
+    ReadTrace* trace = new ReadTrace(path, RecordCount);
+
+    // Fewer records than wake the writer by themselves
+    for (u32 i = 0; i < 3; i++)
+        trace->Add(0x71, 0, i * 0x100, 0x20, 0);
+
+    trace->RequestFlush();
+    EXPECT(WaitForRecords(path, 3, 500));
+    return true;
+}
+
+HOST_TEST(ReadTraceFlushTimer)
+{
+    const char* path = "0:/trace_timer.bin";
+    ReadTrace* trace = new ReadTrace(path, RecordCount);
+
+    trace->Add(0x71, 0, 0, 0x20, 0);
+    EXPECT(WaitForRecords(path, 1, 5000));
+
+    trace->Add(0x8C, 0, 0, 0, 0);
+    EXPECT(WaitForRecords(path, 2, 5000));
+    return true;
+}
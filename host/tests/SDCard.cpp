@@ -0,0 +1,139 @@
+// SDCard.cpp - Tests of the SD card driver's buffer handling
+//
+// SPDX-License-Identifier: MIT
+
+#include "Harness.hpp"
+#include "Host.hpp"
+#include "Test.hpp"
+#include <Disk/SDCard.hpp>
+#include <FAT/ff.h>
+#include <IOS/System.hpp>
+#include <cstring>
+
+static constexpr u32 SectorSize = 512;
+// Config::GetSDBounceSize
+static constexpr u32 BounceSectors = 32;
+// Too large for one bounce
+static constexpr u32 SectorCount = 50;
+
+/**
+ * First sector of the disc image file, so the data read isn't all zeroes.
+ */
+static u32 FindImageSector()
+{
+    FIL file;
+    if (f_open(&file, "0:/xaa", FA_READ) != FR_OK)
+        return 0;
+
+    u32 sector =
+      file.obj.fs->database + (file.obj.sclust - 2) * file.obj.fs->csize;
+    f_close(&file);
+    return sector;
+}
+
+/**
+ * Read SectorCount sectors to a buffer and check the data against an aligned
+ * read, recording the commands sent to the card for the test range.
+ */
+static u32 ReadAndLog(u32 sector, u8* buffer, Host::SDIO::Command* commands,
+  u32 maxCommands, bool* dataOk)
+{
+    static u8* expected = reinterpret_cast<u8*>(
+      IOS_AllocAligned(Host::IPCHeap, SectorCount * SectorSize, 32));
+
+    *dataOk = SDCard::ReadSectors(sector, SectorCount, expected) >= 0;
+
+    Host::SDIO* sdio = Host::Harness::GetSDIO();
+    memset(buffer, 0xA5, SectorCount * SectorSize);
+    sdio->StartLog();
+    s32 ret = SDCard::ReadSectors(sector, SectorCount, buffer);
+    u32 logCount = sdio->StopLog();
+
+    *dataOk = *dataOk && ret >= 0 &&
+              memcmp(buffer, expected, SectorCount * SectorSize) == 0;
+
+    // Other threads may use the card at the same time
+    u32 count = 0;
+    for (u32 i = 0; i < logCount && count < maxCommands; i++) {
+        const Host::SDIO::Command& command = sdio->GetLogCommand(i);
+        if (!command.isWrite && command.sector < sector + SectorCount &&
+            command.sector + command.count > sector)
+            commands[count++] = command;
+    }
+
+    return count;
+}
+
+HOST_TEST(SDReadUnalignedMEM2)
+{
+    u32 sector = FindImageSector();
+    EXPECT(sector != 0);
+
+    auto alloc = reinterpret_cast<u8*>(IOS_AllocAligned(
+      Host::IPCHeap, SectorCount * SectorSize + 32, 32));
+    u8* buffer = alloc + 4;
+
+    // All but the last sector straight into the buffer at the next aligned
+    // address, then the last sector through the bounce buffer
+    Host::SDIO::Command commands[4];
+    bool dataOk;
+    u32 count = ReadAndLog(sector, buffer, commands, 4, &dataOk);
+    EXPECT(dataOk);
+    EXPECT(count == 2);
+    EXPECT(commands[0].sector == sector);
+    EXPECT(commands[0].count == SectorCount - 1);
+    EXPECT(commands[0].buffer == uintptr_t(alloc + 32));
+    EXPECT(commands[1].sector == sector + SectorCount - 1);
+    EXPECT(commands[1].count == 1);
+
+    IOS_Free(Host::IPCHeap, alloc);
+    return true;
+}
+
+HOST_TEST(SDReadUnalignedMEM1)
+{
+    u32 sector = FindImageSector();
+    EXPECT(sector != 0);
+
+    auto alloc = reinterpret_cast<u8*>(IOS_AllocAligned(
+      Host::MEM1Heap, SectorCount * SectorSize + 32, 32));
+    EXPECT(uintptr_t(alloc) < Host::MEM1Base + Host::MEM1Size);
+    u8* buffer = alloc + 4;
+
+    // In bounce buffer sized chunks, never into the MEM1 buffer itself
+    Host::SDIO::Command commands[4];
+    bool dataOk;
+    u32 count = ReadAndLog(sector, buffer, commands, 4, &dataOk);
+    EXPECT(dataOk);
+    EXPECT(count == 2);
+    EXPECT(commands[0].sector == sector);
+    EXPECT(commands[0].count == BounceSectors);
+    EXPECT(commands[1].sector == sector + BounceSectors);
+    EXPECT(commands[1].count == SectorCount - BounceSectors);
+    EXPECT(commands[0].buffer == commands[1].buffer);
+    EXPECT(commands[0].buffer < uintptr_t(alloc) ||
+           commands[0].buffer >= uintptr_t(alloc) + SectorCount * SectorSize);
+
+    IOS_Free(Host::MEM1Heap, alloc);
+    return true;
+}
+
+HOST_TEST(SDReadAligned)
+{
+    u32 sector = FindImageSector();
+    EXPECT(sector != 0);
+
+    auto buffer = reinterpret_cast<u8*>(
+      IOS_AllocAligned(Host::IPCHeap, SectorCount * SectorSize, 32));
+
+    Host::SDIO::Command commands[4];
+    bool dataOk;
+    u32 count = ReadAndLog(sector, buffer, commands, 4, &dataOk);
+    EXPECT(dataOk);
+    EXPECT(count == 1);
+    EXPECT(commands[0].count == SectorCount);
+    EXPECT(commands[0].buffer == uintptr_t(buffer));
+
+    IOS_Free(Host::IPCHeap, buffer);
+    return true;
+}
@@ -0,0 +1,111 @@
+// SHA.cpp - Tests of SHA-1 hashing on the engine and in software
+//
+// SPDX-License-Identifier: MIT
+
+#include "Harness.hpp"
+#include "Host.hpp"
+#include "Test.hpp"
+#include <IOS/System.hpp>
+#include <System/SHA.hpp>
+#include <algorithm>
+#include <cstring>
+
+static constexpr u32 DataSize = 0x1000;
+
+static u8* GetData()
+{
+    static u8* data = nullptr;
+    if (data == nullptr) {
+        data = reinterpret_cast<u8*>(
+          IOS_AllocAligned(Host::IPCHeap, DataSize + 64, 64));
+        for (u32 i = 0; i < DataSize + 64; i++)
+            data[i] = u8(i * 7 + (i >> 8));
+    }
+    return data;
+}
+
+/**
+ * Hash data in pieces of the given sizes, repeated until len is used up.
+ */
+static bool Hash(bool software, const u8* data, u32 len, const u32* pieces,
+  u32 pieceCount, u8* hashOut)
+{
+    SHA::Context ctx;
+    if (SHA::s_instance->Init(&ctx, software) != IOSError::OK)
+        return false;
+
+    for (u32 i = 0; len != 0; i++) {
+        u32 piece = std::min(pieces[i % pieceCount], len);
+        if (SHA::s_instance->Update(&ctx, data, piece) != IOSError::OK)
+            return false;
+        data += piece;
+        len -= piece;
+    }
+
+    return SHA::s_instance->Final(&ctx, hashOut) == IOSError::OK;
+}
+
+HOST_TEST(SHAKnownHashes)
+{
+    static const u8 abc[] = {0xA9, 0x99, 0x3E, 0x36, 0x47, 0x06, 0x81, 0x6A,
+      0xBA, 0x3E, 0x25, 0x71, 0x78, 0x50, 0xC2, 0x6C, 0x9C, 0xD0, 0xD8, 0x9D};
+    static const u8 empty[] = {0xDA, 0x39, 0xA3, 0xEE, 0x5E, 0x6B, 0x4B, 0x0D,
+      0x32, 0x55, 0xBF, 0xEF, 0x95, 0x60, 0x18, 0x90, 0xAF, 0xD8, 0x07, 0x09};
+
+    u8* data = GetData();
+    for (u32 software = 0; software < 2; software++) {
+        u8 hash[0x14];
+        const u32 whole[] = {DataSize};
+
+        memcpy(data + DataSize, "abc", 3);
+        EXPECT(Hash(software, data + DataSize, 3, whole, 1, hash));
+        EXPECT(memcmp(hash, abc, sizeof(hash)) == 0);
+
+        EXPECT(Hash(software, data, 0, whole, 1, hash));
+        EXPECT(memcmp(hash, empty, sizeof(hash)) == 0);
+    }
+
+    return true;
+}
+
+HOST_TEST(SHAEngineAlignment)
+{
+    static const u32 pieceSets[][3] = {
+      {0x40, 0x40, 0x40},
+      {0x1000, 0x1000, 0x1000},
+      {1, 0x3F, 0x80},
+      {0x1C, 0x200, 0x24},
+      {3, 0x41, 0x7F},
+      {0x45, 0x45, 0x45},
+    };
+
+    static const u32 starts[] = {0, 4, 0x20, 0x3F};
+    static const u32 lengths[] = {0x3F, 0x40, 0x41, 0x7C0, DataSize - 0x40};
+
+    u8* data = GetData();
+    Host::SHAEngine* engine = Host::Harness::GetSHA();
+
+    for (u32 start : starts) {
+        for (u32 len : lengths) {
+            u8 expected[0x14];
+            const u32 whole[] = {len};
+            EXPECT(Hash(true, data + start, len, whole, 1, expected));
+
+            for (const auto& pieces : pieceSets) {
+                u8 hash[0x14];
+                engine->ResetStats();
+                EXPECT(Hash(false, data + start, len, pieces, 3, hash));
+                EXPECT(memcmp(hash, expected, sizeof(hash)) == 0);
+                EXPECT(engine->GetStats().unalignedCommands == 0);
+            }
+        }
+    }
+
+    // Aligned data in whole blocks stays on the engine
+    engine->ResetStats();
+    u8 hash[0x14];
+    const u32 blocks[] = {0x400};
+    EXPECT(Hash(false, data, DataSize, blocks, 1, hash));
+    EXPECT(engine->GetStats().bytesHashed == DataSize);
+    return true;
+}
@@ -0,0 +1,53 @@
+// Test.hpp - Host test runner
+//
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cstdio>
+
+namespace Host::Test
+{
+
+struct Case {
+    const char* name;
+    bool (*func)();
+    Case* next;
+};
+
+/**
+ * Add a test to the list run by hosttest. Used by HOST_TEST from static
+ * constructors, so it can't allocate.
+ */
+void Register(Case* test);
+
+struct Registrar {
+    explicit Registrar(Case* test)
+    {
+        Register(test);
+    }
+};
+
+} // namespace Host::Test
+
+/**
+ * Define a test. It runs on an IOS thread after Harness::Start, and returns
+ * false if it failed.
+ */
+#define HOST_TEST(name)                                                        \
+  static bool HostTest_##name();                                               \
+  static Host::Test::Case HostTestCase_##name = {                              \
+    #name, HostTest_##name, nullptr};                                          \
+  static Host::Test::Registrar HostTestRegistrar_##name(&HostTestCase_##name); \
+  static bool HostTest_##name()
+
+/**
+ * Fail the test if the condition is false.
+ */
+#define EXPECT(cond)                                                           \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      fprintf(stderr, "%s:%d: Expected %s\n", __FILE__, __LINE__, #cond);      \
+      return false;                                                            \
+    }                                                                          \
+  } while (0)
@@ -0,0 +1,222 @@
+// USBStorage.cpp - Tests of USB mass storage transfers
+//
+// SPDX-License-Identifier: MIT
+
+#include "Harness.hpp"
+#include "Host.hpp"
+#include "Test.hpp"
+#include <Disk/USBStorage.hpp>
+#include <IOS/System.hpp>
+#include <System/Util.h>
+#include <cstring>
+
+static constexpr u32 SectorSize = Host::USBVen::DiskBlockSize;
+// USBStorage::BounceSize
+static constexpr u32 BounceSize = 0x4000;
+
+static USBStorage* OpenDisk(u32 devId)
+{
+    auto info = reinterpret_cast<USB::DeviceInfo*>(
+      IOS_AllocAligned(Host::IPCHeap, sizeof(USB::DeviceInfo), 32));
+    USBStorage* storage = nullptr;
+    if (USB::s_instance->GetDeviceInfo(devId, info) == USB::USBError::OK) {
+        storage = new USBStorage(USB::s_instance, *info);
+        if (!storage->Init()) {
+            delete storage;
+            storage = nullptr;
+        }
+    }
+
+    IOS_Free(Host::IPCHeap, info);
+    return storage;
+}
+
+static bool MatchesDisk(u32 devId, u32 sector, const void* data, u32 len)
+{
+    Host::USBVen* usb = Host::Harness::GetUSB();
+    return !memcmp(usb->GetDiskData(devId) + sector * SectorSize, data, len);
+}
+
+static bool IsInside(uintptr_t address, const void* buffer, u32 len)
+{
+    return address >= uintptr_t(buffer) && address < uintptr_t(buffer) + len;
+}
+
+HOST_TEST(USBDirectPacketRounding)
+{
+    // Messages from the caller's buffer are as long as possible in whole
+    // packets, the last one takes the rest
+    constexpr u32 Length = 0x20000;
+    const u32 disks[] = {Host::USBVen::HighSpeedDisk,
+      Host::USBVen::FullSpeedDisk};
+    const u32 maxLengths[] = {round_down<u32>(0xFFFF, 512),
+      round_down<u32>(0xFFFF, 64)};
+
+    Host::USBVen* usb = Host::Harness::GetUSB();
+    auto buffer = reinterpret_cast<u8*>(
+      IOS_AllocAligned(Host::IPCHeap, Length, 32));
+
+    for (u32 i = 0; i < 2; i++) {
+        USBStorage* storage = OpenDisk(disks[i]);
+        EXPECT(storage != nullptr);
+
+        for (bool isWrite : {false, true}) {
+            if (isWrite)
+                memset(buffer, 0x5A + i, Length);
+
+            usb->StartLog();
+            bool ok = isWrite
+                        ? storage->WriteSectors(16, Length / SectorSize, buffer)
+                        : storage->ReadSectors(16, Length / SectorSize, buffer);
+            u32 count = usb->StopLog();
+            EXPECT(ok);
+            EXPECT(MatchesDisk(disks[i], 16, buffer, Length));
+
+            EXPECT(count == Length / maxLengths[i] + 1);
+            for (u32 j = 0; j < count; j++) {
+                const Host::USBVen::Message& msg = usb->GetLogMessage(j);
+                EXPECT(msg.isWrite == isWrite);
+                EXPECT(msg.buffer == uintptr_t(buffer + j * maxLengths[i]));
+                EXPECT(msg.length == (j + 1 < count
+                                         ? maxLengths[i]
+                                         : Length % maxLengths[i]));
+            }
+        }
+
+        delete storage;
+    }
+
+    IOS_Free(Host::IPCHeap, buffer);
+    return true;
+}
+
+HOST_TEST(USBBounced)
+{
+    // Not aligned, and in MEM1, which the host controller can't reach
+    constexpr u32 Length = BounceSize * 4;
+    const s32 heaps[] = {Host::IPCHeap, Host::MEM1Heap};
+    const u32 offsets[] = {4, 0};
+
+    Host::USBVen* usb = Host::Harness::GetUSB();
+    USBStorage* storage = OpenDisk(Host::USBVen::HighSpeedDisk);
+    EXPECT(storage != nullptr);
+
+    for (u32 i = 0; i < 2; i++) {
+        auto alloc = reinterpret_cast<u8*>(
+          IOS_AllocAligned(heaps[i], Length + 32, 32));
+        u8* buffer = alloc + offsets[i];
+
+        usb->StartLog();
+        EXPECT(storage->ReadSectors(64, Length / SectorSize, buffer));
+        u32 count = usb->StopLog();
+        EXPECT(MatchesDisk(Host::USBVen::HighSpeedDisk, 64, buffer, Length));
+
+        // Through the two bounce buffers in turn
+        EXPECT(count == 4);
+        for (u32 j = 0; j < count; j++) {
+            const Host::USBVen::Message& msg = usb->GetLogMessage(j);
+            EXPECT(msg.length == BounceSize);
+            EXPECT(!IsInside(msg.buffer, buffer, Length));
+            EXPECT(msg.buffer == usb->GetLogMessage(j % 2).buffer);
+        }
+        EXPECT(usb->GetLogMessage(1).buffer ==
+               usb->GetLogMessage(0).buffer + BounceSize);
+
+        // One message if it fits in a bounce buffer
+        usb->StartLog();
+        EXPECT(storage->ReadSectors(64, 3, buffer));
+        EXPECT(usb->StopLog() == 1);
+        EXPECT(usb->GetLogMessage(0).length == 3 * SectorSize);
+        EXPECT(MatchesDisk(
+          Host::USBVen::HighSpeedDisk, 64, buffer, 3 * SectorSize));
+
+        IOS_Free(heaps[i], alloc);
+    }
+
+    delete storage;
+    return true;
+}
+
+HOST_TEST(USBVectorGather)
+{
+    constexpr u32 SmallSize = SectorSize;
+    constexpr u32 LargeSize = BounceSize * 2;
+
+    Host::USBVen* usb = Host::Harness::GetUSB();
+    USBStorage* storage = OpenDisk(Host::USBVen::HighSpeedDisk);
+    EXPECT(storage != nullptr);
+
+    u8* small[4];
+    for (u32 i = 0; i < 4; i++) {
+        small[i] = reinterpret_cast<u8*>(
+          IOS_AllocAligned(Host::IPCHeap, SmallSize, 32));
+    }
+    auto large = reinterpret_cast<u8*>(
+      IOS_AllocAligned(Host::IPCHeap, LargeSize, 32));
+
+    // Small buffers are gathered into one message, even though they are
+    // aligned
+    DiskVector smallVec[4];
+    for (u32 i = 0; i < 4; i++)
+        smallVec[i] = {small[i], SmallSize};
+
+    for (bool isWrite : {false, true}) {
+        if (isWrite) {
+            for (u32 i = 0; i < 4; i++)
+                memset(small[i], 0x10 + i, SmallSize);
+        }
+
+        usb->StartLog();
+        EXPECT(isWrite ? storage->WriteSectorsV(200, 4, smallVec, 4)
+                       : storage->ReadSectorsV(200, 4, smallVec, 4));
+        EXPECT(usb->StopLog() == 1);
+        EXPECT(usb->GetLogMessage(0).length == 4 * SmallSize);
+        for (u32 i = 0; i < 4; i++) {
+            EXPECT(!IsInside(usb->GetLogMessage(0).buffer, small[i],
+              SmallSize));
+            EXPECT(MatchesDisk(Host::USBVen::HighSpeedDisk, 200 + i, small[i],
+              SmallSize));
+        }
+    }
+
+    // A large aligned buffer between small ones is used directly
+    DiskVector mixedVec[3] = {
+      {small[0], SmallSize},
+      {large, LargeSize},
+      {small[1], SmallSize},
+    };
+    constexpr u32 MixedSectors = (SmallSize * 2 + LargeSize) / SectorSize;
+
+    for (bool isWrite : {false, true}) {
+        if (isWrite) {
+            memset(small[0], 0x21, SmallSize);
+            memset(large, 0x22, LargeSize);
+            memset(small[1], 0x23, SmallSize);
+        }
+
+        usb->StartLog();
+        EXPECT(isWrite
+                 ? storage->WriteSectorsV(300, MixedSectors, mixedVec, 3)
+                 : storage->ReadSectorsV(300, MixedSectors, mixedVec, 3));
+        EXPECT(usb->StopLog() == 3);
+        EXPECT(usb->GetLogMessage(0).length == SmallSize);
+        EXPECT(!IsInside(usb->GetLogMessage(0).buffer, small[0], SmallSize));
+        EXPECT(usb->GetLogMessage(1).length == LargeSize);
+        EXPECT(usb->GetLogMessage(1).buffer == uintptr_t(large));
+        EXPECT(usb->GetLogMessage(2).length == SmallSize);
+        EXPECT(!IsInside(usb->GetLogMessage(2).buffer, small[1], SmallSize));
+
+        EXPECT(
+          MatchesDisk(Host::USBVen::HighSpeedDisk, 300, small[0], SmallSize));
+        EXPECT(MatchesDisk(Host::USBVen::HighSpeedDisk, 301, large, LargeSize));
+        EXPECT(MatchesDisk(Host::USBVen::HighSpeedDisk,
+          301 + LargeSize / SectorSize, small[1], SmallSize));
+    }
+
+    IOS_Free(Host::IPCHeap, large);
+    for (u32 i = 0; i < 4; i++)
+        IOS_Free(Host::IPCHeap, small[i]);
+
+    delete storage;
+    return true;
+}
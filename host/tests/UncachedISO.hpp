@@ -0,0 +1,48 @@
+// UncachedISO.hpp - Second disc image for the host tests
+//
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "Host.hpp"
+#include <EmuDI/BlockCache.hpp>
+#include <EmuDI/ISO.hpp>
+#include <IOS/System.hpp>
+
+/**
+ * Encrypted image with its raw block buffers in the IPC heap and no block
+ * cache, as the system heap has no room for a second image's buffers next to
+ * the module's.
+ */
+class UncachedISO : public ISO
+{
+public:
+    static constexpr u32 BlockDataSize = 0x7C00;
+
+    UncachedISO(const char* const* paths, u32 count)
+      : UncachedISO(paths, count, Config::s_instance->GetDiscVerifyMode())
+    {
+    }
+
+    UncachedISO(
+      const char* const* paths, u32 count, Config::DiscVerifyMode verifyMode)
+      : ISO(paths, count, false)
+    {
+        m_isEncrypted = true;
+        m_verifyMode = verifyMode;
+        for (u32 i = 0; i < 2; i++) {
+            m_dataBlock[i] = reinterpret_cast<u8*>(
+              IOS_AllocAligned(Host::IPCHeap, BlockSize, 32));
+        }
+        m_aesQueue = new Queue<IOS::Request*>(1);
+        m_blockCache = new BlockCache(0, BlockDataSize);
+    }
+
+    ~UncachedISO()
+    {
+        for (u32 i = 0; i < 2; i++) {
+            IOS_Free(Host::IPCHeap, m_dataBlock[i]);
+            m_dataBlock[i] = nullptr;
+        }
+    }
+};
@@ -137,28 +137,31 @@ bool DeviceMgr::DeviceRead(u32 devId, void* data, u32 sector, u32 count)
         return false;
     }
 
-    if (std::holds_alternative<SDCard>(dev->disk)) {
-        auto ret = SDCard::ReadSectors(sector, count, data);
-        if (ret == IOSError::OK)
-            return true;
+    dev->transferStats.requests++;
+    dev->transferStats.requestSectors += count;
 
-        SetError(devId);
-        PRINT(IOS_DevMgr, ERROR, "SDCard::ReadSectors failed: %08X", ret);
-        return false;
-    }
+    if (dev->cache != nullptr && dev->cache->Read(data, sector, count))
+        return true;
 
-    if (std::holds_alternative<USBStorage>(dev->disk)) {
-        USBStorage& disk = std::get<USBStorage>(dev->disk);
-        if (disk.ReadSectors(sector, count, data))
-            return true;
+    // Read small requests together with the sectors around them, which
+    // FatFS will likely ask for next. Don't read past the end of the volume,
+    // the device may end there.
+    if (dev->cache != nullptr && count <= SectorCache::MaxCachedCount) {
+        u32 limit = 0;
+        if (dev->fs.fs_type != 0)
+            limit = dev->fs.database + (dev->fs.n_fatent - 2) * dev->fs.csize;
 
-        SetError(devId);
-        PRINT(IOS_DevMgr, ERROR, "USBStorage::ReadSectors failed");
-        return false;
+        return dev->cache->ReadThrough(data, sector, count, limit);
     }
 
-    PRINT(IOS_DevMgr, ERROR, "Device not recognized: %u", devId);
-    return false;
+    DiskVector vec = {data, count * SectorCache::SectorSize};
+    if (!TransferDisk(devId, false, sector, count, &vec, 1))
+        return false;
+
+    if (dev->cache != nullptr)
+        dev->cache->Fill(data, sector, count);
+
+    return true;
 }
 
 bool DeviceMgr::DeviceWrite(u32 devId, const void* data, u32 sector, u32 count)
@@ -171,23 +174,52 @@ bool DeviceMgr::DeviceWrite(u32 devId, const void* data, u32 sector, u32 count)
         return false;
     }
 
+    dev->transferStats.requests++;
+    dev->transferStats.requestSectors += count;
+
+    if (dev->cache != nullptr && dev->cache->Write(data, sector, count))
+        return true;
+
+    DiskVector vec = {
+      const_cast<void*>(data), count * SectorCache::SectorSize};
+    if (!TransferDisk(devId, true, sector, count, &vec, 1))
+        return false;
+
+    if (dev->cache != nullptr)
+        dev->cache->Update(data, sector, count);
+
+    return true;
+}
+
+bool DeviceMgr::TransferDisk(u32 devId, bool isWrite, u32 sector, u32 count,
+  const DiskVector* vec, u32 vecCount)
+{
+    DeviceHandle* dev = &m_devices[devId];
+
+    dev->transferStats.transfers++;
+    dev->transferStats.transferSectors += count;
+
     if (std::holds_alternative<SDCard>(dev->disk)) {
-        auto ret = SDCard::WriteSectors(sector, count, data);
-        if (ret == 0)
+        auto ret = isWrite ? SDCard::WriteSectorsV(sector, count, vec, vecCount)
+                           : SDCard::ReadSectorsV(sector, count, vec, vecCount);
+        if (ret >= 0)
             return true;
 
         SetError(devId);
-        PRINT(IOS_DevMgr, ERROR, "SDCard::WriteSectors failed: %08X", ret);
+        PRINT(IOS_DevMgr, ERROR, "SDCard::%sSectors failed: %08X",
+          isWrite ? "Write" : "Read", ret);
         return false;
     }
 
     if (std::holds_alternative<USBStorage>(dev->disk)) {
         USBStorage& disk = std::get<USBStorage>(dev->disk);
-        if (disk.WriteSectors(sector, count, data))
+        if (isWrite ? disk.WriteSectorsV(sector, count, vec, vecCount)
+                    : disk.ReadSectorsV(sector, count, vec, vecCount))
             return true;
 
         SetError(devId);
-        PRINT(IOS_DevMgr, ERROR, "USBStorage::WriteSectors failed");
+        PRINT(IOS_DevMgr, ERROR, "USBStorage::%sSectors failed",
+          isWrite ? "Write" : "Read");
         return false;
     }
 
@@ -195,6 +227,13 @@ bool DeviceMgr::DeviceWrite(u32 devId, const void* data, u32 sector, u32 count)
     return false;
 }
 
+bool DeviceMgr::Transfer(u32 devId, bool isWrite, u32 sector, u32 count,
+  const DiskVector* vec, u32 vecCount)
+{
+    return s_instance->TransferDisk(
+      devId, isWrite, sector, count, vec, vecCount);
+}
+
 bool DeviceMgr::DeviceSync(u32 devId)
 {
     ASSERT(devId < DeviceCount);
@@ -205,6 +244,9 @@ bool DeviceMgr::DeviceSync(u32 devId)
         return false;
     }
 
+    if (dev->cache != nullptr && !dev->cache->Flush())
+        return false;
+
     if (std::holds_alternative<SDCard>(dev->disk)) {
         return true;
     }
@@ -223,6 +265,24 @@ bool DeviceMgr::DeviceSync(u32 devId)
     return false;
 }
 
+bool DeviceMgr::GetCacheStats(u32 devId, SectorCache::Stats* stats)
+{
+    ASSERT(devId < DeviceCount);
+
+    if (m_devices[devId].cache == nullptr)
+        return false;
+
+    *stats = m_devices[devId].cache->GetStats();
+    return true;
+}
+
+DeviceMgr::TransferStats DeviceMgr::GetTransferStats(u32 devId)
+{
+    ASSERT(devId < DeviceCount);
+
+    return m_devices[devId].transferStats;
+}
+
 void DeviceMgr::Run()
 {
     PRINT(IOS_DevMgr, INFO, "Entering DeviceMgr...");
@@ -375,7 +435,7 @@ void DeviceMgr::USBChange(USB::DeviceEntry* devices, u32 count)
         PRINT(IOS_DevMgr, INFO, "Using device %u", k);
 
         auto dev = &m_devices[k];
-        dev->disk = USBStorage(USB::s_instance, info);
+        dev->disk.emplace<USBStorage>(USB::s_instance, info);
 
         m_usbDevices[j].intId = k;
         dev->inserted = true;
@@ -393,6 +453,59 @@ void DeviceMgr::InitHandle(u32 devId)
     m_devices[devId].inserted = false;
     m_devices[devId].error = false;
     m_devices[devId].mounted = false;
+    m_devices[devId].cache = nullptr;
+    m_devices[devId].transferStats = {};
+}
+
+void DeviceMgr::CreateCache(u32 devId)
+{
+    u32 sectorCount = Config::s_instance->GetSectorCacheSize();
+    if (sectorCount == 0)
+        return;
+
+    auto cache = new SectorCache(devId, sectorCount,
+      Config::s_instance->IsSectorCacheWriteBack(), Transfer);
+    if (!cache->IsValid()) {
+        PRINT(IOS_DevMgr, WARN, "Not enough memory for the sector cache");
+        delete cache;
+        return;
+    }
+
+    m_devices[devId].cache = cache;
+    m_devices[devId].transferStats = {};
+}
+
+void DeviceMgr::DestroyCache(u32 devId)
+{
+    SectorCache* cache = m_devices[devId].cache;
+    if (cache == nullptr)
+        return;
+
+    // The device is already gone, so anything not yet written is lost
+    u32 lost = cache->Discard();
+    if (lost != 0) {
+        PRINT(IOS_DevMgr, WARN, "Device %u removed with %u unwritten sectors",
+          devId, lost);
+    }
+
+    auto stats = cache->GetStats();
+    PRINT(IOS_DevMgr, INFO,
+      "Sector cache: %u hits, %u misses, %u evictions, %u write-backs",
+      stats.hits, stats.misses, stats.evictions, stats.writeBacks);
+
+    // Average bytes per FatFS request and per device transfer
+    auto& transferStats = m_devices[devId].transferStats;
+    if (transferStats.requests != 0 && transferStats.transfers != 0) {
+        PRINT(IOS_DevMgr, INFO,
+          "Average transfer size: %u bytes requested, %u bytes transferred",
+          u32((u64) transferStats.requestSectors * SectorCache::SectorSize /
+              transferStats.requests),
+          u32((u64) transferStats.transferSectors * SectorCache::SectorSize /
+              transferStats.transfers));
+    }
+
+    m_devices[devId].cache = nullptr;
+    delete cache;
 }
 
 void DeviceMgr::UpdateHandle(u32 devId)
@@ -429,6 +542,7 @@ void DeviceMgr::UpdateHandle(u32 devId)
         str[0] = devId + '0';
 
         FRESULT fret = f_unmount(str);
+        DestroyCache(devId);
         if (fret != FR_OK) {
             PRINT(IOS_DevMgr, ERROR, "Failed to unmount device %d: %d", devId,
               fret);
@@ -455,10 +569,13 @@ void DeviceMgr::UpdateHandle(u32 devId)
         char str[16] = "0:";
         str[0] = devId + '0';
 
+        CreateCache(devId);
+
         FRESULT fret = f_mount(&dev->fs, str, 0);
         if (fret != FR_OK) {
             PRINT(
               IOS_DevMgr, ERROR, "Failed to mount device %d: %d", devId, fret);
+            DestroyCache(devId);
             dev->error = true;
             dev->enabled = false;
             return;
@@ -6,6 +6,7 @@
 #pragma once
 
 #include <Disk/SDCard.hpp>
+#include <Disk/SectorCache.hpp>
 #include <Disk/USB.hpp>
 #include <Disk/USBStorage.hpp>
 #include <FAT/ff.h>
@@ -47,13 +48,40 @@ public:
     bool DeviceWrite(u32 devId, const void* data, u32 sector, u32 count);
     bool DeviceSync(u32 devId);
 
+    /**
+     * Get the sector cache statistics of a mounted device.
+     * @returns False if the device has no cache.
+     */
+    bool GetCacheStats(u32 devId, SectorCache::Stats* stats);
+
+    struct TransferStats {
+        // Reads and writes from FatFS
+        u32 requests;
+        u32 requestSectors;
+        // Commands sent to the device, after merging requests and cache
+        // fills
+        u32 transfers;
+        u32 transferSectors;
+    };
+
+    TransferStats GetTransferStats(u32 devId);
+
 private:
     void Run();
     static s32 ThreadEntry(void* arg);
 
+    bool TransferDisk(u32 devId, bool isWrite, u32 sector, u32 count,
+      const DiskVector* vec, u32 vecCount);
+    static bool Transfer(u32 devId, bool isWrite, u32 sector, u32 count,
+      const DiskVector* vec, u32 vecCount);
+
     struct DeviceHandle {
         FATFS fs;
         std::variant<SDCard, USBStorage> disk;
+        // Created when the device is mounted, null if disabled or if there
+        // wasn't enough memory
+        SectorCache* cache;
+        TransferStats transferStats;
         bool enabled;
         bool inserted;
         bool error;
@@ -61,6 +89,8 @@ private:
     };
 
     void InitHandle(u32 devId);
+    void CreateCache(u32 devId);
+    void DestroyCache(u32 devId);
     void UpdateHandle(u32 devId);
     bool OpenLogFile();
 
@@ -0,0 +1,79 @@
+// DiskVector.hpp - Vectored storage device transfers
+//
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <System/Types.h>
+#include <algorithm>
+#include <cstring>
+
+/**
+ * One of the buffers of a transfer of a contiguous sector run.
+ */
+struct DiskVector {
+    void* data;
+    u32 len;
+};
+
+/**
+ * Walks the buffers of a vectored transfer, copying to or from a linear
+ * bounce buffer.
+ */
+class DiskVectorCursor
+{
+public:
+    DiskVectorCursor(const DiskVector* vec, u32 count)
+      : m_vec(vec)
+      , m_count(count)
+    {
+    }
+
+    /**
+     * Copy the next bytes of the transfer into the buffers.
+     */
+    void Write(const void* src, u32 len)
+    {
+        const u8* bytes = reinterpret_cast<const u8*>(src);
+        while (len != 0 && m_index < m_count) {
+            u32 copyLen = std::min(len, m_vec[m_index].len - m_offset);
+            memcpy(reinterpret_cast<u8*>(m_vec[m_index].data) + m_offset, bytes,
+              copyLen);
+            bytes += copyLen;
+            len -= copyLen;
+            Advance(copyLen);
+        }
+    }
+
+    /**
+     * Copy the next bytes of the transfer out of the buffers.
+     */
+    void Read(void* dst, u32 len)
+    {
+        u8* bytes = reinterpret_cast<u8*>(dst);
+        while (len != 0 && m_index < m_count) {
+            u32 copyLen = std::min(len, m_vec[m_index].len - m_offset);
+            memcpy(bytes,
+              reinterpret_cast<const u8*>(m_vec[m_index].data) + m_offset,
+              copyLen);
+            bytes += copyLen;
+            len -= copyLen;
+            Advance(copyLen);
+        }
+    }
+
+private:
+    void Advance(u32 len)
+    {
+        m_offset += len;
+        if (m_offset == m_vec[m_index].len) {
+            m_index++;
+            m_offset = 0;
+        }
+    }
+
+    const DiskVector* m_vec;
+    u32 m_count;
+    u32 m_index = 0;
+    u32 m_offset = 0;
+};
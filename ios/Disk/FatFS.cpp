@@ -165,7 +165,7 @@ int ff_del_syncobj(FF_SYNC_t sobj)
 
 void* ff_memcpy(void* dst, const void* src, UINT len)
 {
-    if (u32(dst) < 0x02000000) {
+    if (uintptr_t(dst) < 0x02000000) {
         // MEM1
         System::UnalignedMemcpy(dst, src, len);
     } else {
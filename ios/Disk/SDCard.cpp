@@ -30,6 +30,7 @@
  */
 
 #include "SDCard.hpp"
+#include <System/Config.hpp>
 #include <System/OS.hpp>
 #include <System/Util.h>
 #include <string.h>
@@ -115,6 +116,11 @@
 
 static u8 rw_buffer[SDIO_HEAPSIZE] ATTRIBUTE_ALIGN(32);
 
+// Used for transfers to and from unaligned buffers. Replaced with a larger
+// buffer from the heap on startup if the config asks for one.
+static u8* bounce_buffer = rw_buffer;
+static u32 bounce_sectors = SDIO_HEAPSIZE / PAGE_SIZE512;
+
 struct _sdiorequest {
     u32 cmd;
     u32 cmd_type;
@@ -159,6 +165,21 @@ static inline void SyncBeforeWrite(
 #endif
 }
 
+/*
+ * Copy read data out of the bounce buffer, using word accesses if the
+ * destination is in MEM1, like ff_memcpy.
+ */
+static inline void CopyToBuffer(void* dst, const void* src, u32 len)
+{
+#ifdef TARGET_IOS
+    if ((uintptr_t) dst < 0x02000000) {
+        System::UnalignedMemcpy(dst, src, len);
+        return;
+    }
+#endif
+    memcpy(dst, src, len);
+}
+
 static s32 __sdio_sendcommand(u32 cmd, u32 cmd_type, u32 rsp_type, u32 arg,
   u32 blk_cnt, u32 blk_size, void* buffer, void* reply, u32 rlen)
 {
@@ -571,6 +592,57 @@ bool SDCard::Open()
     return false;
 }
 
+static void __sd0_allocbounce()
+{
+#ifdef TARGET_IOS
+    if (bounce_buffer != rw_buffer)
+        return;
+
+    u32 count = Config::s_instance->GetSDBounceSize();
+    if (count <= bounce_sectors)
+        return;
+
+    // Not required, keep using the static buffer if memory is short
+    void* pool =
+      IOS_AllocAligned(System::GetHeap(), count * PAGE_SIZE512, 32);
+    if (pool == NULL)
+        return;
+
+    bounce_buffer = (u8*) pool;
+    bounce_sectors = count;
+#endif
+}
+
+static s32 __sd0_readblocks(sec_t sector, sec_t numSectors, void* buffer)
+{
+    u32 blk_off;
+
+    if (__sd0_sdhc == 0)
+        blk_off = (sector * PAGE_SIZE512);
+    else
+        blk_off = sector;
+
+    SyncBeforeRead(buffer, PAGE_SIZE512 * numSectors);
+    return __sdio_sendcommand(SDIO_CMD_READMULTIBLOCK, SDIOCMD_TYPE_AC,
+      SDIO_RESPONSE_R1, blk_off, numSectors, PAGE_SIZE512, buffer, NULL, 0);
+}
+
+static s32 __sd0_writeblocks(
+  sec_t sector, sec_t numSectors, const void* buffer)
+{
+    u32 blk_off;
+
+    if (__sd0_sdhc == 0)
+        blk_off = (sector * PAGE_SIZE512);
+    else
+        blk_off = sector;
+
+    SyncBeforeWrite(buffer, PAGE_SIZE512 * numSectors);
+    return __sdio_sendcommand(SDIO_CMD_WRITEMULTIBLOCK, SDIOCMD_TYPE_AC,
+      SDIO_RESPONSE_R1, blk_off, numSectors, PAGE_SIZE512, (void*) buffer,
+      NULL, 0);
+}
+
 bool SDCard::Startup()
 {
     if (__sdio_initialized == 1)
@@ -579,6 +651,8 @@ bool SDCard::Startup()
     if (__sd0_initio() == false)
         return false;
 
+    __sd0_allocbounce();
+
     __sdio_initialized = 1;
     return true;
 }
@@ -596,7 +670,6 @@ s32 SDCard::ReadSectors(sec_t sector, sec_t numSectors, void* buffer)
 {
     s32 ret;
     u8* ptr;
-    sec_t blk_off;
 
     if (buffer == NULL)
         return -1;
@@ -605,36 +678,38 @@ s32 SDCard::ReadSectors(sec_t sector, sec_t numSectors, void* buffer)
     if (ret < 0)
         return ret;
 
-    if ((u32) buffer & 0x1F) {
-        ptr = (u8*) buffer;
-        int secs_to_read;
+    ptr = (u8*) buffer;
+    if (aligned(buffer, 32)) {
+        ret = __sd0_readblocks(sector, numSectors, buffer);
+    } else if (numSectors > bounce_sectors &&
+               (uintptr_t) buffer >= 0x02000000) {
+        // Too large for one bounce. Read all but the last sector to the first
+        // aligned address in the buffer and move it down into place, then
+        // read the last sector through the bounce buffer. MEM1 only takes
+        // word writes and UnalignedMemcpy can't move overlapping data, so a
+        // MEM1 buffer is read in chunks instead.
+        u8* middle = round_up(ptr, 32);
+        ret = __sd0_readblocks(sector, numSectors - 1, middle);
+        if (ret >= 0) {
+            memmove(ptr, middle, PAGE_SIZE512 * (numSectors - 1));
+            ret = __sd0_readblocks(sector + numSectors - 1, 1, bounce_buffer);
+        }
+        if (ret >= 0) {
+            memcpy(ptr + PAGE_SIZE512 * (numSectors - 1), bounce_buffer,
+              PAGE_SIZE512);
+        }
+    } else {
         while (numSectors > 0) {
-            if (__sd0_sdhc == 0)
-                blk_off = (sector * PAGE_SIZE512);
-            else
-                blk_off = sector;
-            if (numSectors > 8)
-                secs_to_read = 8;
-            else
-                secs_to_read = numSectors;
-            SyncBeforeRead(rw_buffer, secs_to_read * PAGE_SIZE512);
-            ret = __sdio_sendcommand(SDIO_CMD_READMULTIBLOCK, SDIOCMD_TYPE_AC,
-              SDIO_RESPONSE_R1, blk_off, secs_to_read, PAGE_SIZE512, rw_buffer,
-              NULL, 0);
-            if (ret >= 0) {
-                memcpy(ptr, rw_buffer, PAGE_SIZE512 * secs_to_read);
-                ptr += PAGE_SIZE512 * secs_to_read;
-                sector += secs_to_read;
-                numSectors -= secs_to_read;
-            } else
+            sec_t secs_to_read = std::min<sec_t>(numSectors, bounce_sectors);
+            ret = __sd0_readblocks(sector, secs_to_read, bounce_buffer);
+            if (ret < 0)
                 break;
+
+            CopyToBuffer(ptr, bounce_buffer, PAGE_SIZE512 * secs_to_read);
+            ptr += PAGE_SIZE512 * secs_to_read;
+            sector += secs_to_read;
+            numSectors -= secs_to_read;
         }
-    } else {
-        if (__sd0_sdhc == 0)
-            sector *= PAGE_SIZE512;
-        SyncBeforeRead(buffer, PAGE_SIZE512 * numSectors);
-        ret = __sdio_sendcommand(SDIO_CMD_READMULTIBLOCK, SDIOCMD_TYPE_AC,
-          SDIO_RESPONSE_R1, sector, numSectors, PAGE_SIZE512, buffer, NULL, 0);
     }
 
     __sd0_deselect();
@@ -645,8 +720,7 @@ s32 SDCard::ReadSectors(sec_t sector, sec_t numSectors, void* buffer)
 s32 SDCard::WriteSectors(sec_t sector, sec_t numSectors, const void* buffer)
 {
     s32 ret;
-    u8* ptr;
-    u32 blk_off;
+    const u8* ptr;
 
     if (buffer == NULL)
         return -1;
@@ -655,37 +729,83 @@ s32 SDCard::WriteSectors(sec_t sector, sec_t numSectors, const void* buffer)
     if (ret < 0)
         return ret;
 
-    if ((u32) buffer & 0x1F) {
-        ptr = (u8*) buffer;
-        int secs_to_write;
+    ptr = (const u8*) buffer;
+    if (aligned(buffer, 32)) {
+        ret = __sd0_writeblocks(sector, numSectors, buffer);
+    } else {
         while (numSectors > 0) {
-            if (__sd0_sdhc == 0)
-                blk_off = (sector * PAGE_SIZE512);
-            else
-                blk_off = sector;
-            if (numSectors > 8)
-                secs_to_write = 8;
-            else
-                secs_to_write = numSectors;
-            memcpy(rw_buffer, ptr, PAGE_SIZE512 * secs_to_write);
-            SyncBeforeWrite(rw_buffer, PAGE_SIZE512 * secs_to_write);
-            ret = __sdio_sendcommand(SDIO_CMD_WRITEMULTIBLOCK, SDIOCMD_TYPE_AC,
-              SDIO_RESPONSE_R1, blk_off, secs_to_write, PAGE_SIZE512, rw_buffer,
-              NULL, 0);
-            if (ret >= 0) {
-                ptr += PAGE_SIZE512 * secs_to_write;
-                sector += secs_to_write;
-                numSectors -= secs_to_write;
-            } else
+            sec_t secs_to_write = std::min<sec_t>(numSectors, bounce_sectors);
+            memcpy(bounce_buffer, ptr, PAGE_SIZE512 * secs_to_write);
+            ret = __sd0_writeblocks(sector, secs_to_write, bounce_buffer);
+            if (ret < 0)
                 break;
+
+            ptr += PAGE_SIZE512 * secs_to_write;
+            sector += secs_to_write;
+            numSectors -= secs_to_write;
         }
-    } else {
-        if (__sd0_sdhc == 0)
-            sector *= PAGE_SIZE512;
-        SyncBeforeWrite(buffer, PAGE_SIZE512 * numSectors);
-        ret = __sdio_sendcommand(SDIO_CMD_WRITEMULTIBLOCK, SDIOCMD_TYPE_AC,
-          SDIO_RESPONSE_R1, sector, numSectors, PAGE_SIZE512, (char*) buffer,
-          NULL, 0);
+    }
+
+    __sd0_deselect();
+
+    return ret;
+}
+
+/*
+ * Vectored transfers go through the bounce buffer, so a run that fits in it
+ * is a single command.
+ */
+s32 SDCard::ReadSectorsV(
+  sec_t sector, sec_t numSectors, const DiskVector* vec, u32 vecCount)
+{
+    s32 ret;
+
+    if (vecCount == 1)
+        return ReadSectors(sector, numSectors, vec[0].data);
+
+    ret = __sd0_select();
+    if (ret < 0)
+        return ret;
+
+    DiskVectorCursor cursor(vec, vecCount);
+    while (numSectors > 0) {
+        sec_t secs_to_read = std::min<sec_t>(numSectors, bounce_sectors);
+        ret = __sd0_readblocks(sector, secs_to_read, bounce_buffer);
+        if (ret < 0)
+            break;
+
+        cursor.Write(bounce_buffer, PAGE_SIZE512 * secs_to_read);
+        sector += secs_to_read;
+        numSectors -= secs_to_read;
+    }
+
+    __sd0_deselect();
+
+    return ret;
+}
+
+s32 SDCard::WriteSectorsV(
+  sec_t sector, sec_t numSectors, const DiskVector* vec, u32 vecCount)
+{
+    s32 ret;
+
+    if (vecCount == 1)
+        return WriteSectors(sector, numSectors, vec[0].data);
+
+    ret = __sd0_select();
+    if (ret < 0)
+        return ret;
+
+    DiskVectorCursor cursor(vec, vecCount);
+    while (numSectors > 0) {
+        sec_t secs_to_write = std::min<sec_t>(numSectors, bounce_sectors);
+        cursor.Read(bounce_buffer, PAGE_SIZE512 * secs_to_write);
+        ret = __sd0_writeblocks(sector, secs_to_write, bounce_buffer);
+        if (ret < 0)
+            break;
+
+        sector += secs_to_write;
+        numSectors -= secs_to_write;
     }
 
     __sd0_deselect();
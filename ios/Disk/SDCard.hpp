@@ -3,6 +3,7 @@
 // SPDX-License-Identifier: MIT
 
 #pragma once
+#include <Disk/DiskVector.hpp>
 #include <System/Types.h>
 
 typedef u32 sec_t;
@@ -15,6 +16,10 @@ public:
     static bool Shutdown();
     static s32 ReadSectors(sec_t sector, sec_t numSectors, void* buffer);
     static s32 WriteSectors(sec_t sector, sec_t numSectors, const void* buffer);
+    static s32 ReadSectorsV(
+      sec_t sector, sec_t numSectors, const DiskVector* vec, u32 vecCount);
+    static s32 WriteSectorsV(
+      sec_t sector, sec_t numSectors, const DiskVector* vec, u32 vecCount);
     static bool ClearStatus();
     static bool IsInserted();
     static bool IsInitialized();
@@ -0,0 +1,395 @@
+// SectorCache.cpp - Storage device sector cache
+//
+// SPDX-License-Identifier: MIT
+
+#include "SectorCache.hpp"
+#include <IOS/Syscalls.h>
+#include <IOS/System.hpp>
+#include <algorithm>
+#include <cstring>
+
+/**
+ * Copy sector data, using word accesses if the destination is in MEM1, like
+ * ff_memcpy.
+ */
+static void CopySector(void* dst, const void* src)
+{
+    if (uintptr_t(dst) < 0x02000000) {
+        System::UnalignedMemcpy(dst, src, SectorCache::SectorSize);
+    } else {
+        memcpy(dst, src, SectorCache::SectorSize);
+    }
+}
+
+SectorCache::SectorCache(
+  u32 devId, u32 sectorCount, bool writeBack, TransferFunc transfer)
+{
+    m_devId = devId;
+    // The longest run must not replace its own sectors
+    m_sectorCount = std::max(sectorCount, MaxRunCount * 2);
+    m_writeBack = writeBack;
+    m_transfer = transfer;
+
+    // Not using new, the cache is optional if memory is short
+    m_entries = reinterpret_cast<Entry*>(
+      IOS_Alloc(System::GetHeap(), m_sectorCount * sizeof(Entry)));
+    if (m_entries == nullptr)
+        return;
+
+    m_data = reinterpret_cast<u8*>(IOS_AllocAligned(
+      System::GetHeap(), (m_sectorCount + 1) * SectorSize, 32));
+    if (m_data == nullptr)
+        return;
+
+    m_scratch = GetSlot(m_sectorCount);
+
+    for (u32 i = 0; i < m_sectorCount; i++) {
+        m_entries[i] = {
+          .sector = InvalidSector,
+          .referenced = false,
+          .dirty = false,
+        };
+    }
+}
+
+SectorCache::~SectorCache()
+{
+    if (m_entries != nullptr)
+        IOS_Free(System::GetHeap(), m_entries);
+
+    if (m_data != nullptr)
+        IOS_Free(System::GetHeap(), m_data);
+}
+
+bool SectorCache::Read(void* out, u32 sector, u32 count)
+{
+    if (count > MaxCachedCount)
+        return false;
+
+    m_mutex.lock();
+
+    u32 indices[MaxCachedCount];
+    for (u32 i = 0; i < count; i++) {
+        indices[i] = Find(sector + i);
+        if (indices[i] == InvalidSector) {
+            m_stats.misses += count;
+            m_mutex.unlock();
+            return false;
+        }
+    }
+
+    for (u32 i = 0; i < count; i++) {
+        m_entries[indices[i]].referenced = true;
+        CopySector(reinterpret_cast<u8*>(out) + i * SectorSize,
+          GetSlot(indices[i]));
+    }
+
+    m_stats.hits += count;
+    m_mutex.unlock();
+
+    return true;
+}
+
+bool SectorCache::ReadThrough(void* out, u32 sector, u32 count, u32 limit)
+{
+    if (count > MaxCachedCount)
+        return false;
+
+    m_mutex.lock();
+
+    // Extend the read to the group boundaries on both sides, but not over
+    // sectors that are already cached at either end
+    u32 end = sector + count;
+    u32 runStart = sector - sector % FillCount;
+    u32 runEnd = std::max(
+      std::min((end + FillCount - 1) / FillCount * FillCount, limit), end);
+
+    while (runStart < sector && Find(runStart) != InvalidSector)
+        runStart++;
+    while (runEnd > end && Find(runEnd - 1) != InvalidSector)
+        runEnd--;
+
+    m_pinStart = runStart;
+    m_pinEnd = runEnd;
+
+    DiskVector vec[MaxRunCount];
+    u32 allocated[MaxRunCount];
+    u32 vecCount = 0;
+    u32 allocCount = 0;
+
+    for (u32 s = runStart; s < runEnd; s++) {
+        if (s == sector) {
+            vec[vecCount++] = {out, count * SectorSize};
+            s = end - 1;
+            continue;
+        }
+
+        // A sector in the middle may be cached and newer than the device
+        u8* data = m_scratch;
+        if (Find(s) == InvalidSector) {
+            allocated[allocCount] = Allocate(s);
+            data = GetSlot(allocated[allocCount++]);
+        }
+
+        // Join slots that happen to be next to each other
+        u8* prevEnd = vecCount != 0
+                        ? reinterpret_cast<u8*>(vec[vecCount - 1].data) +
+                            vec[vecCount - 1].len
+                        : nullptr;
+        if (data != m_scratch && data == prevEnd) {
+            vec[vecCount - 1].len += SectorSize;
+        } else {
+            vec[vecCount++] = {data, SectorSize};
+        }
+    }
+
+    bool ret = m_transfer(
+      m_devId, false, runStart, runEnd - runStart, vec, vecCount);
+
+    if (ret) {
+        CopyDirty(out, sector, count);
+        Insert(out, sector, count);
+    } else {
+        for (u32 i = 0; i < allocCount; i++)
+            Release(allocated[i]);
+    }
+
+    m_pinStart = 0;
+    m_pinEnd = 0;
+    m_mutex.unlock();
+
+    return ret;
+}
+
+void SectorCache::Fill(void* data, u32 sector, u32 count)
+{
+    m_mutex.lock();
+
+    CopyDirty(data, sector, count);
+    if (count <= MaxCachedCount)
+        Insert(data, sector, count);
+
+    m_mutex.unlock();
+}
+
+bool SectorCache::Write(const void* data, u32 sector, u32 count)
+{
+    if (!m_writeBack || count > MaxCachedCount)
+        return false;
+
+    m_mutex.lock();
+
+    m_pinStart = sector;
+    m_pinEnd = sector + count;
+
+    for (u32 i = 0; i < count; i++) {
+        u32 index = Find(sector + i);
+        if (index == InvalidSector)
+            index = Allocate(sector + i);
+
+        if (!m_entries[index].dirty) {
+            m_entries[index].dirty = true;
+            m_dirtyCount++;
+        }
+
+        m_entries[index].referenced = true;
+        memcpy(GetSlot(index),
+          reinterpret_cast<const u8*>(data) + i * SectorSize, SectorSize);
+    }
+
+    m_pinStart = 0;
+    m_pinEnd = 0;
+    m_mutex.unlock();
+
+    return true;
+}
+
+void SectorCache::Update(const void* data, u32 sector, u32 count)
+{
+    m_mutex.lock();
+
+    for (u32 i = 0; i < m_sectorCount; i++) {
+        u32 offset = m_entries[i].sector - sector;
+        if (m_entries[i].sector == InvalidSector || offset >= count)
+            continue;
+
+        if (m_entries[i].dirty) {
+            m_entries[i].dirty = false;
+            m_dirtyCount--;
+        }
+
+        memcpy(GetSlot(i),
+          reinterpret_cast<const u8*>(data) + offset * SectorSize, SectorSize);
+    }
+
+    // Keep small writes, e.g. FAT updates, as they're likely read again
+    if (count <= MaxCachedCount)
+        Insert(data, sector, count);
+
+    m_mutex.unlock();
+}
+
+bool SectorCache::Flush()
+{
+    m_mutex.lock();
+
+    // Write in sector order, joining adjacent dirty sectors into one
+    // transfer
+    bool ret = true;
+    while (m_dirtyCount != 0) {
+        u32 first = InvalidSector;
+        for (u32 i = 0; i < m_sectorCount; i++) {
+            if (m_entries[i].dirty)
+                first = std::min(first, m_entries[i].sector);
+        }
+
+        if (!WriteRun(first))
+            ret = false;
+    }
+
+    m_mutex.unlock();
+
+    return ret;
+}
+
+u32 SectorCache::Discard()
+{
+    m_mutex.lock();
+
+    u32 lost = m_dirtyCount;
+    for (u32 i = 0; i < m_sectorCount; i++) {
+        m_entries[i] = {
+          .sector = InvalidSector,
+          .referenced = false,
+          .dirty = false,
+        };
+    }
+    m_dirtyCount = 0;
+
+    m_mutex.unlock();
+
+    return lost;
+}
+
+SectorCache::Stats SectorCache::GetStats()
+{
+    m_mutex.lock();
+    Stats stats = m_stats;
+    m_mutex.unlock();
+
+    return stats;
+}
+
+u32 SectorCache::Find(u32 sector) const
+{
+    for (u32 i = 0; i < m_sectorCount; i++) {
+        if (m_entries[i].sector == sector)
+            return i;
+    }
+
+    return InvalidSector;
+}
+
+u32 SectorCache::Allocate(u32 sector)
+{
+    // Give every referenced entry a second chance before replacing it
+    while (true) {
+        u32 index = m_hand;
+        m_hand = (m_hand + 1) % m_sectorCount;
+
+        Entry* entry = &m_entries[index];
+        if (entry->sector != InvalidSector &&
+            (entry->referenced ||
+              entry->sector - m_pinStart < m_pinEnd - m_pinStart)) {
+            entry->referenced = false;
+            continue;
+        }
+
+        if (entry->sector != InvalidSector) {
+            m_stats.evictions++;
+            if (entry->dirty)
+                WriteBack(index);
+        }
+
+        entry->sector = sector;
+        // Referenced until the hand comes back around
+        entry->referenced = true;
+        entry->dirty = false;
+        return index;
+    }
+}
+
+void SectorCache::Release(u32 index)
+{
+    m_entries[index] = {
+      .sector = InvalidSector,
+      .referenced = false,
+      .dirty = false,
+    };
+}
+
+void SectorCache::Insert(const void* data, u32 sector, u32 count)
+{
+    m_pinStart = sector;
+    m_pinEnd = sector + count;
+
+    for (u32 i = 0; i < count; i++) {
+        if (Find(sector + i) != InvalidSector)
+            continue;
+
+        u32 index = Allocate(sector + i);
+        memcpy(GetSlot(index),
+          reinterpret_cast<const u8*>(data) + i * SectorSize, SectorSize);
+    }
+
+    m_pinStart = 0;
+    m_pinEnd = 0;
+}
+
+void SectorCache::CopyDirty(void* data, u32 sector, u32 count)
+{
+    // Sectors held in the cache are newer than what's on the device
+    if (m_dirtyCount == 0)
+        return;
+
+    for (u32 i = 0; i < m_sectorCount; i++) {
+        if (m_entries[i].dirty && m_entries[i].sector - sector < count) {
+            CopySector(reinterpret_cast<u8*>(data) +
+                         (m_entries[i].sector - sector) * SectorSize,
+              GetSlot(i));
+        }
+    }
+}
+
+bool SectorCache::WriteBack(u32 index)
+{
+    Entry* entry = &m_entries[index];
+
+    // If the write fails the device is put in the error state, so there's no
+    // point in keeping the sector
+    entry->dirty = false;
+    m_dirtyCount--;
+    m_stats.writeBacks++;
+
+    DiskVector vec = {GetSlot(index), SectorSize};
+    return m_transfer(m_devId, true, entry->sector, 1, &vec, 1);
+}
+
+bool SectorCache::WriteRun(u32 sector)
+{
+    DiskVector vec[MaxRunCount];
+    u32 count = 0;
+
+    for (; count < MaxRunCount; count++) {
+        u32 index = Find(sector + count);
+        if (index == InvalidSector || !m_entries[index].dirty)
+            break;
+
+        m_entries[index].dirty = false;
+        m_dirtyCount--;
+        m_stats.writeBacks++;
+        vec[count] = {GetSlot(index), SectorSize};
+    }
+
+    return m_transfer(m_devId, true, sector, count, vec, count);
+}
@@ -0,0 +1,154 @@
+// SectorCache.hpp - Storage device sector cache
+//
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <Disk/DiskVector.hpp>
+#include <System/OS.hpp>
+#include <System/Types.h>
+
+/**
+ * Cache of recently used sectors of a storage device, mostly FAT and
+ * directory sectors and small file reads. Large requests bypass it, apart
+ * from keeping cached copies of the sectors they touch up to date.
+ *
+ * Entries are replaced with the CLOCK algorithm. In write-back mode small
+ * writes stay in the cache until the sector is replaced or the cache is
+ * flushed.
+ *
+ * A small read that misses also fetches the rest of its aligned group of
+ * sectors in the same transfer, so the adjacent reads FatFS makes next hit.
+ */
+class SectorCache
+{
+public:
+    /**
+     * Reads or writes a sector run on the device, split between the buffers
+     * in vec.
+     */
+    using TransferFunc = bool (*)(u32 devId, bool isWrite, u32 sector,
+      u32 count, const DiskVector* vec, u32 vecCount);
+
+    /**
+     * @param devId Device passed to the transfer function.
+     * @param sectorCount Number of sectors to cache.
+     * @param writeBack Hold small writes in the cache.
+     */
+    SectorCache(
+      u32 devId, u32 sectorCount, bool writeBack, TransferFunc transfer);
+    ~SectorCache();
+
+    static constexpr u32 SectorSize = 512;
+
+    // Longest request that is added to the cache
+    static constexpr u32 MaxCachedCount = 8;
+
+    // Size and alignment of the sector groups read on a miss
+    static constexpr u32 FillCount = 8;
+
+    // Longest transfer the cache makes itself
+    static constexpr u32 MaxRunCount = MaxCachedCount + FillCount * 2;
+
+    struct Stats {
+        // Counted in sectors
+        u32 hits;
+        u32 misses;
+        u32 evictions;
+        u32 writeBacks;
+    };
+
+    /**
+     * False if there wasn't enough memory for the cache.
+     */
+    bool IsValid() const
+    {
+        return m_data != nullptr;
+    }
+
+    /**
+     * Read sectors if they're all in the cache.
+     */
+    bool Read(void* out, u32 sector, u32 count);
+
+    /**
+     * Read a small request that missed from the device, together with the
+     * uncached sectors around it.
+     * @param limit Sector count of the device or volume, nothing at or past
+     * it is read other than the request itself.
+     */
+    bool ReadThrough(void* out, u32 sector, u32 count, u32 limit);
+
+    /**
+     * Update a read from the device with any newer cached data, and cache
+     * the sectors if the read is small.
+     */
+    void Fill(void* data, u32 sector, u32 count);
+
+    /**
+     * Hold a write in the cache, in write-back mode.
+     * @returns False if the write must go to the device.
+     */
+    bool Write(const void* data, u32 sector, u32 count);
+
+    /**
+     * Update the cache after a write to the device.
+     */
+    void Update(const void* data, u32 sector, u32 count);
+
+    /**
+     * Write all dirty sectors to the device.
+     */
+    bool Flush();
+
+    /**
+     * Forget all sectors, e.g. when the device is removed.
+     * @returns Number of dirty sectors that were lost.
+     */
+    u32 Discard();
+
+    Stats GetStats();
+
+private:
+    static constexpr u32 InvalidSector = ~0;
+
+    struct Entry {
+        u32 sector;
+        bool referenced;
+        bool dirty;
+    };
+
+    u32 Find(u32 sector) const;
+    u32 Allocate(u32 sector);
+    void Release(u32 index);
+    void Insert(const void* data, u32 sector, u32 count);
+    void CopyDirty(void* data, u32 sector, u32 count);
+    bool WriteBack(u32 index);
+    bool WriteRun(u32 sector);
+
+    u8* GetSlot(u32 index)
+    {
+        return &m_data[index * SectorSize];
+    }
+
+    u32 m_devId;
+    u32 m_sectorCount;
+    bool m_writeBack;
+    TransferFunc m_transfer;
+
+    Entry* m_entries = nullptr;
+    // The cached sectors, followed by a sector that reads of already cached
+    // sectors are discarded into
+    u8* m_data = nullptr;
+    u8* m_scratch = nullptr;
+    // CLOCK hand
+    u32 m_hand = 0;
+    u32 m_dirtyCount = 0;
+
+    // Sectors of the request being handled, which must not be replaced
+    u32 m_pinStart = 0;
+    u32 m_pinEnd = 0;
+
+    Mutex m_mutex;
+    Stats m_stats = {};
+};
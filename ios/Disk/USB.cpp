@@ -146,7 +146,7 @@ USB::USBError USB::CtrlMsg(u32 devId, u8 requestType, u8 request, u16 value,
   u16 index, u16 length, void* data)
 {
     // Must be in a physical = virtual region.
-    assert((u32) data >= 0x10000000 && (u32) data < 0x14000000);
+    assert((uintptr_t) data >= 0x10000000 && (uintptr_t) data < 0x14000000);
 
     if (!aligned(data, 32))
         return USBError::Invalid;
@@ -197,9 +197,53 @@ USB::USBError USB::CtrlMsg(u32 devId, u8 requestType, u8 request, u16 value,
 
 USB::USBError USB::IntrBulkMsg(
   u32 devId, USBv5Ioctl ioctl, u8 endpoint, u16 length, void* data)
+{
+    AsyncMsg* msg = (AsyncMsg*) IOS::Alloc(sizeof(AsyncMsg));
+
+    USBError err = SetupIntrBulkMsg(msg, devId, ioctl, endpoint, length, data);
+    if (err != USBError::OK) {
+        IOS::Free(msg);
+        return err;
+    }
+
+    s32 ret;
+    if (endpoint & DirEndpointIn) {
+        ret = ven.ioctlv(ioctl, msg->vec.in);
+    } else {
+        ret = ven.ioctlv(ioctl, msg->vec.out);
+    }
+
+    IOS::Free(msg);
+    return MsgResult(ret, length);
+}
+
+USB::USBError USB::BulkMsgAsync(u32 devId, u8 endpoint, u16 length,
+  void* data, AsyncMsg* msg, Queue<IOS::Request*>* queue)
+{
+    USBError err = SetupIntrBulkMsg(
+      msg, devId, USBv5Ioctl::BulkTransfer, endpoint, length, data);
+    if (err != USBError::OK)
+        return err;
+
+    msg->req = {};
+
+    s32 ret;
+    if (endpoint & DirEndpointIn) {
+        ret = ven.ioctlvAsync(
+          USBv5Ioctl::BulkTransfer, msg->vec.in, queue, &msg->req);
+    } else {
+        ret = ven.ioctlvAsync(
+          USBv5Ioctl::BulkTransfer, msg->vec.out, queue, &msg->req);
+    }
+
+    return static_cast<USBError>(ret);
+}
+
+USB::USBError USB::SetupIntrBulkMsg(AsyncMsg* msg, u32 devId,
+  USBv5Ioctl ioctl, u8 endpoint, u16 length, void* data)
 {
     // Must be in a physical = virtual region.
-    assert((u32) data >= 0x10000000 && (u32) data < 0x14000000);
+    assert((uintptr_t) data >= 0x10000000 && (uintptr_t) data < 0x14000000);
 
     if (!aligned(data, 32))
         return USBError::Invalid;
@@ -208,52 +252,38 @@ USB::USBError USB::IntrBulkMsg(
     if (!length && data)
         return USBError::Invalid;
 
-    Input* msg = (Input*) IOS::Alloc(sizeof(Input));
-    msg->fd = devId;
+    msg->input.fd = devId;
+    msg->length = length;
 
     if (ioctl == USBv5Ioctl::IntrTransfer) {
-        msg->intr = {
+        msg->input.intr = {
           .data = data,
           .length = length,
           .endpoint = endpoint,
         };
     } else if (ioctl == USBv5Ioctl::BulkTransfer) {
-        msg->bulk = {
+        msg->input.bulk = {
           .data = data,
           .length = length,
           .pad = {0},
           .endpoint = endpoint,
         };
     } else {
-        IOS::Free(msg);
         return USBError::Invalid;
     }
 
-    s32 ret;
+    IOS_FlushDCache(data, length);
     if (endpoint & DirEndpointIn) {
-        IOS::IVector<2> vec;
-        IOS_FlushDCache(data, length);
-        vec.in[0].data = msg;
-        vec.in[0].len = sizeof(Input);
-        vec.in[1].data = data;
-        vec.in[1].len = length;
-        ret = ven.ioctlv(ioctl, vec);
+        msg->vec.in.in[0].data = &msg->input;
+        msg->vec.in.in[0].len = sizeof(Input);
+        msg->vec.in.in[1].data = data;
+        msg->vec.in.in[1].len = length;
     } else {
-        IOS::IOVector<1, 1> vec;
-        IOS_FlushDCache(data, length);
-        vec.in[0].data = msg;
-        vec.in[0].len = sizeof(Input);
-        vec.out[0].data = data;
-        vec.out[0].len = length;
-        ret = ven.ioctlv(ioctl, vec);
+        msg->vec.out.in[0].data = &msg->input;
+        msg->vec.out.in[0].len = sizeof(Input);
+        msg->vec.out.out[0].data = data;
+        msg->vec.out.out[0].len = length;
     }
 
-    IOS::Free(msg);
-    if (ret == length)
-        return USBError::OK;
-
-    if (ret >= 0)
-        return USBError::ShortTransfer;
-
-    return static_cast<USBError>(ret);
+    return USBError::OK;
 }
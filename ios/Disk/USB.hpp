@@ -90,6 +90,9 @@ public:
 
     static constexpr u32 MaxDevices = 32;
 
+    // Longest interrupt or bulk message
+    static constexpr u32 MaxBulkLength = 0xFFFF;
+
     struct DeviceEntry {
         u32 devId;
         u16 vid;
@@ -216,6 +219,23 @@ public:
 
     static_assert(sizeof(DeviceInfo) == 0xC0);
 
+    /**
+     * An interrupt or bulk message submitted without waiting for it. Must be
+     * allocated with IOS::Alloc and stay in place until the reply is
+     * received.
+     */
+    struct AsyncMsg {
+        Input input;
+
+        union {
+            IOS::IVector<2> in;
+            IOS::IOVector<1, 1> out;
+        } vec;
+
+        IOS::Request req;
+        u16 length;
+    };
+
     USB(s32 id);
 
     /**
@@ -308,6 +328,21 @@ public:
           devId, USBv5Ioctl::BulkTransfer, endpoint, length, data);
     }
 
+    /**
+     * Submit a bulk transfer on the device without waiting for it. &msg->req
+     * is sent to 'queue' when it completes.
+     */
+    USBError BulkMsgAsync(u32 devId, u8 endpoint, u16 length, void* data,
+      AsyncMsg* msg, Queue<IOS::Request*>* queue);
+
+    /**
+     * Get the result of a completed asynchronous message.
+     */
+    static USBError GetAsyncResult(const AsyncMsg* msg)
+    {
+        return MsgResult(msg->req.result, msg->length);
+    }
+
     /**
      * Read control message on the device.
      */
@@ -324,6 +359,20 @@ private:
     USBError IntrBulkMsg(
       u32 devId, USBv5Ioctl ioctl, u8 endpoint, u16 length, void* data);
 
+    USBError SetupIntrBulkMsg(AsyncMsg* msg, u32 devId, USBv5Ioctl ioctl,
+      u8 endpoint, u16 length, void* data);
+
+    static USBError MsgResult(s32 ret, u16 length)
+    {
+        if (ret == length)
+            return USBError::OK;
+
+        if (ret >= 0)
+            return USBError::ShortTransfer;
+
+        return static_cast<USBError>(ret);
+    }
+
     IOS::ResourceCtrl<USBv5Ioctl> ven{-1};
     Thread m_thread;
     bool m_reqSent = false;
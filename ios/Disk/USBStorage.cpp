@@ -44,13 +44,132 @@ enum {
     SCSI_TYPE_DIRECT_ACCESS = 0x0,
 };
 
+/**
+ * Keeps up to PipeDepth bulk messages on one endpoint in flight, so the bus
+ * transfer of one overlaps the copy or setup of the next. Messages are
+ * waited for in the order they were submitted.
+ */
+class USBStorage::BulkPipeline
+{
+public:
+    BulkPipeline(USBStorage* storage, u8 endpoint)
+      : m_storage(storage)
+      , m_endpoint(endpoint)
+      , m_queue(PipeDepth)
+    {
+    }
+
+    ~BulkPipeline()
+    {
+        // The messages must not outlive the queue
+        if (!IsEmpty())
+            Abort();
+    }
+
+    bool IsEmpty() const
+    {
+        return m_submitted == m_completed;
+    }
+
+    bool IsFull() const
+    {
+        return m_submitted - m_completed == PipeDepth;
+    }
+
+    /**
+     * Slot of the next message to submit.
+     */
+    u32 NextSlot() const
+    {
+        return m_submitted % PipeDepth;
+    }
+
+    bool Submit(void* data, u32 len)
+    {
+        assert(!IsFull());
+
+        u32 slot = NextSlot();
+        m_done[slot] = false;
+        if (m_storage->m_usb->BulkMsgAsync(m_storage->m_id, m_endpoint, len,
+              data, &m_storage->m_msgs[slot], &m_queue) != USB::USBError::OK) {
+            PRINT(IOS_USB, ERROR, "BulkMsgAsync failed");
+            return false;
+        }
+
+        m_submitted++;
+        return true;
+    }
+
+    /**
+     * Wait for the oldest message.
+     * @param[out] slot Slot of the message.
+     */
+    bool Wait(u32* slot)
+    {
+        assert(!IsEmpty());
+
+        *slot = m_completed % PipeDepth;
+        while (!m_done[*slot])
+            Receive();
+        m_completed++;
+
+        if (USB::GetAsyncResult(&m_storage->m_msgs[*slot]) !=
+            USB::USBError::OK) {
+            PRINT(IOS_USB, ERROR, "Bulk message failed");
+            return false;
+        }
+
+        return true;
+    }
+
+    /**
+     * Cancel the messages still in flight after an error, so none of them
+     * takes the CSW or data of a later command.
+     */
+    void Abort()
+    {
+        if (IsEmpty())
+            return;
+
+        m_storage->m_usb->CancelEndpoint(m_storage->m_id, m_endpoint);
+        while (!IsEmpty()) {
+            u32 slot;
+            Wait(&slot);
+        }
+    }
+
+private:
+    void Receive()
+    {
+        IOS::Request* req = m_queue.receive();
+        for (u32 i = 0; i < PipeDepth; i++) {
+            if (req == &m_storage->m_msgs[i].req)
+                m_done[i] = true;
+        }
+    }
+
+    USBStorage* m_storage;
+    u8 m_endpoint;
+    Queue<IOS::Request*> m_queue;
+    u32 m_submitted = 0;
+    u32 m_completed = 0;
+    bool m_done[PipeDepth] = {};
+};
+
 USBStorage::USBStorage(USB* usb, USB::DeviceInfo info)
 {
-    m_buffer = (u8*) IOS::Alloc(0x4000);
+    m_buffer = (u8*) IOS::Alloc(BounceSize * PipeDepth);
+    m_msgs = (USB::AsyncMsg*) IOS::Alloc(sizeof(USB::AsyncMsg) * PipeDepth);
     m_usb = usb;
     m_info = info;
 }
 
+USBStorage::~USBStorage()
+{
+    IOS::Free(m_buffer);
+    IOS::Free(m_msgs);
+}
+
 bool USBStorage::GetLunCount(u8* lunCount)
 {
     u8 requestType = USB::CtrlType::Rec_Interface;
@@ -69,6 +188,15 @@ bool USBStorage::SCSITransfer(
   bool isWrite, u32 size, void* data, u8 lun, u8 cbSize, void* cb)
 {
     assert(!!size == !!data);
+
+    DiskVector vec = {data, size};
+    return SCSITransferV(isWrite, size, &vec, data ? 1 : 0, lun, cbSize, cb);
+}
+
+bool USBStorage::SCSITransferV(bool isWrite, u32 size, const DiskVector* vec,
+  u32 vecCount, u8 lun, u8 cbSize, void* cb)
+{
+    assert(!!size == !!vecCount);
     assert(lun <= 16);
     assert(cbSize >= 1 && cbSize <= 16);
     assert(cb);
@@ -91,22 +219,23 @@ bool USBStorage::SCSITransfer(
         return false;
     }
 
-    u32 remainingSize = size;
-    while (remainingSize > 0) {
-        u32 chunkSize = std::min<u32>(remainingSize, 0x4000);
-        if (isWrite) {
-            memcpy(m_buffer, data, chunkSize);
+    // Buffers the host controller can reach are used directly, the rest are
+    // gathered through the bounce buffer
+    for (u32 i = 0; i < vecCount;) {
+        if (IsDirect(vec[i], vecCount)) {
+            if (!TransferDirect(isWrite, vec[i]))
+                return false;
+            i++;
+            continue;
         }
-        if (m_usb->WriteBulkMsg(m_id, isWrite ? m_outEndpoint : m_inEndpoint,
-              chunkSize, m_buffer) != USB::USBError::OK) {
-            PRINT(IOS_USB, ERROR, "WriteBulkMsg (2) failed");
+
+        u32 count = 1;
+        while (i + count < vecCount && !IsDirect(vec[i + count], vecCount))
+            count++;
+
+        if (!TransferBounced(isWrite, vec + i, count))
             return false;
-        }
-        if (!isWrite) {
-            memcpy(data, m_buffer, chunkSize);
-        }
-        remainingSize -= chunkSize;
-        data += chunkSize;
+        i += count;
     }
 
     memset(m_buffer, 0, CBW_SIZE);
@@ -133,6 +262,120 @@ bool USBStorage::SCSITransfer(
     return true;
 }
 
+/**
+ * Small buffers of a vectored transfer are gathered even if they could be
+ * used directly, as a bulk message costs more than copying them.
+ */
+bool USBStorage::IsDirect(const DiskVector& vec, u32 vecCount) const
+{
+    // Must be in a physical = virtual region, and not share a cache line
+    // with anything else
+    const uintptr_t data = uintptr_t(vec.data);
+    if (data < 0x10000000 || data >= 0x14000000 ||
+        data + vec.len > 0x14000000)
+        return false;
+
+    if (!aligned(vec.data, 32) || !aligned(vec.len, 32))
+        return false;
+
+    return vecCount == 1 || vec.len >= BounceSize;
+}
+
+bool USBStorage::TransferDirect(bool isWrite, const DiskVector& vec)
+{
+    u8 endpoint = isWrite ? m_outEndpoint : m_inEndpoint;
+    u8* data = reinterpret_cast<u8*>(vec.data);
+    u32 remainingSize = vec.len;
+
+    if (remainingSize <= m_maxTransferSize) {
+        if (m_usb->WriteBulkMsg(m_id, endpoint, remainingSize, data) !=
+            USB::USBError::OK) {
+            PRINT(IOS_USB, ERROR, "WriteBulkMsg (2) failed");
+            return false;
+        }
+        return true;
+    }
+
+    BulkPipeline pipeline(this, endpoint);
+    while (remainingSize > 0 || !pipeline.IsEmpty()) {
+        if (remainingSize > 0 && !pipeline.IsFull()) {
+            u32 chunkSize = std::min<u32>(remainingSize, m_maxTransferSize);
+            if (!pipeline.Submit(data, chunkSize)) {
+                pipeline.Abort();
+                return false;
+            }
+            data += chunkSize;
+            remainingSize -= chunkSize;
+            continue;
+        }
+
+        u32 slot;
+        if (!pipeline.Wait(&slot)) {
+            pipeline.Abort();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool USBStorage::TransferBounced(
+  bool isWrite, const DiskVector* vec, u32 vecCount)
+{
+    u8 endpoint = isWrite ? m_outEndpoint : m_inEndpoint;
+    u32 remainingSize = 0;
+    for (u32 i = 0; i < vecCount; i++)
+        remainingSize += vec[i].len;
+
+    DiskVectorCursor cursor(vec, vecCount);
+
+    if (remainingSize <= BounceSize) {
+        if (isWrite) {
+            cursor.Read(m_buffer, remainingSize);
+        }
+        if (m_usb->WriteBulkMsg(m_id, endpoint, remainingSize, m_buffer) !=
+            USB::USBError::OK) {
+            PRINT(IOS_USB, ERROR, "WriteBulkMsg (2) failed");
+            return false;
+        }
+        if (!isWrite) {
+            cursor.Write(m_buffer, remainingSize);
+        }
+        return true;
+    }
+
+    // Each message in flight has its own bounce buffer, so the next chunk of
+    // a write is gathered, or the last chunk of a read scattered, while the
+    // bus is busy
+    BulkPipeline pipeline(this, endpoint);
+    while (remainingSize > 0 || !pipeline.IsEmpty()) {
+        if (remainingSize > 0 && !pipeline.IsFull()) {
+            u8* buffer = m_buffer + pipeline.NextSlot() * BounceSize;
+            u32 chunkSize = std::min<u32>(remainingSize, BounceSize);
+            if (isWrite) {
+                cursor.Read(buffer, chunkSize);
+            }
+            if (!pipeline.Submit(buffer, chunkSize)) {
+                pipeline.Abort();
+                return false;
+            }
+            remainingSize -= chunkSize;
+            continue;
+        }
+
+        u32 slot;
+        if (!pipeline.Wait(&slot)) {
+            pipeline.Abort();
+            return false;
+        }
+        if (!isWrite) {
+            cursor.Write(m_buffer + slot * BounceSize, m_msgs[slot].length);
+        }
+    }
+
+    return true;
+}
+
 bool USBStorage::TestUnitReady(u8 lun)
 {
     u8 cmd[6] = {0};
@@ -259,6 +502,11 @@ bool USBStorage::Init()
 
     PRINT(IOS_USB, INFO, "USBStorage: Max packet size: %d", m_maxPacketSize);
 
+    // The length of a bulk message is 16-bit. Every message but the last
+    // must be whole packets, or the device ends the data phase early.
+    m_maxTransferSize =
+      round_down<u32>(USB::MaxBulkLength, std::max<u32>(m_maxPacketSize, 32));
+
     u8 lunCount;
     if (!GetLunCount(&lunCount)) {
         return false;
@@ -336,6 +584,38 @@ bool USBStorage::WriteSectors(
     return false;
 }
 
+bool USBStorage::ReadSectorsV(
+  u32 firstSector, u32 sectorCount, const DiskVector* vec, u32 vecCount)
+{
+    assert(sectorCount <= UINT16_MAX);
+
+    u8 cmd[10] = {0};
+    write8(cmd + 0x0, SCSI_READ_10);
+    write16(cmd + 0x2, firstSector >> 16);
+    write16(cmd + 0x4, firstSector & 0xFFFF);
+    write8(cmd + 0x7, sectorCount >> 8);
+    write8(cmd + 0x8, sectorCount & 0xFF);
+
+    u32 size = sectorCount * m_blockSize;
+    return SCSITransferV(false, size, vec, vecCount, m_lun, sizeof(cmd), cmd);
+}
+
+bool USBStorage::WriteSectorsV(
+  u32 firstSector, u32 sectorCount, const DiskVector* vec, u32 vecCount)
+{
+    assert(sectorCount <= UINT16_MAX);
+
+    u8 cmd[10] = {0};
+    write8(cmd + 0x0, SCSI_WRITE_10);
+    write16(cmd + 0x2, firstSector >> 16);
+    write16(cmd + 0x4, firstSector & 0xFFFF);
+    write8(cmd + 0x7, sectorCount >> 8);
+    write8(cmd + 0x8, sectorCount & 0xFF);
+
+    u32 size = sectorCount * m_blockSize;
+    return SCSITransferV(true, size, vec, vecCount, m_lun, sizeof(cmd), cmd);
+}
+
 bool USBStorage::Sync()
 {
     u8 cmd[10] = {0};
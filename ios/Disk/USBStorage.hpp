@@ -3,6 +3,7 @@
 // SPDX-License-Identifier: MIT
 
 #pragma once
+#include <Disk/DiskVector.hpp>
 #include <Disk/USB.hpp>
 #include <System/Types.h>
 
@@ -10,8 +11,12 @@ class USBStorage
 {
 public:
     USBStorage(USB* usb, USB::DeviceInfo info);
+    USBStorage(const USBStorage& from) = delete;
+    ~USBStorage();
 
 private:
+    class BulkPipeline;
+
     enum class USBStorageError {
         OK = 0,
         USBHalted = int(USB::USBError::Halted),
@@ -20,6 +25,11 @@ private:
     bool GetLunCount(u8* lunCount);
     bool SCSITransfer(
       bool isWrite, u32 size, void* data, u8 lun, u8 cbSize, void* cb);
+    bool SCSITransferV(bool isWrite, u32 size, const DiskVector* vec,
+      u32 vecCount, u8 lun, u8 cbSize, void* cb);
+    bool IsDirect(const DiskVector& vec, u32 vecCount) const;
+    bool TransferDirect(bool isWrite, const DiskVector& vec);
+    bool TransferBounced(bool isWrite, const DiskVector* vec, u32 vecCount);
     bool TestUnitReady(u8 lun);
     bool Inquiry(u8 lun, u8* type);
     bool InitLun(u8 lun);
@@ -33,6 +43,10 @@ public:
     u32 SectorSize();
     bool ReadSectors(u32 firstSector, u32 sectorCount, void* buffer);
     bool WriteSectors(u32 firstSector, u32 sectorCount, const void* buffer);
+    bool ReadSectorsV(u32 firstSector, u32 sectorCount, const DiskVector* vec,
+      u32 vecCount);
+    bool WriteSectorsV(u32 firstSector, u32 sectorCount,
+      const DiskVector* vec, u32 vecCount);
     bool Sync();
 
     u32 GetDevID() const
@@ -41,6 +55,11 @@ public:
     }
 
 private:
+    static constexpr u32 BounceSize = 0x4000;
+
+    // Bulk messages of a data phase kept in flight at once
+    static constexpr u32 PipeDepth = 2;
+
     USB* m_usb;
     USB::DeviceInfo m_info;
     bool m_valid = false;
@@ -49,8 +68,12 @@ private:
     u8 m_interface;
     u8 m_outEndpoint;
     u8 m_inEndpoint;
+    // PipeDepth bounce buffers, the first is also used for the CBW and CSW
     u8* m_buffer;
+    USB::AsyncMsg* m_msgs;
     u32 m_maxPacketSize;
+    // Longest bulk message sent from a caller's buffer
+    u32 m_maxTransferSize;
     u32 m_tag = 0;
     u8 m_lun;
     u32 m_blockSize;
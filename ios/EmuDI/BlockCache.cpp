@@ -0,0 +1,121 @@
+// BlockCache.cpp - Decrypted disc block cache
+//
+// SPDX-License-Identifier: MIT
+
+#include "BlockCache.hpp"
+#include <IOS/Syscalls.h>
+#include <IOS/System.hpp>
+
+BlockCache::BlockCache(u32 blockCount, u32 blockSize)
+{
+    m_blockSize = blockSize;
+
+    // Not using new, the cache shrinks to whatever fits in the heap, with
+    // its entries
+    for (; blockCount > 0; blockCount--) {
+        m_data = reinterpret_cast<u8*>(IOS_AllocAligned(
+          System::GetHeap(), blockCount * blockSize, 32));
+        if (m_data == nullptr)
+            continue;
+
+        m_entries = reinterpret_cast<Entry*>(
+          IOS_Alloc(System::GetHeap(), blockCount * sizeof(Entry)));
+        if (m_entries != nullptr)
+            break;
+
+        IOS_Free(System::GetHeap(), m_data);
+        m_data = nullptr;
+    }
+
+    if (m_data == nullptr)
+        return;
+
+    m_blockCount = blockCount;
+    Clear();
+}
+
+BlockCache::~BlockCache()
+{
+    if (m_entries != nullptr)
+        IOS_Free(System::GetHeap(), m_entries);
+
+    if (m_data != nullptr)
+        IOS_Free(System::GetHeap(), m_data);
+}
+
+u8* BlockCache::Lookup(u32 key)
+{
+    for (u32 i = 0; i < m_blockCount; i++) {
+        if (m_entries[i].key != key)
+            continue;
+
+        m_entries[i].lastUse = ++m_useCounter;
+        m_stats.hits++;
+        if (m_entries[i].prefetched) {
+            m_entries[i].prefetched = false;
+            m_stats.prefetchHits++;
+        }
+        return &m_data[i * m_blockSize];
+    }
+
+    m_stats.misses++;
+    return nullptr;
+}
+
+bool BlockCache::Contains(u32 key) const
+{
+    for (u32 i = 0; i < m_blockCount; i++) {
+        if (m_entries[i].key == key)
+            return true;
+    }
+
+    return false;
+}
+
+u8* BlockCache::Insert(u32 key, bool prefetch)
+{
+    assert(key != InvalidKey);
+
+    if (m_blockCount == 0)
+        return nullptr;
+
+    // Prefer an empty entry, otherwise replace the least recently used one
+    u32 victim = 0;
+    for (u32 i = 0; i < m_blockCount; i++) {
+        if (m_entries[i].key == InvalidKey) {
+            victim = i;
+            break;
+        }
+
+        if (m_entries[i].lastUse < m_entries[victim].lastUse)
+            victim = i;
+    }
+
+    if (m_entries[victim].key != InvalidKey)
+        m_stats.evictions++;
+
+    m_entries[victim].key = key;
+    m_entries[victim].lastUse = ++m_useCounter;
+    m_entries[victim].prefetched = prefetch;
+    return &m_data[victim * m_blockSize];
+}
+
+void BlockCache::Invalidate(u32 key)
+{
+    for (u32 i = 0; i < m_blockCount; i++) {
+        if (m_entries[i].key == key) {
+            m_entries[i].key = InvalidKey;
+            m_entries[i].lastUse = 0;
+            m_entries[i].prefetched = false;
+        }
+    }
+}
+
+void BlockCache::Clear()
+{
+    for (u32 i = 0; i < m_blockCount; i++) {
+        m_entries[i].key = InvalidKey;
+        m_entries[i].lastUse = 0;
+        m_entries[i].prefetched = false;
+    }
+}
@@ -0,0 +1,97 @@
+// BlockCache.hpp - Decrypted disc block cache
+//
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <System/Types.h>
+
+class BlockCache
+{
+public:
+    /**
+     * @param blockCount Number of blocks to cache. Fewer are used if there
+     * isn't enough memory, possibly none.
+     * @param blockSize Size of each block in bytes.
+     */
+    BlockCache(u32 blockCount, u32 blockSize);
+    ~BlockCache();
+
+    // Block word offsets are always 0x8000 byte aligned, so 1 can never be a
+    // valid key.
+    static constexpr u32 InvalidKey = 1;
+
+    struct Stats {
+        u32 hits;
+        u32 misses;
+        u32 evictions;
+        // Hits on blocks inserted by a prefetch, counted once per block
+        u32 prefetchHits;
+    };
+
+    /**
+     * Find a block in the cache and mark it as the most recently used.
+     * @param key Word offset of the block.
+     * @returns Pointer to the block data, or nullptr if it isn't cached.
+     */
+    u8* Lookup(u32 key);
+
+    /**
+     * Check if a block is in the cache without affecting its use order or the
+     * hit statistics.
+     */
+    bool Contains(u32 key) const;
+
+    /**
+     * Claim a buffer for a new block, evicting the least recently used block
+     * if the cache is full. The caller must fill the buffer, or call
+     * Invalidate if it fails to do so.
+     * @param key Word offset of the block.
+     * @param prefetch The block is read ahead of time, not for a request.
+     * @returns Pointer to the block buffer, or nullptr if the cache has no
+     * blocks.
+     */
+    u8* Insert(u32 key, bool prefetch = false);
+
+    /**
+     * Remove a block from the cache if it's present.
+     */
+    void Invalidate(u32 key);
+
+    /**
+     * Remove all blocks from the cache.
+     */
+    void Clear();
+
+    u32 GetBlockCount() const
+    {
+        return m_blockCount;
+    }
+
+    const Stats& GetStats() const
+    {
+        return m_stats;
+    }
+
+    void ResetStats()
+    {
+        m_stats = {};
+    }
+
+private:
+    struct Entry {
+        u32 key;
+        u32 lastUse;
+        bool prefetched;
+    };
+
+    u32 m_blockCount = 0;
+    u32 m_blockSize;
+    Entry* m_entries = nullptr;
+    u8* m_data = nullptr;
+
+    // Incremented on every access, used to find the least recently used entry.
+    u32 m_useCounter = 0;
+
+    Stats m_stats = {};
+};
@@ -0,0 +1,275 @@
+// CompressedISO.cpp - Chunk-compressed disc image
+//
+// SPDX-License-Identifier: MIT
+
+#include "CompressedISO.hpp"
+#include "LZ4.hpp"
+#include <Debug/Log.hpp>
+#include <IOS/Syscalls.h>
+#include <IOS/System.hpp>
+#include <System/Config.hpp>
+#include <algorithm>
+#include <cstring>
+
+CompressedISO::CompressedISO(const char* const* paths, u32 count)
+  : ISO(paths, count, false)
+{
+    // Not using new, an image without its buffers is reported as not inserted
+    m_compressed = reinterpret_cast<u8*>(
+      IOS_AllocAligned(System::GetHeap(), ChunkSize, 32));
+    m_chunk = reinterpret_cast<u8*>(
+      IOS_AllocAligned(System::GetHeap(), ChunkSize, 32));
+    if (m_compressed == nullptr || m_chunk == nullptr) {
+        PRINT(IOS_EmuDI, ERROR, "Not enough memory for the chunk buffers");
+        return;
+    }
+
+    m_valid = ReadHeader();
+    if (!m_valid) {
+        PRINT(IOS_EmuDI, ERROR, "Invalid compressed disc image");
+        return;
+    }
+
+    // The hash headers are kept with the decrypted data
+    m_verifyMode = Config::s_instance->GetDiscVerifyMode();
+
+    PRINT(IOS_EmuDI, INFO, "Successfully opened compressed disc image");
+    PRINT(IOS_EmuDI, INFO, "Chunk count: %u", m_header.chunkCount);
+}
+
+CompressedISO::~CompressedISO()
+{
+    if (m_compressed != nullptr)
+        IOS_Free(System::GetHeap(), m_compressed);
+
+    if (m_chunk != nullptr)
+        IOS_Free(System::GetHeap(), m_chunk);
+}
+
+bool CompressedISO::IsInserted()
+{
+    return m_valid && ISO::IsInserted();
+}
+
+bool CompressedISO::ReadHeader()
+{
+    if (!ReadImage(&m_header, 0, sizeof(Header))) {
+        PRINT(IOS_EmuDI, ERROR, "Failed to read header");
+        return false;
+    }
+
+    if (m_header.magic != Magic || m_header.version != Version) {
+        PRINT(IOS_EmuDI, ERROR, "Bad magic or version: %08X, %u",
+          m_header.magic, m_header.version);
+        return false;
+    }
+
+    if (m_header.chunkSize != ChunkSize) {
+        PRINT(IOS_EmuDI, ERROR, "Unsupported chunk size: %X",
+          m_header.chunkSize);
+        return false;
+    }
+
+    if ((u64) m_header.chunkCount * ChunkSize < m_header.discSize) {
+        PRINT(IOS_EmuDI, ERROR, "Chunk index doesn't cover the disc");
+        return false;
+    }
+
+    if ((m_header.partitionWordOffset << 2) % ChunkSize != 0) {
+        PRINT(IOS_EmuDI, ERROR, "Decrypted partition not aligned to a chunk");
+        return false;
+    }
+
+    return true;
+}
+
+bool CompressedISO::GetChunkEntry(u32 chunk, ChunkEntry* entry)
+{
+    u32 page = chunk / IndexPageEntries;
+
+    if (page != m_indexPageNum) {
+        u32 first = page * IndexPageEntries;
+        u32 count = std::min(IndexPageEntries, m_header.chunkCount - first);
+
+        m_indexPageNum = ~0;
+        if (!ReadImage(m_indexPage,
+              m_header.indexOffset + first * sizeof(ChunkEntry),
+              count * sizeof(ChunkEntry))) {
+            PRINT(IOS_EmuDI, ERROR, "Failed to read chunk index");
+            return false;
+        }
+
+        m_indexPageNum = page;
+        m_stats.indexReads++;
+    }
+
+    *entry = m_indexPage[chunk % IndexPageEntries];
+    return true;
+}
+
+bool CompressedISO::ReadChunk(u32 chunk, const ChunkEntry& entry, u8* out)
+{
+    u32 size = (entry.size[0] << 16) | (entry.size[1] << 8) | entry.size[2];
+    u64 offset = (u64) entry.offset << 4;
+
+    switch (entry.type) {
+    case ChunkType::Fill:
+        std::memset(out, entry.size[2], ChunkSize);
+        m_stats.chunksFilled++;
+        return true;
+
+    case ChunkType::Stored:
+        if (!ReadImage(out, offset, ChunkSize))
+            return false;
+
+        m_stats.chunksStored++;
+        return true;
+
+    case ChunkType::LZ4: {
+        if (size > ChunkSize || !ReadImage(m_compressed, offset, size))
+            return false;
+
+        s32 ret = LZ4::Decompress(m_compressed, size, out, ChunkSize);
+        if (ret != s32(ChunkSize)) {
+            PRINT(IOS_EmuDI, ERROR, "Corrupt chunk %u (%d)", chunk, ret);
+            return false;
+        }
+
+        m_stats.chunksDecompressed++;
+        return true;
+    }
+
+    default:
+        PRINT(IOS_EmuDI, ERROR, "Unknown chunk type: %u", u32(entry.type));
+        return false;
+    }
+}
+
+const u8* CompressedISO::LoadChunk(u32 chunk)
+{
+    if (chunk == m_chunkNum)
+        return m_chunk;
+
+    m_chunkNum = ~0;
+    ChunkEntry entry;
+    if (!GetChunkEntry(chunk, &entry) || !ReadChunk(chunk, entry, m_chunk))
+        return nullptr;
+
+    m_chunkNum = chunk;
+    return m_chunk;
+}
+
+bool CompressedISO::ReadRaw(void* buffer, u32 wordOffset, u32 byteLen)
+{
+    if (!m_valid)
+        return false;
+
+    u8* writeBuffer = reinterpret_cast<u8*>(buffer);
+    u64 offset = (u64) wordOffset * 4;
+
+    if (offset + byteLen > m_header.discSize) {
+        PRINT(IOS_EmuDI, ERROR, "Read off the end of the disc (%llX)",
+          offset + byteLen);
+        return false;
+    }
+
+    while (byteLen > 0) {
+        u32 chunk = offset / ChunkSize;
+        u32 chunkOffset = offset % ChunkSize;
+        u32 copyLen = std::min(byteLen, ChunkSize - chunkOffset);
+
+        if (copyLen == ChunkSize && chunk != m_chunkNum) {
+            // Whole chunk, write it straight to the output
+            ChunkEntry entry;
+            if (!GetChunkEntry(chunk, &entry) ||
+                !ReadChunk(chunk, entry, writeBuffer))
+                return false;
+        } else {
+            const u8* data = LoadChunk(chunk);
+            if (data == nullptr)
+                return false;
+
+            std::memcpy(writeBuffer, data + chunkOffset, copyLen);
+        }
+
+        writeBuffer += copyLen;
+        offset += copyLen;
+        byteLen -= copyLen;
+    }
+
+    return true;
+}
+
+bool CompressedISO::ReadFromPartition(void* out, u32 wordOffset, u32 byteLen)
+{
+    if (!m_partitionOpened) {
+        PRINT(IOS_EmuDI, ERROR, "Attempt read with no open partition");
+        return false;
+    }
+
+    if (m_partitionOffset != m_header.partitionWordOffset) {
+        PRINT(IOS_EmuDI, ERROR, "Partition 0x%08X is not decrypted in image",
+          m_partitionOffset);
+        return false;
+    }
+
+    if ((m_partition.dataWordOffset << 2) % ChunkSize != 0) {
+        PRINT(IOS_EmuDI, ERROR, "Partition data not aligned to a chunk");
+        return false;
+    }
+
+    if (!aligned(byteLen, 32)) {
+        PRINT(IOS_EmuDI, ERROR, "Read length not 32-byte aligned");
+        return false;
+    }
+
+    u64 offset = (u64) wordOffset * 4;
+    if (offset + byteLen > (u64) m_partitionBlockCount * BlockDataSize) {
+        PRINT(IOS_EmuDI, ERROR, "Read off the end of the partition (%llX)",
+          offset + byteLen);
+        return false;
+    }
+
+    u8* writeBuffer = reinterpret_cast<u8*>(out);
+    u32 dataStart = m_partitionOffset + m_partition.dataWordOffset;
+    bool ret = true;
+
+    m_mutex.lock();
+    while (ret && byteLen > 0) {
+        u32 block = offset / BlockDataSize;
+        u32 blockOffset = offset % BlockDataSize;
+        u32 copyLen = std::min(byteLen, BlockDataSize - blockOffset);
+
+        // The H3 hash is read through the chunk buffer, so it can't be read
+        // while checking the block
+        if (m_verifyMode != Config::DiscVerifyMode::Off && !LoadH3Hash(block)) {
+            ret = false;
+            break;
+        }
+
+        // A block is a chunk, the hash header and then the data
+        u32 blockWordOffset = dataStart + block * (BlockSize >> 2);
+        const u8* data = LoadChunk(blockWordOffset / (ChunkSize >> 2));
+        ret = data != nullptr &&
+              VerifyBlock(blockWordOffset, data, data + BlockHeaderSize);
+        if (ret) {
+            std::memcpy(
+              writeBuffer, data + BlockHeaderSize + blockOffset, copyLen);
+        }
+
+        writeBuffer += copyLen;
+        offset += copyLen;
+        byteLen -= copyLen;
+    }
+    m_mutex.unlock();
+
+    return ret;
+}
+
+bool CompressedISO::Prefetch(
+  [[maybe_unused]] u32 wordOffset, [[maybe_unused]] u32 byteLen)
+{
+    // A chunk has to be decompressed into the one chunk buffer to be read, so
+    // there's nowhere to keep prefetched blocks
+    return false;
+}
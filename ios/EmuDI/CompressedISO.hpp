@@ -0,0 +1,118 @@
+// CompressedISO.hpp - Chunk-compressed disc image
+//
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "ISO.hpp"
+#include <System/Types.h>
+
+/**
+ * Disc image split into fixed-size chunks, each compressed separately with
+ * LZ4 so any chunk can be read on its own. Chunks that are filled with a
+ * single byte value, like zeroed padding, take no space in the file. Made
+ * from a normal ISO with tools/compress_disc.py.
+ *
+ * Encrypted data doesn't compress, so the game partition's blocks are stored
+ * decrypted, hash header included. Partition reads then need no AES, and the
+ * hashes can still be checked. Other partitions can't be opened.
+ */
+class CompressedISO : public ISO
+{
+public:
+    CompressedISO(const char* const* paths, u32 count);
+    virtual ~CompressedISO();
+
+    virtual bool IsInserted() override;
+
+    static constexpr u32 Magic = 0x57434D50; // 'WCMP'
+    static constexpr u32 Version = 2;
+
+    // Same as a Wii disc block, so an encrypted block read needs one chunk
+    static constexpr u32 ChunkSize = 0x8000;
+
+    struct Header {
+        u32 magic;
+        u32 version;
+        u32 chunkSize;
+        u32 chunkCount;
+        u64 discSize;
+        // File offset of the chunk index
+        u64 indexOffset;
+        // Disc word offset of the partition stored decrypted
+        u32 partitionWordOffset;
+        u32 pad;
+    };
+
+    static_assert(sizeof(Header) == 0x28);
+
+    enum class ChunkType : u8 {
+        LZ4 = 0,
+        Stored = 1,
+        // Every byte of the chunk is the same, nothing is stored in the file
+        Fill = 2,
+    };
+
+    struct ChunkEntry {
+        // File offset in 16 byte units
+        u32 offset;
+        ChunkType type;
+        // Compressed size for LZ4, fill byte value in the last byte for Fill
+        u8 size[3];
+    };
+
+    static_assert(sizeof(ChunkEntry) == 8);
+
+    struct Stats {
+        u32 chunksDecompressed;
+        u32 chunksStored;
+        u32 chunksFilled;
+        u32 indexReads;
+    };
+
+    Stats GetStats() const
+    {
+        return m_stats;
+    }
+
+    bool ReadFromPartition(void* out, u32 wordOffset, u32 byteLen) override;
+    bool Prefetch(u32 wordOffset, u32 byteLen) override;
+
+protected:
+    /**
+     * Read raw data at a disc offset. In the decrypted partition, this is the
+     * decrypted blocks.
+     */
+    virtual bool ReadRaw(void* buffer, u32 wordOffset, u32 byteLen) override;
+
+private:
+    bool ReadHeader();
+    bool GetChunkEntry(u32 chunk, ChunkEntry* entry);
+    bool ReadChunk(u32 chunk, const ChunkEntry& entry, u8* out);
+
+    /**
+     * Decompress a chunk into m_chunk, unless it's there already.
+     * @returns m_chunk, or nullptr on failure.
+     */
+    const u8* LoadChunk(u32 chunk);
+
+    bool m_valid = false;
+    Header m_header;
+
+    // The index for a whole disc doesn't fit in memory, so it's read one page
+    // at a time
+    static constexpr u32 IndexPageEntries = 64;
+    ChunkEntry m_indexPage[IndexPageEntries];
+    u32 m_indexPageNum = ~0;
+
+    // Compressed input for the chunk being read. Allocated from the heap,
+    // instead of the block buffers an encrypted image would need.
+    u8* m_compressed = nullptr;
+
+    // Last chunk decompressed for a partial read, kept for the next read of
+    // the same chunk
+    u8* m_chunk = nullptr;
+    u32 m_chunkNum = ~0;
+
+    Stats m_stats = {};
+};
@@ -0,0 +1,130 @@
+// DecryptedISO.cpp - Pre-decrypted disc image
+//
+// SPDX-License-Identifier: MIT
+
+#include "DecryptedISO.hpp"
+#include <Debug/Log.hpp>
+#include <IOS/System.hpp>
+#include <algorithm>
+#include <cstring>
+
+DecryptedISO::DecryptedISO(const char* const* paths, u32 count)
+  : ISO(paths, count, false)
+{
+    m_valid = ReadHeader();
+    if (!m_valid) {
+        PRINT(IOS_EmuDI, ERROR, "Invalid decrypted disc image");
+        return;
+    }
+
+    PRINT(IOS_EmuDI, INFO, "Successfully opened decrypted disc image");
+    PRINT(IOS_EmuDI, INFO, "Partition data size: %llX", m_header.dataSize);
+}
+
+DecryptedISO::~DecryptedISO() = default;
+
+bool DecryptedISO::IsInserted()
+{
+    return m_valid && ISO::IsInserted();
+}
+
+bool DecryptedISO::ReadHeader()
+{
+    if (!ReadImage(&m_header, 0, sizeof(Header))) {
+        PRINT(IOS_EmuDI, ERROR, "Failed to read header");
+        return false;
+    }
+
+    if (m_header.magic != Magic || m_header.version != Version) {
+        PRINT(IOS_EmuDI, ERROR, "Bad magic or version: %08X, %u",
+          m_header.magic, m_header.version);
+        return false;
+    }
+
+    if (m_header.extentCount > MaxExtents) {
+        PRINT(IOS_EmuDI, ERROR, "Too many extents: %u", m_header.extentCount);
+        return false;
+    }
+
+    if (!ReadImage(m_extents, m_header.extentTableOffset,
+          m_header.extentCount * sizeof(Extent))) {
+        PRINT(IOS_EmuDI, ERROR, "Failed to read extent table");
+        return false;
+    }
+
+    return true;
+}
+
+bool DecryptedISO::ReadRaw(void* buffer, u32 wordOffset, u32 byteLen)
+{
+    if (!m_valid)
+        return false;
+
+    u8* writeBuffer = reinterpret_cast<u8*>(buffer);
+    u64 offset = (u64) wordOffset * 4;
+    const u64 end = offset + byteLen;
+
+    // Areas not covered by an extent read as zero, like the unused parts of a
+    // WBFS disc
+    std::memset(buffer, 0, byteLen);
+
+    for (u32 i = 0; i < m_header.extentCount; i++) {
+        const Extent& extent = m_extents[i];
+        u64 extentStart = (u64) extent.discWordOffset * 4;
+        u64 extentEnd = extentStart + extent.byteLength;
+
+        u64 start = std::max(offset, extentStart);
+        u64 stop = std::min(end, extentEnd);
+        if (start >= stop)
+            continue;
+
+        if (!ReadImage(writeBuffer + (start - offset),
+              extent.fileOffset + (start - extentStart), stop - start)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool DecryptedISO::ReadFromPartition(void* out, u32 wordOffset, u32 byteLen)
+{
+    if (!m_partitionOpened) {
+        PRINT(IOS_EmuDI, ERROR, "Attempt read with no open partition");
+        return false;
+    }
+
+    if (m_partitionOffset != m_header.partitionWordOffset) {
+        PRINT(IOS_EmuDI, ERROR, "Partition 0x%08X is not in the image",
+          m_partitionOffset);
+        return false;
+    }
+
+    if (!aligned(byteLen, 32)) {
+        PRINT(IOS_EmuDI, ERROR, "Read length not 32-byte aligned");
+        return false;
+    }
+
+    if (byteLen == 0)
+        return true;
+
+    u64 offset = (u64) wordOffset * 4;
+    if (offset + byteLen > m_header.dataSize) {
+        PRINT(IOS_EmuDI, ERROR, "Read off the end of the partition (%llX)",
+          offset + byteLen);
+        return false;
+    }
+
+    m_mutex.lock();
+    bool ret = ReadImage(out, m_header.dataOffset + offset, byteLen);
+    m_mutex.unlock();
+
+    return ret;
+}
+
+bool DecryptedISO::Prefetch(
+  [[maybe_unused]] u32 wordOffset, [[maybe_unused]] u32 byteLen)
+{
+    // Reads go straight to the file, there's nothing worth doing ahead of time
+    return false;
+}
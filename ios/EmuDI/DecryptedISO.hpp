@@ -0,0 +1,69 @@
+// DecryptedISO.hpp - Pre-decrypted disc image
+//
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "ISO.hpp"
+#include <System/Types.h>
+
+/**
+ * Disc image with the game partition already decrypted and the hash blocks
+ * removed, so partition reads are a plain file read. Only the unencrypted
+ * areas the disc interface needs (disc header, partition table, partition
+ * header with the ticket, TMD and H3 table) are kept, as extents in the file.
+ * Made from a normal ISO with tools/decrypt_disc.py.
+ */
+class DecryptedISO : public ISO
+{
+public:
+    DecryptedISO(const char* const* paths, u32 count);
+    virtual ~DecryptedISO();
+
+    virtual bool IsInserted() override;
+
+    static constexpr u32 Magic = 0x57444543; // 'WDEC'
+    static constexpr u32 Version = 1;
+
+    struct Header {
+        u32 magic;
+        u32 version;
+        u32 extentCount;
+        // File offset of the extent table
+        u32 extentTableOffset;
+        // Disc word offset of the decrypted partition
+        u32 partitionWordOffset;
+        u32 pad;
+        // File offset and size of the decrypted partition data
+        u64 dataOffset;
+        u64 dataSize;
+    };
+
+    static_assert(sizeof(Header) == 0x28);
+
+    /**
+     * An unencrypted area of the disc stored in the file.
+     */
+    struct Extent {
+        u32 discWordOffset;
+        u32 byteLength;
+        u64 fileOffset;
+    };
+
+    static_assert(sizeof(Extent) == 0x10);
+
+    static constexpr u32 MaxExtents = 16;
+
+    bool ReadFromPartition(void* out, u32 wordOffset, u32 byteLen) override;
+    bool Prefetch(u32 wordOffset, u32 byteLen) override;
+
+protected:
+    virtual bool ReadRaw(void* buffer, u32 wordOffset, u32 byteLen) override;
+
+private:
+    bool ReadHeader();
+
+    bool m_valid = false;
+    Header m_header;
+    Extent m_extents[MaxExtents];
+};
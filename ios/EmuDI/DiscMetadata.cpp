@@ -0,0 +1,207 @@
+// DiscMetadata.cpp - Saved disc headers of an emulated disc image
+//
+// SPDX-License-Identifier: MIT
+
+#include "DiscMetadata.hpp"
+#include <Debug/Log.hpp>
+#include <FAT/ff.h>
+#include <System/SHA.hpp>
+#include <cstdio>
+#include <cstring>
+
+DiscMetadata::DiscMetadata(
+  const char* imagePath, u64 imageSize, u32 imageTime)
+{
+    // A cut off path could name another image's file, so go without one
+    if (u32(snprintf(m_path, sizeof(m_path), "%s.meta", imagePath)) >=
+        sizeof(m_path)) {
+        PRINT(IOS_EmuDI, WARN, "Image path too long for disc metadata: %s",
+          imagePath);
+        m_path[0] = '\0';
+    }
+
+    m_imageSize = imageSize;
+    m_imageTime = imageTime;
+    m_body = {};
+}
+
+bool DiscMetadata::Load()
+{
+    if (m_path[0] == '\0')
+        return false;
+
+    FIL file;
+    auto fret = f_open(&file, m_path, FA_READ);
+    if (fret != FR_OK)
+        return false;
+
+    FileHeader header;
+    UINT br1 = 0, br2 = 0;
+    auto fret1 = f_read(&file, &header, sizeof(header), &br1);
+    auto fret2 = f_read(&file, &m_body, sizeof(m_body), &br2);
+    f_close(&file);
+
+    if (fret1 != FR_OK || fret2 != FR_OK || br1 != sizeof(header) ||
+        br2 != sizeof(m_body) || header.magic != Magic ||
+        header.version != Version || header.bodySize != sizeof(m_body) ||
+        header.imageSize != m_imageSize || header.imageTime != m_imageTime) {
+        PRINT(IOS_EmuDI, INFO, "Disc metadata %s is outdated", m_path);
+        m_body = {};
+        return false;
+    }
+
+    u8 hash[0x14] ATTRIBUTE_ALIGN(32);
+    if (SHA::Calculate(&m_body, sizeof(m_body), hash) != IOSError::OK ||
+        memcmp(hash, header.hash, sizeof(hash)) != 0 ||
+        m_body.regionCount > MaxRegions ||
+        m_body.partitionCount > MaxPartitions) {
+        PRINT(IOS_EmuDI, ERROR, "Disc metadata %s is corrupt", m_path);
+        m_body = {};
+        return false;
+    }
+
+    bool valid = true;
+    for (u32 i = 0; i < m_body.regionCount; i++) {
+        if (m_body.regions[i].byteLen > MaxRegionSize)
+            valid = false;
+    }
+
+    for (u32 i = 0; i < m_body.partitionCount; i++) {
+        if (m_body.partitions[i].header.tmdByteLength >
+            sizeof(Partition::tmd))
+            valid = false;
+    }
+
+    if (!valid) {
+        PRINT(IOS_EmuDI, ERROR, "Disc metadata %s is corrupt", m_path);
+        m_body = {};
+        return false;
+    }
+
+    PRINT(IOS_EmuDI, INFO, "Loaded disc metadata: %u regions, %u partitions",
+      m_body.regionCount, m_body.partitionCount);
+    m_dirty = false;
+    return true;
+}
+
+void DiscMetadata::Save()
+{
+    if (!m_dirty || m_path[0] == '\0')
+        return;
+
+    m_dirty = false;
+
+    FileHeader header = {
+      .magic = Magic,
+      .version = Version,
+      .imageSize = m_imageSize,
+      .imageTime = m_imageTime,
+      .bodySize = sizeof(m_body),
+      .hash = {},
+      .pad = 0,
+    };
+
+    if (SHA::Calculate(&m_body, sizeof(m_body), header.hash) != IOSError::OK)
+        return;
+
+    FIL file;
+    auto fret = f_open(&file, m_path, FA_CREATE_ALWAYS | FA_WRITE);
+    if (fret != FR_OK) {
+        PRINT(IOS_EmuDI, ERROR, "Failed to create %s: %d", m_path, fret);
+        return;
+    }
+
+    UINT bw1 = 0, bw2 = 0;
+    auto fret1 = f_write(&file, &header, sizeof(header), &bw1);
+    auto fret2 = f_write(&file, &m_body, sizeof(m_body), &bw2);
+    fret = f_close(&file);
+
+    if (fret1 != FR_OK || fret2 != FR_OK || fret != FR_OK ||
+        bw1 != sizeof(header) || bw2 != sizeof(m_body)) {
+        PRINT(IOS_EmuDI, ERROR, "Failed to write %s", m_path);
+        // Don't leave a truncated file behind
+        f_unlink(m_path);
+    }
+}
+
+bool DiscMetadata::GetDiskID(DI::DiskID* out) const
+{
+    if (!m_body.hasDiskID)
+        return false;
+
+    *out = m_body.diskID;
+    return true;
+}
+
+void DiscMetadata::SetDiskID(const DI::DiskID& diskID)
+{
+    if (m_body.hasDiskID && !memcmp(&m_body.diskID, &diskID, sizeof(diskID)))
+        return;
+
+    m_body.hasDiskID = true;
+    m_body.diskID = diskID;
+    m_dirty = true;
+}
+
+bool DiscMetadata::ReadRegion(
+  void* out, u32 partitionWordOffset, u32 wordOffset, u32 byteLen) const
+{
+    for (u32 i = 0; i < m_body.regionCount; i++) {
+        const Region* region = &m_body.regions[i];
+        if (region->partitionWordOffset != partitionWordOffset ||
+            wordOffset < region->wordOffset)
+            continue;
+
+        u32 words = wordOffset - region->wordOffset;
+        if (words > region->byteLen / 4 ||
+            byteLen > region->byteLen - words * 4)
+            continue;
+
+        memcpy(out, &region->data[words * 4], byteLen);
+        return true;
+    }
+
+    return false;
+}
+
+void DiscMetadata::AddRegion(
+  const void* data, u32 partitionWordOffset, u32 wordOffset, u32 byteLen)
+{
+    if (byteLen == 0 || byteLen > MaxRegionSize ||
+        m_body.regionCount == MaxRegions)
+        return;
+
+    Region* region = &m_body.regions[m_body.regionCount++];
+    region->partitionWordOffset = partitionWordOffset;
+    region->wordOffset = wordOffset;
+    region->byteLen = byteLen;
+    memcpy(region->data, data, byteLen);
+    m_dirty = true;
+}
+
+const DiscMetadata::Partition* DiscMetadata::FindPartition(
+  u32 wordOffset) const
+{
+    for (u32 i = 0; i < m_body.partitionCount; i++) {
+        if (m_body.partitions[i].wordOffset == wordOffset)
+            return &m_body.partitions[i];
+    }
+
+    return nullptr;
+}
+
+void DiscMetadata::AddPartition(u32 wordOffset, const DI::Partition& header,
+  const ES::TMD* tmd, u32 tmdByteLength)
+{
+    if (tmdByteLength > sizeof(Partition::tmd) ||
+        FindPartition(wordOffset) != nullptr ||
+        m_body.partitionCount == MaxPartitions)
+        return;
+
+    Partition* partition = &m_body.partitions[m_body.partitionCount++];
+    partition->wordOffset = wordOffset;
+    partition->header = header;
+    memset(&partition->tmd, 0, sizeof(partition->tmd));
+    memcpy(&partition->tmd, tmd, tmdByteLength);
+    m_dirty = true;
+}
@@ -0,0 +1,124 @@
+// DiscMetadata.hpp - Saved disc headers of an emulated disc image
+//
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <DVD/DI.hpp>
+#include <System/ES.hpp>
+#include <System/Types.h>
+
+/**
+ * Disc and partition headers of a disc image, saved to a file next to the
+ * image so later launches don't have to read them again. The file is only
+ * used if the image's size and modification time match, and the whole file
+ * is checked against a SHA-1 before use. Title keys are only saved encrypted
+ * in the ticket, and are decrypted again on each open. Not thread safe.
+ */
+class DiscMetadata
+{
+public:
+    /**
+     * @param imagePath Path of the first image part, the file is saved next
+     * to it. Nothing is loaded or saved if the file's path doesn't fit in
+     * MaxPathSize.
+     * @param imageTime FAT modification date and time of the newest part.
+     */
+    DiscMetadata(const char* imagePath, u64 imageSize, u32 imageTime);
+
+    static constexpr u32 Magic = 0x44494D44; // 'DIMD'
+    static constexpr u32 Version = 2;
+
+    static constexpr u32 MaxPartitions = 4;
+    // Disc games have a single content, anything else isn't cached
+    static constexpr u32 MaxTMDContents = 4;
+
+    // Small header reads kept, e.g. the volume and partition tables and the
+    // FST location
+    static constexpr u32 MaxRegions = 16;
+    static constexpr u32 MaxRegionSize = 0x40;
+
+    // Regions not inside a partition
+    static constexpr u32 NoPartition = ~0;
+
+    // Longest path of the file with its null terminator, enough for the
+    // image names EmuDI looks for
+    static constexpr u32 MaxPathSize = 40;
+
+    struct Partition {
+        u32 wordOffset;
+        DI::Partition header;
+        ES::TMDFixed<MaxTMDContents> tmd;
+    };
+
+    /**
+     * Load the file, if it exists and matches the image.
+     */
+    bool Load();
+
+    /**
+     * Write the file if anything was added since it was loaded or saved.
+     */
+    void Save();
+
+    bool GetDiskID(DI::DiskID* out) const;
+    void SetDiskID(const DI::DiskID& diskID);
+
+    /**
+     * Copy a read from a saved region.
+     * @param partitionWordOffset Partition the read is from, or NoPartition
+     * for an unencrypted read.
+     * @returns False if the read isn't entirely inside a saved region.
+     */
+    bool ReadRegion(
+      void* out, u32 partitionWordOffset, u32 wordOffset, u32 byteLen) const;
+
+    /**
+     * Save a read, if it's small enough and there is room.
+     */
+    void AddRegion(const void* data, u32 partitionWordOffset, u32 wordOffset,
+      u32 byteLen);
+
+    const Partition* FindPartition(u32 wordOffset) const;
+
+    /**
+     * Save an opened partition's headers.
+     */
+    void AddPartition(u32 wordOffset, const DI::Partition& header,
+      const ES::TMD* tmd, u32 tmdByteLength);
+
+private:
+    struct FileHeader {
+        u32 magic;
+        u32 version;
+        u64 imageSize;
+        u32 imageTime;
+        u32 bodySize;
+        // SHA-1 of the body
+        u8 hash[0x14];
+        u32 pad;
+    };
+
+    struct Region {
+        u32 partitionWordOffset;
+        u32 wordOffset;
+        u32 byteLen;
+        u8 data[MaxRegionSize];
+    };
+
+    struct Body {
+        u32 hasDiskID;
+        DI::DiskID diskID;
+        u32 regionCount;
+        u32 partitionCount;
+        Region regions[MaxRegions];
+        Partition partitions[MaxPartitions];
+    };
+
+    char m_path[MaxPathSize];
+    u64 m_imageSize;
+    u32 m_imageTime;
+    bool m_dirty = false;
+
+    Body m_body ATTRIBUTE_ALIGN(32);
+};
@@ -0,0 +1,528 @@
+// DriveCache.cpp - SD card cache of reads from the disc drive
+//
+// SPDX-License-Identifier: MIT
+
+#include "DriveCache.hpp"
+#include <Debug/Log.hpp>
+#include <IOS/Syscalls.h>
+#include <IOS/System.hpp>
+#include <System/SHA.hpp>
+#include <System/Util.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+DriveCache* DriveCache::s_instance = nullptr;
+
+// Folder on the SD card the cache files are kept in
+static constexpr const char* CacheDir = "0:/dicache";
+
+// Keep the file size below the FAT32 limit
+static constexpr u32 MaxSizeMB = 3584;
+
+// Encrypted Wii disc block size, the TMD content size is in these
+static constexpr u32 DiscBlockSize = 0x8000;
+
+// Number of blocks written between syncing the file
+static constexpr u32 SyncInterval = 16;
+
+DriveCache::DriveCache(u32 sizeMB)
+{
+    u64 size = (u64) std::min(sizeMB, MaxSizeMB) * 1024 * 1024;
+    m_setCount = std::max<u32>(size / BlockSize / Ways, 1);
+    m_dataOffset = round_up(HeaderSize + m_setCount * Ways * sizeof(Tag),
+      static_cast<unsigned int>(DiscBlockSize));
+
+    // Not using new, the cache is optional if memory is short
+    m_readBuffer = reinterpret_cast<u8*>(
+      IOS_AllocAligned(System::GetHeap(), BlockSize, 32));
+
+    for (u32 i = 0; i < PendingCount; i++) {
+        m_pending[i].data = reinterpret_cast<u8*>(
+          IOS_AllocAligned(System::GetHeap(), BlockSize, 32));
+        if (m_pending[i].data != nullptr)
+            m_freeQueue.send(&m_pending[i]);
+    }
+
+    if (m_readBuffer == nullptr) {
+        PRINT(IOS_EmuDI, WARN, "Not enough memory for the drive cache");
+        return;
+    }
+
+    // Below the DI workers, so drive reads come first
+    m_thread.create(
+      ThreadEntry, reinterpret_cast<void*>(this), nullptr, 0x1000, 25);
+}
+
+void DriveCache::SetPresent(u32 block, bool present)
+{
+    if (block >= m_blockCount)
+        return;
+
+    if (present)
+        m_present[block / 8] |= 1 << (block % 8);
+    else
+        m_present[block / 8] &= ~(1 << (block % 8));
+}
+
+bool DriveCache::CreateFile(const FileHeader& header)
+{
+    auto fret = f_mkdir(CacheDir);
+    if (fret != FR_OK && fret != FR_EXIST) {
+        PRINT(IOS_EmuDI, ERROR, "Failed to create %s: %d", CacheDir, fret);
+        return false;
+    }
+
+    fret = f_open(&m_file, m_path, FA_CREATE_ALWAYS | FA_READ | FA_WRITE);
+    if (fret != FR_OK) {
+        PRINT(IOS_EmuDI, ERROR, "Failed to create %s: %d", m_path, fret);
+        return false;
+    }
+
+    // Allocate the whole file up front, so writing a block never has to
+    // extend the cluster chain. It still works if the card has no contiguous
+    // space left, just slower.
+    fret = f_expand(&m_file, GetSlotOffset(m_setCount * Ways), 1);
+    if (fret != FR_OK)
+        PRINT(IOS_EmuDI, WARN, "Failed to preallocate %s: %d", m_path, fret);
+
+    memset(m_readBuffer, 0, HeaderSize);
+    memcpy(m_readBuffer, &header, sizeof(header));
+
+    UINT bw;
+    fret = f_write(&m_file, m_readBuffer, HeaderSize, &bw);
+
+    // Mark every slot empty
+    Tag* tags = reinterpret_cast<Tag*>(m_readBuffer);
+    constexpr u32 tagsPerWrite = BlockSize / sizeof(Tag);
+    for (u32 i = 0; i < tagsPerWrite; i++) {
+        tags[i] = {
+          .block = InvalidBlock,
+          .sequence = 0,
+          .hash = {},
+          .pad = 0,
+        };
+    }
+
+    u32 tagCount = m_setCount * Ways;
+    for (u32 i = 0; fret == FR_OK && i < tagCount; i += tagsPerWrite) {
+        u32 len = std::min(tagCount - i, tagsPerWrite) * sizeof(Tag);
+        fret = f_write(&m_file, m_readBuffer, len, &bw);
+        if (fret == FR_OK && bw != len)
+            fret = FR_DENIED;
+    }
+
+    if (fret == FR_OK)
+        fret = f_sync(&m_file);
+
+    if (fret != FR_OK) {
+        PRINT(IOS_EmuDI, ERROR, "Failed to write %s: %d", m_path, fret);
+        f_close(&m_file);
+        f_unlink(m_path);
+        return false;
+    }
+
+    return true;
+}
+
+bool DriveCache::LoadTags()
+{
+    auto fret = f_lseek(&m_file, HeaderSize);
+
+    Tag* tags = reinterpret_cast<Tag*>(m_readBuffer);
+    constexpr u32 tagsPerRead = BlockSize / sizeof(Tag);
+
+    u32 tagCount = m_setCount * Ways;
+    for (u32 i = 0; fret == FR_OK && i < tagCount; i += tagsPerRead) {
+        u32 count = std::min(tagCount - i, tagsPerRead);
+
+        UINT br;
+        fret = f_read(&m_file, m_readBuffer, count * sizeof(Tag), &br);
+        if (fret != FR_OK || br != count * sizeof(Tag))
+            return false;
+
+        for (u32 j = 0; j < count; j++) {
+            if (tags[j].block == InvalidBlock)
+                continue;
+
+            SetPresent(tags[j].block, true);
+            m_sequence = std::max(m_sequence, tags[j].sequence + 1);
+        }
+    }
+
+    return fret == FR_OK;
+}
+
+void DriveCache::Open(const DI::DiskID& diskID, u32 partitionWordOffset,
+  const ES::TMDFixed<512>* tmd)
+{
+    Close();
+
+    if (m_readBuffer == nullptr)
+        return;
+
+    FileHeader header = {};
+    header.magic = Magic;
+    header.version = Version;
+    memcpy(header.gameID, diskID.gameID, sizeof(header.gameID));
+    header.groupID = diskID.groupID;
+    header.discNum = diskID.discNum;
+    header.discVer = diskID.discVer;
+    header.partitionWordOffset = partitionWordOffset;
+    memcpy(header.h3Hash, tmd->contents[0].hash, sizeof(header.h3Hash));
+    header.setCount = m_setCount;
+    header.ways = Ways;
+
+    u32 blockCount = tmd->contents[0].size / DiscBlockSize;
+
+    m_fileMutex.lock();
+
+    // Nothing else uses the bitmap until the file is open
+    m_present =
+      reinterpret_cast<u8*>(IOS_Alloc(System::GetHeap(), (blockCount + 7) / 8));
+    if (m_present == nullptr) {
+        PRINT(IOS_EmuDI, WARN, "Not enough memory for the drive cache bitmap");
+        m_fileMutex.unlock();
+        return;
+    }
+
+    memset(m_present, 0, (blockCount + 7) / 8);
+    m_blockCount = blockCount;
+    m_sequence = 0;
+
+    // e.g. 0:/dicache/RMCE01-0-000F8000.bin
+    char id[7];
+    memcpy(id, diskID.gameID, 4);
+    id[4] = diskID.groupID >> 8;
+    id[5] = diskID.groupID & 0xFF;
+    id[6] = '\0';
+    for (u32 i = 0; i < 6; i++) {
+        if (!(id[i] >= '0' && id[i] <= '9') && !(id[i] >= 'A' && id[i] <= 'Z'))
+            id[i] = '_';
+    }
+    snprintf(m_path, sizeof(m_path), "%s/%s-%u-%08X.bin", CacheDir, id,
+      diskID.discNum, partitionWordOffset);
+
+    bool opened = f_open(&m_file, m_path, FA_READ | FA_WRITE) == FR_OK;
+    if (opened) {
+        // A different disc revision or cache size can't use the file
+        FileHeader fileHeader;
+        UINT br;
+        if (f_read(&m_file, &fileHeader, sizeof(fileHeader), &br) != FR_OK ||
+            br != sizeof(fileHeader) ||
+            memcmp(&fileHeader, &header, sizeof(header)) != 0 || !LoadTags()) {
+            PRINT(IOS_EmuDI, WARN, "Drive cache %s is outdated", m_path);
+            f_close(&m_file);
+            memset(m_present, 0, (blockCount + 7) / 8);
+            m_sequence = 0;
+            opened = false;
+        }
+    }
+
+    if (!opened)
+        opened = CreateFile(header);
+
+    if (!opened) {
+        IOS_Free(System::GetHeap(), m_present);
+        m_present = nullptr;
+        m_blockCount = 0;
+        m_fileMutex.unlock();
+        return;
+    }
+
+    m_unsynced = 0;
+
+    m_mutex.lock();
+    m_open = true;
+    m_generation++;
+    m_mutex.unlock();
+
+    PRINT(IOS_EmuDI, INFO, "Opened drive cache %s", m_path);
+
+    m_fileMutex.unlock();
+}
+
+void DriveCache::Close()
+{
+    m_fileMutex.lock();
+    m_mutex.lock();
+
+    bool wasOpen = m_open;
+    if (m_open) {
+        m_open = false;
+        // Drop pending writes for the old partition
+        m_generation++;
+    }
+
+    if (m_present != nullptr) {
+        IOS_Free(System::GetHeap(), m_present);
+        m_present = nullptr;
+    }
+    m_blockCount = 0;
+
+    m_mutex.unlock();
+
+    if (wasOpen)
+        f_close(&m_file);
+
+    m_fileMutex.unlock();
+}
+
+bool DriveCache::ReadSet(u32 set, Tag* tags)
+{
+    UINT br;
+    auto fret = f_lseek(&m_file, HeaderSize + set * Ways * sizeof(Tag));
+    if (fret == FR_OK)
+        fret = f_read(&m_file, tags, Ways * sizeof(Tag), &br);
+
+    return fret == FR_OK && br == Ways * sizeof(Tag);
+}
+
+bool DriveCache::ReadBlock(u8* out, u32 block, u32 offset, u32 len)
+{
+    u32 set = block % m_setCount;
+    Tag tags[Ways];
+    if (!ReadSet(set, tags))
+        return false;
+
+    u32 way = 0;
+    while (way < Ways && tags[way].block != block)
+        way++;
+
+    if (way == Ways) {
+        // The bitmap is out of date
+        m_mutex.lock();
+        SetPresent(block, false);
+        m_mutex.unlock();
+        return false;
+    }
+
+    u32 slot = set * Ways + way;
+
+    // The whole block is needed to check the hash
+    UINT br;
+    auto fret = f_lseek(&m_file, GetSlotOffset(slot));
+    if (fret == FR_OK)
+        fret = f_read(&m_file, m_readBuffer, BlockSize, &br);
+    if (fret != FR_OK || br != BlockSize) {
+        PRINT(IOS_EmuDI, ERROR, "Failed to read drive cache slot %u", slot);
+        return false;
+    }
+
+    u8 hash[0x14] ATTRIBUTE_ALIGN(32);
+    if (SHA::Calculate(m_readBuffer, BlockSize, hash) != IOSError::OK)
+        return false;
+
+    if (memcmp(hash, tags[way].hash, sizeof(hash)) != 0) {
+        PRINT(IOS_EmuDI, WARN, "Drive cache block %u is corrupt", block);
+
+        // Forget the slot so the block is fetched from the drive again
+        tags[way].block = InvalidBlock;
+        f_lseek(&m_file, HeaderSize + slot * sizeof(Tag));
+        f_write(&m_file, &tags[way], sizeof(Tag), &br);
+
+        m_mutex.lock();
+        m_stats.hashFailures++;
+        SetPresent(block, false);
+        m_mutex.unlock();
+        return false;
+    }
+
+    memcpy(out, &m_readBuffer[offset], len);
+    return true;
+}
+
+bool DriveCache::Read(void* out, u32 wordOffset, u32 byteLen)
+{
+    if (byteLen == 0)
+        return false;
+
+    u32 block = wordOffset / BlockWords;
+    u32 blockEnd = (wordOffset + (byteLen + 3) / 4 - 1) / BlockWords + 1;
+
+    m_mutex.lock();
+
+    if (!m_open) {
+        m_mutex.unlock();
+        return false;
+    }
+
+    // Only use the cache if the whole read is there, rather than splitting
+    // it between the cache and the drive
+    for (u32 i = block; i < blockEnd; i++) {
+        if (!IsPresent(i)) {
+            m_stats.misses++;
+            m_mutex.unlock();
+            return false;
+        }
+    }
+
+    u32 generation = m_generation;
+    m_mutex.unlock();
+
+    m_fileMutex.lock();
+
+    // The file can't change while the file mutex is held, but it may have
+    // been closed or reopened since the check
+    bool hit = m_open && m_generation == generation;
+
+    u8* outBytes = reinterpret_cast<u8*>(out);
+    u32 offset = (wordOffset % BlockWords) * 4;
+    for (u32 i = block; hit && i < blockEnd; i++) {
+        u32 len = std::min(byteLen, BlockSize - offset);
+        hit = ReadBlock(outBytes, i, offset, len);
+
+        outBytes += len;
+        byteLen -= len;
+        offset = 0;
+    }
+
+    m_fileMutex.unlock();
+
+    m_mutex.lock();
+    if (hit)
+        m_stats.hits++;
+    else
+        m_stats.misses++;
+    m_mutex.unlock();
+
+    return hit;
+}
+
+void DriveCache::Insert(const void* data, u32 wordOffset, u32 byteLen)
+{
+    // Only blocks the read covers completely can be cached
+    u32 block = (wordOffset + BlockWords - 1) / BlockWords;
+    u32 blockEnd = (wordOffset + byteLen / 4) / BlockWords;
+    const u8* dataBytes = reinterpret_cast<const u8*>(data) +
+                          (block * BlockWords - wordOffset) * 4;
+
+    for (; block < blockEnd; block++, dataBytes += BlockSize) {
+        m_mutex.lock();
+        bool skip = !m_open || IsPresent(block);
+        u32 generation = m_generation;
+        m_mutex.unlock();
+
+        if (skip)
+            continue;
+
+        // Don't wait for the writer, the game is waiting for this read
+        u32 msg;
+        s32 ret = IOS_ReceiveMessage(m_freeQueue.id(), &msg, 1);
+        if (ret != IOS_SUCCESS) {
+            m_mutex.lock();
+            m_stats.blocksDropped++;
+            m_mutex.unlock();
+            continue;
+        }
+
+        PendingWrite* write = reinterpret_cast<PendingWrite*>(uintptr_t(msg));
+        write->block = block;
+        write->generation = generation;
+        memcpy(write->data, dataBytes, BlockSize);
+        m_writeQueue.send(write);
+    }
+}
+
+void DriveCache::WriteBlock(const PendingWrite* write)
+{
+    u8 hash[0x14] ATTRIBUTE_ALIGN(32);
+    if (SHA::Calculate(write->data, BlockSize, hash) != IOSError::OK)
+        return;
+
+    m_fileMutex.lock();
+
+    m_mutex.lock();
+    bool skip = !m_open || write->generation != m_generation ||
+                IsPresent(write->block);
+    m_mutex.unlock();
+
+    u32 set = write->block % m_setCount;
+    Tag tags[Ways];
+    if (skip || !ReadSet(set, tags)) {
+        m_fileMutex.unlock();
+        return;
+    }
+
+    // Use an empty slot, otherwise replace the oldest block in the set
+    u32 way = 0;
+    for (u32 i = 0; i < Ways; i++) {
+        if (tags[i].block == InvalidBlock) {
+            way = i;
+            break;
+        }
+
+        if (tags[i].sequence < tags[way].sequence)
+            way = i;
+    }
+
+    if (tags[way].block != InvalidBlock) {
+        m_mutex.lock();
+        SetPresent(tags[way].block, false);
+        m_mutex.unlock();
+    }
+
+    // Write the data before the tag. If the tag isn't written, the old tag's
+    // hash won't match the new data.
+    u32 slot = set * Ways + way;
+    Tag tag = {
+      .block = write->block,
+      .sequence = m_sequence++,
+      .hash = {},
+      .pad = 0,
+    };
+    memcpy(tag.hash, hash, sizeof(tag.hash));
+
+    UINT bw1 = 0, bw2 = 0;
+    auto fret = f_lseek(&m_file, GetSlotOffset(slot));
+    if (fret == FR_OK)
+        fret = f_write(&m_file, write->data, BlockSize, &bw1);
+    if (fret == FR_OK)
+        fret = f_lseek(&m_file, HeaderSize + slot * sizeof(Tag));
+    if (fret == FR_OK)
+        fret = f_write(&m_file, &tag, sizeof(tag), &bw2);
+
+    if (fret != FR_OK || bw1 != BlockSize || bw2 != sizeof(tag)) {
+        PRINT(IOS_EmuDI, ERROR, "Failed to write drive cache: %d", fret);
+        m_fileMutex.unlock();
+        return;
+    }
+
+    m_mutex.lock();
+    SetPresent(write->block, true);
+    m_stats.blocksWritten++;
+    m_mutex.unlock();
+
+    if (++m_unsynced >= SyncInterval) {
+        f_sync(&m_file);
+        m_unsynced = 0;
+    }
+
+    m_fileMutex.unlock();
+}
+
+DriveCache::Stats DriveCache::GetStats()
+{
+    m_mutex.lock();
+    Stats stats = m_stats;
+    m_mutex.unlock();
+
+    return stats;
+}
+
+void DriveCache::Run()
+{
+    while (true) {
+        PendingWrite* write = m_writeQueue.receive();
+        WriteBlock(write);
+        m_freeQueue.send(write);
+    }
+}
+
+s32 DriveCache::ThreadEntry(void* arg)
+{
+    DriveCache* that = reinterpret_cast<DriveCache*>(arg);
+    that->Run();
+
+    return 0;
+}
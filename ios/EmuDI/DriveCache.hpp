@@ -0,0 +1,164 @@
+// DriveCache.hpp - SD card cache of reads from the disc drive
+//
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <DVD/DI.hpp>
+#include <FAT/ff.h>
+#include <System/ES.hpp>
+#include <System/OS.hpp>
+#include <System/Types.h>
+
+/**
+ * Read-through cache of decrypted partition blocks read from the real disc
+ * drive, kept in a file per disc and partition. Blocks are written to the
+ * file by a background thread after the drive read completes.
+ *
+ * The file is a 4-way set associative cache. Each slot has a tag with the
+ * block it holds and the block's SHA-1, checked on every hit. The file is
+ * bound to the partition's H3 table hash from the TMD, and is started over
+ * if that doesn't match.
+ */
+class DriveCache
+{
+public:
+    static DriveCache* s_instance;
+
+    /**
+     * @param sizeMB Size budget of each cache file in megabytes.
+     */
+    explicit DriveCache(u32 sizeMB);
+
+    static constexpr u32 Magic = 0x44494348; // 'DICH'
+    static constexpr u32 Version = 1;
+
+    // Decrypted Wii disc block size, the unit of caching
+    static constexpr u32 BlockSize = 0x7C00;
+    static constexpr u32 BlockWords = BlockSize >> 2;
+    static constexpr u32 Ways = 4;
+
+    struct Stats {
+        u32 hits;
+        u32 misses;
+        u32 blocksWritten;
+        // Blocks not cached because the writer was busy
+        u32 blocksDropped;
+        // Cached blocks that didn't match their hash
+        u32 hashFailures;
+    };
+
+    /**
+     * Open or create the cache file for a partition that was just opened on
+     * the drive.
+     * @param tmd The partition's TMD, as returned by the drive.
+     */
+    void Open(const DI::DiskID& diskID, u32 partitionWordOffset,
+      const ES::TMDFixed<512>* tmd);
+
+    /**
+     * Stop using the cache file, e.g. when the partition is closed.
+     */
+    void Close();
+
+    /**
+     * Read partition data from the cache.
+     * @returns False if any of the data isn't cached.
+     */
+    bool Read(void* out, u32 wordOffset, u32 byteLen);
+
+    /**
+     * Queue the blocks fully covered by a read from the drive to be written
+     * to the cache.
+     */
+    void Insert(const void* data, u32 wordOffset, u32 byteLen);
+
+    Stats GetStats();
+
+private:
+    struct FileHeader {
+        u32 magic;
+        u32 version;
+        char gameID[4];
+        u16 groupID;
+        u8 discNum;
+        u8 discVer;
+        u32 partitionWordOffset;
+        u8 h3Hash[0x14];
+        u32 setCount;
+        u32 ways;
+    };
+
+    struct Tag {
+        u32 block;
+        // Insertion order, the oldest block in a set is replaced first
+        u32 sequence;
+        u8 hash[0x14];
+        u32 pad;
+    };
+
+    static_assert(sizeof(Tag) == 0x20);
+
+    static constexpr u32 InvalidBlock = ~0;
+    static constexpr u32 HeaderSize = 0x200;
+    static constexpr u32 PendingCount = 2;
+
+    struct PendingWrite {
+        u32 block;
+        // Cache file the write was queued for
+        u32 generation;
+        u8* data;
+    };
+
+    bool CreateFile(const FileHeader& header);
+    bool LoadTags();
+    bool ReadSet(u32 set, Tag* tags);
+    bool ReadBlock(u8* out, u32 block, u32 offset, u32 len);
+    void WriteBlock(const PendingWrite* write);
+    void Run();
+    static s32 ThreadEntry(void* arg);
+
+    bool IsPresent(u32 block) const
+    {
+        return block < m_blockCount &&
+               (m_present[block / 8] & (1 << (block % 8)));
+    }
+
+    void SetPresent(u32 block, bool present);
+
+    u64 GetSlotOffset(u32 slot) const
+    {
+        return m_dataOffset + (u64) slot * BlockSize;
+    }
+
+    u32 m_setCount;
+    char m_path[48];
+    FIL m_file;
+    bool m_open = false;
+    u64 m_dataOffset = 0;
+    u32 m_sequence = 0;
+    u32 m_generation = 0;
+    u32 m_unsynced = 0;
+
+    // Used to check the hash of cached blocks and to set up the file
+    u8* m_readBuffer;
+
+    // One bit per partition block, so misses don't need to read the tags
+    u8* m_present = nullptr;
+    u32 m_blockCount = 0;
+
+    // Protects the open state, the presence bitmap and the statistics. Only
+    // held for short checks and updates, never across file I/O, so lookups
+    // and inserts don't wait for the writer.
+    Mutex m_mutex;
+    Stats m_stats = {};
+
+    // Protects the file and the read buffer. Taken before m_mutex when both
+    // are needed.
+    Mutex m_fileMutex;
+
+    PendingWrite m_pending[PendingCount];
+    Queue<PendingWrite*> m_freeQueue{PendingCount};
+    Queue<PendingWrite*> m_writeQueue{PendingCount};
+    Thread m_thread;
+};
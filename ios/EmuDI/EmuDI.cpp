@@ -4,8 +4,16 @@
 // SPDX-License-Identifier: MIT
 
 #include "EmuDI.hpp"
+#include "CompressedISO.hpp"
+#include "DecryptedISO.hpp"
+#include "DriveCache.hpp"
+#include "FileIndex.hpp"
 #include "ISO.hpp"
+#include "PatchTable.hpp"
+#include "ReadAhead.hpp"
+#include "ReadTrace.hpp"
 #include "VirtualDisc.hpp"
+#include "WBFS.hpp"
 #include <DVD/DI.hpp>
 #include <DVD/EmuDI.hpp>
 #include <Debug/Log.hpp>
@@ -13,8 +21,12 @@
 #include <IOS/IPCLog.hpp>
 #include <IOS/Syscalls.h>
 #include <IOS/System.hpp>
+#include <System/Config.hpp>
 #include <System/ES.hpp>
+#include <System/Hollywood.hpp>
 #include <System/Types.h>
+#include <algorithm>
+#include <cstdio>
 #include <cstring>
 
 namespace EmuDI
@@ -27,24 +39,91 @@ typedef struct {
 } DVDCommand;
 
 static s32 DiMsgQueue = -1;
-static u32 __diMsgData[8];
+
+/**
+ * Requests that may take long, such as reads, are passed to a worker. Each
+ * handle always uses the same worker, so its requests complete in order.
+ * Workers handle one request at a time between them (see DiWorkerMutex), so
+ * more than one worker only gives each group of handles its own queue; it
+ * doesn't read in parallel.
+ */
+struct DiWorker {
+    explicit DiWorker(u32 queueDepth)
+      : queue(queueDepth)
+    {
+    }
+
+    Queue<IOSRequest*> queue;
+    Thread thread;
+    // Requests sent to and completed by the worker, each only written by one
+    // thread
+    u32 sent = 0;
+    u32 completed = 0;
+};
+
+static constexpr u32 MaxDiWorkers = 4;
+static DiWorker* DiWorkers[MaxDiWorkers];
+static u32 DiWorkerCount = 0;
+// The disc backend, patches and statistics aren't thread safe, so workers
+// take turns handling requests
+static Mutex* DiWorkerMutex;
 static bool DiStarted = false;
 static bool GameStarted = false;
 
-/* 200 for now */
-static DVDPatch DiPatches[200];
-static u32 DiNumPatches = 0;
+static PatchTable DiPatches;
 
 #define DI_PROXY_IOCTL_PATCHDVD 0x00
 #define DI_PROXY_IOCTL_STARTGAME 0x01
+#define DI_PROXY_IOCTL_PATCHDVD_ADD 0x02
+#define DI_PROXY_IOCTL_GETSTATS 0x03
+#define DI_PROXY_IOCTL_RESETSTATS 0x04
+#define DI_PROXY_IOCTL_GETFILESTATS 0x05
 
 #define DI_EOK 0x1
 #define DI_ESECURITY 0x20
 #define DI_EBADARGUMENT 0x80
 
 VirtualDisc* disc;
+ReadAhead* readAhead;
+FileIndex* fileIndex;
 bool useVirtualDisc = false;
 
+static DVDReadStats DiReadStats;
+
+// Disc ID last read from the real drive
+static DI::DiskID DriveDiskID;
+
+static inline u32 ReadTimer()
+{
+    return ACRReadTrusted(ACRReg::TIMER);
+}
+
+/**
+ * Record a finished read in the statistics.
+ * @param startTime Timer value from before the read.
+ */
+static void RecordRead(
+  DVDReadStats::Category* stats, u32 startTime, u32 byteLen, bool success)
+{
+    // Unsigned subtraction handles the timer wrapping around
+    u32 ticks = ReadTimer() - startTime;
+    u32 micros = (u64) ticks * 1000000 / HW_TIMER_FREQ;
+
+    stats->reads++;
+    if (!success)
+        stats->errors++;
+    stats->bytes += byteLen;
+    stats->totalMicros += micros;
+    stats->maxMicros = std::max(stats->maxMicros, micros);
+
+    u32 bucket = 0;
+    while (bucket < DVDReadStats::LatencyBuckets - 1 &&
+           (micros >> (bucket + 1)) != 0) {
+        bucket++;
+    }
+    stats->latency[bucket]++;
+}
+
 static DI::DIError WriteOutput(
   void* out, u32 outLen, const void* data, u32 dataLen)
 {
@@ -105,9 +184,18 @@ static DI::DIError EmuIoctl(
             return DI::DIError::Security;
         }
 
-        if (!disc->ReadFromPartition(out, inWordOffset, inByteLength))
+        u32 startTime = ReadTimer();
+        bool ret = disc->ReadFromPartition(out, inWordOffset, inByteLength);
+        RecordRead(&DiReadStats.partitionRead, startTime, inByteLength, ret);
+
+        if (!ret)
             return DI::DIError::Drive;
 
+        // Queue the next blocks to be fetched while the game processes this
+        // buffer
+        if (readAhead != nullptr)
+            readAhead->OnRead(inWordOffset, inByteLength);
+
         return DI::DIError::OK;
     }
 
@@ -147,7 +235,11 @@ static DI::DIError EmuIoctl(
         if (wordOffsetEnd > 0x14000)
             return DI::DIError::Security;
 
-        if (!disc->UnencryptedRead(out, inWordOffset, inByteLength))
+        u32 startTime = ReadTimer();
+        bool ret = disc->UnencryptedRead(out, inWordOffset, inByteLength);
+        RecordRead(&DiReadStats.unencryptedRead, startTime, inByteLength, ret);
+
+        if (!ret)
             return DI::DIError::Drive;
 
         return DI::DIError::OK;
@@ -242,7 +334,22 @@ static DI::DIError EmuIoctlv(DVDCommand* block, DI::DIIoctl cmd, u32 inCount,
           reinterpret_cast<ES::ESError*>(vec[4].data);
 
         PRINT(IOS_EmuDI, INFO, "All open partition params correct");
-        return disc->OpenPartition(block->args[0], outTmd);
+        auto ret = disc->OpenPartition(block->args[0], outTmd);
+        if (ret == DI::DIError::OK && readAhead != nullptr) {
+            readAhead->Reset();
+
+            if (fileIndex != nullptr) {
+                // Read-ahead still works without the index
+                bool built = fileIndex->Build(disc);
+                readAhead->SetFileIndex(built ? fileIndex : nullptr);
+            }
+
+            DI::DiskID diskID;
+            if (disc->ReadDiskID(&diskID))
+                readAhead->StartProfile(diskID, block->args[0]);
+        }
+
+        return ret;
     }
 
     default:
@@ -256,7 +363,7 @@ static DI::DIError EmuIoctlv(DVDCommand* block, DI::DIIoctl cmd, u32 inCount,
  * @param[out] fp FATFS file pointer
  * @param[in] patch DVD patch to open.
  */
-static void OpenPatchFile(FIL* fp, DVDPatch* patch)
+static void OpenPatchFile(FIL* fp, const DVDPatch* patch)
 {
     memset(fp, 0, sizeof(FIL));
 
@@ -273,25 +380,78 @@ static void OpenPatchFile(FIL* fp, DVDPatch* patch)
     fp->clust = patch->cur_cluster;
 }
 
-static inline u32 SearchPatch(u32 offset)
-{
-    for (s32 j = 0, i = DiNumPatches; i != 0; i >>= 1) {
-        s32 k = j + (i >> 1);
-        u32 p_start = DiPatches[k].disc_offset;
-        u32 p_end = p_start + DiPatches[k].disc_length;
-
-        if (p_start == offset)
-            return k;
-        if (offset > p_start) {
-            if (p_end > offset)
-                return k;
-            // Move right
-            j = k + 1;
-            i--;
+// Patch files are kept open between reads, so FatFS keeps its sector buffer
+// and cluster position, and each handle gets a cluster map for fast seeking
+// within the file.
+static constexpr u32 PatchHandleCount = 4;
+static constexpr u32 PatchClmtSize = 64;
+
+struct PatchHandle {
+    bool valid;
+    u32 patchIndex;
+    u32 lastUse;
+    FIL file;
+    DWORD clmt[PatchClmtSize];
+};
+
+static PatchHandle PatchHandles[PatchHandleCount];
+static u32 PatchHandleUseCounter = 0;
+static u32 PatchHandleGeneration = 0;
+
+/**
+ * Close all cached patch file handles, e.g. when the patch list changes.
+ */
+static void ResetPatchHandles()
+{
+    PatchHandleGeneration = DiPatches.GetGeneration();
+
+    for (u32 i = 0; i < PatchHandleCount; i++) {
+        PatchHandles[i].valid = false;
+        PatchHandles[i].lastUse = 0;
+    }
+}
+
+/**
+ * Get an open file for a patch, reusing a cached handle if the patch was read
+ * recently.
+ * @param idx Index of the patch in the patch table.
+ */
+static FIL* GetPatchFile(u32 idx)
+{
+    if (PatchHandleGeneration != DiPatches.GetGeneration())
+        ResetPatchHandles();
+
+    PatchHandle* handle = &PatchHandles[0];
+    for (u32 i = 0; i < PatchHandleCount; i++) {
+        if (PatchHandles[i].valid && PatchHandles[i].patchIndex == idx) {
+            PatchHandles[i].lastUse = ++PatchHandleUseCounter;
+            return &PatchHandles[i].file;
         }
-        // offset < p_start
+
+        // Replace an unused or the least recently used handle
+        if (!handle->valid)
+            continue;
+
+        if (!PatchHandles[i].valid ||
+            PatchHandles[i].lastUse < handle->lastUse)
+            handle = &PatchHandles[i];
     }
-    return DiNumPatches;
+
+    OpenPatchFile(&handle->file, &DiPatches.Get(idx));
+
+    handle->clmt[0] = PatchClmtSize;
+    handle->file.cltbl = handle->clmt;
+    const FRESULT fret = f_lseek(&handle->file, CREATE_LINKMAP);
+    if (fret != FR_OK) {
+        // Too fragmented for the cluster map, seek the normal way
+        PRINT(IOS_EmuDI, WARN, "No fast seek for patch %u: %d", idx, fret);
+        handle->file.cltbl = nullptr;
+    }
+
+    handle->valid = true;
+    handle->patchIndex = idx;
+    handle->lastUse = ++PatchHandleUseCounter;
+    return &handle->file;
 }
 
 static s32 RealRead(void* outbuf, u32 offset, u32 length)
@@ -306,7 +466,21 @@ static s32 RealRead(void* outbuf, u32 offset, u32 length)
           EmuIoctl(&rblock, DI::DIIoctl::Read, outbuf, length));
     }
 
-    return static_cast<s32>(DI::s_instance->Read(outbuf, length, offset));
+    u32 startTime = ReadTimer();
+    auto driveCache = DriveCache::s_instance;
+    if (driveCache != nullptr && driveCache->Read(outbuf, offset, length)) {
+        RecordRead(&DiReadStats.partitionRead, startTime, length, true);
+        return DI_EOK;
+    }
+
+    auto ret = DI::s_instance->Read(outbuf, length, offset);
+    RecordRead(&DiReadStats.partitionRead, startTime, length,
+      ret == DI::DIError::OK);
+
+    if (driveCache != nullptr && ret == DI::DIError::OK)
+        driveCache->Insert(outbuf, offset, length);
+
+    return static_cast<s32>(ret);
 }
 
 static inline bool IsPatchedOffset(u32 wordOffset)
@@ -334,36 +508,39 @@ static s32 Read(u8* outbuf, u32 offset, u32 length)
         length -= (0x80000000 - offset) << 2;
     }
 
-    for (u32 idx = SearchPatch(offset); length != 0; idx++) {
-        PRINT(IOS_EmuDI, INFO, "Read patch %d of %d", idx, DiNumPatches);
-        if (idx >= DiNumPatches) {
+    u32 startTime = ReadTimer();
+    u32 patchedLength = length;
+    bool success = true;
+
+    while (length != 0) {
+        u32 idx = DiPatches.Find(offset);
+        if (idx >= DiPatches.GetCount()) {
             PRINT(IOS_EmuDI, WARN, "Out of bounds DVD read");
             memset(outbuf, 0, length);
-            return DI_EOK; // Just success, I guess?
+            break; // Just success, I guess?
         }
 
-        FIL f;
-        OpenPatchFile(&f, &DiPatches[idx]);
+        const DVDPatch& patch = DiPatches.Get(idx);
+        FIL* f = GetPatchFile(idx);
 
-        u32 read_len = DiPatches[idx].disc_length << 2;
-        if (DiPatches[idx].disc_offset != offset) {
-            const FRESULT fret =
-              f_lseek(&f, (offset - DiPatches[idx].disc_offset) << 2);
-            if (fret != FR_OK) {
-                PRINT(IOS_EmuDI, ERROR, "FS_LSeek failed: %d", fret);
-                abort();
-            }
-            read_len -= (offset - DiPatches[idx].disc_offset) << 2;
+        u32 patch_pos = (offset - patch.disc_offset) << 2;
+        u32 read_len = (patch.disc_length << 2) - patch_pos;
+
+        FRESULT fret = f_lseek(f, patch.file_offset + patch_pos);
+        if (fret != FR_OK) {
+            PRINT(IOS_EmuDI, ERROR, "FS_LSeek failed: %d", fret);
+            abort();
         }
 
         if (read_len > length)
             read_len = length;
         UINT read = 0;
 
-        const FRESULT fret = f_read(&f, outbuf, read_len, &read);
+        fret = f_read(f, outbuf, read_len, &read);
         if (fret != FR_OK) {
             PRINT(IOS_EmuDI, ERROR, "FS_Read failed: %d", fret);
             memset(outbuf + read, 0, read_len - read);
+            success = false;
         }
 
         outbuf += read_len;
@@ -371,6 +548,7 @@ static s32 Read(u8* outbuf, u32 offset, u32 length)
         offset += read_len >> 2;
     }
 
+    RecordRead(&DiReadStats.patchedRead, startTime, patchedLength, success);
     return DI_EOK;
 }
 
@@ -412,25 +590,93 @@ static bool DI_DoNewIOCTL(IOSRequest* req)
     }
 
     switch (req->ioctl.cmd) {
-    case DI_PROXY_IOCTL_PATCHDVD: {
+    case DI_PROXY_IOCTL_PATCHDVD:
+    case DI_PROXY_IOCTL_PATCHDVD_ADD: {
         // Assuming patches are valid, this could only be called from secure
-        // code
+        // code. PATCHDVD replaces the patch list, PATCHDVD_ADD appends to it so
+        // large lists can be uploaded in chunks.
         if (GameStarted)
             return false;
-        if (req->ioctl.in_len == 0) {
+        if (req->ioctl.in_len == 0 ||
+            req->ioctl.in_len % sizeof(DVDPatch) != 0) {
             IOS_ResourceReply(req, IOS_EINVAL);
             return true;
         }
 
-        DiNumPatches = req->ioctl.in_len / sizeof(DVDPatch);
-        if (req->ioctl.in_len > sizeof(DiPatches)) {
+        if (req->ioctl.cmd == DI_PROXY_IOCTL_PATCHDVD)
+            DiPatches.Clear();
+
+        if (!DiPatches.Add(reinterpret_cast<const DVDPatch*>(req->ioctl.in),
+              req->ioctl.in_len / sizeof(DVDPatch))) {
             PRINT(IOS_EmuDI, ERROR,
               "DI_PROXY_IOCTL_PATCHDVD: "
               "Not enough memory for DVD patches");
             IOS_ResourceReply(req, IOS_ENOMEM);
             return true;
         }
-        memcpy(DiPatches, req->ioctl.in, req->ioctl.in_len);
+        IOS_ResourceReply(req, IOS_SUCCESS);
+        return true;
+    }
+
+    case DI_PROXY_IOCTL_GETSTATS: {
+        if (req->ioctl.io_len != sizeof(DVDReadStats)) {
+            IOS_ResourceReply(req, IOS_EINVAL);
+            return true;
+        }
+
+        if (readAhead != nullptr) {
+            auto raStats = readAhead->GetStats();
+            DiReadStats.streamsStarted = raStats.streamsStarted;
+            DiReadStats.blocksPrefetched = raStats.blocksPrefetched;
+            DiReadStats.blocksCancelled = raStats.blocksCancelled;
+            DiReadStats.profileRanges = raStats.profileRanges;
+            DiReadStats.profileBlocksPrefetched =
+              raStats.profileBlocksPrefetched;
+            DiReadStats.profileBlocksRead = raStats.profileBlocksRead;
+        }
+
+        if (disc != nullptr)
+            disc->GetStats(&DiReadStats);
+
+        if (DriveCache::s_instance != nullptr) {
+            auto dcStats = DriveCache::s_instance->GetStats();
+            DiReadStats.driveCacheHits = dcStats.hits;
+            DiReadStats.driveCacheMisses = dcStats.misses;
+            DiReadStats.driveCacheBlocksWritten = dcStats.blocksWritten;
+            DiReadStats.driveCacheBlocksDropped = dcStats.blocksDropped;
+            DiReadStats.driveCacheHashFailures = dcStats.hashFailures;
+        }
+
+        memcpy(req->ioctl.io, &DiReadStats, sizeof(DVDReadStats));
+        IOS_ResourceReply(req, IOS_SUCCESS);
+        return true;
+    }
+
+    case DI_PROXY_IOCTL_GETFILESTATS: {
+        // Output is an array of DVDFileStats, most read file first
+        if (req->ioctl.io_len % sizeof(DVDFileStats) != 0 ||
+            !aligned(req->ioctl.io, alignof(DVDFileStats))) {
+            IOS_ResourceReply(req, IOS_EINVAL);
+            return true;
+        }
+
+        u32 count = 0;
+        if (fileIndex != nullptr) {
+            count = fileIndex->GetTopFiles(
+              reinterpret_cast<DVDFileStats*>(req->ioctl.io),
+              req->ioctl.io_len / sizeof(DVDFileStats));
+        }
+
+        IOS_ResourceReply(req, count);
+        return true;
+    }
+
+    case DI_PROXY_IOCTL_RESETSTATS: {
+        DiReadStats = {};
+        if (disc != nullptr)
+            disc->ResetStats();
+        if (fileIndex != nullptr)
+            fileIndex->ResetStats();
         IOS_ResourceReply(req, IOS_SUCCESS);
         return true;
     }
@@ -467,7 +713,49 @@ static inline void ReqClose(IOSRequest* req)
     IOS_ResourceReply(req, ret);
 }
 
-static inline void ReqIoctl(IOSRequest* req)
+/**
+ * Follow the disc and partition state of the real drive for the drive cache.
+ * @param ret Result of the forwarded ioctl.
+ */
+static void DriveCacheOnIoctl(IOSRequest* req, s32 ret)
+{
+    switch (static_cast<DI::DIIoctl>(req->ioctl.cmd)) {
+    case DI::DIIoctl::ReadDiskID:
+        if (ret == DI_EOK && req->ioctl.io_len >= sizeof(DI::DiskID))
+            memcpy(&DriveDiskID, req->ioctl.io, sizeof(DI::DiskID));
+        break;
+
+    case DI::DIIoctl::ClosePartition:
+    case DI::DIIoctl::Reset:
+        DriveCache::s_instance->Close();
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void DriveCacheOnIoctlv(IOSRequest* req, s32 ret)
+{
+    if (static_cast<DI::DIIoctl>(req->ioctlv.cmd) !=
+        DI::DIIoctl::OpenPartition)
+        return;
+
+    if (ret != DI_EOK || req->ioctlv.in_count != 3 ||
+        req->ioctlv.io_count != 2 ||
+        req->ioctlv.vec[0].len < sizeof(DVDCommand) ||
+        req->ioctlv.vec[3].len < sizeof(ES::TMDFixed<512>)) {
+        DriveCache::s_instance->Close();
+        return;
+    }
+
+    auto block = reinterpret_cast<const DVDCommand*>(req->ioctlv.vec[0].data);
+    auto tmd =
+      reinterpret_cast<const ES::TMDFixed<512>*>(req->ioctlv.vec[3].data);
+    DriveCache::s_instance->Open(DriveDiskID, block->args[0], tmd);
+}
+
+static inline void DispatchIoctl(IOSRequest* req)
 {
     if (DI_DoNewIOCTL(req))
         return;
@@ -492,10 +780,14 @@ static inline void ReqIoctl(IOSRequest* req)
     // Real drive
     const s32 ret = IOS_Ioctl(DI::s_instance->GetFd(), req->ioctl.cmd,
       req->ioctl.in, req->ioctl.in_len, req->ioctl.io, req->ioctl.io_len);
+
+    if (DriveCache::s_instance != nullptr)
+        DriveCacheOnIoctl(req, ret);
+
     IOS_ResourceReply(req, ret);
 }
 
-static inline void ReqIoctlv(IOSRequest* req)
+static inline void DispatchIoctlv(IOSRequest* req)
 {
     // Probably won't be replacing any IOCTLVs
 
@@ -519,9 +811,73 @@ static inline void ReqIoctlv(IOSRequest* req)
     // Real drive
     const s32 ret = IOS_Ioctlv(DI::s_instance->GetFd(), req->ioctlv.cmd,
       req->ioctlv.in_count, req->ioctlv.io_count, req->ioctlv.vec);
+
+    if (DriveCache::s_instance != nullptr)
+        DriveCacheOnIoctlv(req, ret);
+
     IOS_ResourceReply(req, ret);
 }
 
+/**
+ * Add a request to the read trace. The request must not be accessed after it
+ * has been replied to, so the command block is copied out before dispatching.
+ */
+static void TraceRequest(u32 cmd, u8 flags, const DVDCommand* block,
+  void (*dispatch)(IOSRequest*), IOSRequest* req)
+{
+    u32 startTime = ReadTimer();
+    u32 length = block != nullptr ? block->args[0] : 0;
+    u32 wordOffset = block != nullptr ? block->args[1] : 0;
+
+    dispatch(req);
+
+    // The command arguments are only an offset and length for reads
+    if (cmd == static_cast<u32>(DI::DIIoctl::Read) && length >= 4) {
+        if (IsPatchedOffset(wordOffset) ||
+            IsPatchedOffset(wordOffset + (length >> 2) - 1))
+            flags |= ReadTrace::Flag_Patched;
+        else if (useVirtualDisc && disc->WasLastReadCached())
+            flags |= ReadTrace::Flag_Cached;
+    }
+
+    ReadTrace::s_instance->Add(cmd, flags, wordOffset, length, startTime);
+
+    // The game is done with the partition, get its trace onto the SD card
+    if (cmd == static_cast<u32>(DI::DIIoctl::ClosePartition) ||
+        cmd == static_cast<u32>(DI::DIIoctl::Reset))
+        ReadTrace::s_instance->RequestFlush();
+}
+
+static inline void ReqIoctl(IOSRequest* req)
+{
+    if (ReadTrace::s_instance == nullptr) {
+        DispatchIoctl(req);
+        return;
+    }
+
+    const DVDCommand* block = nullptr;
+    if (req->ioctl.in_len >= sizeof(DVDCommand))
+        block = reinterpret_cast<const DVDCommand*>(req->ioctl.in);
+
+    TraceRequest(req->ioctl.cmd, 0, block, DispatchIoctl, req);
+}
+
+static inline void ReqIoctlv(IOSRequest* req)
+{
+    if (ReadTrace::s_instance == nullptr) {
+        DispatchIoctlv(req);
+        return;
+    }
+
+    const DVDCommand* block = nullptr;
+    if (req->ioctlv.in_count >= 1 &&
+        req->ioctlv.vec[0].len >= sizeof(DVDCommand))
+        block = reinterpret_cast<const DVDCommand*>(req->ioctlv.vec[0].data);
+
+    TraceRequest(
+      req->ioctlv.cmd, ReadTrace::Flag_Ioctlv, block, DispatchIoctlv, req);
+}
+
 void HandleRequest(IOSRequest* req)
 {
     switch (req->cmd) {
@@ -550,15 +906,255 @@ void HandleRequest(IOSRequest* req)
     }
 }
 
+/**
+ * Answer a request in the dispatcher, without waiting for the reads queued
+ * before it. Only requests that don't use the disc backend, patches, read
+ * trace or statistics, and don't wait on another resource manager, are
+ * answered here, as the dispatcher doesn't hold DiWorkerMutex. These
+ * requests aren't added to the read trace.
+ * @returns False if the request must be queued for a worker.
+ */
+static bool HandleImmediateRequest(IOSRequest* req)
+{
+    switch (req->cmd) {
+    case IOS_OPEN:
+        ReqOpen(req);
+        return true;
+
+    case IOS_IPC_REPLY:
+        IOS_ResourceReply(req, req->result);
+        return true;
+
+    case IOS_IOCTL:
+        break;
+
+    default:
+        return false;
+    }
+
+    // The real drive blocks in IOS_Ioctl, and so does Inquiry for the
+    // emulated one
+    if (!useVirtualDisc || req->ioctl.in_len < sizeof(DVDCommand))
+        return false;
+
+    auto cmd = static_cast<DI::DIIoctl>(req->ioctl.cmd);
+    switch (cmd) {
+    case DI::DIIoctl::GetCoverRegister:
+    case DI::DIIoctl::GetStatusRegister:
+    case DI::DIIoctl::ClearCoverInterrupt: {
+        auto reply = EmuIoctl(reinterpret_cast<DVDCommand*>(req->ioctl.in),
+          cmd, req->ioctl.io, req->ioctl.io_len);
+        IOS_ResourceReply(req, static_cast<s32>(reply));
+        return true;
+    }
+
+    default:
+        return false;
+    }
+}
+
+static void QueueRequest(IOSRequest* req)
+{
+    DiWorker* worker = DiWorkers[static_cast<u32>(req->handle) % DiWorkerCount];
+
+    u32 depth = ++worker->sent - worker->completed;
+    DiReadStats.requestsQueued++;
+    DiReadStats.maxQueueDepth = std::max(DiReadStats.maxQueueDepth, depth);
+
+    // Try without blocking first to count how often the queue is full
+    s32 ret =
+      IOS_SendMessage(worker->queue.id(), reinterpret_cast<uintptr_t>(req), 1);
+    if (ret != IOS_SUCCESS) {
+        DiReadStats.queueFullStalls++;
+        worker->queue.send(req);
+    }
+}
+
+static s32 WorkerEntry(void* arg)
+{
+    DiWorker* worker = reinterpret_cast<DiWorker*>(arg);
+
+    while (true) {
+        IOSRequest* req = worker->queue.receive();
+
+        DiWorkerMutex->lock();
+        HandleRequest(req);
+        DiWorkerMutex->unlock();
+
+        worker->completed++;
+    }
+
+    return 0;
+}
+
+// Longest path of an image part with its null terminator, e.g.
+// 0:/game.part31.iso
+static constexpr u32 MaxImagePathSize = 20;
+
+/**
+ * Find the parts of a disc image split with the 'split' utility, named xaa,
+ * xab, xac and so on.
+ * @returns Number of parts found.
+ */
+static u32 FindImageParts(char (*paths)[MaxImagePathSize], u32 maxParts)
+{
+    u32 count = 0;
+    for (; count < maxParts && count < 26 * 26; count++) {
+        snprintf(paths[count], sizeof(paths[count]), "0:/x%c%c",
+          'a' + count / 26, 'a' + count % 26);
+
+        if (f_stat(paths[count], nullptr) != FR_OK)
+            break;
+    }
+
+    return count;
+}
+
+/**
+ * Find the parts of a disc image named like WBFS files, e.g. game.wbfs,
+ * game.wbf1, game.wbf2 and so on.
+ * @param ext Four character file extension of the first part.
+ * @returns Number of parts found.
+ */
+static u32 FindNumberedParts(
+  char (*paths)[MaxImagePathSize], u32 maxParts, const char* ext)
+{
+    u32 count = 0;
+    for (; count < maxParts; count++) {
+        if (count == 0) {
+            snprintf(paths[count], sizeof(paths[count]), "0:/game.%s", ext);
+        } else {
+            snprintf(paths[count], sizeof(paths[count]), "0:/game.%.3s%u", ext,
+              count);
+        }
+
+        if (f_stat(paths[count], nullptr) != FR_OK)
+            break;
+    }
+
+    return count;
+}
+
+/**
+ * Find the parts of a disc image split to fit on FAT32, named
+ * game.part0.iso, game.part1.iso and so on. An image in one file is
+ * game.part0.iso too.
+ * @returns Number of parts found.
+ */
+static u32 FindPartParts(char (*paths)[MaxImagePathSize], u32 maxParts)
+{
+    u32 count = 0;
+    for (; count < maxParts; count++) {
+        snprintf(paths[count], sizeof(paths[count]), "0:/game.part%u.iso",
+          count);
+
+        if (f_stat(paths[count], nullptr) != FR_OK)
+            break;
+    }
+
+    return count;
+}
+
+/**
+ * Open the disc image on the SD card. Only the names the Find functions above
+ * look for are found, each in the root directory.
+ * @returns Null if there is no disc image.
+ */
+static VirtualDisc* OpenDiscImage()
+{
+    static char partPaths[ISO::MaxParts][MaxImagePathSize];
+    const char* parts[ISO::MaxParts];
+    enum class ImageType {
+        Decrypted,
+        Compressed,
+        WBFS,
+        ISO,
+    } type = ImageType::Decrypted;
+
+    u32 partCount = FindNumberedParts(partPaths, ISO::MaxParts, "wdec");
+    if (partCount == 0) {
+        type = ImageType::Compressed;
+        partCount = FindNumberedParts(partPaths, ISO::MaxParts, "wcmp");
+    }
+    if (partCount == 0) {
+        type = ImageType::WBFS;
+        partCount = FindNumberedParts(partPaths, ISO::MaxParts, "wbfs");
+    }
+    if (partCount == 0) {
+        type = ImageType::ISO;
+        partCount = FindImageParts(partPaths, ISO::MaxParts);
+    }
+    if (partCount == 0)
+        partCount = FindPartParts(partPaths, ISO::MaxParts);
+    if (partCount == 0)
+        return nullptr;
+
+    for (u32 i = 0; i < partCount; i++) {
+        parts[i] = partPaths[i];
+    }
+
+    switch (type) {
+    case ImageType::Decrypted:
+        return new DecryptedISO(parts, partCount);
+
+    case ImageType::Compressed:
+        return new CompressedISO(parts, partCount);
+
+    case ImageType::WBFS:
+        return new WBFS(parts, partCount);
+
+    case ImageType::ISO:
+        return new ISO(parts, partCount);
+    }
+
+    return nullptr;
+}
+
 s32 ThreadEntry([[maybe_unused]] void* arg)
 {
     PRINT(IOS_EmuDI, INFO, "Starting DI...");
     PRINT(IOS_EmuDI, INFO, "EmuDI thread ID: %d", IOS_GetThreadId());
 
-    disc = new ISO("0:/xaa", "0:/xab");
-    useVirtualDisc = true;
+    disc = OpenDiscImage();
+    if (disc != nullptr) {
+        useVirtualDisc = true;
+
+        // Read ahead as far as the budget goes, but keep a cache block free
+        // for the block the game is reading
+        u32 cacheBlocks = disc->GetPrefetchCapacity();
+        readAhead = new ReadAhead(disc,
+          std::min(Config::s_instance->GetReadAheadSize() / ReadAhead::UnitSize,
+            cacheBlocks != 0 ? cacheBlocks - 1 : 0));
+
+        fileIndex = new FileIndex();
+        if (!fileIndex->IsValid())
+            PRINT(IOS_EmuDI, WARN, "Not enough memory for the disc file index");
+    } else {
+        PRINT(IOS_EmuDI, INFO, "No disc image found, using the disc drive");
+
+        if (Config::s_instance->IsDriveCacheEnabled()) {
+            DriveCache::s_instance =
+              new DriveCache(Config::s_instance->GetDriveCacheSize());
+        }
+    }
+
+    if (Config::s_instance->IsReadTraceEnabled())
+        ReadTrace::s_instance = new ReadTrace("0:/ditrace.bin", 512);
+
+    u32 queueDepth = std::max<u32>(Config::s_instance->GetDIQueueDepth(), 1);
+    DiWorkerCount = std::clamp<u32>(
+      Config::s_instance->GetDIWorkerCount(), 1, MaxDiWorkers);
+
+    DiWorkerMutex = new Mutex;
+    for (u32 i = 0; i < DiWorkerCount; i++) {
+        DiWorkers[i] = new DiWorker(queueDepth);
+        // Below the dispatcher, so it can answer requests while a worker is
+        // busy
+        DiWorkers[i]->thread.create(WorkerEntry,
+          reinterpret_cast<void*>(DiWorkers[i]), nullptr, 0x2000, 70);
+    }
 
-    s32 ret = IOS_CreateMessageQueue(__diMsgData, 8);
+    s32 ret = IOS_CreateMessageQueue(new u32[queueDepth], queueDepth);
     if (ret < 0) {
         PRINT(IOS_EmuDI, ERROR, "IOS_CreateMessageQueue failed: %d", ret);
         abort();
@@ -576,14 +1172,20 @@ s32 ThreadEntry([[maybe_unused]] void* arg)
     DiStarted = true;
     IPCLog::s_instance->Notify();
     while (1) {
-        IOSRequest* req;
-        ret = IOS_ReceiveMessage(DiMsgQueue, (u32*) &req, 0);
+        u32 msg;
+        ret = IOS_ReceiveMessage(DiMsgQueue, &msg, 0);
         if (ret != IOS_SUCCESS) {
             PRINT(IOS_EmuDI, ERROR, "IOS_ReceiveMessage failed: %d", ret);
             abort();
         }
 
-        HandleRequest(req);
+        IOSRequest* req = reinterpret_cast<IOSRequest*>(uintptr_t(msg));
+
+        if (HandleImmediateRequest(req)) {
+            DiReadStats.requestsImmediate++;
+        } else {
+            QueueRequest(req);
+        }
     }
     return 0;
 }
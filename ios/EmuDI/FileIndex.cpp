@@ -0,0 +1,198 @@
+// FileIndex.cpp - Index of the file extents in a disc partition
+//
+// SPDX-License-Identifier: MIT
+
+#include "FileIndex.hpp"
+#include <Debug/Log.hpp>
+#include <IOS/Syscalls.h>
+#include <IOS/System.hpp>
+#include <algorithm>
+#include <cstring>
+
+// The FST is read through this buffer, it's only allocated while building
+static constexpr u32 ChunkSize = 0x1000;
+
+// Location of the FST offset and size in the partition's disc header
+static constexpr u32 FSTInfoWordOffset = 0x420 >> 2;
+
+FileIndex::FileIndex()
+{
+    // Not using new, read-ahead works without the index
+    m_files = reinterpret_cast<EmuDI::DVDFileStats*>(
+      IOS_Alloc(System::GetHeap(), MaxFiles * sizeof(EmuDI::DVDFileStats)));
+}
+
+bool FileIndex::ReadFST(void* out, u32 offset, u32 len)
+{
+    u8* outBytes = reinterpret_cast<u8*>(out);
+
+    while (len > 0) {
+        u32 chunkOffset = offset / ChunkSize * ChunkSize;
+        if (chunkOffset != m_chunkOffset) {
+            if (!m_disc->ReadFromPartition(
+                  m_chunk, m_fstWordOffset + chunkOffset / 4, ChunkSize)) {
+                return false;
+            }
+
+            m_chunkOffset = chunkOffset;
+        }
+
+        u32 copyLen = std::min(len, ChunkSize - (offset - chunkOffset));
+        memcpy(outBytes, &m_chunk[offset - chunkOffset], copyLen);
+        outBytes += copyLen;
+        offset += copyLen;
+        len -= copyLen;
+    }
+
+    return true;
+}
+
+void FileIndex::Add(u32 fstIndex, const FSTEntry& entry)
+{
+    EmuDI::DVDFileStats* file = nullptr;
+
+    if (m_fileCount < MaxFiles) {
+        file = &m_files[m_fileCount++];
+    } else {
+        // Replace the smallest file
+        file = &m_files[0];
+        for (u32 i = 1; i < MaxFiles; i++) {
+            if (m_files[i].size < file->size)
+                file = &m_files[i];
+        }
+
+        if (file->size >= entry.size)
+            return;
+    }
+
+    *file = {
+      .fstIndex = fstIndex,
+      .wordOffset = entry.offset,
+      .size = entry.size,
+      .reads = 0,
+      .bytesRead = 0,
+    };
+}
+
+bool FileIndex::Build(VirtualDisc* disc)
+{
+    m_fileCount = 0;
+    if (!IsValid())
+        return false;
+
+    u32 fstInfo[8] ATTRIBUTE_ALIGN(32);
+    if (!disc->ReadFromPartition(fstInfo, FSTInfoWordOffset, sizeof(fstInfo))) {
+        PRINT(IOS_EmuDI, ERROR, "Failed to read the FST location");
+        return false;
+    }
+
+    // Both are shifted right by 2 on Wii discs
+    u32 fstWordOffset = fstInfo[1];
+    u32 fstSize = fstInfo[2] << 2;
+
+    m_chunk = reinterpret_cast<u8*>(
+      IOS_AllocAligned(System::GetHeap(), ChunkSize, 32));
+    if (m_chunk == nullptr) {
+        PRINT(IOS_EmuDI, WARN, "Not enough memory to read the FST");
+        return false;
+    }
+
+    m_disc = disc;
+    m_fstWordOffset = fstWordOffset;
+    m_chunkOffset = ~0;
+
+    // The size of the root entry is the number of entries
+    FSTEntry root;
+    bool ret = ReadFST(&root, 0, sizeof(root));
+    if (ret && (root.size == 0 || root.size > fstSize / sizeof(FSTEntry))) {
+        PRINT(IOS_EmuDI, ERROR, "FST entry count is invalid");
+        ret = false;
+    }
+
+    for (u32 i = 1; ret && i < root.size; i++) {
+        FSTEntry entry;
+        ret = ReadFST(&entry, i * sizeof(FSTEntry), sizeof(FSTEntry));
+
+        if (ret && !(entry.typeName >> 24) && entry.size >= MinFileSize)
+            Add(i, entry);
+    }
+
+    IOS_Free(System::GetHeap(), m_chunk);
+    m_chunk = nullptr;
+    m_disc = nullptr;
+
+    if (!ret) {
+        PRINT(IOS_EmuDI, ERROR, "Failed to read the FST");
+        m_fileCount = 0;
+        return false;
+    }
+
+    std::sort(&m_files[0], &m_files[m_fileCount],
+      [](const EmuDI::DVDFileStats& a, const EmuDI::DVDFileStats& b) {
+          return a.wordOffset < b.wordOffset;
+      });
+
+    PRINT(IOS_EmuDI, INFO, "Indexed %u of %u FST entries", m_fileCount,
+      root.size);
+    return true;
+}
+
+u32 FileIndex::Find(u32 wordOffset) const
+{
+    // Find the last file starting at or before the offset
+    auto file = std::upper_bound(&m_files[0], &m_files[m_fileCount],
+      wordOffset, [](u32 offset, const EmuDI::DVDFileStats& f) {
+          return offset < f.wordOffset;
+      });
+
+    if (file == &m_files[0])
+        return NotFound;
+
+    u32 index = file - &m_files[0] - 1;
+    if (wordOffset >= GetEnd(index))
+        return NotFound;
+
+    return index;
+}
+
+void FileIndex::AddRead(u32 index, u32 byteLen)
+{
+    assert(index < m_fileCount);
+
+    m_files[index].reads++;
+    m_files[index].bytesRead += byteLen;
+}
+
+u32 FileIndex::GetTopFiles(EmuDI::DVDFileStats* out, u32 count) const
+{
+    u32 outCount = 0;
+
+    // Insertion sort into the output, the list is short
+    for (u32 i = 0; i < m_fileCount; i++) {
+        const EmuDI::DVDFileStats& file = m_files[i];
+        if (file.reads == 0)
+            continue;
+
+        u32 pos = outCount;
+        while (pos > 0 && out[pos - 1].bytesRead < file.bytesRead)
+            pos--;
+
+        if (pos == count)
+            continue;
+
+        u32 moveCount = std::min(outCount, count - 1) - pos;
+        memmove(&out[pos + 1], &out[pos], moveCount * sizeof(out[0]));
+        out[pos] = file;
+        outCount = std::min(outCount + 1, count);
+    }
+
+    return outCount;
+}
+
+void FileIndex::ResetStats()
+{
+    for (u32 i = 0; i < m_fileCount; i++) {
+        m_files[i].reads = 0;
+        m_files[i].bytesRead = 0;
+    }
+}
@@ -0,0 +1,97 @@
+// FileIndex.hpp - Index of the file extents in a disc partition
+//
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "VirtualDisc.hpp"
+#include <DVD/EmuDI.hpp>
+#include <System/Types.h>
+
+/**
+ * Sorted list of the large files in the open partition, built from its FST,
+ * so read-ahead knows where a file ends. Also counts the reads from each
+ * file. Only used from the DI thread.
+ */
+class FileIndex
+{
+public:
+    FileIndex();
+
+    // Smaller files don't span enough blocks to be worth prefetching
+    static constexpr u32 MinFileSize = 0x10000;
+    static constexpr u32 MaxFiles = 512;
+
+    static constexpr u32 NotFound = ~0;
+
+    /**
+     * False if there wasn't enough memory for the index.
+     */
+    bool IsValid() const
+    {
+        return m_files != nullptr;
+    }
+
+    /**
+     * Read the FST of the open partition and index its files. If there are
+     * more than MaxFiles large files, the largest ones are kept.
+     */
+    bool Build(VirtualDisc* disc);
+
+    void Clear()
+    {
+        m_fileCount = 0;
+    }
+
+    /**
+     * Find the file containing a partition word offset.
+     * @returns Index of the file, or NotFound.
+     */
+    u32 Find(u32 wordOffset) const;
+
+    const EmuDI::DVDFileStats& Get(u32 index) const
+    {
+        assert(index < m_fileCount);
+        return m_files[index];
+    }
+
+    /**
+     * Word offset of the end of a file.
+     */
+    u32 GetEnd(u32 index) const
+    {
+        return Get(index).wordOffset + (Get(index).size + 3) / 4;
+    }
+
+    void AddRead(u32 index, u32 byteLen);
+
+    /**
+     * Get the most read files, in order of bytes read.
+     * @returns Number of files written to out.
+     */
+    u32 GetTopFiles(EmuDI::DVDFileStats* out, u32 count) const;
+
+    void ResetStats();
+
+private:
+    struct FSTEntry {
+        // Directory flag in the top byte, the rest is the name offset
+        u32 typeName;
+        // Word offset for files, parent index for directories
+        u32 offset;
+        // Byte size for files, index of the next entry for directories
+        u32 size;
+    };
+
+    bool ReadFST(void* out, u32 offset, u32 len);
+    void Add(u32 fstIndex, const FSTEntry& entry);
+
+    EmuDI::DVDFileStats* m_files;
+    u32 m_fileCount = 0;
+
+    // Used while building the index
+    VirtualDisc* m_disc = nullptr;
+    u8* m_chunk = nullptr;
+    u32 m_chunkOffset = 0;
+    u32 m_fstWordOffset = 0;
+};
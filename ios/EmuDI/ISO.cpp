@@ -8,66 +8,169 @@
 #include <IOS/EmuES.hpp>
 #include <IOS/System.hpp>
 #include <System/AES.hpp>
+#include <System/Config.hpp>
+#include <System/Hollywood.hpp>
+#include <System/SHA.hpp>
 #include <algorithm>
 #include <cstring>
 
-ISO::ISO(const char* path, const char* path2)
+ISO::ISO(const char* const* paths, u32 count)
+  : ISO(paths, count, true)
 {
-    m_numParts = 0;
-    m_partSize = 0;
-    m_lastPartSize = 0;
+}
 
-    assert(path != nullptr);
-    auto fret = f_open(&m_isoFile, path, FA_READ);
-    assert(fret == FR_OK);
+ISO::ISO(const char* const* paths, u32 count, bool encrypted)
+{
+    assert(paths != nullptr);
+    assert(count >= 1 && count <= MaxParts);
 
-    m_numParts = 1;
-    m_partSize = f_size(&m_isoFile);
-    m_lastPartSize = m_partSize;
+    m_isEncrypted = encrypted;
+    m_verifyMode = encrypted ? Config::s_instance->GetDiscVerifyMode()
+                             : Config::DiscVerifyMode::Off;
 
-    if (path2 != nullptr) {
-        fret = f_open(&m_isoFile2, path2, FA_READ);
-        assert(fret == FR_OK);
-
-        m_numParts = 2;
-        m_lastPartSize = f_size(&m_isoFile2);
-    }
+    // The large buffers first, while the heap is least fragmented
+    if (m_isEncrypted)
+        AllocateBlockBuffers();
 
-    // Use FatFS fast seek function to speed up long backwards seeks
-    // Distribute cluster map equally across the two parts
-    const u32 clmtSize = sizeof(m_isoClmt) / sizeof(DWORD);
+    m_numParts = count;
+    m_parts = new Part[count];
+    m_imageSize = 0;
 
-    if (m_numParts == 1) {
-        m_isoFile.cltbl = m_isoClmt;
-        m_isoClmt[0] = clmtSize;
+    // All parts except the last having the same size lets us find a part
+    // with a division instead of a search
+    m_uniformParts = true;
+    u32 imageTime = 0;
 
-        fret = f_lseek(&m_isoFile, CREATE_LINKMAP);
+    for (u32 i = 0; i < count; i++) {
+        FILINFO info;
+        auto fret = f_stat(paths[i], &info);
         assert(fret == FR_OK);
-    } else {
-        u32 dist = ((u64) m_partSize + (u64) m_lastPartSize) / clmtSize;
-        u32 clmt1stSize = m_partSize / dist;
+        imageTime = std::max<u32>(imageTime, (info.fdate << 16) | info.ftime);
 
-        m_isoFile.cltbl = m_isoClmt;
-        m_isoClmt[0] = clmt1stSize;
+        fret = f_open(&m_parts[i].file, paths[i], FA_READ);
+        assert(fret == FR_OK);
 
-        m_isoFile2.cltbl = &m_isoClmt[clmt1stSize];
-        m_isoClmt[clmt1stSize] = clmtSize - clmt1stSize;
+        m_parts[i].offset = m_imageSize;
+        m_parts[i].size = f_size(&m_parts[i].file);
+        m_imageSize += m_parts[i].size;
 
-        fret = f_lseek(&m_isoFile, CREATE_LINKMAP);
-        assert(fret == FR_OK);
+        if (i != 0 && i != count - 1 && m_parts[i].size != m_parts[0].size)
+            m_uniformParts = false;
 
-        fret = f_lseek(&m_isoFile2, CREATE_LINKMAP);
-        assert(fret == FR_OK);
+        assert(m_parts[i].size != 0);
     }
 
+    if (count > 1 && m_parts[count - 1].size > m_parts[0].size)
+        m_uniformParts = false;
+
+    SetupFastSeek();
+
+    m_metadata = new DiscMetadata(paths[0], m_imageSize, imageTime);
+    m_metadata->Load();
+
     PRINT(IOS_EmuDI, INFO, "Successfully opened ISO file");
-    PRINT(IOS_EmuDI, INFO, "Part size: %08X", m_partSize);
-    PRINT(IOS_EmuDI, INFO, "Num parts: %08X", m_numParts);
-    PRINT(IOS_EmuDI, INFO, "Last part size: %08X", m_lastPartSize);
+    PRINT(IOS_EmuDI, INFO, "Num parts: %u", m_numParts);
+    PRINT(IOS_EmuDI, INFO, "Image size: %llX", m_imageSize);
 }
 
 ISO::~ISO()
 {
+    for (u32 i = 0; i < m_numParts; i++) {
+        f_close(&m_parts[i].file);
+    }
+
+    delete[] m_parts;
+    delete[] m_isoClmt;
+    delete m_metadata;
+    delete m_blockCache;
+    delete m_aesQueue;
+
+    for (u32 i = 0; i < 2; i++) {
+        if (m_dataBlock[i] != nullptr)
+            IOS_Free(System::GetHeap(), m_dataBlock[i]);
+    }
+
+    if (m_verifiedBlocks != nullptr)
+        IOS_Free(System::GetHeap(), m_verifiedBlocks);
+}
+
+void ISO::AllocateBlockBuffers()
+{
+    // Not using new, a failure is reported when the partition is opened
+    for (u32 i = 0; i < 2; i++) {
+        m_dataBlock[i] = reinterpret_cast<u8*>(
+          IOS_AllocAligned(System::GetHeap(), BlockSize, 32));
+    }
+
+    m_aesQueue = new Queue<IOS::Request*>(1);
+
+    u32 cacheBlocks = Config::s_instance->GetDiscCacheSize() / BlockDataSize;
+    m_blockCache = new BlockCache(cacheBlocks, BlockDataSize);
+    if (m_blockCache->GetBlockCount() < cacheBlocks) {
+        PRINT(IOS_EmuDI, WARN, "Not enough memory for the block cache (%u)",
+          m_blockCache->GetBlockCount());
+    }
+}
+
+void ISO::SetupFastSeek()
+{
+    // Use FatFS fast seek function to speed up long backwards seeks. First
+    // find how many cluster map entries each part needs, which depends on how
+    // fragmented it is rather than on its size.
+    u32* required = new u32[m_numParts];
+    u32 total = 0;
+
+    for (u32 i = 0; i < m_numParts; i++) {
+        DWORD probe[1] = {0};
+        m_parts[i].file.cltbl = probe;
+
+        auto fret = f_lseek(&m_parts[i].file, CREATE_LINKMAP);
+        assert(fret == FR_OK || fret == FR_NOT_ENOUGH_CORE);
+
+        m_parts[i].file.cltbl = nullptr;
+        required[i] = probe[0];
+        total += probe[0];
+    }
+
+    u32 clmtSize = std::min(total, ClmtBudget);
+    m_isoClmt = new DWORD[clmtSize];
+
+    // A cluster map only works if it's complete. If the budget doesn't cover
+    // every part, give maps to the least fragmented parts first so as many
+    // parts as possible get fast seek.
+    u32 used = 0;
+    while (true) {
+        u32 next = m_numParts;
+        for (u32 i = 0; i < m_numParts; i++) {
+            if (m_parts[i].file.cltbl != nullptr || required[i] == 0)
+                continue;
+
+            if (next == m_numParts || required[i] < required[next])
+                next = i;
+        }
+
+        if (next == m_numParts || used + required[next] > clmtSize)
+            break;
+
+        DWORD* clmt = &m_isoClmt[used];
+        clmt[0] = required[next];
+        m_parts[next].file.cltbl = clmt;
+
+        auto fret = f_lseek(&m_parts[next].file, CREATE_LINKMAP);
+        assert(fret == FR_OK);
+
+        used += required[next];
+    }
+
+    for (u32 i = 0; i < m_numParts; i++) {
+        if (m_parts[i].file.cltbl == nullptr) {
+            PRINT(IOS_EmuDI, WARN,
+              "Not enough cluster map space for part %u (needs %u)", i,
+              required[i]);
+        }
+    }
+
+    delete[] required;
 }
 
 bool ISO::IsInserted()
@@ -75,89 +178,325 @@ bool ISO::IsInserted()
     return DeviceMgr::s_instance->IsInserted(m_devId);
 }
 
-bool ISO::ReadRaw(void* buffer, u32 wordOffset, u32 byteLen)
+u32 ISO::FindPart(u64 offset) const
 {
-    const u32 lastPart = m_numParts - 1;
+    if (m_uniformParts)
+        return std::min<u32>(offset / m_parts[0].size, m_numParts - 1);
+
+    // Binary search for the last part starting at or before the offset
+    u32 low = 0, high = m_numParts;
+    while (high - low > 1) {
+        u32 mid = (low + high) / 2;
+        if (m_parts[mid].offset <= offset)
+            low = mid;
+        else
+            high = mid;
+    }
 
+    return low;
+}
+
+bool ISO::ReadImage(void* buffer, u64 offset, u32 byteLen)
+{
     if (byteLen == 0) {
         PRINT(IOS_EmuDI, WARN, "Zero length read");
         return false;
     }
 
-    u64 realOffset = (u64) wordOffset * 4;
+    if (offset + byteLen > m_imageSize) {
+        PRINT(IOS_EmuDI, ERROR, "Read off the end of the ISO (%llX > %llX)",
+          offset + byteLen, m_imageSize);
+        return false;
+    }
+
+    u8* writeBuffer = reinterpret_cast<u8*>(buffer);
+
+    for (u32 partNum = FindPart(offset); byteLen > 0; partNum++) {
+        Part* part = &m_parts[partNum];
+
+        u64 partOffset = offset - part->offset;
+        u32 lengthToRead = std::min<u64>(byteLen, part->size - partOffset);
+
+        auto fret = f_lseek(&part->file, partOffset);
+        if (fret != FR_OK)
+            return false;
+
+        UINT br;
+        fret = f_read(&part->file, writeBuffer, lengthToRead, &br);
+        if (fret != FR_OK || br != lengthToRead)
+            return false;
+
+        writeBuffer += lengthToRead;
+        offset += lengthToRead;
+        byteLen -= lengthToRead;
+    }
+
+    return true;
+}
+
+bool ISO::ReadRaw(void* buffer, u32 wordOffset, u32 byteLen)
+{
+    return ReadImage(buffer, (u64) wordOffset * 4, byteLen);
+}
+
+bool ISO::UnencryptedRead(void* out, u32 wordOffset, u32 byteLen)
+{
+    // The read-ahead thread may be reading the image at the same time
+    m_mutex.lock();
+    bool ret = m_metadata->ReadRegion(
+      out, DiscMetadata::NoPartition, wordOffset, byteLen);
+    if (!ret) {
+        ret = ReadRaw(out, wordOffset, byteLen);
+        if (ret) {
+            m_metadata->AddRegion(
+              out, DiscMetadata::NoPartition, wordOffset, byteLen);
+        }
+    }
+    m_mutex.unlock();
+
+    return ret;
+}
+
+bool ISO::DecryptBlock(u32 wordOffset, void* out)
+{
+    u8* rawBlock = m_dataBlock[0];
 
-    u32 partNum = realOffset / m_partSize;
-    u32 partNumEnd = (realOffset + byteLen - 1) / m_partSize;
-    u64 partOffset = realOffset % m_partSize;
+    if (!ReadRaw(rawBlock, wordOffset, BlockSize)) {
+        PRINT(IOS_EmuDI, ERROR, "Failed to read block from disc image");
+        return false;
+    }
 
-    if (partNumEnd >= m_numParts) {
-        PRINT(IOS_EmuDI, ERROR, "Read off the end of the ISO parts");
+    // Decrypt the block using the unique title key
+    memcpy(m_dataIV[0], &rawBlock[0x3D0], 16);
+    u32 startTime = ACRReadTrusted(ACRReg::TIMER);
+    s32 ret = AES::s_instance->Decrypt(m_titleKey, m_dataIV[0],
+      &rawBlock[BlockHeaderSize], BlockDataSize, out);
+    m_readStats.blocksDecrypted++;
+    m_readStats.decryptTicks += ACRReadTrusted(ACRReg::TIMER) - startTime;
+    if (ret != IOSError::OK) {
+        PRINT(IOS_EmuDI, ERROR, "Failed to decrypt block: %d", ret);
         return false;
     }
 
-    if (partNumEnd == lastPart && (partOffset + byteLen) >= m_lastPartSize) {
-        PRINT(IOS_EmuDI, ERROR,
-          "Read off the end of the last part (%llX >= %llx)", partOffset,
-          m_lastPartSize);
+    return VerifyBlock(wordOffset, rawBlock, reinterpret_cast<u8*>(out));
+}
+
+bool ISO::VerifyBlock(u32 blockWordOffset, const u8* rawBlock, const u8* data)
+{
+    if (m_verifyMode == Config::DiscVerifyMode::Off)
+        return true;
+
+    u32 dataStart = m_partitionOffset + m_partition.dataWordOffset;
+    u32 block = (blockWordOffset - dataStart) / (BlockSize >> 2);
+    if (block >= m_partitionBlockCount) {
+        PRINT(IOS_EmuDI, ERROR, "Block %u is outside of the partition", block);
         return false;
     }
 
-    while (byteLen > 0) {
-        // TODO: Add support for larger discs that require more than two parts.
-        FIL* fp = partNum == 0   ? &m_isoFile
-                  : partNum == 1 ? &m_isoFile2
-                                 : nullptr;
+    if (m_verifiedBlocks != nullptr &&
+        (m_verifiedBlocks[block / 8] & (1 << (block % 8))))
+        return true;
 
-        u32 lengthToRead =
-          partNum == partNumEnd ? byteLen : m_partSize - partOffset;
+    u32 startTime = ACRReadTrusted(ACRReg::TIMER);
+    bool ret = CheckBlockHashes(block, rawBlock, data);
+
+    m_readStats.blocksVerified++;
+    if (!ret)
+        m_readStats.verifyFailures++;
+    m_readStats.verifyTicks += ACRReadTrusted(ACRReg::TIMER) - startTime;
+
+    if (ret && m_verifiedBlocks != nullptr)
+        m_verifiedBlocks[block / 8] |= 1 << (block % 8);
+
+    return ret;
+}
 
-        if (fp == nullptr) {
-            PRINT(IOS_EmuDI, ERROR,
-              "Part counts greater than 1 currently aren't supported");
+bool ISO::CheckBlockHashes(u32 block, const u8* rawBlock, const u8* data)
+{
+    u8 hash[0x14] ATTRIBUTE_ALIGN(32);
+    const u8* header = rawBlock;
+
+    // The hash header is encrypted separately with a zero IV, unless the
+    // image has it decrypted already
+    if (m_isEncrypted) {
+        u8 iv[16] ATTRIBUTE_ALIGN(32) = {};
+        if (AES::s_instance->Decrypt(m_titleKey, iv, rawBlock, BlockHeaderSize,
+              m_hashHeader) != IOSError::OK) {
+            PRINT(IOS_EmuDI, ERROR, "Failed to decrypt hash header");
             return false;
         }
+        header = m_hashHeader;
+    }
 
-        auto fret = f_lseek(fp, partOffset);
-        if (fret != FR_OK)
-            return false;
-        UINT br;
-        fret = f_read(fp, buffer, lengthToRead, &br);
-        if (fret != FR_OK)
+    // H0: each 0x400 bytes of data
+    for (u32 i = 0; i < BlockDataSize / H0ChunkSize; i++) {
+        SHA::Calculate(&data[i * H0ChunkSize], H0ChunkSize, hash);
+        if (memcmp(hash, &header[H0Offset + i * 0x14], 0x14) != 0) {
+            PRINT(IOS_EmuDI, ERROR, "H0 mismatch in block %u chunk %u",
+              block, i);
             return false;
+        }
+    }
 
-        partOffset = 0;
-        byteLen -= lengthToRead;
-        partNum++;
+    // H1: the H0 table of each of the 8 blocks in the subgroup
+    SHA::Calculate(&header[H0Offset], H0Size, hash);
+    if (memcmp(hash, &header[H1Offset + (block % 8) * 0x14], 0x14) != 0) {
+        PRINT(IOS_EmuDI, ERROR, "H1 mismatch in block %u", block);
+        return false;
+    }
+
+    // H2: the H1 table of each of the 8 subgroups in the group
+    SHA::Calculate(&header[H1Offset], H1H2Size, hash);
+    if (memcmp(hash, &header[H2Offset + (block / 8 % 8) * 0x14], 0x14) != 0) {
+        PRINT(IOS_EmuDI, ERROR, "H2 mismatch in block %u", block);
+        return false;
+    }
+
+    // H3: the H2 table of each group, from the partition header
+    if (!LoadH3Hash(block))
+        return false;
+
+    SHA::Calculate(&header[H2Offset], H1H2Size, hash);
+    if (memcmp(hash, m_h3Hash, 0x14) != 0) {
+        PRINT(IOS_EmuDI, ERROR, "H3 mismatch in block %u", block);
+        return false;
     }
 
     return true;
 }
 
-bool ISO::UnencryptedRead(void* out, u32 wordOffset, u32 byteLen)
+bool ISO::LoadH3Hash(u32 block)
 {
-    return ReadRaw(out, wordOffset, byteLen);
+    if (m_h3Group == block / 64)
+        return true;
+
+    m_h3Group = ~0;
+    if (!ReadRaw(m_h3Hash,
+          m_partitionOffset + m_partition.h3TableWordOffset +
+            (block / 64 * 0x14 >> 2),
+          0x14)) {
+        PRINT(IOS_EmuDI, ERROR, "Failed to read H3 hash");
+        return false;
+    }
+
+    m_h3Group = block / 64;
+    return true;
 }
 
-bool ISO::ReadAndDecryptBlock(u32 wordOffset)
+bool ISO::VerifyH3Table(const ES::TMDFixed<512>* tmd)
 {
-    if (m_lastReadBlock == wordOffset)
-        return true;
+    if (tmd->header.numContents == 0) {
+        PRINT(IOS_EmuDI, ERROR, "TMD has no contents");
+        return false;
+    }
 
-    m_lastReadBlock = wordOffset;
+    SHA::Context ctx ATTRIBUTE_ALIGN(32);
+    if (SHA::s_instance->Init(&ctx) != IOSError::OK)
+        return false;
 
-    if (!ReadRaw(m_dataBlock, wordOffset, BlockSize)) {
-        PRINT(IOS_EmuDI, ERROR, "Failed to read block from disc image");
+    // Hash the table a block buffer at a time, or a hash header buffer at a
+    // time for images without block buffers
+    u8* buffer = m_dataBlock[0] != nullptr ? m_dataBlock[0] : m_hashHeader;
+    u32 bufferSize = m_dataBlock[0] != nullptr ? BlockSize : BlockHeaderSize;
+    u32 wordOffset = m_partitionOffset + m_partition.h3TableWordOffset;
+
+    for (u32 offset = 0; offset < H3TableSize; offset += bufferSize) {
+        u32 len = std::min(bufferSize, H3TableSize - offset);
+        if (!ReadRaw(buffer, wordOffset + (offset >> 2), len)) {
+            PRINT(IOS_EmuDI, ERROR, "Failed to read H3 table");
+            return false;
+        }
+
+        if (SHA::s_instance->Update(&ctx, buffer, len) != IOSError::OK)
+            return false;
+    }
+
+    u8 hash[0x14] ATTRIBUTE_ALIGN(32);
+    if (SHA::s_instance->Final(&ctx, hash) != IOSError::OK)
+        return false;
+
+    if (memcmp(hash, tmd->contents[0].hash, 0x14) != 0) {
+        PRINT(IOS_EmuDI, ERROR, "H3 table does not match the TMD");
+        return false;
+    }
+
+    return true;
+}
+
+bool ISO::WaitDecryptAsync()
+{
+    // Only the time the read waits is counted, the block is decrypted while
+    // the next one is read
+    u32 startTime = ACRReadTrusted(ACRReg::TIMER);
+    IOS::Request* req = m_aesQueue->receive();
+    assert(req == &m_aesRequest.req);
+    m_readStats.blocksDecrypted++;
+    m_readStats.decryptTicks += ACRReadTrusted(ACRReg::TIMER) - startTime;
+
+    if (req->result != IOSError::OK) {
+        PRINT(IOS_EmuDI, ERROR, "Failed to decrypt block: %d", req->result);
         return false;
     }
 
-    // Decrypt the block using the unique title key
-    s32 ret = AES::s_instance->Decrypt(m_titleKey, &m_dataBlock[0x3D0],
-      &m_dataBlock[BlockHeaderSize], BlockDataSize, m_dataBlockDecrypted);
-    assert(ret == IOSError::OK);
     return true;
 }
 
+const u8* ISO::ReadAndDecryptBlock(u32 wordOffset)
+{
+    if (const u8* block = m_blockCache->Lookup(wordOffset))
+        return block;
+
+    // Without a cache the block is decrypted in place in the raw block
+    // buffer, which keeps the header for verification. It's only valid until
+    // the next block is read.
+    u8* block = m_blockCache->Insert(wordOffset);
+    if (block == nullptr)
+        block = &m_dataBlock[0][BlockHeaderSize];
+
+    if (!DecryptBlock(wordOffset, block)) {
+        m_blockCache->Invalidate(wordOffset);
+        return nullptr;
+    }
+
+    return block;
+}
+
 bool ISO::ReadFromPartition(void* out, u32 wordOffset, u32 byteLen)
+{
+    m_mutex.lock();
+
+    // Small reads of the partition's boot header, e.g. the FST location
+    bool bootHeader = wordOffset + byteLen / 4 <= BootHeaderWords;
+    if (bootHeader && m_partitionOpened &&
+        m_metadata->ReadRegion(out, m_partitionOffset, wordOffset, byteLen)) {
+        m_lastReadCached = true;
+        m_mutex.unlock();
+        return true;
+    }
+
+    // Every block read from the disc image goes through either a cache miss
+    // or a decrypt into the output buffer
+    u32 misses = m_blockCache->GetStats().misses;
+    u64 inPlace = m_readStats.bytesDecryptedInPlace;
+
+    bool ret = ReadFromPartitionLocked(out, wordOffset, byteLen);
+
+    m_lastReadCached = ret && misses == m_blockCache->GetStats().misses &&
+                       inPlace == m_readStats.bytesDecryptedInPlace;
+
+    if (ret && bootHeader && m_partitionOpened)
+        m_metadata->AddRegion(out, m_partitionOffset, wordOffset, byteLen);
+    m_mutex.unlock();
+
+    return ret;
+}
+
+bool ISO::WasLastReadCached()
+{
+    return m_lastReadCached;
+}
+
+bool ISO::ReadFromPartitionLocked(void* out, u32 wordOffset, u32 byteLen)
 {
     if (!m_partitionOpened) {
         PRINT(IOS_EmuDI, ERROR, "Attempt read with no open partition");
@@ -183,44 +522,159 @@ bool ISO::ReadFromPartition(void* out, u32 wordOffset, u32 byteLen)
 
     // Decrypt first block separately if it's not aligned to a block boundary
     if (wordOffset % (BlockDataSize >> 2)) {
-        if (!ReadAndDecryptBlock(blockWordOffset))
+        const u8* block = ReadAndDecryptBlock(blockWordOffset);
+        if (block == nullptr)
             return false;
 
         u32 copyOffset = wordOffset % (BlockDataSize >> 2);
         u32 copyLen = std::min(byteLen, BlockDataSize - (copyOffset << 2));
-        memcpy(writeBuffer, &m_dataBlockDecrypted[copyOffset << 2], copyLen);
+        memcpy(writeBuffer, &block[copyOffset << 2], copyLen);
+        m_readStats.bytesCopied += copyLen;
 
         writeBuffer += copyLen;
         byteLen -= copyLen;
         blockWordOffset += (BlockSize >> 2);
     }
 
-    // Read the next full blocks
-    while (byteLen >= BlockDataSize) {
-        if (!ReadAndDecryptBlock(blockWordOffset))
-            return false;
+    // Read the next full blocks. Blocks that were already cached (e.g. by
+    // read-ahead) are copied, otherwise they're decrypted straight into the
+    // output buffer if the AES engine can write to it. The decryption runs
+    // asynchronously, so the next block is read from the disc image while
+    // the previous one is being decrypted.
+    u32 pipeIndex = 0;
+    bool decryptPending = false;
+    u32 pendingWordOffset = 0;
+    u8* pendingOut = nullptr;
+
+    // Wait for the block being decrypted and check its hashes, its raw block
+    // is in the other pipeline buffer
+    auto finishPending = [&]() {
+        if (!decryptPending)
+            return true;
+
+        decryptPending = false;
+        return WaitDecryptAsync() &&
+               VerifyBlock(
+                 pendingWordOffset, m_dataBlock[pipeIndex ^ 1], pendingOut);
+    };
 
-        memcpy(writeBuffer, m_dataBlockDecrypted, BlockDataSize);
+    while (byteLen >= BlockDataSize) {
+        if (m_blockCache->Contains(blockWordOffset) ||
+            !aligned(writeBuffer, 32)) {
+            // ReadAndDecryptBlock uses the first raw block buffer
+            if (!finishPending())
+                return false;
+
+            const u8* block = ReadAndDecryptBlock(blockWordOffset);
+            if (block == nullptr)
+                return false;
+
+            memcpy(writeBuffer, block, BlockDataSize);
+            m_readStats.bytesCopied += BlockDataSize;
+        } else {
+            u8* rawBlock = m_dataBlock[pipeIndex];
+
+            bool ret = ReadRaw(rawBlock, blockWordOffset, BlockSize);
+            if (!finishPending())
+                return false;
+
+            if (!ret) {
+                PRINT(IOS_EmuDI, ERROR, "Failed to read block from disc image");
+                return false;
+            }
+
+            memcpy(m_dataIV[pipeIndex], &rawBlock[0x3D0], 16);
+            s32 ret2 = AES::s_instance->DecryptAsync(m_titleKey,
+              m_dataIV[pipeIndex], &rawBlock[BlockHeaderSize], BlockDataSize,
+              writeBuffer, m_aesQueue, &m_aesRequest);
+            if (ret2 != IOSError::OK) {
+                PRINT(IOS_EmuDI, ERROR, "Failed to start decrypt: %d", ret2);
+                return false;
+            }
+
+            decryptPending = true;
+            pendingWordOffset = blockWordOffset;
+            pendingOut = writeBuffer;
+            pipeIndex ^= 1;
+            m_readStats.bytesDecryptedInPlace += BlockDataSize;
+        }
 
         writeBuffer += BlockDataSize;
         byteLen -= BlockDataSize;
         blockWordOffset += (BlockSize >> 2);
     }
 
+    if (!finishPending())
+        return false;
+
     // Read the last short block
     if (byteLen > 0) {
-        if (!ReadAndDecryptBlock(blockWordOffset))
+        const u8* block = ReadAndDecryptBlock(blockWordOffset);
+        if (block == nullptr)
             return false;
 
-        memcpy(writeBuffer, m_dataBlockDecrypted, byteLen);
+        memcpy(writeBuffer, block, byteLen);
+        m_readStats.bytesCopied += byteLen;
+    }
+
+    return true;
+}
+
+bool ISO::Prefetch(u32 wordOffset, u32 byteLen)
+{
+    if (!m_partitionOpened || byteLen == 0 ||
+        m_blockCache->GetBlockCount() == 0)
+        return false;
+
+    constexpr u32 blockDataWords = BlockDataSize >> 2;
+    constexpr u32 blockWords = BlockSize >> 2;
+
+    u32 dataStart = m_partitionOffset + m_partition.dataWordOffset;
+    u32 blockCount = m_partition.dataWordLength / blockWords;
+
+    u32 block = wordOffset / blockDataWords;
+    u32 blockEnd = (wordOffset + ((byteLen + 3) >> 2) - 1) / blockDataWords + 1;
+    blockEnd = std::min(blockEnd, blockCount);
+
+    for (; block < blockEnd; block++) {
+        u32 blockWordOffset = dataStart + block * blockWords;
+
+        // Lock per block so a read from the game doesn't have to wait for the
+        // whole range to be fetched
+        m_mutex.lock();
+        bool ret = true;
+        if (!m_blockCache->Contains(blockWordOffset)) {
+            u8* data = m_blockCache->Insert(blockWordOffset, true);
+            ret = DecryptBlock(blockWordOffset, data);
+            if (!ret)
+                m_blockCache->Invalidate(blockWordOffset);
+        }
+        m_mutex.unlock();
+
+        if (!ret)
+            return false;
     }
 
     return true;
 }
 
+u32 ISO::GetPrefetchCapacity()
+{
+    return m_blockCache != nullptr ? m_blockCache->GetBlockCount() : 0;
+}
+
 bool ISO::ReadDiskID(DI::DiskID* out)
 {
-    if (!ReadRawStruct(&m_diskID, DiskID_OFFSET))
+    m_mutex.lock();
+    bool ret = m_metadata->GetDiskID(&m_diskID);
+    if (!ret) {
+        ret = ReadRawStruct(&m_diskID, DiskID_OFFSET);
+        if (ret)
+            m_metadata->SetDiskID(m_diskID);
+    }
+    m_mutex.unlock();
+
+    if (!ret)
         return false;
 
     *out = m_diskID;
@@ -241,6 +695,15 @@ DI::DIError ISO::ReadTMD(ES::TMDFixed<512>* out)
         return DI::DIError::Security;
     }
 
+    m_mutex.lock();
+    auto saved = m_metadata->FindPartition(m_partitionOffset);
+    if (saved != nullptr)
+        memcpy(out, &saved->tmd, m_partition.tmdByteLength);
+    m_mutex.unlock();
+
+    if (saved != nullptr)
+        return DI::DIError::OK;
+
     if (!ReadRaw(reinterpret_cast<void*>(out),
           m_partitionOffset + m_partition.tmdWordOffset,
           m_partition.tmdByteLength)) {
@@ -251,41 +714,8 @@ DI::DIError ISO::ReadTMD(ES::TMDFixed<512>* out)
     return DI::DIError::OK;
 }
 
-DI::DIError ISO::OpenPartition(u32 wordOffset, ES::TMDFixed<512>* tmdOut)
+void ISO::DecryptTitleKey()
 {
-    if (m_partitionOpened) {
-        PRINT(IOS_EmuDI, ERROR,
-          "Attempt to open a partition when one is already open");
-        return DI::DIError::Invalid;
-    }
-
-    if (!m_readDiskIDCalled) {
-        PRINT(IOS_EmuDI, ERROR,
-          "ReadDiskID must be called before attempting to open a partition");
-        return DI::DIError::Invalid;
-    }
-
-    m_partitionOffset = wordOffset;
-
-    if (!ReadRawStruct(&m_partition, wordOffset)) {
-        PRINT(IOS_EmuDI, ERROR, "Failed to read partition at offset 0x%08X",
-          wordOffset);
-        return DI::DIError::Drive;
-    }
-
-    // Read TMD from disc image
-    auto ret = ReadTMD(tmdOut);
-    if (ret != DI::DIError::OK) {
-        return ret;
-    }
-
-    auto esRet =
-      EmuES::DIVerify(m_partition.ticket.info.titleID, &m_partition.ticket);
-    if (esRet != ES::ESError::OK) {
-        PRINT(IOS_EmuDI, ERROR, "DIVerify failed: %d", esRet);
-        return DI::DIError::Verify;
-    }
-
     u8 titleKeyBuffer[32] ATTRIBUTE_ALIGN(32);
     memcpy(titleKeyBuffer, m_partition.ticket.titleKey, 16);
 
@@ -312,11 +742,149 @@ DI::DIError ISO::OpenPartition(u32 wordOffset, ES::TMDFixed<512>* tmdOut)
     u8 iv[16] = {0};
     memcpy(iv, &m_partition.ticket.info.titleID, 8);
 
-    auto ret2 = AES::s_instance->Decrypt(
+    auto ret = AES::s_instance->Decrypt(
       key, iv, titleKeyBuffer, sizeof(titleKeyBuffer), titleKeyBuffer);
-    assert(ret2 == IOSError::OK);
+    assert(ret == IOSError::OK);
     memcpy(m_titleKey, titleKeyBuffer, 16);
+}
+
+DI::DIError ISO::ReadPartitionHeaders(
+  u32 wordOffset, ES::TMDFixed<512>* tmdOut)
+{
+    m_mutex.lock();
+    auto saved = m_metadata->FindPartition(wordOffset);
+    if (saved != nullptr)
+        m_partition = saved->header;
+    m_mutex.unlock();
+
+    if (saved != nullptr) {
+        // Only the ticket is saved, the key is never written out decrypted
+        DecryptTitleKey();
+        return ReadTMD(tmdOut);
+    }
+
+    if (!ReadRawStruct(&m_partition, wordOffset)) {
+        PRINT(IOS_EmuDI, ERROR, "Failed to read partition at offset 0x%08X",
+          wordOffset);
+        return DI::DIError::Drive;
+    }
+
+    // Read TMD from disc image
+    auto ret = ReadTMD(tmdOut);
+    if (ret != DI::DIError::OK) {
+        return ret;
+    }
+
+    DecryptTitleKey();
+
+    m_mutex.lock();
+    m_metadata->AddPartition(
+      wordOffset, m_partition, tmdOut, m_partition.tmdByteLength);
+    m_mutex.unlock();
+
+    return DI::DIError::OK;
+}
+
+DI::DIError ISO::OpenPartition(u32 wordOffset, ES::TMDFixed<512>* tmdOut)
+{
+    if (m_partitionOpened) {
+        PRINT(IOS_EmuDI, ERROR,
+          "Attempt to open a partition when one is already open");
+        return DI::DIError::Invalid;
+    }
+
+    if (!m_readDiskIDCalled) {
+        PRINT(IOS_EmuDI, ERROR,
+          "ReadDiskID must be called before attempting to open a partition");
+        return DI::DIError::Invalid;
+    }
+
+    if (m_isEncrypted &&
+        (m_dataBlock[0] == nullptr || m_dataBlock[1] == nullptr)) {
+        PRINT(IOS_EmuDI, ERROR, "Not enough memory for the block buffers");
+        return DI::DIError::Drive;
+    }
+
+    m_partitionOffset = wordOffset;
+
+    auto ret = ReadPartitionHeaders(wordOffset, tmdOut);
+    if (ret != DI::DIError::OK) {
+        return ret;
+    }
+
+    m_partitionBlockCount = m_partition.dataWordLength / (BlockSize >> 2);
+
+    if (m_verifyMode != Config::DiscVerifyMode::Off) {
+        if (!VerifyH3Table(tmdOut))
+            return DI::DIError::Drive;
+
+        m_h3Group = ~0;
+    }
+
+    if (m_verifyMode == Config::DiscVerifyMode::Lazy) {
+        // Not using new, lazy mode can fall back to checking every read
+        u32 bitmapSize = (m_partitionBlockCount + 7) / 8;
+        m_verifiedBlocks =
+          reinterpret_cast<u8*>(IOS_Alloc(System::GetHeap(), bitmapSize));
+        if (m_verifiedBlocks != nullptr) {
+            memset(m_verifiedBlocks, 0, bitmapSize);
+        } else {
+            PRINT(IOS_EmuDI, WARN, "Not enough memory for the verify bitmap");
+        }
+    }
+
+    auto esRet =
+      EmuES::DIVerify(m_partition.ticket.info.titleID, &m_partition.ticket);
+    if (esRet != ES::ESError::OK) {
+        PRINT(IOS_EmuDI, ERROR, "DIVerify failed: %d", esRet);
+        return DI::DIError::Verify;
+    }
+
+    // Write anything read for the first time since the last save, the next
+    // launch can then skip reading it
+    m_mutex.lock();
+    m_metadata->Save();
+    m_mutex.unlock();
 
     m_partitionOpened = true;
     return DI::DIError::OK;
 }
+
+void ISO::GetStats(EmuDI::DVDReadStats* stats)
+{
+    stats->blocksVerified = m_readStats.blocksVerified;
+    stats->verifyFailures = m_readStats.verifyFailures;
+    stats->verifyMicros = m_readStats.verifyTicks * 1000000 / HW_TIMER_FREQ;
+    stats->blocksDecrypted = m_readStats.blocksDecrypted;
+    stats->decryptMicros = m_readStats.decryptTicks * 1000000 / HW_TIMER_FREQ;
+
+    if (m_blockCache != nullptr) {
+        m_mutex.lock();
+        stats->prefetchHits = m_blockCache->GetStats().prefetchHits;
+        m_mutex.unlock();
+    }
+
+    SectorCache::Stats cacheStats = {};
+    DeviceMgr::s_instance->GetCacheStats(m_devId, &cacheStats);
+    stats->deviceCacheHits = cacheStats.hits;
+    stats->deviceCacheMisses = cacheStats.misses;
+    stats->deviceCacheEvictions = cacheStats.evictions;
+    stats->deviceCacheWriteBacks = cacheStats.writeBacks;
+
+    auto transferStats = DeviceMgr::s_instance->GetTransferStats(m_devId);
+    stats->deviceRequests = transferStats.requests;
+    stats->deviceRequestSectors = transferStats.requestSectors;
+    stats->deviceTransfers = transferStats.transfers;
+    stats->deviceTransferSectors = transferStats.transferSectors;
+}
+
+void ISO::ResetStats()
+{
+    m_readStats = {};
+
+    if (m_blockCache != nullptr) {
+        m_mutex.lock();
+        m_blockCache->ResetStats();
+        m_mutex.unlock();
+    }
+}
@@ -5,25 +5,78 @@
 
 #pragma once
 
+#include "BlockCache.hpp"
+#include "DiscMetadata.hpp"
 #include "VirtualDisc.hpp"
 #include <Disk/DeviceMgr.hpp>
 #include <FAT/ff.h>
+#include <System/AES.hpp>
+#include <System/Config.hpp>
+#include <System/OS.hpp>
 #include <System/Types.h>
 
 class ISO : public VirtualDisc
 {
 public:
-    ISO(const char* path, const char* path2);
+    /**
+     * @param paths Paths of the image parts, in order. Images split into
+     * multiple files are read as if the parts were concatenated.
+     * @param count Number of parts.
+     */
+    ISO(const char* const* paths, u32 count);
+
+    static constexpr u32 MaxParts = 32;
+
     virtual ~ISO();
     virtual bool IsInserted() override;
 
+    struct ReadStats {
+        // Bytes copied out of the block cache
+        u64 bytesCopied;
+        // Bytes decrypted directly into the output buffer
+        u64 bytesDecryptedInPlace;
+        // Blocks decrypted and the timer ticks spent waiting for the AES
+        // engine
+        u32 blocksDecrypted;
+        u64 decryptTicks;
+        // Hash tree checks and the timer ticks spent on them
+        u32 blocksVerified;
+        u32 verifyFailures;
+        u64 verifyTicks;
+    };
+
+    ReadStats GetReadStats() const
+    {
+        return m_readStats;
+    }
+
 protected:
+    /**
+     * @param encrypted The image has encrypted partition blocks. Images that
+     * don't, like pre-decrypted ones, get no block buffers or block cache,
+     * and no hash verification unless they keep the hash headers and turn it
+     * on.
+     */
+    ISO(const char* const* paths, u32 count, bool encrypted);
+
     static constexpr u32 DiskID_OFFSET = 0;
 
     static constexpr u32 BlockSize = 0x8000;
     static constexpr u32 BlockHeaderSize = 0x400;
     static constexpr u32 BlockDataSize = 0x7C00;
 
+    // Partition boot.bin and bi2.bin, before the apploader
+    static constexpr u32 BootHeaderWords = 0x2440 >> 2;
+
+    /**
+     * Read from the disc image file(s).
+     * @param offset Byte offset into the image.
+     */
+    bool ReadImage(void* buffer, u64 offset, u32 byteLen);
+
+    /**
+     * Read raw data at a disc offset.
+     */
     virtual bool ReadRaw(void* buffer, u32 wordOffset, u32 byteLen);
 
     template <class T>
@@ -32,20 +85,95 @@ protected:
         return ReadRaw(reinterpret_cast<void*>(data), wordOffset, sizeof(T));
     }
 
-    bool ReadAndDecryptBlock(u32 wordOffset);
+    /**
+     * Get a decrypted block from the block cache, reading and decrypting it
+     * from the disc image if it isn't cached.
+     * @param wordOffset Word offset of the encrypted block.
+     * @returns Pointer to the decrypted block data, or nullptr on failure.
+     */
+    const u8* ReadAndDecryptBlock(u32 wordOffset);
+
+    /**
+     * Read a block from the disc image and decrypt its data.
+     * @param wordOffset Word offset of the encrypted block.
+     * @param[out] out Output for the BlockDataSize bytes of decrypted data.
+     */
+    bool DecryptBlock(u32 wordOffset, void* out);
+
+    /**
+     * Wait for the pending asynchronous block decrypt to complete.
+     */
+    bool WaitDecryptAsync();
+
+    // Hash header layout
+    static constexpr u32 H0Offset = 0x000;
+    static constexpr u32 H0Size = 31 * 0x14;
+    static constexpr u32 H1Offset = 0x280;
+    static constexpr u32 H2Offset = 0x340;
+    static constexpr u32 H1H2Size = 8 * 0x14;
+    static constexpr u32 H3TableSize = 0x18000;
+    // Data covered by each H0 hash
+    static constexpr u32 H0ChunkSize = 0x400;
+
+    /**
+     * Check a decrypted block against the partition hash tree, if enabled.
+     * @param blockWordOffset Word offset of the encrypted block.
+     * @param rawBlock The block as stored in the image, only the header is
+     * used. The header is decrypted first for encrypted images.
+     * @param data The decrypted block data.
+     */
+    bool VerifyBlock(u32 blockWordOffset, const u8* rawBlock, const u8* data);
+
+    bool CheckBlockHashes(u32 block, const u8* rawBlock, const u8* data);
+
+    /**
+     * Read the H3 hash of a block's group into m_h3Hash, if it isn't there
+     * already. Images that read the H3 table through the same buffer as the
+     * block load it before the block.
+     * @param block Block number in the partition.
+     */
+    bool LoadH3Hash(u32 block);
+
+    /**
+     * Check the partition's H3 table against the content hash in the TMD.
+     */
+    bool VerifyH3Table(const ES::TMDFixed<512>* tmd);
+
+    bool ReadFromPartitionLocked(void* out, u32 wordOffset, u32 byteLen);
+
+    /**
+     * Decrypt the title key in the partition's ticket into m_titleKey.
+     */
+    void DecryptTitleKey();
+
+    /**
+     * Read the partition header and TMD, from the saved metadata if possible,
+     * and decrypt the title key.
+     */
+    DI::DIError ReadPartitionHeaders(
+      u32 wordOffset, ES::TMDFixed<512>* tmdOut);
 
 private:
-    FIL m_isoFile;
-
-    // If ISO is split into multiple parts.
+    void AllocateBlockBuffers();
+    void SetupFastSeek();
+    u32 FindPart(u64 offset) const;
+
+    struct Part {
+        FIL file;
+        // Offset of the part in the image
+        u64 offset;
+        u64 size;
+    };
+
+    Part* m_parts = nullptr;
     u32 m_numParts;
-    u64 m_partSize;
-    u64 m_lastPartSize;
-
-    FIL m_isoFile2;
+    u64 m_imageSize;
+    bool m_uniformParts;
 
-    // FatFS fast seek feature
-    DWORD m_isoClmt[0x1000] = {0};
+    // FatFS fast seek feature; maximum number of cluster map entries shared
+    // between all the parts
+    static constexpr u32 ClmtBudget = 0x1000;
+    DWORD* m_isoClmt = nullptr;
 
 protected:
     u32 m_devId = 0;
@@ -58,15 +186,47 @@ protected:
 
     bool m_isEncrypted = true;
     u8 m_titleKey[16] ATTRIBUTE_ALIGN(4);
-    u8 m_dataBlock[BlockSize] ATTRIBUTE_ALIGN(32);
-    u8 m_dataBlockDecrypted[BlockDataSize] ATTRIBUTE_ALIGN(32);
-    // Offset of the block in m_dataBlockDecrypted. 1 is an invalid block offset
-    // so this won't be initially used.
-    u32 m_lastReadBlock = 1;
+    // Two encrypted block buffers, so one block can be read while the other
+    // is being decrypted. Allocated from the heap for encrypted images only.
+    u8* m_dataBlock[2] = {};
+    // Data IVs copied out of the block headers, as the AES engine overwrites
+    // the IV and the header is still needed for verification.
+    u8 m_dataIV[2][16] ATTRIBUTE_ALIGN(32);
+
+    Config::DiscVerifyMode m_verifyMode;
+    // One bit per partition block, set once the block has passed in lazy mode
+    u8* m_verifiedBlocks = nullptr;
+    u32 m_partitionBlockCount = 0;
+    // Last H3 hash read from the disc image
+    u32 m_h3Group = ~0;
+    u8 m_h3Hash[0x14];
+    u8 m_hashHeader[BlockHeaderSize] ATTRIBUTE_ALIGN(32);
+
+    Queue<IOS::Request*>* m_aesQueue = nullptr;
+    AES::AsyncRequest m_aesRequest;
+
+    // Decrypted blocks keyed by the word offset of the encrypted block, only
+    // for encrypted images
+    BlockCache* m_blockCache = nullptr;
+
+    // Protects the block cache and the disc image reads, as blocks may be
+    // prefetched from another thread.
+    Mutex m_mutex;
+
+    ReadStats m_readStats = {};
+    bool m_lastReadCached = false;
+
+    // Headers saved from an earlier launch of the same image
+    DiscMetadata* m_metadata;
 
 public:
     bool UnencryptedRead(void* out, u32 wordOffset, u32 byteLen) override;
     bool ReadFromPartition(void* out, u32 wordOffset, u32 byteLen) override;
+    bool Prefetch(u32 wordOffset, u32 byteLen) override;
+    u32 GetPrefetchCapacity() override;
+    void GetStats(EmuDI::DVDReadStats* stats) override;
+    void ResetStats() override;
+    bool WasLastReadCached() override;
     bool ReadDiskID(DI::DiskID* out) override;
     DI::DIError ReadTMD(ES::TMDFixed<512>* out) override;
     DI::DIError OpenPartition(
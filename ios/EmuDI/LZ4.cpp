@@ -0,0 +1,83 @@
+// LZ4.cpp - LZ4 block decompression
+//
+// SPDX-License-Identifier: MIT
+
+#include "LZ4.hpp"
+#include <cstring>
+
+namespace LZ4
+{
+
+static bool ReadLength(const u8*& ip, const u8* inEnd, u32* length)
+{
+    u8 byte;
+    do {
+        if (ip == inEnd)
+            return false;
+
+        byte = *ip++;
+        *length += byte;
+    } while (byte == 255);
+
+    return true;
+}
+
+s32 Decompress(const u8* in, u32 inSize, u8* out, u32 outSize)
+{
+    const u8* ip = in;
+    const u8* inEnd = in + inSize;
+    u8* op = out;
+    u8* outEnd = out + outSize;
+
+    while (ip < inEnd) {
+        u8 token = *ip++;
+
+        // Literals
+        u32 length = token >> 4;
+        if (length == 15 && !ReadLength(ip, inEnd, &length))
+            return -1;
+
+        if (length > u32(inEnd - ip) || length > u32(outEnd - op))
+            return -1;
+
+        std::memcpy(op, ip, length);
+        ip += length;
+        op += length;
+
+        // The last sequence only has literals
+        if (ip == inEnd)
+            break;
+
+        // Match
+        if (inEnd - ip < 2)
+            return -1;
+
+        u32 offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+
+        if (offset == 0 || offset > u32(op - out))
+            return -1;
+
+        length = (token & 15) + 4;
+        if ((token & 15) == 15 && !ReadLength(ip, inEnd, &length))
+            return -1;
+
+        if (length > u32(outEnd - op))
+            return -1;
+
+        const u8* match = op - offset;
+        if (offset >= length) {
+            std::memcpy(op, match, length);
+            op += length;
+        } else {
+            // Overlapping match, repeats the last offset bytes
+            for (u32 i = 0; i < length; i++) {
+                *op++ = *match++;
+            }
+        }
+    }
+
+    return op - out;
+}
+
+} // namespace LZ4
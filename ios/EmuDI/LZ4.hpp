@@ -0,0 +1,23 @@
+// LZ4.hpp - LZ4 block decompression
+//
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <System/Types.h>
+
+namespace LZ4
+{
+
+/**
+ * Decompress an LZ4 block (no frame header).
+ * @param in Compressed data.
+ * @param inSize Size of the compressed data.
+ * @param out Output buffer.
+ * @param outSize Size of the output buffer.
+ * @returns Number of bytes written to the output, or -1 if the data is
+ * corrupt or doesn't fit in the output buffer.
+ */
+s32 Decompress(const u8* in, u32 inSize, u8* out, u32 outSize);
+
+} // namespace LZ4
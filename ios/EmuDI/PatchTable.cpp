@@ -0,0 +1,154 @@
+// PatchTable.cpp - Sorted table of DVD patch extents
+//
+// SPDX-License-Identifier: MIT
+
+#include "PatchTable.hpp"
+#include <Debug/Log.hpp>
+#include <IOS/Syscalls.h>
+#include <IOS/System.hpp>
+#include <algorithm>
+#include <cstring>
+
+namespace EmuDI
+{
+
+void PatchTable::Clear()
+{
+    if (m_patches != nullptr)
+        IOS_Free(System::GetHeap(), m_patches);
+
+    m_patches = nullptr;
+    m_count = 0;
+    m_capacity = 0;
+    m_sorted = true;
+    m_cursor = 0;
+    m_generation++;
+}
+
+bool PatchTable::Reserve(u32 capacity)
+{
+    if (capacity <= m_capacity)
+        return true;
+
+    // Not using new, running out of memory here shouldn't be fatal
+    DVDPatch* patches = reinterpret_cast<DVDPatch*>(
+      IOS_Alloc(System::GetHeap(), capacity * sizeof(DVDPatch)));
+    if (patches == nullptr)
+        return false;
+
+    if (m_patches != nullptr) {
+        std::memcpy(patches, m_patches, m_count * sizeof(DVDPatch));
+        IOS_Free(System::GetHeap(), m_patches);
+    }
+
+    m_patches = patches;
+    m_capacity = capacity;
+    return true;
+}
+
+bool PatchTable::Add(const DVDPatch* patches, u32 count)
+{
+    if (count == 0)
+        return true;
+
+    // Grow in steps to keep the number of copies down while uploading in
+    // many small chunks
+    u32 capacity = std::max<u32>(m_capacity, 64);
+    while (capacity < m_count + count) {
+        capacity *= 2;
+    }
+
+    if (!Reserve(capacity) && !Reserve(m_count + count)) {
+        PRINT(IOS_EmuDI, ERROR, "Not enough memory for %u DVD patches",
+          m_count + count);
+        return false;
+    }
+
+    std::memcpy(&m_patches[m_count], patches, count * sizeof(DVDPatch));
+    m_count += count;
+    m_sorted = false;
+    m_generation++;
+    return true;
+}
+
+void PatchTable::Sort()
+{
+    std::sort(m_patches, m_patches + m_count,
+      [](const DVDPatch& a, const DVDPatch& b) {
+          return a.disc_offset < b.disc_offset;
+      });
+
+    // Merge patches that continue the same file where the previous one ended,
+    // and drop empty or overlapping ones
+    u32 out = 0;
+    for (u32 i = 0; i < m_count; i++) {
+        const DVDPatch& patch = m_patches[i];
+        if (patch.disc_length == 0)
+            continue;
+
+        if (out != 0) {
+            DVDPatch& last = m_patches[out - 1];
+            u32 lastEnd = last.disc_offset + last.disc_length;
+
+            if (patch.disc_offset < lastEnd) {
+                PRINT(IOS_EmuDI, WARN, "Overlapping DVD patch at 0x%08X",
+                  patch.disc_offset);
+                continue;
+            }
+
+            if (patch.disc_offset == lastEnd && patch.drv == last.drv &&
+                patch.start_cluster == last.start_cluster &&
+                patch.file_offset ==
+                  last.file_offset + (last.disc_length << 2)) {
+                last.disc_length += patch.disc_length;
+                continue;
+            }
+        }
+
+        m_patches[out++] = patch;
+    }
+
+    PRINT(IOS_EmuDI, INFO, "DVD patches: %u, merged to %u", m_count, out);
+
+    m_count = out;
+    m_sorted = true;
+    m_cursor = 0;
+    m_generation++;
+}
+
+bool PatchTable::Contains(u32 index, u32 wordOffset) const
+{
+    return index < m_count && wordOffset >= m_patches[index].disc_offset &&
+           wordOffset - m_patches[index].disc_offset <
+             m_patches[index].disc_length;
+}
+
+u32 PatchTable::Find(u32 wordOffset)
+{
+    if (!m_sorted)
+        Sort();
+
+    if (Contains(m_cursor, wordOffset))
+        return m_cursor;
+
+    if (Contains(m_cursor + 1, wordOffset))
+        return ++m_cursor;
+
+    // Find the last patch starting at or before the offset
+    u32 low = 0, high = m_count;
+    while (low < high) {
+        u32 mid = low + (high - low) / 2;
+        if (m_patches[mid].disc_offset <= wordOffset)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    if (low == 0 || !Contains(low - 1, wordOffset))
+        return m_count;
+
+    m_cursor = low - 1;
+    return m_cursor;
+}
+
+} // namespace EmuDI
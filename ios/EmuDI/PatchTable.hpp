@@ -0,0 +1,75 @@
+// PatchTable.hpp - Sorted table of DVD patch extents
+//
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <DVD/EmuDI.hpp>
+#include <System/Types.h>
+
+namespace EmuDI
+{
+
+/**
+ * Maps patched disc ranges to replacement files. Patches can be uploaded in
+ * any order over several calls; the table is sorted and adjacent extents of
+ * the same file are merged on the first lookup after a change. Kept trivially
+ * destructible so it can be a global; call Clear to free the table.
+ */
+class PatchTable
+{
+public:
+    PatchTable() = default;
+
+    /**
+     * Remove all patches and free the table.
+     */
+    void Clear();
+
+    /**
+     * Add patches to the table.
+     * @returns False if there isn't enough memory for the new patches.
+     */
+    bool Add(const DVDPatch* patches, u32 count);
+
+    /**
+     * Find the patch containing a disc word offset. Reads tend to be
+     * sequential, so the last patch found and the one after it are checked
+     * before searching the table.
+     * @returns Index of the patch, or GetCount() if the offset isn't patched.
+     */
+    u32 Find(u32 wordOffset);
+
+    const DVDPatch& Get(u32 index) const
+    {
+        return m_patches[index];
+    }
+
+    u32 GetCount() const
+    {
+        return m_count;
+    }
+
+    /**
+     * Increments every time the table changes, used to drop anything that
+     * refers to patches by index.
+     */
+    u32 GetGeneration() const
+    {
+        return m_generation;
+    }
+
+private:
+    bool Reserve(u32 capacity);
+    void Sort();
+    bool Contains(u32 index, u32 wordOffset) const;
+
+    DVDPatch* m_patches = nullptr;
+    u32 m_count = 0;
+    u32 m_capacity = 0;
+    bool m_sorted = true;
+    u32 m_cursor = 0;
+    u32 m_generation = 0;
+};
+
+} // namespace EmuDI
@@ -0,0 +1,281 @@
+// PrefetchProfile.cpp - Recorded disc read order for prefetching
+//
+// SPDX-License-Identifier: MIT
+
+#include "PrefetchProfile.hpp"
+#include <Debug/Log.hpp>
+#include <FAT/ff.h>
+#include <IOS/Syscalls.h>
+#include <IOS/System.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+// Folder on the SD card the profiles are kept in
+static constexpr const char* ProfileDir = "0:/diprof";
+
+// Recently recorded ranges checked for repeated reads, e.g. a game reading
+// the same file header again
+static constexpr u32 RecentRanges = 8;
+
+// Ranges searched forward from the hint before searching the whole profile
+static constexpr u32 LocateWindow = 8;
+
+PrefetchProfile::PrefetchProfile()
+{
+    // Not using new, the profile is optional if memory is short
+    m_ranges = reinterpret_cast<Range*>(IOS_Alloc(
+      System::GetHeap(), MaxRanges * (sizeof(Range) + sizeof(u32))));
+    m_ordinals = m_ranges != nullptr
+                   ? reinterpret_cast<u32*>(&m_ranges[MaxRanges])
+                   : nullptr;
+}
+
+void PrefetchProfile::Start(const DI::DiskID& diskID, u32 partitionWordOffset)
+{
+    m_header = {};
+    m_header.magic = Magic;
+    m_header.version = Version;
+    memcpy(m_header.gameID, diskID.gameID, sizeof(m_header.gameID));
+    m_header.groupID = diskID.groupID;
+    m_header.discNum = diskID.discNum;
+    m_header.discVer = diskID.discVer;
+    m_header.partitionWordOffset = partitionWordOffset;
+
+    m_loaded = false;
+    m_rangeCount = 0;
+    m_blockCount = 0;
+}
+
+bool PrefetchProfile::IsSameDisc(
+  const DI::DiskID& diskID, u32 partitionWordOffset) const
+{
+    return IsStarted() &&
+           !memcmp(m_header.gameID, diskID.gameID, sizeof(diskID.gameID)) &&
+           m_header.groupID == diskID.groupID &&
+           m_header.discNum == diskID.discNum &&
+           m_header.discVer == diskID.discVer &&
+           m_header.partitionWordOffset == partitionWordOffset;
+}
+
+bool PrefetchProfile::Record(u32 block, u32 count)
+{
+    if (!IsValid() || !IsStarted() || m_loaded || count == 0)
+        return false;
+
+    if (m_rangeCount != 0) {
+        // Extend the last range if the read continues or overlaps it
+        Range* last = &m_ranges[m_rangeCount - 1];
+        if (block >= last->block && block <= last->block + last->count) {
+            u32 end = std::max(last->block + last->count, block + count);
+            u32 added = std::min(
+              end - last->block - last->count, MaxBlocks - m_blockCount);
+            last->count += added;
+            m_blockCount += added;
+            return false;
+        }
+
+        // Don't record data that was read just before again
+        u32 first = m_rangeCount - std::min(m_rangeCount, RecentRanges);
+        for (u32 i = first; i < m_rangeCount; i++) {
+            if (block >= m_ranges[i].block &&
+                block + count <= m_ranges[i].block + m_ranges[i].count)
+                return false;
+        }
+    }
+
+    if (IsFull())
+        return false;
+
+    m_ranges[m_rangeCount] = {
+      .block = block,
+      .count = std::min(count, MaxBlocks - m_blockCount),
+    };
+    m_ordinals[m_rangeCount] = m_blockCount;
+    m_blockCount += m_ranges[m_rangeCount].count;
+    m_rangeCount++;
+    return true;
+}
+
+u32 PrefetchProfile::Locate(u32 block, u32* hint) const
+{
+    auto contains = [&](u32 i) {
+        return block >= m_ranges[i].block &&
+               block - m_ranges[i].block < m_ranges[i].count;
+    };
+
+    u32 i = std::min(*hint, m_rangeCount);
+    u32 end = std::min(i + LocateWindow, m_rangeCount);
+    for (; i < end; i++) {
+        if (contains(i))
+            break;
+    }
+
+    if (i == end) {
+        // The game skipped part of the profile or went back to an earlier
+        // part of it
+        for (i = 0; i < m_rangeCount; i++) {
+            if (contains(i))
+                break;
+        }
+
+        if (i == m_rangeCount)
+            return InvalidOrdinal;
+    }
+
+    *hint = i;
+    return m_ordinals[i] + (block - m_ranges[i].block);
+}
+
+u32 PrefetchProfile::GetBlock(u32 ordinal, u32* hint) const
+{
+    assert(ordinal < m_blockCount);
+
+    u32 i = std::min(*hint, m_rangeCount - 1);
+    if (m_ordinals[i] > ordinal)
+        i = 0;
+
+    while (ordinal - m_ordinals[i] >= m_ranges[i].count)
+        i++;
+
+    *hint = i;
+    return m_ranges[i].block + (ordinal - m_ordinals[i]);
+}
+
+void PrefetchProfile::CopyFrom(const PrefetchProfile& from)
+{
+    assert(IsValid() && from.IsValid());
+
+    m_header = from.m_header;
+    m_loaded = from.m_loaded;
+    m_rangeCount = from.m_rangeCount;
+    m_blockCount = from.m_blockCount;
+    memcpy(m_ranges, from.m_ranges, m_rangeCount * sizeof(Range));
+    memcpy(m_ordinals, from.m_ordinals, m_rangeCount * sizeof(u32));
+}
+
+void PrefetchProfile::GetPath(char* path, u32 len) const
+{
+    // e.g. 0:/diprof/RMCE01-0.bin
+    char id[7];
+    memcpy(id, m_header.gameID, 4);
+    id[4] = m_header.groupID >> 8;
+    id[5] = m_header.groupID & 0xFF;
+    id[6] = '\0';
+
+    for (u32 i = 0; i < 6; i++) {
+        if (!(id[i] >= '0' && id[i] <= '9') && !(id[i] >= 'A' && id[i] <= 'Z'))
+            id[i] = '_';
+    }
+
+    snprintf(path, len, "%s/%s-%u.bin", ProfileDir, id, m_header.discNum);
+}
+
+bool PrefetchProfile::Load()
+{
+    if (!IsValid())
+        return false;
+
+    char path[32];
+    GetPath(path, sizeof(path));
+
+    FIL file;
+    if (f_open(&file, path, FA_READ) != FR_OK)
+        return false;
+
+    FileHeader header;
+    UINT br;
+    auto fret = f_read(&file, &header, sizeof(header), &br);
+    if (fret != FR_OK || br != sizeof(header) || header.magic != Magic ||
+        header.version != Version) {
+        PRINT(IOS_EmuDI, WARN, "Ignoring outdated prefetch profile %s", path);
+        f_close(&file);
+        return false;
+    }
+
+    // The profile must belong to this exact disc revision and partition
+    if (memcmp(header.gameID, m_header.gameID, sizeof(header.gameID)) ||
+        header.groupID != m_header.groupID ||
+        header.discNum != m_header.discNum ||
+        header.discVer != m_header.discVer ||
+        header.partitionWordOffset != m_header.partitionWordOffset ||
+        header.rangeCount > MaxRanges || header.blockCount > MaxBlocks) {
+        PRINT(IOS_EmuDI, WARN, "Prefetch profile %s doesn't match", path);
+        f_close(&file);
+        return false;
+    }
+
+    fret = f_read(&file, m_ranges, header.rangeCount * sizeof(Range), &br);
+    f_close(&file);
+    if (fret != FR_OK || br != header.rangeCount * sizeof(Range)) {
+        PRINT(IOS_EmuDI, ERROR, "Failed to read prefetch profile %s", path);
+        m_rangeCount = 0;
+        m_blockCount = 0;
+        return false;
+    }
+
+    u32 blockCount = 0;
+    u32 i = 0;
+    for (; i < header.rangeCount; i++) {
+        if (m_ranges[i].count == 0 ||
+            m_ranges[i].count > header.blockCount - blockCount)
+            break;
+
+        m_ordinals[i] = blockCount;
+        blockCount += m_ranges[i].count;
+    }
+
+    if (i != header.rangeCount || blockCount != header.blockCount) {
+        PRINT(IOS_EmuDI, ERROR, "Prefetch profile %s is corrupt", path);
+        m_rangeCount = 0;
+        m_blockCount = 0;
+        return false;
+    }
+
+    m_rangeCount = header.rangeCount;
+    m_blockCount = header.blockCount;
+    m_loaded = true;
+    return true;
+}
+
+bool PrefetchProfile::Save() const
+{
+    if (!IsValid() || m_rangeCount == 0)
+        return false;
+
+    char path[32];
+    GetPath(path, sizeof(path));
+
+    auto fret = f_mkdir(ProfileDir);
+    if (fret != FR_OK && fret != FR_EXIST) {
+        PRINT(IOS_EmuDI, ERROR, "Failed to create %s: %d", ProfileDir, fret);
+        return false;
+    }
+
+    FIL file;
+    fret = f_open(&file, path, FA_CREATE_ALWAYS | FA_WRITE);
+    if (fret != FR_OK) {
+        PRINT(IOS_EmuDI, ERROR, "Failed to create %s: %d", path, fret);
+        return false;
+    }
+
+    FileHeader header = m_header;
+    header.rangeCount = m_rangeCount;
+    header.blockCount = m_blockCount;
+
+    UINT bw1 = 0, bw2 = 0;
+    auto fret1 = f_write(&file, &header, sizeof(header), &bw1);
+    auto fret2 =
+      f_write(&file, m_ranges, m_rangeCount * sizeof(Range), &bw2);
+    fret = f_close(&file);
+
+    if (fret1 != FR_OK || fret2 != FR_OK || fret != FR_OK ||
+        bw1 != sizeof(header) || bw2 != m_rangeCount * sizeof(Range)) {
+        PRINT(IOS_EmuDI, ERROR, "Failed to write %s", path);
+        // Don't leave a truncated profile behind
+        f_unlink(path);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,141 @@
+// PrefetchProfile.hpp - Recorded disc read order for prefetching
+//
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <DVD/DI.hpp>
+#include <System/Types.h>
+
+/**
+ * Ordered list of the block ranges a game reads from a partition, saved to
+ * the SD card per disc. Games load the same data in the same order every
+ * boot, so a profile recorded on the first launch tells the read-ahead what
+ * to fetch next on later launches. Not thread safe.
+ */
+class PrefetchProfile
+{
+public:
+    PrefetchProfile();
+
+    static constexpr u32 Magic = 0x44495046; // 'DIPF'
+    static constexpr u32 Version = 1;
+
+    // Size limits, so a profile stays small and a long play session doesn't
+    // keep growing the file
+    static constexpr u32 MaxRanges = 256;
+    static constexpr u32 MaxBlocks = 0x2000;
+
+    static constexpr u32 InvalidOrdinal = ~0;
+
+    struct FileHeader {
+        u32 magic;
+        u32 version;
+        char gameID[4];
+        u16 groupID;
+        u8 discNum;
+        u8 discVer;
+        u32 partitionWordOffset;
+        u32 rangeCount;
+        u32 blockCount;
+    };
+
+    struct Range {
+        u32 block;
+        u32 count;
+    };
+
+    /**
+     * False if there wasn't enough memory for the range list.
+     */
+    bool IsValid() const
+    {
+        return m_ranges != nullptr;
+    }
+
+    /**
+     * Start a new, empty profile for a partition.
+     */
+    void Start(const DI::DiskID& diskID, u32 partitionWordOffset);
+
+    bool IsStarted() const
+    {
+        return m_header.magic == Magic;
+    }
+
+    bool IsSameDisc(const DI::DiskID& diskID, u32 partitionWordOffset) const;
+
+    /**
+     * Add a read to the end of the profile, unless the profile was loaded from
+     * a file or is full.
+     * @param block First partition data block read.
+     * @param count Number of blocks read.
+     * @returns True if a new range was added.
+     */
+    bool Record(u32 block, u32 count);
+
+    /**
+     * Find the position of a block in the profile's read order.
+     * @param[in,out] hint Range to start the search from, updated to the range
+     * the block was found in.
+     * @returns Ordinal of the block, or InvalidOrdinal if it isn't in the
+     * profile.
+     */
+    u32 Locate(u32 block, u32* hint) const;
+
+    /**
+     * Get the block at an ordinal. Ordinals are looked up in increasing order,
+     * so the search starts from the range given by the hint.
+     */
+    u32 GetBlock(u32 ordinal, u32* hint) const;
+
+    /**
+     * Replace this profile with a copy of another.
+     */
+    void CopyFrom(const PrefetchProfile& from);
+
+    /**
+     * Load the profile for the current disc from the SD card, replacing the
+     * one being recorded.
+     */
+    bool Load();
+
+    bool Save() const;
+
+    /**
+     * True if the profile was loaded from a file, and should be played back
+     * instead of recorded.
+     */
+    bool IsLoaded() const
+    {
+        return m_loaded;
+    }
+
+    bool IsFull() const
+    {
+        return m_rangeCount == MaxRanges || m_blockCount == MaxBlocks;
+    }
+
+    u32 GetRangeCount() const
+    {
+        return m_rangeCount;
+    }
+
+    u32 GetBlockCount() const
+    {
+        return m_blockCount;
+    }
+
+private:
+    void GetPath(char* path, u32 len) const;
+
+    FileHeader m_header = {};
+    bool m_loaded = false;
+
+    Range* m_ranges;
+    // Ordinal of the first block of each range, i.e. the number of blocks in
+    // the ranges before it
+    u32* m_ordinals;
+    u32 m_rangeCount = 0;
+    u32 m_blockCount = 0;
+};
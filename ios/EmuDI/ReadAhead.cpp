@@ -0,0 +1,345 @@
+// ReadAhead.cpp - Sequential read-ahead for the emulated disc
+//
+// SPDX-License-Identifier: MIT
+
+#include "ReadAhead.hpp"
+#include <Debug/Log.hpp>
+#include <IOS/Syscalls.h>
+#include <IOS/System.hpp>
+#include <algorithm>
+
+ReadAhead::ReadAhead(VirtualDisc* disc, u32 maxWindow)
+{
+    assert(disc != nullptr);
+
+    m_disc = disc;
+    m_maxWindow = std::max<u32>(maxWindow, 1);
+
+    // Run below the resource manager threads so prefetching only happens
+    // while they're waiting for requests.
+    m_thread.create(
+      ThreadEntry, reinterpret_cast<void*>(this), nullptr, 0x2000, 30);
+}
+
+void ReadAhead::OnRead(u32 wordOffset, u32 byteLen)
+{
+    if (byteLen == 0)
+        return;
+
+    u32 endWordOffset = wordOffset + (byteLen >> 2);
+
+    m_mutex.lock();
+
+    bool wake = OnProfileRead(
+      wordOffset / UnitWords, (endWordOffset - 1) / UnitWords + 1);
+
+    // Don't prefetch past the end of the file being read, but fetch a full
+    // window of a large file as soon as the game starts reading it
+    u32 limit = ~0;
+    bool fileStart = false;
+    if (m_fileIndex != nullptr) {
+        u32 file = m_fileIndex->Find(wordOffset);
+        if (file != FileIndex::NotFound) {
+            m_fileIndex->AddRead(file, byteLen);
+            limit = (m_fileIndex->GetEnd(file) + UnitWords - 1) / UnitWords;
+            fileStart = wordOffset == m_fileIndex->Get(file).wordOffset;
+        }
+    }
+
+    // Find a stream this read continues. A read that skips forward within the
+    // prefetched range still counts as sequential.
+    Stream* stream = nullptr;
+    for (u32 i = 0; i < StreamCount; i++) {
+        Stream* s = &m_streams[i];
+        if (!s->valid)
+            continue;
+
+        if (wordOffset == s->nextWordOffset ||
+            (wordOffset > s->nextWordOffset &&
+              wordOffset / UnitWords < s->prefetchEnd)) {
+            stream = s;
+            break;
+        }
+    }
+
+    if (stream != nullptr) {
+        // Grow the window while the stream stays sequential
+        stream->window = std::min(
+          stream->window == 0 ? 1 : stream->window * 2, m_maxWindow);
+    } else {
+        // Access pattern changed; replace the least recently used stream
+        stream = &m_streams[0];
+        for (u32 i = 0; i < StreamCount; i++) {
+            if (!m_streams[i].valid) {
+                stream = &m_streams[i];
+                break;
+            }
+
+            if (m_streams[i].lastUse < stream->lastUse)
+                stream = &m_streams[i];
+        }
+
+        CancelStream(stream);
+        stream->valid = true;
+        stream->window = 0;
+        stream->prefetchPos = 0;
+        stream->prefetchEnd = 0;
+        m_stats.streamsStarted++;
+    }
+
+    stream->nextWordOffset = endWordOffset;
+    stream->lastUse = ++m_useCounter;
+
+    if (fileStart)
+        stream->window = m_maxWindow;
+
+    if (stream->window != 0) {
+        // Blocks before the end of this read have already been read by the
+        // game, so don't bother fetching them
+        u32 start = endWordOffset / UnitWords;
+        u32 end = std::min(start + stream->window, limit);
+
+        stream->prefetchPos = std::max(stream->prefetchPos, start);
+        stream->prefetchEnd =
+          std::min(std::max(stream->prefetchEnd, end), limit);
+        wake |= stream->prefetchPos < stream->prefetchEnd;
+    }
+
+    m_mutex.unlock();
+
+    if (wake)
+        Wake();
+}
+
+void ReadAhead::Reset()
+{
+    m_mutex.lock();
+
+    for (u32 i = 0; i < StreamCount; i++) {
+        CancelStream(&m_streams[i]);
+        m_streams[i].valid = false;
+    }
+
+    m_mutex.unlock();
+}
+
+void ReadAhead::SetFileIndex(FileIndex* index)
+{
+    m_mutex.lock();
+    m_fileIndex = index;
+    m_mutex.unlock();
+}
+
+void ReadAhead::StartProfile(
+  const DI::DiskID& diskID, u32 partitionWordOffset)
+{
+    if (!m_profile.IsValid() || !m_profileFile.IsValid())
+        return;
+
+    m_mutex.lock();
+
+    // Reopening the same partition continues recording, or plays the profile
+    // back from the start
+    if (!m_profile.IsSameDisc(diskID, partitionWordOffset)) {
+        m_profile.Start(diskID, partitionWordOffset);
+        m_profileSavedRanges = 0;
+        m_profileLoadPending = true;
+        m_profileSavePending = false;
+    }
+
+    m_profileFetch = 0;
+    m_profileRead = 0;
+    m_profileFetchHint = 0;
+    m_profileReadHint = 0;
+
+    m_mutex.unlock();
+
+    Wake();
+}
+
+ReadAhead::Stats ReadAhead::GetStats()
+{
+    m_mutex.lock();
+    Stats stats = m_stats;
+    stats.profileRanges = m_profile.IsValid() ? m_profile.GetRangeCount() : 0;
+    m_mutex.unlock();
+
+    return stats;
+}
+
+void ReadAhead::CancelStream(Stream* stream)
+{
+    if (stream->prefetchPos < stream->prefetchEnd)
+        m_stats.blocksCancelled += stream->prefetchEnd - stream->prefetchPos;
+
+    stream->prefetchPos = stream->prefetchEnd;
+}
+
+bool ReadAhead::OnProfileRead(u32 block, u32 blockEnd)
+{
+    if (!m_profile.IsValid())
+        return false;
+
+    if (!m_profile.IsLoaded()) {
+        m_profile.Record(block, blockEnd - block);
+
+        u32 rangeCount = m_profile.GetRangeCount();
+        if (rangeCount == m_profileSavedRanges ||
+            (rangeCount - m_profileSavedRanges < ProfileSaveInterval &&
+              !m_profile.IsFull()))
+            return false;
+
+        m_profileSavedRanges = rangeCount;
+        m_profileSavePending = true;
+        return true;
+    }
+
+    u32 ordinal = m_profile.Locate(blockEnd - 1, &m_profileReadHint);
+    if (ordinal == PrefetchProfile::InvalidOrdinal)
+        return false;
+
+    m_stats.profileBlocksRead += std::min(blockEnd - block, ordinal + 1);
+    m_profileRead = ordinal + 1;
+
+    // Start over from the read if the game went back to an earlier part of
+    // the profile or skipped ahead of what was prefetched
+    if (m_profileFetch < m_profileRead ||
+        m_profileFetch > m_profileRead + m_maxWindow) {
+        m_profileFetch = m_profileRead;
+        m_profileFetchHint = m_profileReadHint;
+    }
+
+    return m_profileFetch < GetProfileFetchEnd();
+}
+
+u32 ReadAhead::GetProfileFetchEnd() const
+{
+    // The cache is small, so only stay a window ahead of the game
+    return std::min(m_profileRead + m_maxWindow, m_profile.GetBlockCount());
+}
+
+void ReadAhead::Wake()
+{
+    // Don't block if the worker already has a pending wake up
+    IOS_SendMessage(m_wakeQueue.id(), 0, 1);
+}
+
+bool ReadAhead::LoadProfile()
+{
+    m_mutex.lock();
+    if (!m_profileLoadPending) {
+        m_mutex.unlock();
+        return false;
+    }
+
+    m_profileLoadPending = false;
+    m_profileFile.CopyFrom(m_profile);
+    m_mutex.unlock();
+
+    bool loaded = m_profileFile.Load();
+
+    m_mutex.lock();
+    // Check another partition wasn't opened while loading
+    if (loaded && !m_profileLoadPending) {
+        PRINT(IOS_EmuDI, INFO, "Loaded prefetch profile: %u ranges, %u blocks",
+          m_profileFile.GetRangeCount(), m_profileFile.GetBlockCount());
+
+        // Discard what was recorded while loading. Playback starts from the
+        // beginning until the game's next read is found in the profile.
+        m_profile.CopyFrom(m_profileFile);
+        m_profileSavePending = false;
+        m_profileFetch = 0;
+        m_profileRead = 0;
+        m_profileFetchHint = 0;
+        m_profileReadHint = 0;
+    }
+    m_mutex.unlock();
+
+    return true;
+}
+
+bool ReadAhead::SaveProfile()
+{
+    m_mutex.lock();
+    if (!m_profileSavePending) {
+        m_mutex.unlock();
+        return false;
+    }
+
+    m_profileSavePending = false;
+    m_profileFile.CopyFrom(m_profile);
+    m_mutex.unlock();
+
+    if (m_profileFile.Save()) {
+        PRINT(IOS_EmuDI, INFO, "Saved prefetch profile: %u ranges, %u blocks",
+          m_profileFile.GetRangeCount(), m_profileFile.GetBlockCount());
+    }
+
+    return true;
+}
+
+bool ReadAhead::PrefetchNext()
+{
+    m_mutex.lock();
+
+    // The profile knows exactly what the game reads next, so it comes before
+    // the streams
+    if (m_profile.IsLoaded() && m_profileFetch < GetProfileFetchEnd()) {
+        u32 block = m_profile.GetBlock(m_profileFetch++, &m_profileFetchHint);
+        m_stats.profileBlocksPrefetched++;
+
+        m_mutex.unlock();
+
+        m_disc->Prefetch(block * UnitWords, UnitSize);
+        return true;
+    }
+
+    // Service the streams round robin, one block at a time, so a cancelled
+    // stream stops after at most one more block
+    u32 index = StreamCount;
+    for (u32 i = 0; i < StreamCount; i++) {
+        u32 j = (m_nextStream + i) % StreamCount;
+        if (m_streams[j].prefetchPos < m_streams[j].prefetchEnd) {
+            index = j;
+            break;
+        }
+    }
+
+    if (index == StreamCount) {
+        m_mutex.unlock();
+        return false;
+    }
+
+    u32 block = m_streams[index].prefetchPos++;
+    m_nextStream = (index + 1) % StreamCount;
+    m_stats.blocksPrefetched++;
+
+    m_mutex.unlock();
+
+    if (!m_disc->Prefetch(block * UnitWords, UnitSize)) {
+        // Most likely the end of the partition
+        m_mutex.lock();
+        CancelStream(&m_streams[index]);
+        m_mutex.unlock();
+    }
+
+    return true;
+}
+
+void ReadAhead::Run()
+{
+    while (true) {
+        m_wakeQueue.receive();
+
+        while (LoadProfile() || PrefetchNext() || SaveProfile()) {
+        }
+    }
+}
+
+s32 ReadAhead::ThreadEntry(void* arg)
+{
+    ReadAhead* that = reinterpret_cast<ReadAhead*>(arg);
+    that->Run();
+
+    return 0;
+}
@@ -0,0 +1,125 @@
+// ReadAhead.hpp - Sequential read-ahead for the emulated disc
+//
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "FileIndex.hpp"
+#include "PrefetchProfile.hpp"
+#include "VirtualDisc.hpp"
+#include <System/OS.hpp>
+#include <System/Types.h>
+
+class ReadAhead
+{
+public:
+    /**
+     * @param disc Disc to prefetch from.
+     * @param maxWindow Maximum number of blocks to read ahead of a stream, and
+     * of the game's reads in the prefetch profile.
+     */
+    ReadAhead(VirtualDisc* disc, u32 maxWindow);
+
+    // Decrypted Wii disc block size, the unit data is prefetched in
+    static constexpr u32 UnitSize = 0x7C00;
+    static constexpr u32 UnitWords = UnitSize >> 2;
+
+    // Number of sequential streams tracked at once
+    static constexpr u32 StreamCount = 4;
+
+    // Save a profile being recorded every time this many ranges are added
+    static constexpr u32 ProfileSaveInterval = 32;
+
+    struct Stats {
+        u32 streamsStarted;
+        u32 blocksPrefetched;
+        u32 blocksCancelled;
+
+        // Prefetch profile of the open partition
+        u32 profileRanges;
+        u32 profileBlocksPrefetched;
+        // Blocks read by the game that were in the profile
+        u32 profileBlocksRead;
+    };
+
+    /**
+     * Notify that the game read from the partition. Continues or starts a
+     * stream and queues the next blocks for prefetch.
+     */
+    void OnRead(u32 wordOffset, u32 byteLen);
+
+    /**
+     * Forget all streams and cancel pending prefetches, e.g. when a new
+     * partition is opened.
+     */
+    void Reset();
+
+    /**
+     * Use the file extents of the open partition to stop prefetching at file
+     * boundaries. Pass nullptr if there is no index.
+     */
+    void SetFileIndex(FileIndex* index);
+
+    /**
+     * Load the prefetch profile for a newly opened partition and start
+     * prefetching its first blocks, or start recording one if there isn't a
+     * profile yet.
+     */
+    void StartProfile(const DI::DiskID& diskID, u32 partitionWordOffset);
+
+    Stats GetStats();
+
+private:
+    struct Stream {
+        bool valid;
+        // Partition word offset the next sequential read would start at
+        u32 nextWordOffset;
+        // Read-ahead window in blocks
+        u32 window;
+        // Range of block indices still to be prefetched
+        u32 prefetchPos;
+        u32 prefetchEnd;
+        u32 lastUse;
+    };
+
+    void CancelStream(Stream* stream);
+    bool OnProfileRead(u32 block, u32 blockEnd);
+    u32 GetProfileFetchEnd() const;
+    void Wake();
+    bool LoadProfile();
+    bool SaveProfile();
+    bool PrefetchNext();
+    void Run();
+    static s32 ThreadEntry(void* arg);
+
+    VirtualDisc* m_disc;
+    u32 m_maxWindow;
+    FileIndex* m_fileIndex = nullptr;
+
+    // Protects the stream state, the worker only holds it while picking the
+    // next block.
+    Mutex m_mutex;
+    Stream m_streams[StreamCount] = {};
+    u32 m_useCounter = 0;
+    u32 m_nextStream = 0;
+    Stats m_stats = {};
+
+    // The profile being recorded or played back
+    PrefetchProfile m_profile;
+    // Ordinal of the next profile block to prefetch, and of the block after
+    // the last one the game read
+    u32 m_profileFetch = 0;
+    u32 m_profileRead = 0;
+    u32 m_profileFetchHint = 0;
+    u32 m_profileReadHint = 0;
+    u32 m_profileSavedRanges = 0;
+    bool m_profileLoadPending = false;
+    bool m_profileSavePending = false;
+
+    // Copy of the profile the worker loads and saves without holding the
+    // mutex, as that uses the SD card.
+    PrefetchProfile m_profileFile;
+
+    Queue<u32> m_wakeQueue{1};
+    Thread m_thread;
+};
@@ -0,0 +1,148 @@
+// ReadTrace.cpp - Binary trace of DI requests
+//
+// SPDX-License-Identifier: MIT
+
+#include "ReadTrace.hpp"
+#include <Debug/Log.hpp>
+#include <IOS/Syscalls.h>
+#include <IOS/System.hpp>
+#include <System/Hollywood.hpp>
+#include <algorithm>
+
+ReadTrace* ReadTrace::s_instance = nullptr;
+
+ReadTrace::ReadTrace(const char* path, u32 recordCount)
+{
+    assert(recordCount != 0);
+
+    m_path = path;
+    m_recordCount = recordCount;
+    m_records = new Record[recordCount];
+
+    m_timer = IOS_CreateTimer(
+      FlushInterval, FlushInterval, m_wakeQueue.id(), 0);
+    assert(m_timer >= 0);
+
+    // Below the read-ahead worker, the trace is the least urgent thing to do
+    m_thread.create(
+      ThreadEntry, reinterpret_cast<void*>(this), nullptr, 0x1000, 20);
+}
+
+void ReadTrace::Add(
+  u8 ioctl, u8 flags, u32 wordOffset, u32 length, u32 startTime)
+{
+    u32 now = ACRReadTrusted(ACRReg::TIMER);
+
+    m_mutex.lock();
+
+    if (m_head - m_tail == m_recordCount) {
+        m_dropped++;
+        m_mutex.unlock();
+        return;
+    }
+
+    Record* record = &m_records[m_head % m_recordCount];
+    record->startTime = startTime;
+    record->serviceTicks = now - startTime;
+    record->wordOffset = wordOffset;
+    record->length = length;
+    record->ioctl = ioctl;
+    record->flags = flags;
+    record->pad = 0;
+    m_head++;
+
+    // Wake the writer once a quarter of the buffer is filled, so writes to
+    // the SD card are batched
+    bool wake = m_head - m_tail >= std::max<u32>(m_recordCount / 4, 1);
+
+    m_mutex.unlock();
+
+    if (wake)
+        RequestFlush();
+}
+
+void ReadTrace::RequestFlush()
+{
+    // Don't block if the writer already has a pending wake up
+    IOS_SendMessage(m_wakeQueue.id(), 0, 1);
+}
+
+void ReadTrace::Flush()
+{
+    m_mutex.lock();
+    u32 head = m_head;
+    u32 tail = m_tail;
+    u32 dropped = m_dropped;
+    m_dropped = 0;
+    m_mutex.unlock();
+
+    // Nothing new since the last timer tick
+    if (head == tail && dropped == 0 && (m_fileOpen || m_fileFailed))
+        return;
+
+    if (dropped != 0)
+        PRINT(IOS_EmuDI, WARN, "Read trace dropped %u records", dropped);
+
+    if (!m_fileOpen && !m_fileFailed) {
+        auto fret = f_open(&m_file, m_path, FA_CREATE_ALWAYS | FA_WRITE);
+        if (fret != FR_OK) {
+            PRINT(IOS_EmuDI, ERROR, "Failed to open read trace: %d", fret);
+            m_fileFailed = true;
+        } else {
+            FileHeader header = {
+              .magic = Magic,
+              .version = Version,
+              .recordSize = sizeof(Record),
+              .timerFrequency = HW_TIMER_FREQ,
+            };
+
+            UINT bw;
+            f_write(&m_file, &header, sizeof(header), &bw);
+            m_fileOpen = true;
+        }
+    }
+
+    // Write the pending records, in two parts if they wrap around the end of
+    // the buffer
+    while (m_fileOpen && tail != head) {
+        u32 index = tail % m_recordCount;
+        u32 count = std::min(head - tail, m_recordCount - index);
+
+        UINT bw;
+        auto fret =
+          f_write(&m_file, &m_records[index], count * sizeof(Record), &bw);
+        if (fret != FR_OK || bw != count * sizeof(Record)) {
+            PRINT(IOS_EmuDI, ERROR, "Failed to write read trace: %d", fret);
+            f_close(&m_file);
+            m_fileOpen = false;
+            m_fileFailed = true;
+            break;
+        }
+
+        tail += count;
+    }
+
+    if (m_fileOpen)
+        f_sync(&m_file);
+
+    // Records are discarded if the file can't be written
+    m_mutex.lock();
+    m_tail = head;
+    m_mutex.unlock();
+}
+
+void ReadTrace::Run()
+{
+    while (true) {
+        m_wakeQueue.receive();
+        Flush();
+    }
+}
+
+s32 ReadTrace::ThreadEntry(void* arg)
+{
+    ReadTrace* that = reinterpret_cast<ReadTrace*>(arg);
+    that->Run();
+
+    return 0;
+}
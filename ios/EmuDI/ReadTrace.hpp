@@ -0,0 +1,101 @@
+// ReadTrace.hpp - Binary trace of DI requests
+//
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <FAT/ff.h>
+#include <System/OS.hpp>
+#include <System/Types.h>
+
+/**
+ * Records every DI request into a ring buffer, which a background thread
+ * writes to a file on the SD card. Decode with tools/ditrace.py. The writer
+ * runs when a quarter of the buffer is filled, on a timer and when asked to,
+ * so the end of a session makes it to the file as well.
+ */
+class ReadTrace
+{
+public:
+    static ReadTrace* s_instance;
+
+    /**
+     * @param path File to write the trace to.
+     * @param recordCount Size of the ring buffer in records.
+     */
+    ReadTrace(const char* path, u32 recordCount);
+
+    static constexpr u32 Magic = 0x44495452; // 'DITR'
+    static constexpr u32 Version = 1;
+
+    struct FileHeader {
+        u32 magic;
+        u32 version;
+        u32 recordSize;
+        u32 timerFrequency;
+    };
+
+    enum Flags {
+        // Served from patch files instead of the disc
+        Flag_Patched = 0x1,
+        // Emulated disc read served entirely from memory
+        Flag_Cached = 0x2,
+        // The request was an ioctlv
+        Flag_Ioctlv = 0x4,
+    };
+
+    struct Record {
+        // ACR timer value when the request was received
+        u32 startTime;
+        // ACR timer ticks taken to handle the request
+        u32 serviceTicks;
+        u32 wordOffset;
+        u32 length;
+        u8 ioctl;
+        u8 flags;
+        u16 pad;
+    };
+
+    static_assert(sizeof(Record) == 0x14);
+
+    /**
+     * Add a request to the trace. Never blocks on the SD card; the record is
+     * dropped if the buffer is full.
+     * @param startTime ACR timer value from when the request was received.
+     */
+    void Add(u8 ioctl, u8 flags, u32 wordOffset, u32 length, u32 startTime);
+
+    /**
+     * Write the records added so far without waiting for more. Doesn't block.
+     */
+    void RequestFlush();
+
+private:
+    // Longest time a record waits in the buffer while the disc is idle
+    static constexpr s32 FlushInterval = 2000000; // 2 seconds
+
+
+    void Flush();
+    void Run();
+    static s32 ThreadEntry(void* arg);
+
+    const char* m_path;
+    FIL m_file;
+    bool m_fileOpen = false;
+    bool m_fileFailed = false;
+
+    Record* m_records;
+    u32 m_recordCount;
+
+    // Protects m_head and m_tail. Records between the tail and the head are
+    // waiting to be written; the writer doesn't hold the lock while writing,
+    // as new records only go after the head.
+    Mutex m_mutex;
+    u32 m_head = 0;
+    u32 m_tail = 0;
+    u32 m_dropped = 0;
+
+    Queue<u32> m_wakeQueue{1};
+    s32 m_timer;
+    Thread m_thread;
+};
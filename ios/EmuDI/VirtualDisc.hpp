@@ -6,6 +6,7 @@
 #pragma once
 
 #include <DVD/DI.hpp>
+#include <DVD/EmuDI.hpp>
 #include <System/Types.h>
 #include <optional>
 
@@ -21,4 +22,43 @@ public:
     virtual bool ReadDiskID(DI::DiskID* out) = 0;
     virtual DI::DIError ReadTMD(ES::TMDFixed<512>* out) = 0;
     virtual bool IsInserted() = 0;
+
+    /**
+     * Read partition data ahead of time so a later ReadFromPartition can be
+     * served from memory. Can be called from a different thread than the
+     * other functions.
+     */
+    virtual bool Prefetch(u32 wordOffset, u32 byteLen)
+    {
+        return false;
+    }
+
+    /**
+     * Number of 0x7C00 byte blocks Prefetch can keep in memory at once, shared
+     * with the blocks of the game's reads.
+     */
+    virtual u32 GetPrefetchCapacity()
+    {
+        return 0;
+    }
+
+    /**
+     * Fill in the statistics specific to the disc backend.
+     */
+    virtual void GetStats(EmuDI::DVDReadStats* stats)
+    {
+    }
+
+    virtual void ResetStats()
+    {
+    }
+
+    /**
+     * Check if the last ReadFromPartition was served entirely from memory,
+     * without reading the disc image.
+     */
+    virtual bool WasLastReadCached()
+    {
+        return false;
+    }
 };
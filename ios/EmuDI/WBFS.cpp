@@ -0,0 +1,161 @@
+// WBFS.cpp - WBFS virtual disc
+//
+// SPDX-License-Identifier: MIT
+
+#include "WBFS.hpp"
+#include <Debug/Log.hpp>
+#include <IOS/System.hpp>
+#include <algorithm>
+#include <cstring>
+
+WBFS::WBFS(const char* const* paths, u32 count)
+  : ISO(paths, count)
+{
+    m_valid = ReadHeader();
+    if (!m_valid) {
+        PRINT(IOS_EmuDI, ERROR, "Invalid WBFS file");
+        return;
+    }
+
+    PRINT(IOS_EmuDI, INFO, "Successfully opened WBFS file");
+    PRINT(IOS_EmuDI, INFO, "Block size: %X", 1 << m_blockShift);
+}
+
+WBFS::~WBFS()
+{
+    delete[] m_blockTable;
+}
+
+bool WBFS::IsInserted()
+{
+    return m_valid && ISO::IsInserted();
+}
+
+bool WBFS::ReadHeader()
+{
+    u8* sector = m_dataBlock[0];
+    if (sector == nullptr) {
+        PRINT(IOS_EmuDI, ERROR, "Not enough memory for the block buffers");
+        return false;
+    }
+
+    if (!ReadImage(sector, 0, sizeof(Header))) {
+        PRINT(IOS_EmuDI, ERROR, "Failed to read WBFS header");
+        return false;
+    }
+
+    Header header;
+    std::memcpy(&header, sector, sizeof(Header));
+
+    if (header.magic != Magic) {
+        PRINT(IOS_EmuDI, ERROR, "Bad WBFS magic: %08X", header.magic);
+        return false;
+    }
+
+    // The header sector must fit in the block buffer, and a WBFS block can't
+    // be smaller than a Wii disc sector
+    if (header.hdSectorShift < 9 || header.hdSectorShift > 31 ||
+        (1u << header.hdSectorShift) > BlockSize ||
+        header.wbfsSectorShift < WiiSectorShift ||
+        header.wbfsSectorShift > 31) {
+        PRINT(IOS_EmuDI, ERROR, "Bad WBFS sector sizes: %u, %u",
+          header.hdSectorShift, header.wbfsSectorShift);
+        return false;
+    }
+
+    const u32 hdSectorSize = 1 << header.hdSectorShift;
+    if (!ReadImage(sector, 0, hdSectorSize)) {
+        PRINT(IOS_EmuDI, ERROR, "Failed to read WBFS header");
+        return false;
+    }
+
+    m_blockShift = header.wbfsSectorShift;
+    m_blockCount =
+      WiiSectorsPerDisc >> (header.wbfsSectorShift - WiiSectorShift);
+
+    if (m_blockCount * sizeof(u16) > MaxBlockTableSize) {
+        PRINT(IOS_EmuDI, ERROR, "WBFS block size too small: %X",
+          1 << m_blockShift);
+        return false;
+    }
+
+    // The disc info for each disc slot takes a whole number of HDD sectors
+    const u32 discInfoSize = DiscHeaderCopySize + m_blockCount * sizeof(u16);
+    const u32 discInfoSectors =
+      (discInfoSize + hdSectorSize - 1) >> header.hdSectorShift;
+
+    // WBFS files made for loaders hold one disc, but it doesn't have to be in
+    // the first slot. A whole WBFS partition copied to a file can have more.
+    const u8* discTable = sector + sizeof(Header);
+    const u32 discTableSize = hdSectorSize - sizeof(Header);
+    u32 slot = discTableSize;
+    u32 discCount = 0;
+    for (u32 i = 0; i < discTableSize; i++) {
+        if (discTable[i] == 0)
+            continue;
+
+        if (discCount++ == 0)
+            slot = i;
+    }
+
+    if (discCount == 0) {
+        PRINT(IOS_EmuDI, ERROR, "No disc in WBFS file");
+        return false;
+    }
+
+    if (discCount > 1) {
+        PRINT(IOS_EmuDI, ERROR,
+          "WBFS file holds %u discs, only single disc files are supported",
+          discCount);
+        return false;
+    }
+
+    u64 discInfoOffset = (u64) (1 + slot * discInfoSectors) * hdSectorSize;
+
+    m_blockTable = new u16[m_blockCount];
+    if (!ReadImage(m_blockTable, discInfoOffset + DiscHeaderCopySize,
+          m_blockCount * sizeof(u16))) {
+        PRINT(IOS_EmuDI, ERROR, "Failed to read WBFS block table");
+        return false;
+    }
+
+    return true;
+}
+
+bool WBFS::ReadRaw(void* buffer, u32 wordOffset, u32 byteLen)
+{
+    if (!m_valid)
+        return false;
+
+    u8* writeBuffer = reinterpret_cast<u8*>(buffer);
+    u64 offset = (u64) wordOffset * 4;
+    const u64 blockMask = (1ull << m_blockShift) - 1;
+
+    while (byteLen > 0) {
+        u32 block = offset >> m_blockShift;
+        u64 blockOffset = offset & blockMask;
+        u32 lengthToRead = std::min<u64>(byteLen, blockMask + 1 - blockOffset);
+
+        if (block >= m_blockCount) {
+            PRINT(IOS_EmuDI, ERROR, "Read off the end of the disc (%llX)",
+              offset);
+            return false;
+        }
+
+        u16 wbfsBlock = m_blockTable[block];
+        if (wbfsBlock == 0) {
+            // Unused area, not stored in the file
+            std::memset(writeBuffer, 0, lengthToRead);
+        } else if (!ReadImage(writeBuffer,
+                     ((u64) wbfsBlock << m_blockShift) + blockOffset,
+                     lengthToRead)) {
+            return false;
+        }
+
+        writeBuffer += lengthToRead;
+        offset += lengthToRead;
+        byteLen -= lengthToRead;
+    }
+
+    return true;
+}
@@ -0,0 +1,67 @@
+// WBFS.hpp - WBFS virtual disc
+//
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "ISO.hpp"
+#include <System/Types.h>
+
+/**
+ * Disc stored in a WBFS file. WBFS only stores the used areas of the disc, in
+ * blocks that are mapped to disc offsets by a table in the header. Everything
+ * else, including decryption and caching, works the same as for ISO. Only
+ * files with a single disc are read, as there's no way to pick one of several.
+ */
+class WBFS : public ISO
+{
+public:
+    /**
+     * @param paths Paths of the WBFS file parts (.wbfs, .wbf1, ...), in order.
+     * @param count Number of parts.
+     */
+    WBFS(const char* const* paths, u32 count);
+    virtual ~WBFS();
+
+    virtual bool IsInserted() override;
+
+protected:
+    static constexpr u32 Magic = 0x57424653; // 'WBFS'
+
+    // Wii disc size in 0x8000 byte sectors, dual layer
+    static constexpr u32 WiiSectorShift = 15;
+    static constexpr u32 WiiSectorsPerDisc = 143432 * 2;
+
+    struct Header {
+        u32 magic;
+        // Number of HDD sectors
+        u32 hdSectorCount;
+        // Log2 of HDD sector size
+        u8 hdSectorShift;
+        // Log2 of WBFS block size
+        u8 wbfsSectorShift;
+        u8 pad[2];
+        // Followed by the disc table
+    };
+
+    static_assert(sizeof(Header) == 0xC);
+
+    // Disc info contains a copy of the disc header before the block table
+    static constexpr u32 DiscHeaderCopySize = 0x100;
+
+    // The block table is kept in memory, which limits how small the blocks can
+    // be. The usual 2 MB blocks need about 9 KB.
+    static constexpr u32 MaxBlockTableSize = 0x8000;
+
+    virtual bool ReadRaw(void* buffer, u32 wordOffset, u32 byteLen) override;
+
+private:
+    bool ReadHeader();
+
+    bool m_valid = false;
+
+    u8 m_blockShift;
+    u32 m_blockCount;
+    // WBFS block number for each disc block, 0 if the disc block isn't used
+    u16* m_blockTable = nullptr;
+};
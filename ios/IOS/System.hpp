@@ -67,9 +67,16 @@ void KernelWrite(u32 address, u32 value);
 
 EXTERN_C_START
 void abort();
+#ifndef TARGET_HOST
 void usleep(u32 usec);
+#endif
 EXTERN_C_END
 
+#ifdef TARGET_HOST
+// The host runtime replaces the libc usleep, keeping its declaration
+#  include <unistd.h>
+#endif
+
 #define assert(expr)                                                           \
   (((expr) ? (void) 0 : AssertFail(#expr, __FILE__, __LINE__)))
 #define ASSERT assert
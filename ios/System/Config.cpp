@@ -29,3 +29,58 @@ bool Config::BlockIOSReload()
 {
     return false;
 }
+
+u32 Config::GetDiscCacheSize()
+{
+    return 0x7C00 * 2;
+}
+
+u32 Config::GetReadAheadSize()
+{
+    return 0x7C00 * 8;
+}
+
+Config::DiscVerifyMode Config::GetDiscVerifyMode()
+{
+    return m_discVerifyMode;
+}
+
+bool Config::IsReadTraceEnabled()
+{
+    return false;
+}
+
+u32 Config::GetDIQueueDepth()
+{
+    return 16;
+}
+
+u32 Config::GetDIWorkerCount()
+{
+    return 1;
+}
+
+bool Config::IsDriveCacheEnabled()
+{
+    return false;
+}
+
+u32 Config::GetDriveCacheSize()
+{
+    return 512;
+}
+
+u32 Config::GetSectorCacheSize()
+{
+    return 48;
+}
+
+bool Config::IsSectorCacheWriteBack()
+{
+    return false;
+}
+
+u32 Config::GetSDBounceSize()
+{
+    return 32;
+}
@@ -5,6 +5,8 @@
 
 #pragma once
 
+#include <System/Types.h>
+
 // Config is currently hardcoded
 
 class Config
@@ -15,4 +17,100 @@ public:
     bool IsISFSPathReplaced(const char* path);
     bool IsFileLogEnabled();
     bool BlockIOSReload();
+
+    /**
+     * Memory in bytes for the emulated disc's cache of decrypted 0x7C00 byte
+     * blocks. The module's heap is 256 KB. Before the disc is opened about
+     * 70 KB of it goes to thread stacks, FatFS and the other objects of the
+     * module, 24 KB to the sector cache and 16 KB to the SD card bounce
+     * buffer, and the disc image takes 64 KB for its raw block buffers. Two
+     * cache blocks leave about 20 KB for what is allocated while the game
+     * runs. The cache has fewer blocks, or none, if the memory isn't there
+     * when the disc is opened.
+     */
+    u32 GetDiscCacheSize();
+
+    /**
+     * Memory in bytes of the disc cache the read-ahead may fill, ahead of
+     * each sequential stream and of the prefetch profile. It gets at most all
+     * but one of the cache's blocks, which is kept for the game's own reads,
+     * so with the two blocks that fit in the heap it reads one block ahead.
+     */
+    u32 GetReadAheadSize();
+
+    enum class DiscVerifyMode {
+        // Don't check the disc hashes
+        Off,
+        // Check each block the first time it's read
+        Lazy,
+        // Check each block every time it's read from the disc image
+        Strict,
+    };
+
+    /**
+     * How the emulated disc checks the partition hash tree.
+     */
+    DiscVerifyMode GetDiscVerifyMode();
+
+#ifdef TARGET_HOST
+    /**
+     * Override the hardcoded verify mode in the host tests and benchmarks.
+     */
+    void SetDiscVerifyMode(DiscVerifyMode mode)
+    {
+        m_discVerifyMode = mode;
+    }
+#endif
+
+    /**
+     * Record every DI request to a trace file on the SD card.
+     */
+    bool IsReadTraceEnabled();
+
+    /**
+     * Number of requests the DI resource manager and each of its workers can
+     * have queued.
+     */
+    u32 GetDIQueueDepth();
+
+    /**
+     * Number of threads handling DI reads. Requests from the same handle are
+     * always handled in order. The threads take turns, so more than one only
+     * gives handles separate queues.
+     */
+    u32 GetDIWorkerCount();
+
+    /**
+     * Cache reads from the disc drive on the SD card when there is no disc
+     * image.
+     */
+    bool IsDriveCacheEnabled();
+
+    /**
+     * Size limit of each disc partition's drive cache file in megabytes.
+     */
+    u32 GetDriveCacheSize();
+
+    /**
+     * Number of sectors cached in memory for each mounted storage device, or
+     * 0 to disable the cache. At least 48 are used. Comes from the same heap
+     * as the disc cache, see GetDiscCacheSize.
+     */
+    u32 GetSectorCacheSize();
+
+    /**
+     * Keep small writes in the sector cache until the filesystem syncs. Data
+     * not yet written is lost if the device is removed.
+     */
+    bool IsSectorCacheWriteBack();
+
+    /**
+     * Number of sectors in the SD card bounce buffer, used for transfers to
+     * and from unaligned buffers. Sizes up to 10 use the static buffer. Comes
+     * from the same heap as the disc cache, see GetDiscCacheSize.
+     */
+    u32 GetSDBounceSize();
+
+private:
+    DiscVerifyMode m_discVerifyMode = DiscVerifyMode::Off;
 };
@@ -0,0 +1,195 @@
+#!/usr/bin/env python3
+# compress_disc.py - Make a chunk-compressed disc image from a Wii ISO
+#
+# SPDX-License-Identifier: MIT
+#
+# The output is read by ios/EmuDI/CompressedISO. The disc is split into
+# 0x8000 byte chunks, each compressed separately as an LZ4 block. Chunks
+# filled with a single byte are only recorded in the index, and chunks that
+# don't compress are stored as is. Encrypted data doesn't compress, so the
+# blocks of the game partition are decrypted first, the hash header and the
+# data each with its own IV as on the disc. Requires the lz4 package and
+# pycryptodome.
+#
+# Usage: compress_disc.py [--verify] game.iso game.wcmp
+#
+# --verify reads the output back and checks every chunk against the input.
+
+import struct, sys
+import lz4.block
+from Crypto.Cipher import AES
+from decrypt_disc import COMMON_KEY, find_game_partition, read_at
+
+MAGIC = 0x57434D50  # 'WCMP'
+VERSION = 2
+
+CHUNK_SIZE = 0x8000
+BLOCK_HEADER_SIZE = 0x400
+
+HEADER_FORMAT = ">IIIIQQII"
+ENTRY_FORMAT = ">IB3s"
+
+TYPE_LZ4 = 0
+TYPE_STORED = 1
+TYPE_FILL = 2
+
+
+def align(value, alignment):
+    return (value + alignment - 1) // alignment * alignment
+
+
+class Partition:
+    """The game partition, whose blocks are stored decrypted."""
+
+    def __init__(self, iso):
+        self.offset = find_game_partition(iso)
+
+        ticket = read_at(iso, self.offset, 0x2A4)
+        enc_title_key = ticket[0x1BF:0x1CF]
+        title_id = ticket[0x1DC:0x1E4]
+        self.title_key = AES.new(COMMON_KEY, AES.MODE_CBC,
+                                 title_id + bytes(8)).decrypt(enc_title_key)
+
+        info = read_at(iso, self.offset + 0x2A4, 0x1C)
+        data_offset = struct.unpack_from(">I", info, 0x14)[0] << 2
+        data_size = struct.unpack_from(">I", info, 0x18)[0] << 2
+        self.data_start = self.offset + data_offset
+        self.data_end = self.data_start + data_size
+
+        if self.data_start % CHUNK_SIZE != 0:
+            raise ValueError("partition data not aligned to a chunk")
+
+    def decrypt(self, offset, data):
+        if offset < self.data_start or offset >= self.data_end:
+            return data
+
+        # The data IV is in the encrypted hash header
+        iv = data[0x3D0:0x3E0]
+        header = AES.new(self.title_key, AES.MODE_CBC, bytes(16)) \
+            .decrypt(data[:BLOCK_HEADER_SIZE])
+        return header + AES.new(self.title_key, AES.MODE_CBC, iv) \
+            .decrypt(data[BLOCK_HEADER_SIZE:])
+
+
+def read_chunk(f, chunk, partition):
+    f.seek(chunk * CHUNK_SIZE)
+    data = f.read(CHUNK_SIZE)
+    # Pad the last chunk
+    data += bytes(CHUNK_SIZE - len(data))
+    return partition.decrypt(chunk * CHUNK_SIZE, data)
+
+
+def pack(iso, out):
+    partition = Partition(iso)
+
+    iso.seek(0, 2)
+    disc_size = iso.tell()
+    chunk_count = align(disc_size, CHUNK_SIZE) // CHUNK_SIZE
+
+    header_size = struct.calcsize(HEADER_FORMAT)
+    index_offset = align(header_size, 0x20)
+    data_offset = align(index_offset +
+                        chunk_count * struct.calcsize(ENTRY_FORMAT), 0x20)
+
+    out.write(struct.pack(HEADER_FORMAT, MAGIC, VERSION, CHUNK_SIZE,
+                          chunk_count, disc_size, index_offset,
+                          partition.offset >> 2, 0))
+
+    index = []
+    counts = [0, 0, 0]
+    out.seek(data_offset)
+
+    for chunk in range(chunk_count):
+        data = read_chunk(iso, chunk, partition)
+
+        if data.count(data[0]) == CHUNK_SIZE:
+            index.append((0, TYPE_FILL, bytes([0, 0, data[0]])))
+            counts[TYPE_FILL] += 1
+            continue
+
+        offset = out.tell()
+        compressed = lz4.block.compress(data, store_size=False)
+        if len(compressed) < CHUNK_SIZE:
+            out.write(compressed)
+            size = len(compressed)
+            index.append((offset >> 4, TYPE_LZ4, size.to_bytes(3, "big")))
+            counts[TYPE_LZ4] += 1
+        else:
+            out.write(data)
+            index.append((offset >> 4, TYPE_STORED, bytes(3)))
+            counts[TYPE_STORED] += 1
+
+        # Chunk offsets are stored in 16 byte units
+        out.seek(align(out.tell(), 0x10))
+
+        if chunk % 0x1000 == 0:
+            print("%u/%u chunks" % (chunk, chunk_count), file=sys.stderr)
+
+    end = out.tell()
+    out.seek(index_offset)
+    for entry in index:
+        out.write(struct.pack(ENTRY_FORMAT, *entry))
+
+    out.truncate(end)
+
+    print("%u compressed, %u stored, %u filled; %u -> %u bytes" % (
+        counts[TYPE_LZ4], counts[TYPE_STORED], counts[TYPE_FILL], disc_size,
+        end))
+
+
+def verify(iso, out):
+    out.seek(0)
+    magic, version, chunk_size, chunk_count, disc_size, index_offset, \
+        partition_offset, _ = struct.unpack(
+            HEADER_FORMAT, out.read(struct.calcsize(HEADER_FORMAT)))
+    assert magic == MAGIC and version == VERSION
+    assert chunk_size == CHUNK_SIZE
+
+    partition = Partition(iso)
+    assert partition_offset == partition.offset >> 2
+
+    out.seek(index_offset)
+    entry_size = struct.calcsize(ENTRY_FORMAT)
+    index = [struct.unpack(ENTRY_FORMAT, out.read(entry_size))
+             for _ in range(chunk_count)]
+
+    for chunk, (offset, chunk_type, size) in enumerate(index):
+        size = int.from_bytes(size, "big")
+        if chunk_type == TYPE_FILL:
+            data = bytes([size & 0xFF]) * CHUNK_SIZE
+        elif chunk_type == TYPE_STORED:
+            out.seek(offset << 4)
+            data = out.read(CHUNK_SIZE)
+        elif chunk_type == TYPE_LZ4:
+            out.seek(offset << 4)
+            data = lz4.block.decompress(out.read(size),
+                                        uncompressed_size=CHUNK_SIZE)
+        else:
+            raise ValueError("chunk %u: unknown type %u" % (chunk, chunk_type))
+
+        if data != read_chunk(iso, chunk, partition):
+            raise ValueError("chunk %u: data mismatch" % chunk)
+
+    print("Verified %u chunks" % chunk_count)
+
+
+def main():
+    args = sys.argv[1:]
+    do_verify = "--verify" in args
+    if do_verify:
+        args.remove("--verify")
+
+    if len(args) != 2:
+        print("usage: %s [--verify] game.iso game.wcmp" % sys.argv[0])
+        return 1
+
+    with open(args[0], "rb") as iso, open(args[1], "w+b") as out:
+        pack(iso, out)
+        if do_verify:
+            verify(iso, out)
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
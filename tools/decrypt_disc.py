@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+# decrypt_disc.py - Make a pre-decrypted disc image from a Wii ISO
+#
+# SPDX-License-Identifier: MIT
+#
+# The output is read by ios/EmuDI/DecryptedISO. It contains the game partition
+# decrypted with the hash blocks removed, plus the unencrypted areas of the
+# disc EmuDI needs to open the partition. Requires pycryptodome.
+#
+# Usage: decrypt_disc.py game.iso game.wdec
+
+import struct, sys
+from Crypto.Cipher import AES
+
+MAGIC = 0x57444543  # 'WDEC'
+VERSION = 1
+
+HEADER_FORMAT = ">IIIIIIQQ"
+EXTENT_FORMAT = ">IIQ"
+MAX_EXTENTS = 16
+
+BLOCK_SIZE = 0x8000
+BLOCK_HEADER_SIZE = 0x400
+BLOCK_DATA_SIZE = 0x7C00
+
+# Disc header, partition table and region info
+DISC_HEADER_SIZE = 0x50000
+PARTITION_TABLE_OFFSET = 0x40000
+
+COMMON_KEY = bytes([
+    0xeb, 0xe4, 0x2a, 0x22, 0x5e, 0x85, 0x93, 0xe4,
+    0x48, 0xd9, 0xc5, 0x45, 0x73, 0x81, 0xaa, 0xf7,
+])
+
+
+def align(value, alignment):
+    return (value + alignment - 1) // alignment * alignment
+
+
+def read_at(f, offset, size):
+    f.seek(offset)
+    data = f.read(size)
+    if len(data) != size:
+        raise ValueError("unexpected end of image at 0x%X" % offset)
+    return data
+
+
+def find_game_partition(iso):
+    table = read_at(iso, PARTITION_TABLE_OFFSET, 0x20)
+    for group in range(4):
+        count, offset = struct.unpack_from(">II", table, group * 8)
+        entries = read_at(iso, offset << 2, count * 8)
+        for i in range(count):
+            part_offset, part_type = struct.unpack_from(">II", entries, i * 8)
+            if part_type == 0:
+                return part_offset << 2
+
+    raise ValueError("no game partition on disc")
+
+
+def main():
+    if len(sys.argv) != 3:
+        print("usage: %s game.iso game.wdec" % sys.argv[0])
+        return 1
+
+    iso = open(sys.argv[1], "rb")
+    out = open(sys.argv[2], "wb")
+
+    part_offset = find_game_partition(iso)
+
+    ticket = read_at(iso, part_offset, 0x2A4)
+    enc_title_key = ticket[0x1BF:0x1CF]
+    title_id = ticket[0x1DC:0x1E4]
+    title_key = AES.new(COMMON_KEY, AES.MODE_CBC, title_id + bytes(8)) \
+        .decrypt(enc_title_key)
+
+    info = read_at(iso, part_offset + 0x2A4, 0x1C)
+    data_offset = struct.unpack_from(">I", info, 0x14)[0] << 2
+    data_size = struct.unpack_from(">I", info, 0x18)[0] << 2
+    block_count = data_size // BLOCK_SIZE
+
+    # Unencrypted areas: the disc header and the partition header up to the
+    # start of the encrypted data (ticket, TMD, certificates, H3 table)
+    areas = [
+        (0, DISC_HEADER_SIZE),
+        (part_offset, data_offset),
+    ]
+    assert len(areas) <= MAX_EXTENTS
+
+    header_size = struct.calcsize(HEADER_FORMAT)
+    extent_table_offset = align(header_size, 0x20)
+    file_offset = align(extent_table_offset +
+                        len(areas) * struct.calcsize(EXTENT_FORMAT),
+                        BLOCK_SIZE)
+
+    extents = []
+    for disc_offset, size in areas:
+        extents.append((disc_offset, size, file_offset))
+        file_offset = align(file_offset + size, BLOCK_SIZE)
+
+    out_data_offset = file_offset
+    out_data_size = block_count * BLOCK_DATA_SIZE
+
+    out.write(struct.pack(HEADER_FORMAT, MAGIC, VERSION, len(extents),
+                          extent_table_offset, part_offset >> 2, 0,
+                          out_data_offset, out_data_size))
+    out.seek(extent_table_offset)
+    for disc_offset, size, offset in extents:
+        out.write(struct.pack(EXTENT_FORMAT, disc_offset >> 2, size, offset))
+
+    for disc_offset, size, offset in extents:
+        out.seek(offset)
+        out.write(read_at(iso, disc_offset, size))
+
+    out.seek(out_data_offset)
+    iso.seek(part_offset + data_offset)
+    for block in range(block_count):
+        raw = iso.read(BLOCK_SIZE)
+        if len(raw) != BLOCK_SIZE:
+            raise ValueError("unexpected end of partition at block %u" % block)
+
+        iv = raw[0x3D0:0x3E0]
+        out.write(AES.new(title_key, AES.MODE_CBC, iv)
+                  .decrypt(raw[BLOCK_HEADER_SIZE:]))
+
+        if block % 0x1000 == 0:
+            print("%u/%u blocks" % (block, block_count), file=sys.stderr)
+
+    out.close()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,208 @@
+#!/usr/bin/env python3
+# ditrace.py - Decode a DI read trace recorded by ios/EmuDI/ReadTrace
+#
+# SPDX-License-Identifier: MIT
+#
+# Prints a summary of the requests in the trace: counts per ioctl, how many
+# reads were served from memory, service time percentiles and the most read
+# areas of the disc. The reads can also be replayed against a model of the
+# emulated disc block cache to try out other cache sizes.
+#
+# Usage: ditrace.py [--csv] [--cache-blocks N] ditrace.bin
+
+import argparse, collections, struct, sys
+
+MAGIC = 0x44495452  # 'DITR'
+VERSION = 1
+
+HEADER_FORMAT = ">IIII"
+RECORD_FORMAT = ">IIIIBBH"
+
+FLAG_PATCHED = 0x1
+FLAG_CACHED = 0x2
+FLAG_IOCTLV = 0x4
+
+IOCTL_READ = 0x71
+IOCTL_NAMES = {
+    0x12: "Inquiry",
+    0x70: "ReadDiskID",
+    0x71: "Read",
+    0x7A: "GetCoverRegister",
+    0x86: "ClearCoverInterrupt",
+    0x88: "GetCoverStatus",
+    0x8A: "Reset",
+    0x8B: "OpenPartition",
+    0x8C: "ClosePartition",
+    0x8D: "UnencryptedRead",
+    0x95: "GetStatusRegister",
+    0xD0: "ReadDvd",
+}
+
+# Decrypted Wii disc block, the unit EmuDI caches data in
+BLOCK_DATA_SIZE = 0x7C00
+REGION_SIZE = 0x100000
+
+
+def read_trace(path):
+    with open(path, "rb") as f:
+        data = f.read()
+
+    header_size = struct.calcsize(HEADER_FORMAT)
+    if len(data) < header_size:
+        sys.exit("%s: file too short" % path)
+
+    magic, version, record_size, timer_freq = struct.unpack_from(
+        HEADER_FORMAT, data
+    )
+    if magic != MAGIC or version != VERSION:
+        sys.exit("%s: not a DI read trace" % path)
+    if record_size < struct.calcsize(RECORD_FORMAT):
+        sys.exit("%s: unsupported record size %d" % (path, record_size))
+
+    records = []
+    # A partial record at the end is left over from a power off mid-write
+    for pos in range(header_size, len(data) - record_size + 1, record_size):
+        start, ticks, offset, length, ioctl, flags, _ = struct.unpack_from(
+            RECORD_FORMAT, data, pos
+        )
+        records.append((start, ticks, offset, length, ioctl, flags))
+
+    return timer_freq, records
+
+
+def ioctl_name(ioctl):
+    return IOCTL_NAMES.get(ioctl, "0x%02X" % ioctl)
+
+
+def percentile(values, p):
+    if not values:
+        return 0
+    return values[min(len(values) - 1, len(values) * p // 100)]
+
+
+def print_csv(timer_freq, records):
+    print("time_us,ioctl,word_offset,length,service_us,patched,cached,ioctlv")
+    base = records[0][0] if records else 0
+    for start, ticks, offset, length, ioctl, flags in records:
+        print(
+            "%d,%s,0x%08X,0x%X,%d,%d,%d,%d"
+            % (
+                ((start - base) & 0xFFFFFFFF) * 1000000 // timer_freq,
+                ioctl_name(ioctl),
+                offset,
+                length,
+                ticks * 1000000 // timer_freq,
+                bool(flags & FLAG_PATCHED),
+                bool(flags & FLAG_CACHED),
+                bool(flags & FLAG_IOCTLV),
+            )
+        )
+
+
+def print_summary(timer_freq, records):
+    per_ioctl = collections.defaultdict(list)
+    for record in records:
+        per_ioctl[record[4]].append(record)
+
+    print("%d requests" % len(records))
+    print()
+    print("%-20s %8s %10s %10s %10s %10s" %
+          ("ioctl", "count", "p50 us", "p90 us", "p99 us", "max us"))
+    for ioctl, group in sorted(per_ioctl.items()):
+        micros = sorted(r[1] * 1000000 // timer_freq for r in group)
+        print(
+            "%-20s %8d %10d %10d %10d %10d"
+            % (
+                ioctl_name(ioctl),
+                len(group),
+                percentile(micros, 50),
+                percentile(micros, 90),
+                percentile(micros, 99),
+                micros[-1],
+            )
+        )
+
+    reads = per_ioctl.get(IOCTL_READ, [])
+    if not reads:
+        return
+
+    cached = sum(1 for r in reads if r[5] & FLAG_CACHED)
+    patched = sum(1 for r in reads if r[5] & FLAG_PATCHED)
+    total_bytes = sum(r[3] for r in reads)
+    total_ticks = sum(r[1] for r in reads)
+    print()
+    print("Reads: %d, %d bytes, %d served from memory (%.1f%%), %d patched"
+          % (len(reads), total_bytes, cached, 100 * cached / len(reads),
+             patched))
+    if total_ticks:
+        print("Throughput: %.1f KiB/s while reading"
+              % (total_bytes / 1024 / (total_ticks / timer_freq)))
+
+    # Where the time goes, by 1 MiB region of the partition
+    regions = collections.defaultdict(lambda: [0, 0, 0])
+    for _, ticks, offset, length, _, flags in reads:
+        if flags & FLAG_PATCHED:
+            continue
+        region = regions[offset * 4 // REGION_SIZE]
+        region[0] += 1
+        region[1] += length
+        region[2] += ticks
+
+    print()
+    print("Hottest regions by service time:")
+    print("%-12s %8s %12s %10s" % ("offset", "reads", "bytes", "total ms"))
+    hottest = sorted(regions.items(), key=lambda i: i[1][2], reverse=True)
+    for index, (count, length, ticks) in hottest[:10]:
+        print("0x%09X %8d %12d %10d"
+              % (index * REGION_SIZE, count, length,
+                 ticks * 1000 // timer_freq))
+
+
+def replay(records, cache_blocks):
+    """Replay the partition reads against an LRU cache of decrypted blocks."""
+    cache = collections.OrderedDict()
+    hits = misses = 0
+    for _, _, offset, length, ioctl, flags in records:
+        if ioctl != IOCTL_READ or flags & FLAG_PATCHED or length == 0:
+            continue
+
+        first = offset * 4 // BLOCK_DATA_SIZE
+        last = (offset * 4 + length - 1) // BLOCK_DATA_SIZE
+        for block in range(first, last + 1):
+            if block in cache:
+                cache.move_to_end(block)
+                hits += 1
+                continue
+
+            misses += 1
+            cache[block] = True
+            if len(cache) > cache_blocks:
+                cache.popitem(last=False)
+
+    total = hits + misses
+    print()
+    print("Replay with %d cached blocks: %d block reads, %d hits (%.1f%%)"
+          % (cache_blocks, total, hits, 100 * hits / total if total else 0))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode a DI read trace")
+    parser.add_argument("trace")
+    parser.add_argument("--csv", action="store_true",
+                        help="print every record as CSV")
+    parser.add_argument("--cache-blocks", type=int, default=0,
+                        help="replay reads against a block cache this big")
+    args = parser.parse_args()
+
+    timer_freq, records = read_trace(args.trace)
+    if args.csv:
+        print_csv(timer_freq, records)
+        return
+
+    print_summary(timer_freq, records)
+    if args.cache_blocks > 0:
+        replay(records, args.cache_blocks)
+
+
+if __name__ == "__main__":
+    main()